@@ -1,9 +1,15 @@
 
 #include <vector>
+#include <algorithm>
 #include <limits>
 #include <cmath>
 #include <cassert>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "RandomSource.h"
 #include "LogSumExp.h"
 #include "AISInference.h"
 
@@ -11,7 +17,9 @@ namespace Grante {
 
 AISInference::AISInference(const FactorGraph* fg)
 	: InferenceMethod(fg), log_z(std::numeric_limits<double>::signaling_NaN()),
-		gibbs(fg), K(80), gibbs_sweeps(1), sample_count(1000) {
+		logw_mean(std::numeric_limits<double>::signaling_NaN()),
+		logw_var(std::numeric_limits<double>::signaling_NaN()),
+		K(80), gibbs_sweeps(1), sample_count(1000), streaming(false) {
 }
 
 AISInference::~AISInference() {
@@ -31,6 +39,32 @@ void AISInference::SetSamplingParameters(unsigned int anneal_k,
 	this->sample_count = sample_count;
 }
 
+void AISInference::SetStreaming(bool streaming) {
+	this->streaming = streaming;
+}
+
+const std::vector<double>& AISInference::LogImportanceWeights() const {
+	return (logw);
+}
+
+void AISInference::LogImportanceWeightStatistics(double& mean,
+	double& variance) const {
+	mean = logw_mean;
+	variance = logw_var;
+}
+
+boost::uint32_t AISInference::RunSeed(boost::uint32_t base_seed,
+	unsigned int run) {
+	// Murmur3 finalizer, decorrelates seeds of consecutive runs
+	boost::uint32_t h = base_seed + 0x9e3779b9u * (run + 1);
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35u;
+	h ^= h >> 16;
+	return (h);
+}
+
 void AISInference::PerformInference() {
 	// The first non-zero beta,
 	// 0 = beta_0 < beta_1 < beta_2 < ... < beta_K
@@ -38,72 +72,148 @@ void AISInference::PerformInference() {
 	// beta_k = gamma^(k-1)*beta_1
 	double gamma = std::pow(1.0 / beta_1, 1.0 / static_cast<double>(K-1));
 
-	std::vector<double> logw(sample_count);
-	std::vector<std::vector<unsigned int> > samples(sample_count);
-	for (unsigned int si = 0; si < sample_count; ++si) {
+	const std::vector<Factor*>& factors = fg->Factors();
+	int thread_count = 1;
+#ifdef _OPENMP
+	thread_count = omp_get_max_threads();
+#endif
+
+	// Per-thread partial results.  The marginals of each thread are
+	// weighted by exp(logw - lse.Max()) of the thread-local accumulator.
+	std::vector<GibbsSampler*> thread_gibbs(thread_count);
+	std::vector<LogSumExpAccumulator> thread_lse(thread_count);
+	std::vector<std::vector<std::vector<double> > >
+		thread_marginals(thread_count);
+	std::vector<double> thread_count_runs(thread_count, 0.0);
+	std::vector<double> thread_mean(thread_count, 0.0);
+	std::vector<double> thread_m2(thread_count, 0.0);
+	for (int ti = 0; ti < thread_count; ++ti) {
+		thread_gibbs[ti] = new GibbsSampler(fg);
+		thread_marginals[ti].resize(factors.size());
+		for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+			thread_marginals[ti][fi].resize(
+				factors[fi]->Type()->ProdCardinalities(), 0.0);
+		}
+	}
+
+	logw.clear();
+	if (streaming == false)
+		logw.resize(sample_count);
+
+	boost::uint32_t base_seed = RandomSource::GetGlobalRandomSeed();
+	int sample_count_i = static_cast<int>(sample_count);
+	#pragma omp parallel for schedule(dynamic)
+	for (int si = 0; si < sample_count_i; ++si) {
+		int ti = 0;
+#ifdef _OPENMP
+		ti = omp_get_thread_num();
+#endif
+		GibbsSampler* gibbs = thread_gibbs[ti];
+		gibbs->SetRandomSeed(RunSeed(base_seed, si));
+
 		// Compute annealed samples
 		double logw_cur = 0.0;
 		double prev_beta = 0.0;	// beta_0
 		double cur_beta = 0.0;
 		for (unsigned int k = 0; k < K; ++k) {
-			gibbs.SetInverseTemperature(cur_beta);
-			gibbs.Sweep(gibbs_sweeps);
+			gibbs->SetInverseTemperature(cur_beta);
+			gibbs->Sweep(gibbs_sweeps);
 
 			prev_beta = cur_beta;
 			cur_beta = std::pow(gamma, static_cast<double>(k)) * beta_1;
 
 			// Add (log p_k(v_k) - log p_{k-1}(v_k))
-			double cur_energy = fg->EvaluateEnergy(gibbs.State());
+			double cur_energy = fg->EvaluateEnergy(gibbs->State());
 			logw_cur += (prev_beta-cur_beta)*cur_energy;
 		}
-		logw[si] = logw_cur;
-		//std::cout << "logw[" << si << "]: " << logw[si] << std::endl;
+		if (streaming == false)
+			logw[si] = logw_cur;
+
+		// Final sample
+		gibbs->SetInverseTemperature(1.0);
+		gibbs->Sweep(gibbs_sweeps);
+		const std::vector<unsigned int>& sample = gibbs->State();
+
+		// Add weighted sample to the thread-local marginals, rescaling them
+		// whenever the reference log-weight increases.  For i.i.d. weights
+		// this happens only O(log n) times.
+		double scale = thread_lse[ti].Add(logw_cur);
+		std::vector<std::vector<double> >& marg = thread_marginals[ti];
+		if (scale != 1.0) {
+			for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+				std::transform(marg[fi].begin(), marg[fi].end(),
+					marg[fi].begin(),
+					[scale](double v) { return v * scale; });
+			}
+		}
+		double sample_contribution =
+			std::exp(logw_cur - thread_lse[ti].Max());
+		for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+			marg[fi][factors[fi]->ComputeAbsoluteIndex(sample)] +=
+				sample_contribution;
+		}
 
-		// Save state
-		gibbs.SetInverseTemperature(1.0);
-		gibbs.Sweep(gibbs_sweeps);
-		samples[si] = gibbs.State();
+		// Running mean and variance of logw (Welford)
+		thread_count_runs[ti] += 1.0;
+		double ld = logw_cur - thread_mean[ti];
+		thread_mean[ti] += ld / thread_count_runs[ti];
+		thread_m2[ti] += ld*(logw_cur - thread_mean[ti]);
 	}
+	for (int ti = 0; ti < thread_count; ++ti)
+		delete (thread_gibbs[ti]);
+
+	// Merge log-weight accumulators and statistics of all threads, see Chan
+	// et al., "Updating Formulae and a Pairwise Algorithm for Computing
+	// Sample Variances", 1979.
+	LogSumExpAccumulator lse;
+	double runs_total = 0.0;
+	logw_mean = 0.0;
+	double logw_m2 = 0.0;
+	for (int ti = 0; ti < thread_count; ++ti) {
+		lse.Add(thread_lse[ti]);
+		if (thread_count_runs[ti] == 0.0)
+			continue;
+
+		double runs_new = runs_total + thread_count_runs[ti];
+		double ld = thread_mean[ti] - logw_mean;
+		logw_mean += ld * thread_count_runs[ti] / runs_new;
+		logw_m2 += thread_m2[ti] +
+			ld*ld * runs_total * thread_count_runs[ti] / runs_new;
+		runs_total = runs_new;
+	}
+	// logw_var: the population variance of the logw's.  According to Neal
+	// the logw will be asymptotically Normal.
+	logw_var = (sample_count > 1) ?
+		(logw_m2 / static_cast<double>(sample_count - 1)) : 0.0;
+
 	double log_ZA = 0.0;
 	const std::vector<unsigned int>& card = fg->Cardinalities();
 	for (unsigned int vi = 0; vi < card.size(); ++vi)
 		log_ZA += std::log(static_cast<double>(card[vi]));
 
 	// Compute AIS approximation to log_z
-	double logw_lse = LogSumExp::Compute(logw);
+	double logw_lse = lse.LogSum();
 	log_z = -std::log(static_cast<double>(sample_count)) + log_ZA + logw_lse;
 
-	// TODO: optionally compute empirical variance (how to do this in a stable
-	// way?)  Neal's paper has normality results for logw, maybe std for logw
-	// gives us the value
-	double logw_mean = 0.0;
-	double logw_var = 0.0;
-	for (unsigned int si = 0; si < sample_count; ++si) {
-		double ld = logw[si] - logw_mean;
-		logw_mean += ld / static_cast<double>(si + 1);
-		logw_var += ld*(logw[si] - logw_mean);
-	}
-	// logw_var: the population variance of the logw's.  According to Neal
-	// the logw will be asymptotically Normal.
-	logw_var /= static_cast<double>(sample_count - 1);
-
-	// Setup marginals
-	const std::vector<Factor*>& factors = fg->Factors();
+	// Combine per-thread marginals, each thread buffer is relative to its
+	// own reference log-weight
 	marginals.resize(factors.size());
 	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
 		marginals[fi].resize(factors[fi]->Type()->ProdCardinalities());
 		std::fill(marginals[fi].begin(), marginals[fi].end(), 0.0);
 	}
-	// Compute marginals from weighted samples
 	double total = 0.0;
-	for (unsigned int si = 0; si < sample_count; ++si) {
-		double sample_contribution = std::exp(logw[si] - logw_lse);
-		total += sample_contribution;
+	for (int ti = 0; ti < thread_count; ++ti) {
+		if (thread_count_runs[ti] == 0.0)
+			continue;
 
-		// Add to marginals
+		double thread_scale = std::exp(thread_lse[ti].Max() - lse.Max()) /
+			lse.ScaledSum();
+		total += thread_lse[ti].ScaledSum() * thread_scale;
 		for (unsigned int fi = 0; fi < factors.size(); ++fi) {
-			marginals[fi][factors[fi]->ComputeAbsoluteIndex(samples[si])] +=
-				sample_contribution;
+			const std::vector<double>& tmarg = thread_marginals[ti][fi];
+			for (unsigned int ei = 0; ei < tmarg.size(); ++ei)
+				marginals[fi][ei] += thread_scale * tmarg[ei];
 		}
 	}
 	assert(std::fabs(total - 1.0) <= 1.0e-6);
@@ -111,6 +221,7 @@ void AISInference::PerformInference() {
 
 void AISInference::ClearInferenceResult() {
 	marginals.clear();
+	logw.clear();
 }
 
 const std::vector<double>& AISInference::Marginal(
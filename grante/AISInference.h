@@ -2,6 +2,10 @@
 #ifndef GRANTE_AISINFERENCE_H
 #define GRANTE_AISINFERENCE_H
 
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
 #include "FactorGraph.h"
 #include "InferenceMethod.h"
 #include "GibbsSampler.h"
@@ -31,6 +35,24 @@ public:
 	void SetSamplingParameters(unsigned int anneal_k,
 		unsigned int gibbs_sweeps, unsigned int sample_count);
 
+	// Streaming mode.  The independent AIS runs are always distributed over
+	// all OpenMP threads and their weighted samples are accumulated into
+	// per-thread marginals, so samples are never stored.  If streaming is
+	// false (default), the log-importance weights of all runs are kept and
+	// available through LogImportanceWeights().  If streaming is true, only
+	// running statistics are kept and the memory use is independent of
+	// sample_count.
+	void SetStreaming(bool streaming);
+
+	// Per-run log-importance weights of the last inference call, empty in
+	// streaming mode.
+	const std::vector<double>& LogImportanceWeights() const;
+
+	// Empirical mean and variance of the log-importance weights of the last
+	// inference call.  According to Neal the log-weights are asymptotically
+	// Normal.
+	void LogImportanceWeightStatistics(double& mean, double& variance) const;
+
 	// Perform AIS to obtain approximate marginals and log-partition function
 	virtual void PerformInference();
 	virtual void ClearInferenceResult();
@@ -57,13 +79,23 @@ private:
 	// Inference result: estimated log-partition function.
 	double log_z;
 
-	// Workhorse: the actual Gibbs sampler used
-	GibbsSampler gibbs;
+	// Inference result: log-importance weights (non-streaming mode only)
+	// and their statistics.
+	std::vector<double> logw;
+	double logw_mean;
+	double logw_var;
 
 	// Gibbs sampling parameters
 	unsigned int K;
 	unsigned int gibbs_sweeps;
 	unsigned int sample_count;
+	bool streaming;
+
+	// Seed of the random stream of a single AIS run.  Each run uses its own
+	// stream so the result does not depend on the assignment of runs to
+	// threads.
+	static boost::uint32_t RunSeed(boost::uint32_t base_seed,
+		unsigned int run);
 };
 
 }
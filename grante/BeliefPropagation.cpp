@@ -11,6 +11,7 @@
 
 #include "BeliefPropagation.h"
 #include "LogSumExp.h"
+#include "VectorMath.h"
 
 using namespace boost::lambda;
 
@@ -19,7 +20,7 @@ namespace Grante {
 BeliefPropagation::BeliefPropagation(const FactorGraph* fg,
 	MessageSchedule sched)
 	: InferenceMethod(fg), verbose(false), max_iter(100), conv_tol(1.0e-5),
-		sched(sched), min_sum(false),
+		sched(sched), min_sum(false), warm_min_sum(false),
 		log_z(std::numeric_limits<double>::quiet_NaN())
 {
 	// Setup message indices
@@ -151,6 +152,14 @@ void BeliefPropagation::PerformInference() {
 }
 
 void BeliefPropagation::InferenceInitialize() {
+	// Reuse the messages and marginals of the previous call
+	const std::vector<Factor*>& factors = fg->Factors();
+	if (warm_start && warm_min_sum == min_sum &&
+		msg_for_var.size() == msg_for_var_srcfactor.size() &&
+		msg_for_factor.size() == msg_for_factor_srcvar.size() &&
+		marginals.size() == factors.size())
+		return;
+
 	// Initialize messages
 	const std::vector<unsigned int>& card = fg->Cardinalities();
 	//  i) factor-to-variable
@@ -181,7 +190,6 @@ void BeliefPropagation::InferenceInitialize() {
 	}
 
 	// Initialize marginals (beliefs)
-	const std::vector<Factor*>& factors = fg->Factors();
 	marginals.resize(factors.size());
 	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
 		marginals[fi].resize(factors[fi]->Type()->ProdCardinalities());
@@ -190,6 +198,11 @@ void BeliefPropagation::InferenceInitialize() {
 }
 
 void BeliefPropagation::InferenceTeardown() {
+	if (warm_start) {
+		warm_min_sum = min_sum;
+		return;
+	}
+
 	// Clear messages
 	msg_for_var.clear();
 	msg_for_factor.clear();
@@ -227,7 +240,19 @@ double BeliefPropagation::MinimizeEnergy(std::vector<unsigned int>& state) {
 	state.resize(fg->Cardinalities().size());
 	std::copy(best_state.begin(), best_state.end(), state.begin());
 	min_sum = false;
-	return (fg->EvaluateEnergy(state));
+	return (fg->EvaluateEnergy(state) + EvaluateOverlayEnergy(state));
+}
+
+bool BeliefPropagation::SupportsUnaryOverlay() const {
+	return (true);
+}
+
+bool BeliefPropagation::SupportsWarmStart() const {
+	return (true);
+}
+
+bool BeliefPropagation::SupportsEvidence() const {
+	return (true);
 }
 
 
@@ -327,6 +352,14 @@ void BeliefPropagation::PassVariableToFactor(unsigned int fi,
 	// Target message to be computed
 	//    q_{n->m}(x_n) = sum_{m' \in M(n) \ m} r_{m'->n}(x_n),
 	// (26.11) McKay, in log-domain.
+	// An observed variable always sends its evidence, which is normalized
+	// for both sum-product and min-sum.
+	if (IsObserved(from_var)) {
+		std::fill(msg.begin(), msg.end(),
+			-std::numeric_limits<double>::infinity());
+		msg[evidence[from_var]] = 0.0;
+		return;
+	}
 	std::fill(msg.begin(), msg.end(), 0.0);
 	msg_list_t::const_iterator mvi = msglist_for_var.find(from_var);
 	assert(mvi != msglist_for_var.end());
@@ -343,6 +376,11 @@ void BeliefPropagation::PassVariableToFactor(unsigned int fi,
 			msg_for_var[for_var_msg_index].end(),
 			msg.begin(), msg.begin(), std::plus<double>());
 	}
+	if (unary_overlay != 0) {
+		const std::vector<double>& ov = (*unary_overlay)[from_var];
+		std::transform(msg.begin(), msg.end(), ov.begin(), msg.begin(),
+			std::minus<double>());
+	}
 
 	// Normalization for numerical stability,
 	//   i) sum-product: log-sum-exp = 0,
@@ -404,22 +442,29 @@ double BeliefPropagation::ComputeVariableBeliefs() {
 			std::transform(msg.begin(), msg.end(), var_beliefs[vi].begin(),
 				var_beliefs[vi].begin(), std::plus<double>());
 		}
+		if (unary_overlay != 0) {
+			const std::vector<double>& ov = (*unary_overlay)[vi];
+			std::transform(var_beliefs[vi].begin(), var_beliefs[vi].end(),
+				ov.begin(), var_beliefs[vi].begin(), std::minus<double>());
+		}
+		ClampLogTable(vi, var_beliefs[vi]);
 
 		// Compute normalized variable marginal (belief)
-		double Z_vi = min_sum ?
-			(std::accumulate(var_beliefs[vi].begin(),
-				var_beliefs[vi].end(), 0.0) /
-				static_cast<double>(var_beliefs[vi].size()))
-			: LogSumExp::Compute(var_beliefs[vi]);
+		std::vector<double>& belief = var_beliefs[vi];
+		if (min_sum) {
+			double Z_vi = IsObserved(vi) ? belief[evidence[vi]] :
+				(std::accumulate(belief.begin(), belief.end(), 0.0)
+					/ static_cast<double>(belief.size()));
+			for (unsigned int vs = 0; vs < belief.size(); ++vs)
+				belief[vs] -= Z_vi;
+		} else {
+			VectorMath::NormalizeLog(&belief[0], belief.size());
+		}
 		for (unsigned int vs = 0; vs < var_beliefs[vi].size(); ++vs) {
-			if (min_sum) {
-				var_beliefs[vi][vs] -= Z_vi;
-			} else {
-				var_beliefs[vi][vs] = std::exp(var_beliefs[vi][vs] - Z_vi);
-			}
 			if (var_belief_vi_old.empty()) {
 				max_change = std::numeric_limits<double>::infinity();
-			} else {
+			} else if (IsObserved(vi) == false) {
+				// (Beliefs of observed variables are constant)
 				max_change = std::max(max_change,
 					std::fabs(var_beliefs[vi][vs] - var_belief_vi_old[vs]));
 			}
@@ -440,7 +485,7 @@ double BeliefPropagation::ReconstructMinimumEnergyState(
 			var_beliefs[vi].begin(), var_beliefs[vi].end())
 			- var_beliefs[vi].begin());
 	}
-	return (fg->EvaluateEnergy(state));
+	return (fg->EvaluateEnergy(state) + EvaluateOverlayEnergy(state));
 }
 
 // (3.45) in [Wainwright and Jordan], "A(theta) = negative free energy"
@@ -459,6 +504,10 @@ double BeliefPropagation::ComputeBetheFreeEnergy() const {
 		const std::vector<double>& energies = factor->Energies();
 		size_t energies_size = energies.size();
 		for (size_t ei = 0; ei < energies_size; ++ei) {
+			// Zero marginals occur for states excluded by the evidence
+			if (marginals[fi][ei] <= 0.0)
+				continue;
+
 			U_Bethe += -marginals[fi][ei] * (-energies[ei]);
 			H_Bethe += -marginals[fi][ei] * std::log(marginals[fi][ei]);
 		}
@@ -474,9 +523,19 @@ double BeliefPropagation::ComputeBetheFreeEnergy() const {
 		assert(var_degree[vi] >= 1);
 		assert(var_beliefs[vi].size() == card[vi]);
 		double corr = 0.0;
-		for (unsigned int state = 0; state < card[vi]; ++state)
-			corr += var_beliefs[vi][state] * std::log(var_beliefs[vi][state]);
+		for (unsigned int state = 0; state < card[vi]; ++state) {
+			if (var_beliefs[vi][state] > 0.0) {
+				corr += var_beliefs[vi][state] *
+					std::log(var_beliefs[vi][state]);
+			}
+		}
 		H_Bethe += static_cast<double>(var_degree[vi] - 1) * corr;
+
+		// Overlay energies are part of the variable average energy
+		if (unary_overlay != 0) {
+			U_Bethe += std::inner_product(var_beliefs[vi].begin(),
+				var_beliefs[vi].end(), (*unary_overlay)[vi].begin(), 0.0);
+		}
 	}
 
 	// Return the Bethe free energy, log Z = -Bethe = -(U-H)
@@ -55,6 +55,14 @@ public:
 	// Return the exact energy of the solution found.
 	virtual double MinimizeEnergy(std::vector<unsigned int>& state);
 
+	virtual bool SupportsUnaryOverlay() const;
+	// Warm starts keep the messages and marginals of the previous call.
+	// Messages of min-sum and sum-product calls are not mixed.
+	virtual bool SupportsWarmStart() const;
+	// Observed variables send their evidence as fixed messages and have
+	// fixed beliefs.
+	virtual bool SupportsEvidence() const;
+
 private:
 	// Parameters
 	bool verbose;
@@ -63,6 +71,8 @@ private:
 	MessageSchedule sched;
 
 	bool min_sum;
+	// Mode of the messages kept for a warm start
+	bool warm_min_sum;
 	std::vector<unsigned int> best_state;	// Best state observed
 
 	// Inference result 1: approximate marginal distributions for all factors
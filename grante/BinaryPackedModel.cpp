@@ -0,0 +1,426 @@
+
+#include <algorithm>
+#include <cmath>
+#include <cassert>
+
+#include "BinaryPackedModel.h"
+
+namespace Grante {
+
+static inline unsigned int CountTrailingZeros(BinaryPackedModel::word_type w) {
+	assert(w != 0);
+#if defined(__GNUC__)
+	return (static_cast<unsigned int>(__builtin_ctzll(w)));
+#else
+	unsigned int count = 0;
+	while ((w & 1) == 0) {
+		w >>= 1;
+		count += 1;
+	}
+	return (count);
+#endif
+}
+
+BinaryPackedModel::BinaryPackedModel()
+	: var_count(0), constant(0.0) {
+}
+
+BinaryPackedModel::BinaryPackedModel(const FactorGraph* fg)
+	: var_count(static_cast<unsigned int>(fg->Cardinalities().size())),
+		constant(0.0) {
+	assert(IsBinaryPairwise(fg));
+
+	// Factor structure
+	const std::vector<Factor*>& factors = fg->Factors();
+	fac_var0.resize(factors.size());
+	fac_var1.resize(factors.size());
+	fac_J.resize(factors.size(), 0.0);
+	std::vector<unsigned int> degree(var_count, 0);
+	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+		const std::vector<unsigned int>& fvars = factors[fi]->Variables();
+		fac_var0[fi] = fvars[0];
+		fac_var1[fi] = (fvars.size() == 2) ? fvars[1] : var_count;
+		if (fvars.size() == 2) {
+			degree[fvars[0]] += 1;
+			degree[fvars[1]] += 1;
+		}
+	}
+
+	// Neighborhoods in compressed row format
+	nbr_start.resize(var_count + 1);
+	nbr_start[0] = 0;
+	for (unsigned int vi = 0; vi < var_count; ++vi)
+		nbr_start[vi+1] = nbr_start[vi] + degree[vi];
+	nbr_var.resize(nbr_start[var_count]);
+	nbr_fac.resize(nbr_start[var_count]);
+	nbr_J.resize(nbr_start[var_count], 0.0);
+	std::vector<unsigned int> nbr_fill(nbr_start.begin(), nbr_start.end() - 1);
+	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+		if (fac_var1[fi] == var_count)
+			continue;
+
+		unsigned int v0 = fac_var0[fi];
+		unsigned int v1 = fac_var1[fi];
+		nbr_var[nbr_fill[v0]] = v1;
+		nbr_fac[nbr_fill[v0]] = fi;
+		nbr_fill[v0] += 1;
+		nbr_var[nbr_fill[v1]] = v0;
+		nbr_fac[nbr_fill[v1]] = fi;
+		nbr_fill[v1] += 1;
+	}
+	site_uniform.resize(var_count, 0);
+	site_J.resize(var_count, 0.0);
+
+	UpdateEnergies(fg);
+}
+
+bool BinaryPackedModel::IsBinaryPairwise(const FactorGraph* fg) {
+	const std::vector<unsigned int>& card = fg->Cardinalities();
+	for (unsigned int vi = 0; vi < card.size(); ++vi) {
+		if (card[vi] != 2)
+			return (false);
+	}
+	const std::vector<Factor*>& factors = fg->Factors();
+	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+		const std::vector<unsigned int>& fvars = factors[fi]->Variables();
+		if (fvars.size() == 0 || fvars.size() > 2)
+			return (false);
+		if (fvars.size() == 2 && fvars[0] == fvars[1])
+			return (false);
+	}
+	return (true);
+}
+
+void BinaryPackedModel::UpdateEnergies(const FactorGraph* fg) {
+	const std::vector<Factor*>& factors = fg->Factors();
+	assert(factors.size() == fac_var0.size());
+	assert(fg->Cardinalities().size() == var_count);
+
+	// Reparametrize, the energy tables are indexed with the first variable
+	// running fastest, E(y0,y1) = e[y0 + 2*y1].
+	constant = 0.0;
+	h.assign(var_count, 0.0);
+	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+		const std::vector<double>& energies = factors[fi]->Energies();
+		constant += energies[0];
+		h[fac_var0[fi]] += energies[1] - energies[0];
+		if (fac_var1[fi] == var_count)
+			continue;
+
+		assert(energies.size() == 4);
+		h[fac_var1[fi]] += energies[2] - energies[0];
+		fac_J[fi] = energies[3] - energies[2] - energies[1] + energies[0];
+	}
+
+	// Couplings per neighbor and per site
+	for (unsigned int vi = 0; vi < var_count; ++vi) {
+		site_uniform[vi] = 1;
+		site_J[vi] = 0.0;
+		for (unsigned int ni = nbr_start[vi]; ni < nbr_start[vi+1]; ++ni) {
+			nbr_J[ni] = fac_J[nbr_fac[ni]];
+			if (ni == nbr_start[vi])
+				site_J[vi] = nbr_J[ni];
+			else if (nbr_J[ni] != site_J[vi])
+				site_uniform[vi] = 0;
+		}
+	}
+}
+
+unsigned int BinaryPackedModel::VariableCount() const {
+	return (var_count);
+}
+
+size_t BinaryPackedModel::WordCount(size_t var_count) {
+	return ((var_count + 63) / 64);
+}
+
+void BinaryPackedModel::Pack(const std::vector<unsigned int>& state,
+	std::vector<word_type>& packed) {
+	packed.assign(WordCount(state.size()), 0);
+	for (unsigned int vi = 0; vi < state.size(); ++vi) {
+		assert(state[vi] <= 1);
+		packed[vi >> 6] |= static_cast<word_type>(state[vi]) << (vi & 63);
+	}
+}
+
+void BinaryPackedModel::Unpack(const std::vector<word_type>& packed,
+	std::vector<unsigned int>& state) {
+	assert(packed.size() == WordCount(state.size()));
+	for (unsigned int vi = 0; vi < state.size(); ++vi)
+		state[vi] = GetBit(packed, vi);
+}
+
+double BinaryPackedModel::Energy(const std::vector<word_type>& packed) const {
+	assert(packed.size() == WordCount(var_count));
+	double energy = constant;
+
+	// Unary fields of all active variables
+	for (unsigned int wi = 0; wi < packed.size(); ++wi) {
+		for (word_type w = packed[wi]; w != 0; w &= w - 1)
+			energy += h[64*wi + CountTrailingZeros(w)];
+	}
+
+	// Couplings of all pairs of active variables
+	for (unsigned int fi = 0; fi < fac_var0.size(); ++fi) {
+		if (fac_var1[fi] == var_count)
+			continue;
+		if (GetBit(packed, fac_var0[fi]) & GetBit(packed, fac_var1[fi]))
+			energy += fac_J[fi];
+	}
+	return (energy);
+}
+
+double BinaryPackedModel::LocalField(const std::vector<word_type>& packed,
+	unsigned int vi) const {
+	assert(vi < var_count);
+	double field = h[vi];
+	for (unsigned int ni = nbr_start[vi]; ni < nbr_start[vi+1]; ++ni) {
+		if (GetBit(packed, nbr_var[ni]))
+			field += nbr_J[ni];
+	}
+	return (field);
+}
+
+void BinaryPackedModel::RandomReplicas(std::vector<word_type>& replicas,
+	boost::mt19937& rgen) const {
+	replicas.resize(var_count);
+	for (unsigned int vi = 0; vi < var_count; ++vi)
+		replicas[vi] = RandomWord(rgen);
+}
+
+void BinaryPackedModel::SetReplica(std::vector<word_type>& replicas,
+	unsigned int r, const std::vector<unsigned int>& state) const {
+	assert(r < 64);
+	assert(replicas.size() == var_count && state.size() == var_count);
+	word_type mask = static_cast<word_type>(1) << r;
+	for (unsigned int vi = 0; vi < var_count; ++vi) {
+		if (state[vi])
+			replicas[vi] |= mask;
+		else
+			replicas[vi] &= ~mask;
+	}
+}
+
+void BinaryPackedModel::GetReplica(const std::vector<word_type>& replicas,
+	unsigned int r, std::vector<unsigned int>& state) const {
+	assert(r < 64);
+	assert(replicas.size() == var_count);
+	state.resize(var_count);
+	for (unsigned int vi = 0; vi < var_count; ++vi)
+		state[vi] = static_cast<unsigned int>((replicas[vi] >> r) & 1);
+}
+
+void BinaryPackedModel::SwapReplicas(std::vector<word_type>& replicas,
+	unsigned int r1, unsigned int r2) const {
+	assert(r1 < 64 && r2 < 64);
+	for (unsigned int vi = 0; vi < var_count; ++vi) {
+		word_type w = replicas[vi];
+		word_type diff = ((w >> r1) ^ (w >> r2)) & 1;
+		replicas[vi] = w ^ ((diff << r1) | (diff << r2));
+	}
+}
+
+double BinaryPackedModel::ReplicaEnergy(const std::vector<word_type>& replicas,
+	unsigned int r) const {
+	assert(r < 64);
+	assert(replicas.size() == var_count);
+	double energy = constant;
+	for (unsigned int vi = 0; vi < var_count; ++vi) {
+		if ((replicas[vi] >> r) & 1)
+			energy += h[vi];
+	}
+	for (unsigned int fi = 0; fi < fac_var0.size(); ++fi) {
+		if (fac_var1[fi] == var_count)
+			continue;
+		if (((replicas[fac_var0[fi]] & replicas[fac_var1[fi]]) >> r) & 1)
+			energy += fac_J[fi];
+	}
+	return (energy);
+}
+
+void BinaryPackedModel::SweepReplicas(std::vector<word_type>& replicas,
+	const std::vector<double>& lane_inv_temp, boost::mt19937& rgen) const {
+	assert(replicas.size() == var_count);
+	assert(lane_inv_temp.size() >= 1 && lane_inv_temp.size() <= 64);
+	unsigned int lane_count = static_cast<unsigned int>(lane_inv_temp.size());
+	word_type lane_mask = (lane_count == 64) ? ~static_cast<word_type>(0) :
+		((static_cast<word_type>(1) << lane_count) - 1);
+
+	// Lanes at a common inverse temperature form one group
+	std::vector<double> group_inv_temp;
+	std::vector<word_type> group_mask;
+	for (unsigned int r = 0; r < lane_count; ++r) {
+		size_t gi = std::find(group_inv_temp.begin(), group_inv_temp.end(),
+			lane_inv_temp[r]) - group_inv_temp.begin();
+		if (gi == group_inv_temp.size()) {
+			group_inv_temp.push_back(lane_inv_temp[r]);
+			group_mask.push_back(0);
+		}
+		group_mask[gi] |= static_cast<word_type>(1) << r;
+	}
+
+	// The classes are non-empty and disjoint subsets of the lanes
+	word_type class_mask[64];
+	word_type class_mant[64];
+	for (unsigned int vi = 0; vi < var_count; ++vi) {
+		unsigned int degree = nbr_start[vi+1] - nbr_start[vi];
+		if (site_uniform[vi] == 0 || degree > 63) {
+			word_type sample = SampleSiteLanes(replicas, vi,
+				&lane_inv_temp[0], lane_count, rgen);
+			replicas[vi] = (replicas[vi] & ~lane_mask) | sample;
+			continue;
+		}
+
+		// Count active neighbors of all replicas with bit-sliced adders,
+		// plane[b] holds bit b of the count.
+		word_type plane[6] = { 0, 0, 0, 0, 0, 0 };
+		unsigned int plane_count = 0;
+		while ((static_cast<unsigned int>(1) << plane_count) <= degree)
+			plane_count += 1;
+		for (unsigned int ni = nbr_start[vi]; ni < nbr_start[vi+1]; ++ni) {
+			word_type carry = replicas[nbr_var[ni]];
+			for (unsigned int b = 0; b < plane_count && carry != 0; ++b) {
+				word_type next_carry = plane[b] & carry;
+				plane[b] ^= carry;
+				carry = next_carry;
+			}
+		}
+
+		// All replicas with the same count and temperature share the same
+		// conditional probability
+		unsigned int class_count = 0;
+		for (unsigned int count = 0; count <= degree; ++count) {
+			word_type count_mask = lane_mask;
+			for (unsigned int b = 0; b < plane_count; ++b)
+				count_mask &= ((count >> b) & 1) ? plane[b] : ~plane[b];
+			if (count_mask == 0)
+				continue;
+
+			double field = h[vi] + site_J[vi] * static_cast<double>(count);
+			for (size_t gi = 0; gi < group_mask.size(); ++gi) {
+				word_type mask = count_mask & group_mask[gi];
+				if (mask == 0)
+					continue;
+
+				assert(class_count < 64);
+				class_mask[class_count] = mask;
+				class_mant[class_count] = ProbabilityMantissa(
+					1.0 / (1.0 + std::exp(group_inv_temp[gi] * field)));
+				class_count += 1;
+			}
+		}
+		word_type sample = BitSerialBernoulli(class_mask, class_mant,
+			class_count, rgen);
+		replicas[vi] = (replicas[vi] & ~lane_mask) | sample;
+	}
+}
+
+BinaryPackedModel::word_type BinaryPackedModel::SampleSiteLanes(
+	const std::vector<word_type>& replicas, unsigned int vi,
+	const double* lane_inv_temp, unsigned int lane_count,
+	boost::mt19937& rgen) const {
+	word_type lane_mask = (lane_count == 64) ? ~static_cast<word_type>(0) :
+		((static_cast<word_type>(1) << lane_count) - 1);
+
+	// Per-replica local fields
+	double field[64];
+	std::fill(field, field + lane_count, h[vi]);
+	for (unsigned int ni = nbr_start[vi]; ni < nbr_start[vi+1]; ++ni) {
+		for (word_type w = replicas[nbr_var[ni]] & lane_mask; w != 0;
+			w &= w - 1) {
+			field[CountTrailingZeros(w)] += nbr_J[ni];
+		}
+	}
+
+	// Each replica forms its own class
+	word_type class_mask[64];
+	word_type class_mant[64];
+	for (unsigned int r = 0; r < lane_count; ++r) {
+		class_mask[r] = static_cast<word_type>(1) << r;
+		class_mant[r] = ProbabilityMantissa(
+			1.0 / (1.0 + std::exp(lane_inv_temp[r] * field[r])));
+	}
+	return (BitSerialBernoulli(class_mask, class_mant, lane_count, rgen));
+}
+
+void BinaryPackedModel::AccumulateReplicaMarginals(
+	const std::vector<word_type>& replicas, word_type lane_mask, double weight,
+	std::vector<std::vector<double> >& marginals) const {
+	assert(replicas.size() == var_count);
+	assert(marginals.size() == fac_var0.size());
+	double lanes = static_cast<double>(PopCount(lane_mask));
+	for (unsigned int fi = 0; fi < fac_var0.size(); ++fi) {
+		word_type w0 = replicas[fac_var0[fi]] & lane_mask;
+		if (fac_var1[fi] == var_count) {
+			double n1 = static_cast<double>(PopCount(w0));
+			marginals[fi][0] += weight * (lanes - n1);
+			marginals[fi][1] += weight * n1;
+			continue;
+		}
+
+		word_type w1 = replicas[fac_var1[fi]] & lane_mask;
+		double n10 = static_cast<double>(PopCount(w0 & ~w1));
+		double n01 = static_cast<double>(PopCount(~w0 & w1));
+		double n11 = static_cast<double>(PopCount(w0 & w1));
+		marginals[fi][0] += weight * (lanes - n10 - n01 - n11);
+		marginals[fi][1] += weight * n10;
+		marginals[fi][2] += weight * n01;
+		marginals[fi][3] += weight * n11;
+	}
+}
+
+unsigned int BinaryPackedModel::PopCount(word_type w) {
+#if defined(__GNUC__)
+	return (static_cast<unsigned int>(__builtin_popcountll(w)));
+#else
+	w = w - ((w >> 1) & 0x5555555555555555ULL);
+	w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+	w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (static_cast<unsigned int>((w * 0x0101010101010101ULL) >> 56));
+#endif
+}
+
+BinaryPackedModel::word_type BinaryPackedModel::RandomWord(
+	boost::mt19937& rgen) {
+	word_type high = static_cast<word_type>(rgen());
+	return ((high << 32) | static_cast<word_type>(rgen()));
+}
+
+BinaryPackedModel::word_type BinaryPackedModel::BitSerialBernoulli(
+	const word_type* class_mask, const word_type* class_mant,
+	unsigned int class_count, boost::mt19937& rgen) {
+	word_type equal = 0;
+	for (unsigned int ci = 0; ci < class_count; ++ci)
+		equal |= class_mask[ci];
+
+	// Compare the uniform U_r of each lane with its probability p_r, most
+	// significant bit first.  A lane is decided at the first bit where U_r
+	// and p_r differ; U_r < p_r if there p_r has a one.  Each step decides
+	// half of the remaining lanes in expectation.
+	word_type less = 0;
+	for (int bit = 52; bit >= 0 && equal != 0; --bit) {
+		word_type p_bits = 0;
+		for (unsigned int ci = 0; ci < class_count; ++ci) {
+			if ((class_mant[ci] >> bit) & 1)
+				p_bits |= class_mask[ci];
+		}
+		word_type u_bits = RandomWord(rgen);
+		less |= equal & p_bits & ~u_bits;
+		equal &= ~(u_bits ^ p_bits);
+	}
+	return (less);
+}
+
+BinaryPackedModel::word_type BinaryPackedModel::ProbabilityMantissa(
+	double p) {
+	// p in [0,1] as 53 bit fixed point number
+	const double scale = 9007199254740992.0;	// 2^53
+	if (p <= 0.0)
+		return (0);
+	if (p >= 1.0)
+		return ((static_cast<word_type>(1) << 53) - 1);
+	return (static_cast<word_type>(p * scale));
+}
+
+}
+
@@ -0,0 +1,151 @@
+
+#ifndef GRANTE_BINARYPACKEDMODEL_H
+#define GRANTE_BINARYPACKEDMODEL_H
+
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/random.hpp>
+
+#include "FactorGraph.h"
+
+namespace Grante {
+
+/* Bit-packed representation of binary pairwise models.
+ *
+ * If all variables are binary and all factors are unary or pairwise, the
+ * energy can be reparametrized as
+ *    E(y) = c + \sum_i h_i y_i + \sum_{(i,j)} J_ij y_i y_j,   y_i in {0,1}.
+ * Local fields then only need a multiply-add per neighbor instead of
+ * generic energy table lookups, and states can be stored with one bit per
+ * variable.
+ *
+ * Two packed layouts are supported:
+ *    1. A single state: bit (vi % 64) of word vi/64 is y_vi.
+ *    2. Multi-spin coding of 64 replicas: word vi holds y_vi of all
+ *       replicas, bit r belongs to replica r.  All 64 replicas are updated
+ *       together using word-level operations.  For sites whose couplings
+ *       are all equal (Ising and Potts lattices) the number of active
+ *       neighbors is counted with bit-sliced adders and the new spins are
+ *       drawn by bit-serial comparison with shared random words.  Factor
+ *       marginals over replicas are obtained by popcount.
+ *
+ * The reparametrization caches the factor energies, UpdateEnergies must be
+ * called whenever these change.
+ */
+class BinaryPackedModel {
+public:
+	typedef boost::uint64_t word_type;
+
+	BinaryPackedModel();
+	explicit BinaryPackedModel(const FactorGraph* fg);
+
+	// Return true if all variables are binary and all factors are unary or
+	// pairwise (on two distinct variables).
+	static bool IsBinaryPairwise(const FactorGraph* fg);
+
+	// Read the current factor energies of fg into the reparametrization.
+	// fg must have the same structure as the factor graph used for
+	// construction.
+	void UpdateEnergies(const FactorGraph* fg);
+
+	unsigned int VariableCount() const;
+
+	// Single packed state
+	static size_t WordCount(size_t var_count);
+	static void Pack(const std::vector<unsigned int>& state,
+		std::vector<word_type>& packed);
+	// state must have the correct size
+	static void Unpack(const std::vector<word_type>& packed,
+		std::vector<unsigned int>& state);
+	static unsigned int GetBit(const std::vector<word_type>& packed,
+		unsigned int vi) {
+		return (static_cast<unsigned int>((packed[vi >> 6] >> (vi & 63)) & 1));
+	}
+	static void SetBit(std::vector<word_type>& packed, unsigned int vi,
+		unsigned int value) {
+		word_type mask = static_cast<word_type>(1) << (vi & 63);
+		if (value)
+			packed[vi >> 6] |= mask;
+		else
+			packed[vi >> 6] &= ~mask;
+	}
+
+	double Energy(const std::vector<word_type>& packed) const;
+	// Return E(y_vi=1) - E(y_vi=0) given all other variables.
+	double LocalField(const std::vector<word_type>& packed,
+		unsigned int vi) const;
+
+	// Multi-spin coded replicas, replicas.size() == VariableCount()
+	static unsigned int ReplicaCount() {
+		return (64);
+	}
+	// Set all variables of all replicas uniformly at random
+	void RandomReplicas(std::vector<word_type>& replicas,
+		boost::mt19937& rgen) const;
+	void SetReplica(std::vector<word_type>& replicas, unsigned int r,
+		const std::vector<unsigned int>& state) const;
+	void GetReplica(const std::vector<word_type>& replicas, unsigned int r,
+		std::vector<unsigned int>& state) const;
+	void SwapReplicas(std::vector<word_type>& replicas,
+		unsigned int r1, unsigned int r2) const;
+	double ReplicaEnergy(const std::vector<word_type>& replicas,
+		unsigned int r) const;
+
+	// Systematic-scan Gibbs sweep of replicas r < lane_inv_temp.size(),
+	// replica r at inverse temperature lane_inv_temp[r].  The remaining
+	// replicas are unchanged.  On sites with uniform couplings, replicas
+	// with the same active neighbor count and temperature are sampled as one
+	// class.
+	void SweepReplicas(std::vector<word_type>& replicas,
+		const std::vector<double>& lane_inv_temp,
+		boost::mt19937& rgen) const;
+
+	// Add weight times the number of replicas in lane_mask in each factor
+	// configuration to marginals (indexed as fg->Factors()).
+	void AccumulateReplicaMarginals(const std::vector<word_type>& replicas,
+		word_type lane_mask, double weight,
+		std::vector<std::vector<double> >& marginals) const;
+
+	static unsigned int PopCount(word_type w);
+
+private:
+	unsigned int var_count;
+	double constant;
+	std::vector<double> h;	// unary fields
+
+	// Factor variables, fac_var1[fi] is var_count for unary factors
+	std::vector<unsigned int> fac_var0;
+	std::vector<unsigned int> fac_var1;
+	// Pairwise couplings, indexed by factor
+	std::vector<double> fac_J;
+
+	// Neighborhood of variable vi: nbr_var/nbr_J[nbr_start[vi]] to
+	// [nbr_start[vi+1]-1], and nbr_fac the factor index of the coupling
+	std::vector<unsigned int> nbr_start;
+	std::vector<unsigned int> nbr_var;
+	std::vector<unsigned int> nbr_fac;
+	std::vector<double> nbr_J;
+	// site_uniform[vi] is 1 if all couplings of vi are equal to site_J[vi]
+	std::vector<unsigned char> site_uniform;
+	std::vector<double> site_J;
+
+	static word_type RandomWord(boost::mt19937& rgen);
+	// Return a word in which each lane of class_mask[c] is set with
+	// probability class_mant[c] * 2^-53.  The class masks must be
+	// disjoint.  Each lane is compared bit-serially with its own uniform
+	// number, the bits of which are shared random words.
+	static word_type BitSerialBernoulli(const word_type* class_mask,
+		const word_type* class_mant, unsigned int class_count,
+		boost::mt19937& rgen);
+	static word_type ProbabilityMantissa(double p);
+	// Sample lanes r < lane_count of site vi from their per-lane fields
+	word_type SampleSiteLanes(const std::vector<word_type>& replicas,
+		unsigned int vi, const double* lane_inv_temp, unsigned int lane_count,
+		boost::mt19937& rgen) const;
+};
+
+}
+
+#endif
+
@@ -0,0 +1,168 @@
+
+#include "grante/BinaryPackedModel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "grante/BruteForceExactInference.h"
+#include "grante/Factor.h"
+#include "grante/FactorGraph.h"
+#include "grante/FactorGraphModel.h"
+#include "grante/FactorType.h"
+#include "grante/GibbsInference.h"
+#include "grante/InferenceMethod.h"
+#include "grante/ParallelTemperingInference.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Create a 3-by-3 grid with unary factors and equal pairwise couplings.  If
+// add_dummy is true, a zero-energy factor on three variables is added; the
+// distribution is the same, but the model is no longer binary pairwise and
+// the generic sampling code is used.
+Grante::FactorGraph* CreateGrid(Grante::FactorGraphModel& model,
+    bool add_dummy) {
+    std::vector<unsigned int> card1(1, 2);
+    std::vector<double> w1(2);
+    w1[0] = 0.0;
+    w1[1] = 0.3;
+    model.AddFactorType(new Grante::FactorType("unary", card1, w1));
+    std::vector<unsigned int> card2(2, 2);
+    std::vector<double> w2(4);
+    w2[0] = 0.0;
+    w2[1] = 0.4;
+    w2[2] = 0.4;
+    w2[3] = -0.5;
+    model.AddFactorType(new Grante::FactorType("pairwise", card2, w2));
+    std::vector<unsigned int> card3(3, 2);
+    std::vector<double> w3(8, 0.0);
+    model.AddFactorType(new Grante::FactorType("dummy", card3, w3));
+
+    unsigned int N = 3;
+    std::vector<unsigned int> vc(N * N, 2);
+    Grante::FactorGraph* fg = new Grante::FactorGraph(&model, vc);
+    std::vector<double> data;
+    for (unsigned int y = 0; y < N; ++y) {
+        for (unsigned int x = 0; x < N; ++x) {
+            unsigned int vi = y * N + x;
+            std::vector<unsigned int> var_index1(1, vi);
+            fg->AddFactor(new Grante::Factor(model.FindFactorType("unary"),
+                var_index1, data));
+
+            std::vector<unsigned int> var_index2(2, vi);
+            if (x + 1 < N) {
+                var_index2[1] = vi + 1;
+                fg->AddFactor(new Grante::Factor(
+                    model.FindFactorType("pairwise"), var_index2, data));
+            }
+            if (y + 1 < N) {
+                var_index2[1] = vi + N;
+                fg->AddFactor(new Grante::Factor(
+                    model.FindFactorType("pairwise"), var_index2, data));
+            }
+        }
+    }
+    if (add_dummy) {
+        std::vector<unsigned int> var_index3;
+        var_index3.push_back(0);
+        var_index3.push_back(4);
+        var_index3.push_back(8);
+        fg->AddFactor(new Grante::Factor(model.FindFactorType("dummy"),
+            var_index3, data));
+    }
+    fg->ForwardMap();
+
+    return (fg);
+}
+
+// Maximum absolute difference over the factor marginals of inf_ref; these
+// factors must be the leading factors of inf
+double MaxMarginalDifference(const Grante::InferenceMethod& inf,
+    const Grante::InferenceMethod& inf_ref) {
+    double max_diff = 0.0;
+    for (unsigned int fi = 0; fi < inf_ref.Marginals().size(); ++fi) {
+        const std::vector<double>& m_ref = inf_ref.Marginal(fi);
+        for (unsigned int ei = 0; ei < m_ref.size(); ++ei) {
+            max_diff = std::max(max_diff,
+                std::fabs(inf.Marginal(fi)[ei] - m_ref[ei]));
+        }
+    }
+    return (max_diff);
+}
+
+}
+
+TEST(BinaryPackedModel, PackedAndGenericSamplersAgree) {
+    Grante::FactorGraphModel model;
+    Grante::FactorGraph* fg = CreateGrid(model, false);
+    Grante::FactorGraphModel model_dummy;
+    Grante::FactorGraph* fg_dummy = CreateGrid(model_dummy, true);
+    ASSERT_TRUE(Grante::BinaryPackedModel::IsBinaryPairwise(fg));
+    ASSERT_FALSE(Grante::BinaryPackedModel::IsBinaryPairwise(fg_dummy));
+
+    Grante::BruteForceExactInference bfinf(fg);
+    bfinf.PerformInference();
+
+    // Single-site Gibbs sampling, packed and generic
+    Grante::GibbsInference ginf(fg);
+    ginf.SetSamplingParameters(100, 1, 40000);
+    ginf.PerformInference();
+    Grante::GibbsInference ginf_dummy(fg_dummy);
+    ginf_dummy.SetSamplingParameters(100, 1, 40000);
+    ginf_dummy.PerformInference();
+    EXPECT_LT(MaxMarginalDifference(ginf, bfinf), 0.03);
+    EXPECT_LT(MaxMarginalDifference(ginf_dummy, bfinf), 0.03);
+
+    // Parallel tempering, multi-spin coded and generic
+    Grante::ParallelTemperingInference ptinf(fg);
+    ptinf.SetSamplingParameters(8, 5.0, 0.2, 500, 40000);
+    ptinf.PerformInference();
+    Grante::ParallelTemperingInference ptinf_dummy(fg_dummy);
+    ptinf_dummy.SetSamplingParameters(8, 5.0, 0.2, 500, 40000);
+    ptinf_dummy.PerformInference();
+    EXPECT_LT(MaxMarginalDifference(ptinf, bfinf), 0.03);
+    EXPECT_LT(MaxMarginalDifference(ptinf_dummy, bfinf), 0.03);
+    EXPECT_LT(MaxMarginalDifference(ptinf_dummy, ptinf), 0.04);
+
+    delete fg;
+    delete fg_dummy;
+}
+
+TEST(BinaryPackedModel, ReplicaSweepMarginals) {
+    Grante::FactorGraphModel model;
+    Grante::FactorGraph* fg = CreateGrid(model, false);
+    Grante::BruteForceExactInference bfinf(fg);
+    bfinf.PerformInference();
+
+    // All 64 replicas at temperature one, bit-sliced classes on every site
+    Grante::BinaryPackedModel binary(fg);
+    boost::mt19937 rgen(17);
+    std::vector<Grante::BinaryPackedModel::word_type> replicas;
+    binary.RandomReplicas(replicas, rgen);
+    std::vector<double> lane_inv_temp(64, 1.0);
+    for (unsigned int sweep = 0; sweep < 50; ++sweep)
+        binary.SweepReplicas(replicas, lane_inv_temp, rgen);
+
+    std::vector<std::vector<double> > marginals(fg->Factors().size());
+    for (unsigned int fi = 0; fi < marginals.size(); ++fi)
+        marginals[fi].assign(fg->Factors()[fi]->Type()->ProdCardinalities(),
+            0.0);
+    unsigned int sample_count = 1000;
+    double weight = 1.0 / (64.0 * static_cast<double>(sample_count));
+    for (unsigned int si = 0; si < sample_count; ++si) {
+        binary.SweepReplicas(replicas, lane_inv_temp, rgen);
+        binary.AccumulateReplicaMarginals(replicas,
+            ~static_cast<Grante::BinaryPackedModel::word_type>(0), weight,
+            marginals);
+    }
+    for (unsigned int fi = 0; fi < marginals.size(); ++fi) {
+        for (unsigned int ei = 0; ei < marginals[fi].size(); ++ei) {
+            EXPECT_THAT(marginals[fi][ei],
+                testing::DoubleNear(bfinf.Marginal(fi)[ei], 0.02));
+        }
+    }
+    delete fg;
+}
+
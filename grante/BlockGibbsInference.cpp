@@ -0,0 +1,335 @@
+
+#include <algorithm>
+#include <vector>
+#include <set>
+#include <limits>
+#include <cassert>
+
+#include "RandomSource.h"
+#include "Conditioning.h"
+#include "ConditionedFactorType.h"
+#include "FactorGraphPartialObservation.h"
+#include "FactorGraphStructurizer.h"
+#include "VAcyclicDecomposition.h"
+#include "BlockGibbsInference.h"
+
+namespace Grante {
+
+BlockGibbsInference::BlockGibbsInference(const FactorGraph* fg,
+	FactorConditioningTable* fcond_tab)
+	: InferenceMethod(fg), fcond_tab(fcond_tab), burnin_sweeps(50),
+		spacing_sweeps(0), sample_count(1000),
+		rgen(RandomSource::GetGlobalRandomSeed()), randu(rgen, rdestu) {
+	// Keep strongly coupled factors within the blocks
+	VAcyclicDecomposition vac(fg);
+	const std::vector<Factor*>& factors = fg->Factors();
+	std::vector<double> factor_weight(factors.size());
+	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+		// Unary factors never close a cycle, and the entropies of their
+		// single variable only agree up to rounding
+		if (factors[fi]->Variables().size() <= 1) {
+			factor_weight[fi] = 1.0e-3;
+			continue;
+		}
+		double tcorr = factors[fi]->TotalCorrelation();
+		assert(tcorr >= -1.0e-10);
+		// Add an epsilon so it is always better to add factors than to
+		// leave them out.
+		factor_weight[fi] = std::max(0.0, tcorr) + 1.0e-3;
+	}
+	std::vector<bool> factor_is_removed;
+	vac.ComputeDecompositionSP(factor_weight, factor_is_removed);
+
+	InitializeBlocks(factor_is_removed);
+}
+
+BlockGibbsInference::BlockGibbsInference(const FactorGraph* fg,
+	FactorConditioningTable* fcond_tab,
+	const std::vector<bool>& factor_is_removed)
+	: InferenceMethod(fg), fcond_tab(fcond_tab), burnin_sweeps(50),
+		spacing_sweeps(0), sample_count(1000),
+		rgen(RandomSource::GetGlobalRandomSeed()), randu(rgen, rdestu) {
+	assert(factor_is_removed.size() == fg->Factors().size());
+	InitializeBlocks(factor_is_removed);
+}
+
+BlockGibbsInference::~BlockGibbsInference() {
+	// Delete block factor graphs (created in InitializeBlocks)
+	assert(block_fg.size() == block_inf.size());
+	for (unsigned int bi = 0; bi < block_fg.size(); ++bi) {
+		delete (block_inf[bi]);
+		delete (block_fg[bi]);
+	}
+}
+
+void BlockGibbsInference::InitializeBlocks(
+	const std::vector<bool>& factor_is_removed) {
+	const std::vector<Factor*>& factors = fg->Factors();
+	size_t var_count = fg->Cardinalities().size();
+	state.resize(var_count);
+	std::fill(state.begin(), state.end(), 0);
+
+	// Decompose factor graph into tree components
+	std::vector<unsigned int> cc_var_label;
+	unsigned int cc_count = FactorGraphStructurizer::ConnectedComponents(
+		fg, factor_is_removed, cc_var_label);
+
+	// Components are adjacent if they share a removed factor
+	std::vector<std::set<unsigned int> > cc_adj(cc_count);
+	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+		if (factor_is_removed[fi] == false)
+			continue;
+
+		const std::vector<unsigned int>& fac_vars = factors[fi]->Variables();
+		for (unsigned int fvi1 = 0; fvi1 < fac_vars.size(); ++fvi1) {
+			unsigned int c1 = cc_var_label[fac_vars[fvi1]];
+			for (unsigned int fvi2 = fvi1+1; fvi2 < fac_vars.size(); ++fvi2) {
+				unsigned int c2 = cc_var_label[fac_vars[fvi2]];
+				// A removed factor must not close a cycle within a component
+				assert(c1 != c2);
+				cc_adj[c1].insert(c2);
+				cc_adj[c2].insert(c1);
+			}
+		}
+	}
+
+	// Greedy coloring of the component graph: all components of one color
+	// are conditionally independent and form a single forest block.
+	std::vector<unsigned int> cc_color(cc_count,
+		std::numeric_limits<unsigned int>::max());
+	unsigned int block_count = 0;
+	for (unsigned int ci = 0; ci < cc_count; ++ci) {
+		std::vector<bool> color_used(block_count, false);
+		for (std::set<unsigned int>::const_iterator ai = cc_adj[ci].begin();
+			ai != cc_adj[ci].end(); ++ai) {
+			if (cc_color[*ai] < block_count)
+				color_used[cc_color[*ai]] = true;
+		}
+		cc_color[ci] = static_cast<unsigned int>(
+			std::find(color_used.begin(), color_used.end(), false) -
+			color_used.begin());
+		block_count = std::max(block_count, cc_color[ci] + 1);
+	}
+
+	// Instantiate a conditioned factor graph for each block
+	block_fg.resize(block_count);
+	block_inf.resize(block_count);
+	block_var.resize(block_count);
+	block_cfi.resize(block_count);
+	block_cfi_orig.resize(block_count);
+	block_cvar.resize(block_count);
+	for (unsigned int bi = 0; bi < block_count; ++bi) {
+		// Condition on all variables not in this block
+		std::vector<unsigned int> cond_var_set;
+		for (unsigned int vi = 0; vi < var_count; ++vi) {
+			if (cc_color[cc_var_label[vi]] != bi)
+				cond_var_set.push_back(vi);
+		}
+		std::vector<unsigned int> cond_var_state(cond_var_set.size(), 0);
+		FactorGraphPartialObservation pobs(cond_var_set, cond_var_state);
+
+		FactorGraph* fg_cond = Conditioning::ConditionFactorGraph(fcond_tab,
+			fg, &pobs, block_var[bi]);
+		block_fg[bi] = fg_cond;
+		block_inf[bi] = new TreeInference(fg_cond);
+
+		// Collect factors conditioned on variables outside the block
+		const std::vector<Factor*>& comp_factors = fg_cond->Factors();
+		for (unsigned int comp_fi = 0; comp_fi < comp_factors.size();
+			++comp_fi) {
+			const ConditionedFactorType* cft =
+				static_cast<const ConditionedFactorType*>(
+					comp_factors[comp_fi]->Type());
+			const std::vector<unsigned int>& cv_index =
+				cft->ConditionedVariableIndices();
+			if (cv_index.empty())
+				continue;
+
+			Factor* orig_factor =
+				fcond_tab->OriginalFactor(comp_factors[comp_fi]);
+			const std::vector<unsigned int>& orig_vars =
+				orig_factor->Variables();
+			std::vector<unsigned int> cvar(cv_index.size());
+			for (unsigned int cvi = 0; cvi < cv_index.size(); ++cvi)
+				cvar[cvi] = orig_vars[cv_index[cvi]];
+
+			block_cfi[bi].push_back(comp_fi);
+			block_cfi_orig[bi].push_back(orig_factor);
+			block_cvar[bi].push_back(cvar);
+		}
+	}
+}
+
+InferenceMethod* BlockGibbsInference::Produce(const FactorGraph* fg) const {
+	BlockGibbsInference* bginf = new BlockGibbsInference(fg, fcond_tab);
+	bginf->SetSamplingParameters(burnin_sweeps, spacing_sweeps,
+		sample_count);
+
+	return (bginf);
+}
+
+void BlockGibbsInference::SetSamplingParameters(unsigned int burnin_sweeps,
+	unsigned int spacing_sweeps, unsigned int sample_count) {
+	assert(sample_count > 0);
+	this->burnin_sweeps = burnin_sweeps;
+	this->spacing_sweeps = spacing_sweeps;
+	this->sample_count = sample_count;
+}
+
+unsigned int BlockGibbsInference::BlockCount() const {
+	return (static_cast<unsigned int>(block_fg.size()));
+}
+
+void BlockGibbsInference::SampleBlock(unsigned int bi) {
+	// Update the energies of all factors conditioned on the current state of
+	// variables outside the block.  The base energies are used as they are,
+	// no forward map is performed.
+	const std::vector<Factor*>& comp_factors = block_fg[bi]->Factors();
+	std::vector<unsigned int> cond_state;
+	for (unsigned int bci = 0; bci < block_cfi[bi].size(); ++bci) {
+		const std::vector<unsigned int>& cvar = block_cvar[bi][bci];
+		cond_state.resize(cvar.size());
+		for (unsigned int cvi = 0; cvi < cvar.size(); ++cvi)
+			cond_state[cvi] = state[cvar[cvi]];
+
+		Factor* cfac = comp_factors[block_cfi[bi][bci]];
+		fcond_tab->UpdateConditioningInformation(cfac, cond_state);
+		fcond_tab->ConditionEnergies(cfac,
+			block_cfi_orig[bi][bci]->Energies(), cfac->Energies());
+	}
+
+	// Draw the block jointly from its exact conditional distribution
+	std::vector<std::vector<unsigned int> > block_sample;
+	block_inf[bi]->Sample(block_sample, 1);
+
+	const std::vector<unsigned int>& bvar = block_var[bi];
+	assert(block_sample[0].size() == bvar.size());
+	for (unsigned int vi = 0; vi < bvar.size(); ++vi)
+		state[bvar[vi]] = block_sample[0][vi];
+}
+
+void BlockGibbsInference::Sweep(unsigned int sweep_count) {
+	for (unsigned int sweep = 0; sweep < sweep_count; ++sweep) {
+		for (unsigned int bi = 0; bi < block_fg.size(); ++bi)
+			SampleBlock(bi);
+	}
+}
+
+void BlockGibbsInference::PerformBurninPhase() {
+	// Energies of factors not conditioned on anything are only set once
+	for (unsigned int bi = 0; bi < block_fg.size(); ++bi) {
+		const std::vector<Factor*>& comp_factors = block_fg[bi]->Factors();
+		for (unsigned int comp_fi = 0; comp_fi < comp_factors.size();
+			++comp_fi) {
+			Factor* cfac = comp_factors[comp_fi];
+			fcond_tab->ConditionEnergies(cfac,
+				fcond_tab->OriginalFactor(cfac)->Energies(), cfac->Energies());
+		}
+	}
+
+	SetupBlockEvidence();
+
+	// Uniform random initialization
+	const std::vector<unsigned int>& card = fg->Cardinalities();
+	for (unsigned int vi = 0; vi < card.size(); ++vi) {
+		if (IsObserved(vi)) {
+			state[vi] = evidence[vi];
+			continue;
+		}
+		state[vi] = std::min(card[vi] - 1, static_cast<unsigned int>(
+			randu() * static_cast<double>(card[vi])));
+	}
+	Sweep(burnin_sweeps);
+}
+
+void BlockGibbsInference::SetupBlockEvidence() {
+	std::vector<unsigned int> obs_var;
+	std::vector<unsigned int> obs_state;
+	for (unsigned int bi = 0; bi < block_fg.size(); ++bi) {
+		// Map the observed variables of the block to block variable indices
+		obs_var.clear();
+		obs_state.clear();
+		const std::vector<unsigned int>& bvar = block_var[bi];
+		for (unsigned int vi = 0; vi < bvar.size(); ++vi) {
+			if (IsObserved(bvar[vi]) == false)
+				continue;
+
+			obs_var.push_back(vi);
+			obs_state.push_back(evidence[bvar[vi]]);
+		}
+		if (obs_var.empty()) {
+			block_inf[bi]->ClearEvidence();
+		} else {
+			block_inf[bi]->SetEvidence(obs_var, obs_state);
+		}
+	}
+}
+
+void BlockGibbsInference::PerformInference() {
+	// 1. Setup marginals
+	const std::vector<Factor*>& factors = fg->Factors();
+	marginals.resize(factors.size());
+	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+		marginals[fi].resize(factors[fi]->Type()->ProdCardinalities());
+		std::fill(marginals[fi].begin(), marginals[fi].end(), 0.0);
+	}
+
+	// 2. Burn-in
+	PerformBurninPhase();
+
+	// 3. Produce approximate samples
+	double sample_contribution = 1.0 / static_cast<double>(sample_count);
+	for (unsigned int si = 0; si < sample_count; ++si) {
+		Sweep(1 + spacing_sweeps);
+
+		// Add to marginals
+		for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+			marginals[fi][factors[fi]->ComputeAbsoluteIndex(state)] +=
+				sample_contribution;
+		}
+	}
+}
+
+void BlockGibbsInference::ClearInferenceResult() {
+	marginals.clear();
+}
+
+const std::vector<double>& BlockGibbsInference::Marginal(
+	unsigned int factor_id) const {
+	assert(factor_id < marginals.size());
+	return (marginals[factor_id]);
+}
+
+const std::vector<std::vector<double> >&
+BlockGibbsInference::Marginals() const {
+	return (marginals);
+}
+
+double BlockGibbsInference::LogPartitionFunction() const {
+	return (std::numeric_limits<double>::signaling_NaN());
+}
+
+void BlockGibbsInference::Sample(
+	std::vector<std::vector<unsigned int> >& states,
+	unsigned int sample_count) {
+	PerformBurninPhase();
+
+	states.resize(sample_count);
+	for (unsigned int si = 0; si < sample_count; ++si) {
+		Sweep(1 + spacing_sweeps);
+		states[si] = state;
+	}
+}
+
+double BlockGibbsInference::MinimizeEnergy(std::vector<unsigned int>& state) {
+	// NOT IMPLEMENTED
+	assert(0);
+	return (std::numeric_limits<double>::signaling_NaN());
+}
+
+bool BlockGibbsInference::SupportsEvidence() const {
+	return (true);
+}
+
+}
+
@@ -0,0 +1,144 @@
+
+#ifndef GRANTE_BLOCKGIBBSINFERENCE_H
+#define GRANTE_BLOCKGIBBSINFERENCE_H
+
+#include <vector>
+
+#include <boost/random.hpp>
+
+#include "FactorGraph.h"
+#include "FactorConditioningTable.h"
+#include "TreeInference.h"
+#include "InferenceMethod.h"
+
+namespace Grante {
+
+/* Tree-block Gibbs sampler.
+ *
+ * The factor graph is cut into tree-structured components by means of a
+ * v-acyclic decomposition.  Components that do not share a removed factor are
+ * conditionally independent given the rest and are grouped into one block,
+ * such that each block is a spanning forest of its variables.  A sweep
+ * visits all blocks, conditions each block on the current state of all other
+ * variables and draws the whole block jointly by exact tree sampling.  For
+ * strongly coupled models this mixes much faster than single-site updates.
+ *
+ * References
+ * [Hamze2004] Firas Hamze, Nando de Freitas, "From Fields to Trees", UAI
+ *    2004.
+ * [Bouchard-Cote2009] Alexandre Bouchard-Cote and Michael I. Jordan,
+ *    "Optimization of Structured Mean Field Objectives", UAI 2009.
+ */
+class BlockGibbsInference : public InferenceMethod {
+public:
+	// fg: Factor graph to perform inference on.
+	// fcond_tab: Table to manage conditioned factor types.
+	//
+	// The decomposition keeps strongly correlated factors (as measured by
+	// their total correlation) within the blocks.
+	BlockGibbsInference(const FactorGraph* fg,
+		FactorConditioningTable* fcond_tab);
+
+	// factor_is_removed: custom user-specified decomposition.  By removing
+	//    all factors fi that have factor_is_removed[fi] true the resulting
+	//    factor graph should become v-acyclic.  It is the users duty to
+	//    ensure this.
+	BlockGibbsInference(const FactorGraph* fg,
+		FactorConditioningTable* fcond_tab,
+		const std::vector<bool>& factor_is_removed);
+
+	virtual ~BlockGibbsInference();
+
+	virtual InferenceMethod* Produce(const FactorGraph* fg) const;
+
+	// Set block Gibbs sampling parameters.
+	//
+	// burnin_sweeps: number of block sweeps to discard initially.
+	//    Default: 50.
+	// spacing_sweeps: number of block sweeps to discard between samples.
+	//    Default: 0.
+	// sample_count: number of samples used to estimate marginals.
+	//    Default: 1000.
+	void SetSamplingParameters(unsigned int burnin_sweeps,
+		unsigned int spacing_sweeps, unsigned int sample_count);
+
+	// Return the number of blocks visited in one sweep.
+	unsigned int BlockCount() const;
+
+	// Perform block Gibbs sampling to compute marginals.
+	virtual void PerformInference();
+	virtual void ClearInferenceResult();
+
+	// Approximate marginals
+	virtual const std::vector<double>& Marginal(unsigned int factor_id) const;
+	virtual const std::vector<std::vector<double> >& Marginals() const;
+
+	// Block Gibbs sampling does not support computation of the
+	// log-partition function.
+	// This method always returns the signaling_NaN value.
+	virtual double LogPartitionFunction() const;
+
+	// Produce approximate samples from the distribution
+	virtual void Sample(std::vector<std::vector<unsigned int> >& states,
+		unsigned int sample_count);
+
+	// NOT IMPLEMENTED
+	virtual double MinimizeEnergy(std::vector<unsigned int>& state);
+
+	// Observed variables are clamped in the block tree samplers
+	virtual bool SupportsEvidence() const;
+
+private:
+	// The condition-manager object (can be shared among multiple inference
+	// objects).
+	FactorConditioningTable* fcond_tab;
+
+	// Block factor graphs, each conditioned on all variables not in the
+	// block, and their exact inference objects.
+	std::vector<FactorGraph*> block_fg;
+	std::vector<TreeInference*> block_inf;
+	// block_var[bi][vi] is the original variable index of variable vi of
+	// block_fg[bi].
+	std::vector<std::vector<unsigned int> > block_var;
+	// For each block, the factor indices into block_fg[bi]->Factors() of
+	// factors conditioned on variables outside the block, their original
+	// factors and the original variable indices conditioned on (in the
+	// order of the conditioned factor type).
+	std::vector<std::vector<unsigned int> > block_cfi;
+	std::vector<std::vector<Factor*> > block_cfi_orig;
+	std::vector<std::vector<std::vector<unsigned int> > > block_cvar;
+
+	// Current state of the chain
+	std::vector<unsigned int> state;
+
+	// Inference result: estimated marginal distributions for all factors
+	std::vector<std::vector<double> > marginals;
+
+	// Sampling parameters
+	unsigned int burnin_sweeps;
+	unsigned int spacing_sweeps;
+	unsigned int sample_count;
+
+	// Random number generation, for the initial state
+	boost::mt19937 rgen;
+	boost::uniform_real<double> rdestu;	// range [0,1]
+	boost::variate_generator<boost::mt19937,
+		boost::uniform_real<double> > randu;
+
+	// Setup the blocks from a v-acyclic decomposition
+	void InitializeBlocks(const std::vector<bool>& factor_is_removed);
+
+	// Condition block bi on the current state and sample it jointly
+	void SampleBlock(unsigned int bi);
+	void Sweep(unsigned int sweep_count);
+
+	// Pass the evidence on to the block inference objects
+	void SetupBlockEvidence();
+	// Uniform random initialization and burn-in sweeps
+	void PerformBurninPhase();
+};
+
+}
+
+#endif
+
@@ -5,7 +5,7 @@
 #include <cmath>
 
 #include "Factor.h"
-#include "LogSumExp.h"
+#include "VectorMath.h"
 #include "BruteForceExactInference.h"
 
 namespace Grante {
@@ -30,10 +30,12 @@ void BruteForceExactInference::PerformInference() {
 	InitializeState(cur_state);
 	unsigned int si = 0;
 	do {
-		eval[si] = -fg->EvaluateEnergy(cur_state);
+		eval[si] = -fg->EvaluateEnergy(cur_state) -
+			EvaluateOverlayEnergy(cur_state);
 		si += 1;
 	} while (AdvanceState(cur_state));
-	log_z = LogSumExp::Compute(eval);
+	// eval becomes the normalized probability of each state
+	log_z = VectorMath::NormalizeLog(&eval[0], eval.size());
 
 	// Allocate marginals
 	const std::vector<Factor*>& factors = fg->Factors();
@@ -51,7 +53,7 @@ void BruteForceExactInference::PerformInference() {
 		for (size_t fi = 0; fi < fac_count; ++fi) {
 			unsigned int ei = factors[fi]->Type()->ComputeAbsoluteIndex(
 				factors[fi], cur_state);
-			marginals[fi][ei] += std::exp(eval[si] - log_z);
+			marginals[fi][ei] += eval[si];
 		}
 		si += 1;
 	} while (AdvanceState(cur_state));
@@ -89,7 +91,8 @@ double BruteForceExactInference::MinimizeEnergy(
 	std::vector<unsigned int> cur_state;
 	InitializeState(cur_state);
 	do {
-		double cur_energy = fg->EvaluateEnergy(cur_state);
+		double cur_energy = fg->EvaluateEnergy(cur_state) +
+			EvaluateOverlayEnergy(cur_state);
 		if (cur_energy < best_energy) {
 			best_energy = cur_energy;
 			state = cur_state;
@@ -99,6 +102,10 @@ double BruteForceExactInference::MinimizeEnergy(
 	return (best_energy);
 }
 
+bool BruteForceExactInference::SupportsUnaryOverlay() const {
+	return (true);
+}
+
 unsigned int BruteForceExactInference::StateCount() const {
 	unsigned int scount = 1;
 	const std::vector<unsigned int>& card = fg->Cardinalities();
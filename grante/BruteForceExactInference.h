@@ -32,6 +32,8 @@ public:
 
 	virtual double MinimizeEnergy(std::vector<unsigned int>& state);
 
+	virtual bool SupportsUnaryOverlay() const;
+
 private:
 	std::vector<std::vector<double> > marginals;
 	double log_z;
@@ -0,0 +1,82 @@
+
+#include <algorithm>
+#include <cassert>
+
+#include "ConcurrentDisjointSet.h"
+
+namespace Grante {
+
+ConcurrentDisjointSet::ConcurrentDisjointSet(size_t number_of_elements)
+	: number_of_elements(number_of_elements), parent(number_of_elements) {
+	Reset();
+}
+
+void ConcurrentDisjointSet::Reset() {
+	for (size_t n = 0; n < number_of_elements; ++n)
+		parent[n].store(static_cast<unsigned int>(n), std::memory_order_relaxed);
+}
+
+unsigned int ConcurrentDisjointSet::FindSet(unsigned int element_index) const {
+	assert(element_index < number_of_elements);
+	unsigned int ei = element_index;
+	while (true) {
+		unsigned int p = parent[ei].load(std::memory_order_relaxed);
+		if (p == ei)
+			return (ei);
+
+		// Path-halving: point ei to its grandparent.  A failed exchange only
+		// means another thread already changed the pointer.
+		unsigned int gp = parent[p].load(std::memory_order_relaxed);
+		if (p != gp)
+			parent[ei].compare_exchange_weak(p, gp, std::memory_order_relaxed);
+		ei = gp;
+	}
+}
+
+bool ConcurrentDisjointSet::Union(unsigned int element1,
+	unsigned int element2) {
+	while (true) {
+		unsigned int root1 = FindSet(element1);
+		unsigned int root2 = FindSet(element2);
+		if (root1 == root2)
+			return (false);
+
+		// Link the larger root below the smaller one.  Parents always have
+		// smaller indices, so no cycles can form.
+		if (root1 < root2)
+			std::swap(root1, root2);
+
+		// Only succeeds if root1 is still a root
+		unsigned int expected = root1;
+		if (parent[root1].compare_exchange_strong(expected, root2))
+			return (true);
+	}
+}
+
+unsigned int ConcurrentDisjointSet::UniqueLabeling(
+	std::vector<unsigned int>& out_labeling) const {
+	out_labeling.resize(number_of_elements);
+	int element_count = static_cast<int>(number_of_elements);
+
+	// Flatten all trees, roots are the smallest element in their set
+	#pragma omp parallel for
+	for (int ei = 0; ei < element_count; ++ei)
+		out_labeling[ei] = FindSet(ei);
+
+	// Number the roots in increasing order
+	unsigned int unique_label = 0;
+	for (int ei = 0; ei < element_count; ++ei) {
+		if (out_labeling[ei] == static_cast<unsigned int>(ei)) {
+			out_labeling[ei] = unique_label;
+			unique_label += 1;
+		} else {
+			// Root has smaller index and is already relabeled
+			assert(out_labeling[ei] < static_cast<unsigned int>(ei));
+			out_labeling[ei] = out_labeling[out_labeling[ei]];
+		}
+	}
+	return (unique_label);
+}
+
+}
+
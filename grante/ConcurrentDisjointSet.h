@@ -0,0 +1,49 @@
+
+#ifndef GRANTE_CONCURRENTDISJOINTSET_H
+#define GRANTE_CONCURRENTDISJOINTSET_H
+
+#include <vector>
+#include <atomic>
+
+namespace Grante {
+
+/* Lock-free disjoint-set data structure supporting concurrent FindSet and
+ * Union operations from multiple threads, as used for parallel connected
+ * component labeling.  Sets are linked by index (the larger root is linked
+ * below the smaller one) using compare-and-swap, and FindSet performs
+ * concurrent path halving.  The semantics match DisjointSet.
+ *
+ * Reference
+ * [Anderson1991] Richard J. Anderson, Heather Woll, "Wait-free Parallel
+ *    Algorithms for the Union-Find Problem", STOC 1991.
+ */
+class ConcurrentDisjointSet {
+public:
+	explicit ConcurrentDisjointSet(size_t number_of_elements);
+
+	// Reset to number_of_elements singleton sets.  Not thread-safe.
+	void Reset();
+
+	// Given an element index, find the representer element of its set.
+	// Thread-safe.
+	unsigned int FindSet(unsigned int element_index) const;
+
+	// Merge the sets containing element1 and element2.  Thread-safe.
+	// Return true if the two elements were in different sets.
+	bool Union(unsigned int element1, unsigned int element2);
+
+	// Label all elements uniquely, the labels are ordered by the smallest
+	// element index of each set.  The vector out_labeling will be properly
+	// resized.  Must not run concurrently with Union.
+	// Return the number of disjoint sets.
+	unsigned int UniqueLabeling(std::vector<unsigned int>& out_labeling) const;
+
+private:
+	size_t number_of_elements;
+	mutable std::vector<std::atomic<unsigned int> > parent;
+};
+
+}
+
+#endif
+
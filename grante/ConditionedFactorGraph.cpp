@@ -0,0 +1,115 @@
+
+#include <algorithm>
+#include <limits>
+#include <cassert>
+
+#include "Conditioning.h"
+#include "FactorGraphPartialObservation.h"
+#include "ConditionedFactorGraph.h"
+
+namespace Grante {
+
+ConditionedFactorGraph::ConditionedFactorGraph(FactorConditioningTable* ftab,
+	const FactorGraph* fg_base, const std::vector<unsigned int>& cond_var_set)
+	: ftab(ftab), fg_base(fg_base), fg(0), cond_var_set(cond_var_set),
+		evidence(cond_var_set.size(), 0) {
+	// Build the conditioned graph structure for the all-zero evidence
+	FactorGraphPartialObservation pobs(cond_var_set, evidence);
+	fg = Conditioning::ConditionFactorGraph(ftab, fg_base, &pobs,
+		var_new_to_orig, fac_new_to_orig);
+
+	// Position of each observed variable in the evidence vector
+	std::vector<unsigned int> var_to_evidence(
+		fg_base->Cardinalities().size(),
+		std::numeric_limits<unsigned int>::max());
+	for (unsigned int ci = 0; ci < cond_var_set.size(); ++ci)
+		var_to_evidence[cond_var_set[ci]] = ci;
+
+	// Collect the factors that contain observed variables
+	const std::vector<Factor*>& facs = fg->Factors();
+	const std::vector<Factor*>& base_facs = fg_base->Factors();
+	for (unsigned int fi = 0; fi < facs.size(); ++fi) {
+		const std::vector<unsigned int>& base_vars =
+			base_facs[fac_new_to_orig[fi]]->Variables();
+		std::vector<unsigned int> fac_evidence;
+		for (unsigned int fvi = 0; fvi < base_vars.size(); ++fvi) {
+			unsigned int ci = var_to_evidence[base_vars[fvi]];
+			if (ci != std::numeric_limits<unsigned int>::max())
+				fac_evidence.push_back(ci);
+		}
+		if (fac_evidence.empty())
+			continue;
+
+		cond_fac.push_back(fi);
+		cond_fac_evidence.push_back(fac_evidence);
+		cond_fac_state.push_back(
+			std::vector<unsigned int>(fac_evidence.size(), 0));
+
+		// SetEvidence writes into the energy table of this factor
+		facs[fi]->EnergiesAllocate();
+	}
+	ForwardMap();
+}
+
+ConditionedFactorGraph::~ConditionedFactorGraph() {
+	delete (fg);
+}
+
+void ConditionedFactorGraph::SetEvidence(
+	const std::vector<unsigned int>& var_state) {
+	assert(var_state.size() == evidence.size());
+#ifndef NDEBUG
+	const std::vector<unsigned int>& card = fg_base->Cardinalities();
+	for (unsigned int ci = 0; ci < var_state.size(); ++ci)
+		assert(var_state[ci] < card[cond_var_set[ci]]);
+#endif
+	std::copy(var_state.begin(), var_state.end(), evidence.begin());
+
+	// Only the factors containing observed variables change
+	const std::vector<Factor*>& facs = fg->Factors();
+	for (unsigned int k = 0; k < cond_fac.size(); ++k) {
+		const std::vector<unsigned int>& fac_evidence = cond_fac_evidence[k];
+		std::vector<unsigned int>& fac_state = cond_fac_state[k];
+		for (unsigned int i = 0; i < fac_evidence.size(); ++i)
+			fac_state[i] = evidence[fac_evidence[i]];
+
+		Factor* fac = facs[cond_fac[k]];
+		ftab->UpdateConditioningInformation(fac, fac_state);
+		ftab->ConditionEnergies(fac, ftab->OriginalFactor(fac)->Energies(),
+			fac->Energies());
+	}
+}
+
+void ConditionedFactorGraph::ForwardMap() {
+	fg->ForwardMap();
+}
+
+FactorGraph* ConditionedFactorGraph::FG() {
+	return (fg);
+}
+
+const FactorGraph* ConditionedFactorGraph::FG() const {
+	return (fg);
+}
+
+const std::vector<unsigned int>&
+ConditionedFactorGraph::ConditionedVariables() const {
+	return (cond_var_set);
+}
+
+const std::vector<unsigned int>& ConditionedFactorGraph::Evidence() const {
+	return (evidence);
+}
+
+const std::vector<unsigned int>&
+ConditionedFactorGraph::VariableNewToOriginal() const {
+	return (var_new_to_orig);
+}
+
+const std::vector<unsigned int>&
+ConditionedFactorGraph::FactorNewToOriginal() const {
+	return (fac_new_to_orig);
+}
+
+}
+
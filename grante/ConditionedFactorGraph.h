@@ -0,0 +1,92 @@
+
+#ifndef GRANTE_CONDITIONEDFACTORGRAPH_H
+#define GRANTE_CONDITIONEDFACTORGRAPH_H
+
+#include <vector>
+
+#include "FactorGraph.h"
+#include "FactorConditioningTable.h"
+
+namespace Grante {
+
+/* A factor graph conditioned on discrete observations of a fixed subset of
+ * its variables, where the observed states can be changed.
+ *
+ * Conditioning::ConditionFactorGraph creates a new factor graph for each
+ * observation.  This class instead builds the conditioned factor graph once
+ * for a given set of observed variables.  Setting new evidence only updates
+ * the conditioning states and recomputes the energies of the factors that
+ * contain observed variables; their energy tables are allocated once on
+ * construction and no memory is allocated per query.  This is useful when
+ * the same base graph is conditioned on many observations, for example when
+ * making predictions with evidence that changes per query.
+ */
+class ConditionedFactorGraph {
+public:
+	// ftab: The storage object for conditioned factor types, see
+	//    Conditioning::ConditionFactorGraph.  The conditioning states of the
+	//    factors of this graph are kept in ftab, which must remain valid
+	//    throughout the lifetime of this object.
+	// fg_base: The factor graph to be conditioned.  It must remain valid
+	//    throughout the lifetime of this object.
+	// cond_var_set: The ordered, non-empty set of observed variables.  At
+	//    least one variable must remain unobserved.
+	//
+	// The initial evidence is the all-zero state.  The energies are computed
+	// from the current parameters.
+	ConditionedFactorGraph(FactorConditioningTable* ftab,
+		const FactorGraph* fg_base,
+		const std::vector<unsigned int>& cond_var_set);
+
+	~ConditionedFactorGraph();
+
+	// Set the states of the observed variables, var_state[i] being the state
+	// of cond_var_set[i], and update the energies of all factors containing
+	// observed variables from the energies of fg_base computed by the last
+	// ForwardMap.  If the energies of FG() have been released, call
+	// ForwardMap first.
+	void SetEvidence(const std::vector<unsigned int>& var_state);
+
+	// Recompute all energies of the conditioned graph from the current
+	// parameters, eg. after the model has been trained further.  This does
+	// not assume fg_base has up-to-date energies.
+	void ForwardMap();
+
+	// Return the conditioned factor graph (for inference)
+	FactorGraph* FG();
+	const FactorGraph* FG() const;
+
+	// Observed variables and their current states
+	const std::vector<unsigned int>& ConditionedVariables() const;
+	const std::vector<unsigned int>& Evidence() const;
+
+	// var_new_to_orig[new_variable_index] = original_variable_index
+	const std::vector<unsigned int>& VariableNewToOriginal() const;
+	// fac_new_to_orig[new_factor_index] = original_factor_index
+	const std::vector<unsigned int>& FactorNewToOriginal() const;
+
+private:
+	FactorConditioningTable* ftab;
+	const FactorGraph* fg_base;
+
+	// The conditioned factor graph instance
+	FactorGraph* fg;
+
+	std::vector<unsigned int> cond_var_set;
+	std::vector<unsigned int> evidence;
+	std::vector<unsigned int> var_new_to_orig;
+	std::vector<unsigned int> fac_new_to_orig;
+
+	// Factors of fg that contain observed variables: cond_fac[k] is the
+	// factor index in fg, cond_fac_evidence[k][i] the index into evidence of
+	// the i'th observed variable of the factor, and cond_fac_state[k] the
+	// buffer holding its conditioning states.
+	std::vector<unsigned int> cond_fac;
+	std::vector<std::vector<unsigned int> > cond_fac_evidence;
+	std::vector<std::vector<unsigned int> > cond_fac_state;
+};
+
+}
+
+#endif
+
@@ -23,7 +23,10 @@ ConditionedFactorType::ConditionedFactorType(const FactorType* base_ft,
 	prod_cumcard.reserve(base_card.size()-cond_var_index.size());
 
 	unsigned int cvi = 0;
+	unsigned int base_stride = 1;
 	prod_card = 1;
+	cond_offset.push_back(0);
+	uncond_offset.push_back(0);
 	for (unsigned int vi = 0; vi < base_card.size(); ++vi) {
 		if (cvi > 0 && cvi < cond_var_index.size()) {
 			// Conditioning variable indices must be ordered
@@ -31,6 +34,9 @@ ConditionedFactorType::ConditionedFactorType(const FactorType* base_ft,
 		}
 		if (cvi < cond_var_index.size() && cond_var_index[cvi] == vi) {
 			// Conditioned variable
+			cond_stride.push_back(base_stride);
+			ExtendOffsets(cond_offset, base_card[vi], base_stride);
+			base_stride *= base_card[vi];
 			cvi += 1;
 			continue;
 		}
@@ -39,8 +45,13 @@ ConditionedFactorType::ConditionedFactorType(const FactorType* base_ft,
 		cardinalities.push_back(base_card[vi]);
 		prod_cumcard.push_back(static_cast<unsigned int>(prod_card));
 		prod_card *= base_card[vi];
+		ExtendOffsets(uncond_offset, base_card[vi], base_stride);
+		base_stride *= base_card[vi];
 	}
 	assert(cardinalities.size() == (base_card.size()-cond_var_index.size()));
+	assert(uncond_offset.size() == prod_card);
+	assert(cond_offset.size() * uncond_offset.size() ==
+		base_ft->ProdCardinalities());
 
 	// No weight vector is ever stored in conditional factor types
 	w.clear();
@@ -77,6 +88,37 @@ ConditionedFactorType::ConditionedVariableIndices() const {
 	return (cond_var_index);
 }
 
+const std::vector<unsigned int>&
+ConditionedFactorType::ConditionedOffsets() const {
+	return (cond_offset);
+}
+
+const std::vector<unsigned int>&
+ConditionedFactorType::UnconditionedOffsets() const {
+	return (uncond_offset);
+}
+
+unsigned int ConditionedFactorType::ConditionedOffset(
+	const std::vector<unsigned int>& cond_state) const {
+	assert(cond_state.size() == cond_stride.size());
+	unsigned int offset = 0;
+	for (unsigned int cvi = 0; cvi < cond_stride.size(); ++cvi)
+		offset += cond_state[cvi] * cond_stride[cvi];
+
+	return (offset);
+}
+
+void ConditionedFactorType::ExtendOffsets(std::vector<unsigned int>& offset,
+	unsigned int card, unsigned int stride) {
+	// The new variable runs slowest: offset[s*size + i] = offset[i] + s*stride
+	size_t size = offset.size();
+	offset.resize(size * card);
+	for (unsigned int s = 1; s < card; ++s) {
+		for (size_t i = 0; i < size; ++i)
+			offset[s*size + i] = offset[i] + s*stride;
+	}
+}
+
 bool ConditionedFactorType::IsDataDependent() const {
 	return (true);
 }
@@ -119,5 +161,24 @@ void ConditionedFactorType::BackwardMap(const Factor* factor,
 	base_ft->BackwardMap(orig_factor, ext_marginals, parameter_gradient, mult);
 }
 
+void ConditionedFactorType::SparseBackwardMap(const Factor* factor,
+	const std::vector<double>& marginals,
+	sparse_gradient_type& parameter_gradient, double mult) const {
+	std::vector<double> ext_marginals(base_ft->ProdCardinalities(), 0.0);
+	fcond_data->ExtendMarginals(factor, marginals, ext_marginals);
+
+	const Factor* orig_factor = fcond_data->OriginalFactor(factor);
+	assert(orig_factor != 0);
+	base_ft->SparseBackwardMap(orig_factor, ext_marginals,
+		parameter_gradient, mult);
+}
+
+void ConditionedFactorType::ParameterSupport(const Factor* factor,
+	std::vector<unsigned int>& support) const {
+	const Factor* orig_factor = fcond_data->OriginalFactor(factor);
+	assert(orig_factor != 0);
+	base_ft->ParameterSupport(orig_factor, support);
+}
+
 }
 
@@ -49,6 +49,18 @@ public:
 	const FactorType* BaseType() const;
 	const std::vector<unsigned int>& ConditionedVariableIndices() const;
 
+	// Gather tables, precomputed on construction.  Let cei be the joint
+	// state of the conditioned variables, linearized in the same order as
+	// energy tables, and nei the index into the energy table of this type.
+	// The corresponding index into the base factor type energy table is
+	//    ConditionedOffsets()[cei] + UnconditionedOffsets()[nei].
+	const std::vector<unsigned int>& ConditionedOffsets() const;
+	const std::vector<unsigned int>& UnconditionedOffsets() const;
+	// Return the conditioned offset for the conditioned variables being in
+	// the states cond_state.
+	unsigned int ConditionedOffset(
+		const std::vector<unsigned int>& cond_state) const;
+
 	virtual bool IsDataDependent() const;
 
 	// Pass through to base type
@@ -66,6 +78,11 @@ public:
 	virtual void BackwardMap(const Factor* factor,
 		const std::vector<double>& marginals,
 		std::vector<double>& parameter_gradient, double mult = 1.0) const;
+	virtual void SparseBackwardMap(const Factor* factor,
+		const std::vector<double>& marginals,
+		sparse_gradient_type& parameter_gradient, double mult = 1.0) const;
+	virtual void ParameterSupport(const Factor* factor,
+		std::vector<unsigned int>& support) const;
 
 	struct condfac_tp_hash :
 		public std::unary_function<ConditionedFactorType*, size_t>
@@ -91,6 +108,17 @@ private:
 	// The factortype-relative indices that are conditioned
 	const std::vector<unsigned int> cond_var_index;
 
+	// Base energy table strides of the conditioned variables
+	std::vector<unsigned int> cond_stride;
+	// Gather tables, see ConditionedOffsets
+	std::vector<unsigned int> cond_offset;
+	std::vector<unsigned int> uncond_offset;
+
+	// Append a variable of cardinality card and base stride to the linear
+	// order of a gather table
+	static void ExtendOffsets(std::vector<unsigned int>& offset,
+		unsigned int card, unsigned int stride);
+
 	// Actual data being conditioned on.  This data is external and can be
 	// changed.
 	const FactorConditioningTable* fcond_data;
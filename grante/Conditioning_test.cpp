@@ -1,17 +1,23 @@
 
 #include "grante/Conditioning.h"
 
+#include <algorithm>
 #include <random>
 #include <vector>
 
 #include "gmock/gmock.h"
 #include "grante/BeliefPropagation.h"
+#include "grante/BlockGibbsInference.h"
+#include "grante/ConditionedFactorGraph.h"
 #include "grante/Factor.h"
 #include "grante/FactorConditioningTable.h"
 #include "grante/FactorGraph.h"
 #include "grante/FactorGraphModel.h"
 #include "grante/FactorGraphPartialObservation.h"
 #include "grante/FactorType.h"
+#include "grante/GibbsInference.h"
+#include "grante/MultichainGibbsInference.h"
+#include "grante/NaiveMeanFieldInference.h"
 #include "grante/TreeInference.h"
 #include "gtest/gtest.h"
 
@@ -130,3 +136,409 @@ TEST(Conditioning, Simple) {
     // constant bias, probabilities should not change
     delete fg_cond;
 }
+
+TEST(Conditioning, ConditionedFactorGraph) {
+    Grante::FactorGraphModel model;
+
+    // Pairwise and unary factor types on ternary variables
+    std::vector<unsigned int> card2(2, 3);
+    std::vector<double> w2(9);
+    for (unsigned int i = 0; i < w2.size(); ++i)
+        w2[i] = 0.1 * static_cast<double>((i * 7) % 5);
+    model.AddFactorType(new Grante::FactorType("pairwise", card2, w2));
+    std::vector<unsigned int> card1(1, 3);
+    std::vector<double> w1(3);
+    w1[0] = 0.2;
+    w1[1] = -0.4;
+    w1[2] = 0.5;
+    model.AddFactorType(new Grante::FactorType("unary", card1, w1));
+
+    // Chain of four variables
+    std::vector<unsigned int> vc(4, 3);
+    Grante::FactorGraph fg(&model, vc);
+    const Grante::FactorType* pt2 = model.FindFactorType("pairwise");
+    const Grante::FactorType* pt1 = model.FindFactorType("unary");
+    std::vector<double> data;
+    for (unsigned int vi = 0; vi < vc.size(); ++vi) {
+        std::vector<unsigned int> var_index1(1, vi);
+        fg.AddFactor(new Grante::Factor(pt1, var_index1, data));
+        if (vi + 1 < vc.size()) {
+            std::vector<unsigned int> var_index(2);
+            var_index[0] = vi;
+            var_index[1] = vi + 1;
+            fg.AddFactor(new Grante::Factor(pt2, var_index, data));
+        }
+    }
+    fg.ForwardMap();
+
+    // Observe variables 1 and 3
+    std::vector<unsigned int> cond_var_set;
+    cond_var_set.push_back(1);
+    cond_var_set.push_back(3);
+    Grante::FactorConditioningTable ftab;
+    Grante::ConditionedFactorGraph cfg(&ftab, &fg, cond_var_set);
+    ASSERT_EQ(2, cfg.FG()->Cardinalities().size());
+
+    // Each evidence must give the same energies as conditioning anew
+    std::vector<unsigned int> cond_var_state(2);
+    for (unsigned int s1 = 0; s1 < 3; ++s1) {
+        for (unsigned int s3 = 0; s3 < 3; ++s3) {
+            cond_var_state[0] = s1;
+            cond_var_state[1] = s3;
+            cfg.SetEvidence(cond_var_state);
+
+            Grante::FactorConditioningTable ftab_ref;
+            Grante::FactorGraphPartialObservation pobs(cond_var_set,
+                cond_var_state);
+            std::vector<unsigned int> var_new_to_orig;
+            Grante::FactorGraph* fg_ref =
+                Grante::Conditioning::ConditionFactorGraph(&ftab_ref, &fg,
+                    &pobs, var_new_to_orig);
+            fg_ref->ForwardMap();
+            ASSERT_EQ(var_new_to_orig, cfg.VariableNewToOriginal());
+
+            std::vector<unsigned int> state(2);
+            for (state[0] = 0; state[0] < 3; ++state[0]) {
+                for (state[1] = 0; state[1] < 3; ++state[1]) {
+                    ASSERT_THAT(cfg.FG()->EvaluateEnergy(state),
+                        testing::DoubleNear(fg_ref->EvaluateEnergy(state),
+                            1.0e-10));
+                }
+            }
+            delete fg_ref;
+        }
+    }
+}
+
+TEST(Conditioning, InferenceEvidence) {
+    Grante::FactorGraphModel model;
+
+    // Pairwise and unary factor types on ternary variables
+    std::vector<unsigned int> card2(2, 3);
+    std::vector<double> w2(9);
+    for (unsigned int i = 0; i < w2.size(); ++i)
+        w2[i] = 0.3 * static_cast<double>((i * 5) % 7);
+    model.AddFactorType(new Grante::FactorType("pairwise", card2, w2));
+    std::vector<unsigned int> card1(1, 3);
+    std::vector<double> w1(3);
+    w1[0] = -0.3;
+    w1[1] = 0.6;
+    w1[2] = 0.1;
+    model.AddFactorType(new Grante::FactorType("unary", card1, w1));
+
+    // Chain of four variables, the unary factor of variable vi is factor
+    // 2*vi
+    std::vector<unsigned int> vc(4, 3);
+    Grante::FactorGraph fg(&model, vc);
+    const Grante::FactorType* pt2 = model.FindFactorType("pairwise");
+    const Grante::FactorType* pt1 = model.FindFactorType("unary");
+    std::vector<double> data;
+    for (unsigned int vi = 0; vi < vc.size(); ++vi) {
+        std::vector<unsigned int> var_index1(1, vi);
+        fg.AddFactor(new Grante::Factor(pt1, var_index1, data));
+        if (vi + 1 < vc.size()) {
+            std::vector<unsigned int> var_index(2);
+            var_index[0] = vi;
+            var_index[1] = vi + 1;
+            fg.AddFactor(new Grante::Factor(pt2, var_index, data));
+        }
+    }
+    fg.ForwardMap();
+
+    // Observe variables 1 and 3, reference by conditioning the graph
+    std::vector<unsigned int> cond_var_set;
+    cond_var_set.push_back(1);
+    cond_var_set.push_back(3);
+    Grante::FactorConditioningTable ftab;
+    Grante::ConditionedFactorGraph cfg(&ftab, &fg, cond_var_set);
+    const std::vector<unsigned int>& fac_new_to_orig =
+        cfg.FactorNewToOriginal();
+
+    Grante::TreeInference tinf(&fg);
+    Grante::BeliefPropagation bpinf(&fg);
+    bpinf.SetParameters(false, 100, 1.0e-8);
+    ASSERT_TRUE(tinf.SupportsEvidence());
+    ASSERT_TRUE(bpinf.SupportsEvidence());
+
+    // Approximate methods.  Given variables 1 and 3, variables 0 and 2 are
+    // independent, hence naive mean field is exact; the sampled marginals
+    // are compared with a tolerance.
+    Grante::NaiveMeanFieldInference mfinf(&fg);
+    mfinf.SetParameters(false, 1.0e-8, 100);
+    Grante::GibbsInference ginf(&fg);
+    ginf.SetSamplingParameters(50, 1, 4000);
+    Grante::MultichainGibbsInference mcginf(&fg);
+    mcginf.SetSamplingParameters(4, 1.05, 1, 4000);
+    Grante::FactorConditioningTable ftab_block;
+    Grante::BlockGibbsInference bginf(&fg, &ftab_block);
+    bginf.SetSamplingParameters(50, 1, 4000);
+    std::vector<Grante::InferenceMethod*> approx_inf;
+    approx_inf.push_back(&mfinf);
+    approx_inf.push_back(&ginf);
+    approx_inf.push_back(&mcginf);
+    approx_inf.push_back(&bginf);
+    for (unsigned int ai = 0; ai < approx_inf.size(); ++ai)
+        ASSERT_TRUE(approx_inf[ai]->SupportsEvidence());
+
+    std::vector<unsigned int> cond_var_state(2);
+    for (unsigned int s1 = 0; s1 < 3; ++s1) {
+        for (unsigned int s3 = 0; s3 < 3; ++s3) {
+            cond_var_state[0] = s1;
+            cond_var_state[1] = s3;
+            cfg.SetEvidence(cond_var_state);
+            Grante::TreeInference tinf_ref(cfg.FG());
+            tinf_ref.PerformInference();
+
+            tinf.SetEvidence(cond_var_set, cond_var_state);
+            tinf.PerformInference();
+            bpinf.SetEvidence(cond_var_set, cond_var_state);
+            bpinf.PerformInference();
+            // The reference graph drops the unary factors of the observed
+            // variables, which contribute a constant energy
+            double log_z_ref = tinf_ref.LogPartitionFunction() -
+                w1[s1] - w1[s3];
+            EXPECT_THAT(tinf.LogPartitionFunction(),
+                testing::DoubleNear(log_z_ref, 1.0e-8));
+            EXPECT_THAT(bpinf.LogPartitionFunction(),
+                testing::DoubleNear(log_z_ref, 1.0e-6));
+
+            // Unary marginals of the unobserved variables
+            for (unsigned int fi = 0; fi < fac_new_to_orig.size(); ++fi) {
+                unsigned int fi_orig = fac_new_to_orig[fi];
+                if (fi_orig % 2 != 0 || fi_orig / 2 == 1 || fi_orig / 2 == 3)
+                    continue;
+
+                for (unsigned int si = 0; si < 3; ++si) {
+                    EXPECT_THAT(tinf.Marginal(fi_orig)[si],
+                        testing::DoubleNear(tinf_ref.Marginal(fi)[si],
+                            1.0e-8));
+                    EXPECT_THAT(bpinf.Marginal(fi_orig)[si],
+                        testing::DoubleNear(tinf_ref.Marginal(fi)[si],
+                            1.0e-6));
+                }
+            }
+            // Observed variables are point masses
+            EXPECT_DOUBLE_EQ(1.0, tinf.Marginal(2)[s1]);
+            EXPECT_DOUBLE_EQ(1.0, bpinf.Marginal(6)[s3]);
+
+            // Energy minimization respects the evidence
+            std::vector<unsigned int> state;
+            tinf.MinimizeEnergy(state);
+            EXPECT_EQ(s1, state[1]);
+            EXPECT_EQ(s3, state[3]);
+            bpinf.MinimizeEnergy(state);
+            EXPECT_EQ(s1, state[1]);
+            EXPECT_EQ(s3, state[3]);
+
+            for (unsigned int ai = 0; ai < approx_inf.size(); ++ai) {
+                Grante::InferenceMethod* inf = approx_inf[ai];
+                inf->SetEvidence(cond_var_set, cond_var_state);
+                inf->PerformInference();
+
+                // Observed variables stay fixed: their marginals are point
+                // masses, up to the rounding of the sample averages
+                EXPECT_THAT(inf->Marginal(2)[s1],
+                    testing::DoubleNear(1.0, 1.0e-10));
+                EXPECT_THAT(inf->Marginal(6)[s3],
+                    testing::DoubleNear(1.0, 1.0e-10));
+                double tol = (ai == 0) ? 1.0e-6 : 0.05;
+                for (unsigned int fi = 0; fi < fac_new_to_orig.size(); ++fi) {
+                    unsigned int fi_orig = fac_new_to_orig[fi];
+                    if (fi_orig % 2 != 0 || fi_orig / 2 == 1 ||
+                        fi_orig / 2 == 3)
+                        continue;
+
+                    for (unsigned int si = 0; si < 3; ++si) {
+                        EXPECT_THAT(inf->Marginal(fi_orig)[si],
+                            testing::DoubleNear(tinf_ref.Marginal(fi)[si],
+                                tol));
+                    }
+                }
+            }
+        }
+    }
+
+    // Without evidence the unconditioned distribution is recovered
+    tinf.ClearEvidence();
+    tinf.PerformInference();
+    Grante::TreeInference tinf_full(&fg);
+    tinf_full.PerformInference();
+    EXPECT_DOUBLE_EQ(tinf_full.LogPartitionFunction(),
+        tinf.LogPartitionFunction());
+
+    // Clearing the evidence releases the observed variables of the samplers
+    for (unsigned int ai = 1; ai < approx_inf.size(); ++ai) {
+        approx_inf[ai]->ClearEvidence();
+        approx_inf[ai]->PerformInference();
+        for (unsigned int si = 0; si < 3; ++si) {
+            EXPECT_THAT(approx_inf[ai]->Marginal(2)[si],
+                testing::DoubleNear(tinf_full.Marginal(2)[si], 0.05));
+        }
+    }
+}
+
+namespace {
+
+// Split the original energy index oei of a factor with cardinalities card
+// into the linear index of the conditioned variables cv_set (cei) and of the
+// remaining variables (nei), both with the leftmost variable running
+// fastest.
+void SplitIndexReference(const std::vector<unsigned int>& card,
+    const std::vector<unsigned int>& cv_set, unsigned int oei,
+    unsigned int& cei, unsigned int& nei) {
+    std::vector<unsigned int> state(card.size());
+    for (unsigned int vi = 0; vi < card.size(); ++vi) {
+        state[vi] = oei % card[vi];
+        oei /= card[vi];
+    }
+    cei = 0;
+    nei = 0;
+    unsigned int cei_prod = 1;
+    unsigned int nei_prod = 1;
+    for (unsigned int vi = 0; vi < card.size(); ++vi) {
+        if (std::find(cv_set.begin(), cv_set.end(), vi) != cv_set.end()) {
+            cei += cei_prod * state[vi];
+            cei_prod *= card[vi];
+        } else {
+            nei += nei_prod * state[vi];
+            nei_prod *= card[vi];
+        }
+    }
+}
+
+}
+
+TEST(Conditioning, FactorConditioningTableReference) {
+    Grante::FactorGraphModel model;
+    std::vector<unsigned int> card;
+    card.push_back(2);
+    card.push_back(3);
+    card.push_back(2);
+    card.push_back(3);
+    std::vector<double> w(36, 0.0);
+    Grante::FactorType* ft = new Grante::FactorType("quad", card, w);
+    model.AddFactorType(ft);
+    std::vector<unsigned int> var_index;
+    for (unsigned int vi = 0; vi < card.size(); ++vi)
+        var_index.push_back(vi);
+    std::vector<double> data;
+    Grante::Factor full_factor(ft, var_index, data);
+
+    // Conditioning on the first, a middle and the last variable, and on
+    // mixed subsets of them
+    std::vector<std::vector<unsigned int> > cv_sets(5);
+    cv_sets[0].push_back(0);
+    cv_sets[1].push_back(1);
+    cv_sets[2].push_back(3);
+    cv_sets[3].push_back(0);
+    cv_sets[3].push_back(3);
+    cv_sets[4].push_back(0);
+    cv_sets[4].push_back(2);
+    cv_sets[4].push_back(3);
+
+    std::default_random_engine e1(3);
+    std::uniform_real_distribution<double> randu(0.0, 1.0);
+    std::vector<double> orig_energies(36);
+    for (unsigned int oei = 0; oei < orig_energies.size(); ++oei)
+        orig_energies[oei] = randu(e1);
+
+    Grante::FactorConditioningTable ftab;
+    for (unsigned int si = 0; si < cv_sets.size(); ++si) {
+        const std::vector<unsigned int>& cv_set = cv_sets[si];
+        unsigned int cond_prodcard = 1;
+        std::vector<unsigned int> uncond_var_index;
+        for (unsigned int vi = 0; vi < card.size(); ++vi) {
+            if (std::find(cv_set.begin(), cv_set.end(), vi) != cv_set.end())
+                cond_prodcard *= card[vi];
+            else
+                uncond_var_index.push_back(vi);
+        }
+        unsigned int uncond_prodcard = 36 / cond_prodcard;
+
+        std::vector<double> marginals(uncond_prodcard);
+        for (unsigned int nei = 0; nei < marginals.size(); ++nei)
+            marginals[nei] = randu(e1);
+        std::vector<double> ext_marginals(36);
+        for (unsigned int oei = 0; oei < ext_marginals.size(); ++oei)
+            ext_marginals[oei] = randu(e1);
+
+        // Conditioning on every joint state of the conditioned variables
+        for (unsigned int cstate = 0; cstate < cond_prodcard; ++cstate) {
+            std::vector<unsigned int> cv_state(cv_set.size());
+            unsigned int rem = cstate;
+            for (unsigned int cvi = 0; cvi < cv_set.size(); ++cvi) {
+                cv_state[cvi] = rem % card[cv_set[cvi]];
+                rem /= card[cv_set[cvi]];
+            }
+            Grante::Factor* fac = ftab.ConditionAndAddFactor(&full_factor,
+                cv_set, cv_state, uncond_var_index);
+
+            std::vector<double> energies_ref(uncond_prodcard, -1.0);
+            std::vector<double> ext_marginals_ref(36, 0.0);
+            for (unsigned int oei = 0; oei < 36; ++oei) {
+                unsigned int cei = 0;
+                unsigned int nei = 0;
+                SplitIndexReference(card, cv_set, oei, cei, nei);
+                if (cei != cstate)
+                    continue;
+                energies_ref[nei] = orig_energies[oei];
+                ext_marginals_ref[oei] = marginals[nei];
+            }
+            std::vector<double> energies(uncond_prodcard);
+            ftab.ConditionEnergies(fac, orig_energies, energies);
+            EXPECT_EQ(energies_ref, energies);
+
+            std::vector<double> ext_marg(36, -1.0);
+            ftab.ExtendMarginals(fac, marginals, ext_marg);
+            EXPECT_EQ(ext_marginals_ref, ext_marg);
+            delete fac;
+        }
+
+        // Conditioning on expectations
+        std::vector<double> cv_expect(cond_prodcard);
+        for (unsigned int cei = 0; cei < cv_expect.size(); ++cei)
+            cv_expect[cei] = randu(e1);
+        Grante::Factor* fac = ftab.ConditionAndAddFactor(&full_factor,
+            cv_set, cv_expect, uncond_var_index);
+
+        std::vector<double> energies_ref(uncond_prodcard, 0.0);
+        std::vector<double> ext_marginals_ref(36);
+        std::vector<double> ext_marginals_rep_ref(36);
+        std::vector<double> cond_expect_ref(cond_prodcard);
+        for (unsigned int oei = 0; oei < 36; ++oei) {
+            unsigned int cei = 0;
+            unsigned int nei = 0;
+            SplitIndexReference(card, cv_set, oei, cei, nei);
+            energies_ref[nei] += cv_expect[cei] * orig_energies[oei];
+            ext_marginals_ref[oei] = cv_expect[cei] * marginals[nei];
+            ext_marginals_rep_ref[oei] = marginals[nei];
+            // The entry of the largest original index is projected
+            cond_expect_ref[cei] = ext_marginals[oei];
+        }
+        std::vector<double> energies(uncond_prodcard);
+        ftab.ConditionEnergies(fac, orig_energies, energies);
+        for (unsigned int nei = 0; nei < energies.size(); ++nei)
+            EXPECT_THAT(energies[nei],
+                testing::DoubleNear(energies_ref[nei], 1.0e-12));
+
+        std::vector<double> ext_marg(36, -1.0);
+        ftab.ExtendMarginals(fac, marginals, ext_marg);
+        EXPECT_EQ(ext_marginals_ref, ext_marg);
+        std::fill(ext_marg.begin(), ext_marg.end(), -1.0);
+        ftab.ExtendMarginals(fac, marginals, ext_marg, true);
+        EXPECT_EQ(ext_marginals_rep_ref, ext_marg);
+
+        std::vector<double> cond_expect(cond_prodcard, -1.0);
+        ftab.ProjectExtendedMarginalsCond(fac, ext_marginals, cond_expect);
+        EXPECT_EQ(cond_expect_ref, cond_expect);
+
+        // Projecting extended marginals that are constant within each
+        // conditioned state recovers the conditioned-on expectations
+        ftab.ExtendMarginals(fac, std::vector<double>(uncond_prodcard, 1.0),
+            ext_marg);
+        ftab.ProjectExtendedMarginalsCond(fac, ext_marg, cond_expect);
+        EXPECT_EQ(cv_expect, cond_expect);
+        delete fac;
+    }
+}
+
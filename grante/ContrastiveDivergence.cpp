@@ -1,7 +1,10 @@
 
 #include <iostream>
+#include <algorithm>
+#include <cmath>
 #include <cassert>
 
+#include "RandomSource.h"
 #include "GibbsSampler.h"
 #include "Factor.h"
 #include "FactorType.h"
@@ -11,7 +14,8 @@ namespace Grante {
 
 ContrastiveDivergence::ContrastiveDivergence(FactorGraphModel* fg_model,
 	unsigned int cd_k)
-	: model(fg_model), cd_k(cd_k) {
+	: model(fg_model), cd_k(cd_k),
+		rgen(RandomSource::GetGlobalRandomSeed()), randu(rgen, rdestu) {
 	assert(cd_k > 0);
 
 	// Setup temporary marginal distributions (key is size)
@@ -78,6 +82,83 @@ void ContrastiveDivergence::ComputeGradientPartiallyObserved(
 	AddBackwardMap(parameter_gradient, fg, y_model, -1.0);
 }
 
+void ContrastiveDivergence::ComputeGradientFullyObservedPersistent(
+	std::unordered_map<std::string, std::vector<double> >&
+		parameter_gradient, const FactorGraph* fg,
+	const FactorGraphObservation* obs,
+	std::vector<std::vector<unsigned int> >& particles,
+	const std::vector<double>& inv_temps) const {
+	assert(obs->Type() == FactorGraphObservation::DiscreteLabelingType);
+
+	// Compute: \nabla_w E(y_obs,x,w) - 1/P \sum_p \nabla_w E(y_p,x,w)
+	AddBackwardMap(parameter_gradient, fg, obs->State(), 1.0);
+	AddPersistentModelGradient(parameter_gradient, fg, particles, inv_temps);
+}
+
+void ContrastiveDivergence::ComputeGradientPartiallyObservedPersistent(
+	std::unordered_map<std::string, std::vector<double> >&
+		parameter_gradient, const FactorGraph* fg,
+	const FactorGraphPartialObservation* pobs,
+	std::vector<std::vector<unsigned int> >& particles,
+	const std::vector<double>& inv_temps) const {
+	assert(pobs->Type() == FactorGraphObservation::DiscreteLabelingType);
+
+	const std::vector<unsigned int>& pobs_vars = pobs->ObservedVariableSet();
+	const std::vector<unsigned int>& pobs_states =
+		pobs->ObservedVariableState();
+
+	// Obtain y_pobs as in the non-persistent case, starting the hidden
+	// variables from the first persistent particle.
+	GibbsSampler model_sampler(fg);
+	model_sampler.SetState(particles[0]);
+	for (unsigned int voi = 0; voi < pobs_vars.size(); ++voi)
+		model_sampler.SetState(pobs_vars[voi], pobs_states[voi]);
+	model_sampler.SetFixedVariableIndices(pobs_vars);
+	model_sampler.Sweep(cd_k);
+	AddBackwardMap(parameter_gradient, fg, model_sampler.State(), 1.0);
+
+	// Obtain y_model from the persistent chains
+	AddPersistentModelGradient(parameter_gradient, fg, particles, inv_temps);
+}
+
+void ContrastiveDivergence::AddPersistentModelGradient(
+	std::unordered_map<std::string, std::vector<double> >&
+		parameter_gradient, const FactorGraph* fg,
+	std::vector<std::vector<unsigned int> >& particles,
+	const std::vector<double>& inv_temps) const {
+	size_t levels = inv_temps.size();
+	assert(levels >= 1);
+	assert(inv_temps[0] == 1.0);
+	assert(particles.empty() == false && particles.size() % levels == 0);
+	size_t particle_count = particles.size() / levels;
+	double scale = -1.0 / static_cast<double>(particle_count);
+
+	GibbsSampler model_sampler(fg);
+	for (size_t pi = 0; pi < particle_count; ++pi) {
+		std::vector<unsigned int>* ladder = &particles[pi*levels];
+
+		// Continue each chain at its temperature
+		for (size_t li = 0; li < levels; ++li) {
+			model_sampler.SetInverseTemperature(inv_temps[li]);
+			model_sampler.SetState(ladder[li]);
+			model_sampler.Sweep(cd_k);
+			ladder[li] = model_sampler.State();
+		}
+
+		// Replica exchange between neighboring temperature levels
+		for (size_t li = 0; (li+1) < levels; ++li) {
+			double accept_swap_prob = std::exp(
+				(inv_temps[li] - inv_temps[li+1]) *
+				(fg->EvaluateEnergy(ladder[li]) -
+					fg->EvaluateEnergy(ladder[li+1])));
+			if (randu() < accept_swap_prob)
+				ladder[li].swap(ladder[li+1]);
+		}
+
+		AddBackwardMap(parameter_gradient, fg, ladder[0], scale);
+	}
+}
+
 void ContrastiveDivergence::AddBackwardMap(
 	std::unordered_map<std::string, std::vector<double> >&
 		parameter_gradient, const FactorGraph* fg,
@@ -6,6 +6,8 @@
 #include <string>
 #include <unordered_map>
 
+#include <boost/random.hpp>
+
 #include "FactorGraphModel.h"
 #include "FactorGraph.h"
 #include "FactorGraphObservation.h"
@@ -26,6 +28,14 @@ namespace Grante {
  *
  * [He2004], He, Zemel, Carreira-Perpinan,
  *    "Multiscale conditional random fields for image labeling", CVPR 2004.
+ *
+ * [Tieleman2008] Tijmen Tieleman,
+ *    "Training restricted Boltzmann machines using approximations to the
+ *    likelihood gradient", ICML 2008.
+ *
+ * [Desjardins2010] Guillaume Desjardins, Aaron Courville, Yoshua Bengio,
+ *    Pascal Vincent, Olivier Delalleau, "Tempered Markov chain Monte Carlo
+ *    for training of restricted Boltzmann machines", AISTATS 2010.
  */
 class ContrastiveDivergence {
 public:
@@ -68,10 +78,42 @@ public:
 			parameter_gradient, const FactorGraph* fg,
 		const FactorGraphPartialObservation* pobs) const;
 
+	// Persistent contrastive divergence [Tieleman2008].  As the above two
+	// methods, but the model samples y_model are obtained by continuing a
+	// set of persistent Markov chains ("fantasy particles") for cd_k sweeps
+	// instead of restarting the chain at the observation.  The model term is
+	// averaged over all particles.
+	//
+	// particles: persistent chain states, updated in place.  With
+	//    L=inv_temps.size(), particles.size() must be a non-zero multiple of
+	//    L and particle p*L+l runs at inverse temperature inv_temps[l].
+	// inv_temps: inverse temperature ladder, inv_temps[0] must be 1.0.  If
+	//    L>1, after the sweeps neighboring levels of each particle attempt a
+	//    replica exchange [Desjardins2010].  Only the level zero chains
+	//    contribute to the gradient.
+	void ComputeGradientFullyObservedPersistent(
+		std::unordered_map<std::string, std::vector<double> >&
+			parameter_gradient, const FactorGraph* fg,
+		const FactorGraphObservation* obs,
+		std::vector<std::vector<unsigned int> >& particles,
+		const std::vector<double>& inv_temps) const;
+	void ComputeGradientPartiallyObservedPersistent(
+		std::unordered_map<std::string, std::vector<double> >&
+			parameter_gradient, const FactorGraph* fg,
+		const FactorGraphPartialObservation* pobs,
+		std::vector<std::vector<unsigned int> >& particles,
+		const std::vector<double>& inv_temps) const;
+
 private:
 	FactorGraphModel* model;
 	unsigned int cd_k;
 
+	// Random number generation, for replica exchange moves
+	mutable boost::mt19937 rgen;
+	boost::uniform_real<double> rdestu;	// range [0,1]
+	mutable boost::variate_generator<boost::mt19937,
+		boost::uniform_real<double> > randu;
+
 	// Temporary marginal distributions, key: size
 	mutable std::unordered_map<size_t, std::vector<double> >
 		temp_marginals;
@@ -80,6 +122,13 @@ private:
 	void AddBackwardMap(std::unordered_map<std::string,
 		std::vector<double> >& parameter_gradient, const FactorGraph* fg,
 		const std::vector<unsigned int>& y, double scale) const;
+
+	// Advance persistent particles by cd_k sweeps and add
+	// -(1/P) \sum_p \nabla_w E(y_p,x,w) over the P level zero particles.
+	void AddPersistentModelGradient(std::unordered_map<std::string,
+		std::vector<double> >& parameter_gradient, const FactorGraph* fg,
+		std::vector<std::vector<unsigned int> >& particles,
+		const std::vector<double>& inv_temps) const;
 };
 
 }
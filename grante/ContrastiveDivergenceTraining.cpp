@@ -1,12 +1,18 @@
 
 #include <iostream>
+#include <fstream>
 #include <algorithm>
 #include <numeric>
+#include <cmath>
 #include <cassert>
 
 #include <boost/lambda/lambda.hpp>
+#include <boost/archive/text_iarchive.hpp>
+#include <boost/archive/text_oarchive.hpp>
+#include <boost/serialization/vector.hpp>
 
 #include "RandomSource.h"
+#include "GibbsSampler.h"
 #include "ContrastiveDivergenceTraining.h"
 
 using namespace boost::lambda;
@@ -17,7 +23,8 @@ ContrastiveDivergenceTraining::ContrastiveDivergenceTraining(
 	FactorGraphModel* fg_model, unsigned int cd_k,
 	unsigned int mini_batch_size, double stepsize)
 	: ParameterEstimationMethod(fg_model), mini_batch_size(mini_batch_size),
-		cd(fg_model, cd_k), stepsize(stepsize) {
+		cd(fg_model, cd_k), stepsize(stepsize), particle_count(0),
+		inv_temps(1, 1.0) {
 	assert(cd_k > 0);
 }
 
@@ -43,9 +50,92 @@ void ContrastiveDivergenceTraining::SetupPartiallyObservedTrainingData(
 	this->pobs_training_data = pobs_training_data;
 }
 
+void ContrastiveDivergenceTraining::SetPersistentChains(
+	unsigned int particle_count, unsigned int tempering_levels,
+	double high_temp) {
+	assert(particle_count >= 1);
+	assert(tempering_levels >= 1);
+	this->particle_count = particle_count;
+
+	// Geometric inverse temperature ladder, inv_temps[0] = 1.0
+	inv_temps.resize(tempering_levels);
+	inv_temps[0] = 1.0;
+	if (tempering_levels > 1) {
+		assert(high_temp > 1.0);
+		double alpha = std::exp(std::log(1.0 / high_temp) /
+			static_cast<double>(tempering_levels - 1));
+		for (unsigned int li = 1; li < tempering_levels; ++li)
+			inv_temps[li] = inv_temps[li-1] * alpha;
+	}
+	particle_pool.clear();
+}
+
+const std::vector<std::vector<std::vector<unsigned int> > >&
+ContrastiveDivergenceTraining::ParticlePool() const {
+	return (particle_pool);
+}
+
+void ContrastiveDivergenceTraining::SetParticlePool(
+	const std::vector<std::vector<std::vector<unsigned int> > >& pool) {
+	assert(particle_count > 0);
+	assert(pool.size() ==
+		(training_data.empty() ? pobs_training_data.size() :
+			training_data.size()));
+	for (unsigned int n = 0; n < pool.size(); ++n) {
+		assert(pool[n].size() == particle_count * inv_temps.size());
+	}
+	particle_pool = pool;
+}
+
+void ContrastiveDivergenceTraining::SaveParticlePool(
+	const std::string& filename) const {
+	std::ofstream ofs(filename.c_str());
+	{
+		boost::archive::text_oarchive oa(ofs);
+		oa << particle_pool;
+	}
+}
+
+void ContrastiveDivergenceTraining::LoadParticlePool(
+	const std::string& filename) {
+	std::vector<std::vector<std::vector<unsigned int> > > pool;
+	{
+		std::ifstream ifs(filename.c_str());
+		boost::archive::text_iarchive ia(ifs);
+		ia >> pool;
+	}
+	SetParticlePool(pool);
+}
+
+void ContrastiveDivergenceTraining::InitializeParticlePool() {
+	size_t levels = inv_temps.size();
+	if (training_data.empty() == false) {
+		// Fully observed: start all chains at the observation
+		particle_pool.resize(training_data.size());
+		for (unsigned int n = 0; n < training_data.size(); ++n) {
+			particle_pool[n].assign(particle_count * levels,
+				training_data[n].second->State());
+		}
+		return;
+	}
+
+	// Partially observed: uniform random initialization
+	particle_pool.resize(pobs_training_data.size());
+	for (unsigned int n = 0; n < pobs_training_data.size(); ++n) {
+		GibbsSampler init_sampler(pobs_training_data[n].first);
+		particle_pool[n].resize(particle_count * levels);
+		for (unsigned int pi = 0; pi < particle_pool[n].size(); ++pi) {
+			init_sampler.SetStateUniformRandom();
+			particle_pool[n][pi] = init_sampler.State();
+		}
+	}
+}
+
 double ContrastiveDivergenceTraining::Train(double conv_tol,
 	unsigned int max_iter) {
 	assert(pobs_training_data.empty() ^ training_data.empty());
+	if (particle_count > 0 && particle_pool.empty())
+		InitializeParticlePool();
 
 	size_t instance_count = 0;
 	if (training_data.empty() == false) {
@@ -104,7 +194,19 @@ double ContrastiveDivergenceTraining::Train(double conv_tol,
 			//     CD-gradient.
 			for (size_t mb_si = mb_start; mb_si < mb_end; ++mb_si) {
 				unsigned int ni = instance_idx[mb_si];
-				if (training_data.empty() == false) {
+				if (particle_count > 0 && training_data.empty() == false) {
+					// fully observed, persistent chains
+					cd.ComputeGradientFullyObservedPersistent(
+						parameter_gradient, training_data[ni].first,
+						training_data[ni].second, particle_pool[ni],
+						inv_temps);
+				} else if (particle_count > 0) {
+					// partially observed, persistent chains
+					cd.ComputeGradientPartiallyObservedPersistent(
+						parameter_gradient, pobs_training_data[ni].first,
+						pobs_training_data[ni].second, particle_pool[ni],
+						inv_temps);
+				} else if (training_data.empty() == false) {
 					// fully observed
 					cd.ComputeGradientFullyObserved(parameter_gradient,
 						training_data[ni].first, training_data[ni].second);
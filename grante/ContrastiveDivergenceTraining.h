@@ -3,6 +3,7 @@
 #define GRANTE_CONTRASTIVEDIVERGENCETRAINING_H
 
 #include <vector>
+#include <string>
 #include <unordered_map>
 
 #include "ParameterEstimationMethod.h"
@@ -37,6 +38,33 @@ public:
 		const std::vector<partially_labeled_instance_type>&
 			pobs_training_data);
 
+	// Enable persistent contrastive divergence: for each training instance
+	// a pool of model chains is kept across parameter updates and each
+	// gradient evaluation continues these chains for cd_k sweeps.  This
+	// yields good gradients for much smaller cd_k.
+	//
+	// particle_count: number of persistent chains per instance, >=1.
+	// tempering_levels: number of tempered replicas per chain, >=1.  If one,
+	//    plain persistent CD is used.  Otherwise each chain is a parallel
+	//    tempering ladder with geometric temperatures from 1.0 to high_temp.
+	// high_temp: temperature of the hottest replica, >1.0.
+	void SetPersistentChains(unsigned int particle_count,
+		unsigned int tempering_levels = 1, double high_temp = 10.0);
+
+	// Checkpointing of the persistent chains.  pool[n][p*L+l] is the state
+	// of replica l of chain p of training instance n, where L is the number
+	// of tempering levels.  The pool is empty until the first call to Train
+	// or SetParticlePool.  A pool set here is continued by the next Train
+	// call and must match the SetPersistentChains configuration.
+	const std::vector<std::vector<std::vector<unsigned int> > >&
+		ParticlePool() const;
+	void SetParticlePool(
+		const std::vector<std::vector<std::vector<unsigned int> > >& pool);
+
+	// Serialization of the particle pool.
+	void SaveParticlePool(const std::string& filename) const;
+	void LoadParticlePool(const std::string& filename);
+
 	// TODO: create a convergence test, right now conv_tol is ignored
 	// max_iter: Number of epochs over the training set.
 	virtual double Train(double conv_tol, unsigned int max_iter = 0);
@@ -48,6 +76,15 @@ private:
 
 	std::vector<partially_labeled_instance_type> pobs_training_data;
 
+	// Persistent CD: chains per instance (zero: plain CD), inverse
+	// temperature ladder of each chain and the particle pool.
+	unsigned int particle_count;
+	std::vector<double> inv_temps;
+	std::vector<std::vector<std::vector<unsigned int> > > particle_pool;
+
+	// Initialize chains at the observation or uniformly at random.
+	void InitializeParticlePool();
+
 	void GradientSetup(std::unordered_map<std::string,
 		std::vector<double> >& parameter_gradient) const;
 	void GradientScale(std::unordered_map<std::string,
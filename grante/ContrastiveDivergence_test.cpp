@@ -0,0 +1,150 @@
+
+#include "grante/ContrastiveDivergence.h"
+
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "grante/BruteForceExactInference.h"
+#include "grante/Factor.h"
+#include "grante/FactorGraph.h"
+#include "grante/FactorGraphModel.h"
+#include "grante/FactorGraphObservation.h"
+#include "grante/FactorType.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+typedef std::unordered_map<std::string, std::vector<double> > gradient_type;
+
+// Zero gradient with one entry for each factor type of the model
+void ClearGradient(const Grante::FactorGraphModel& model,
+    gradient_type& grad) {
+    for (unsigned int fti = 0; fti < model.FactorTypes().size(); ++fti) {
+        const Grante::FactorType* ft = model.FactorTypes()[fti];
+        grad[ft->Name()].assign(ft->Weights().size(), 0.0);
+    }
+}
+
+// Add scale times the energy gradient of every factor at the given
+// marginals to grad
+void AddBackwardMap(const Grante::FactorGraph* fg,
+    const std::vector<std::vector<double> >& marginals, double scale,
+    gradient_type& grad) {
+    const std::vector<Grante::Factor*>& factors = fg->Factors();
+    for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+        factors[fi]->BackwardMap(marginals[fi],
+            grad[factors[fi]->Type()->Name()], scale);
+    }
+}
+
+}
+
+TEST(ContrastiveDivergence, PersistentGradientMatchesLikelihoodGradient) {
+    // Loopy 2x3 grid of binary variables with a noisy unary feature and a
+    // data-independent pairwise factor at fixed random weights
+    Grante::FactorGraphModel model;
+    std::default_random_engine e1(19);
+    std::normal_distribution<double> randn(0.0, 1.0);
+    std::vector<unsigned int> card1(1, 2);
+    std::vector<double> w1(2 * 2);
+    for (unsigned int wi = 0; wi < w1.size(); ++wi)
+        w1[wi] = randn(e1);
+    model.AddFactorType(new Grante::FactorType("unary", card1, w1));
+    std::vector<unsigned int> card2(2, 2);
+    std::vector<double> w2(4);
+    for (unsigned int wi = 0; wi < w2.size(); ++wi)
+        w2[wi] = 0.5 * randn(e1);
+    model.AddFactorType(new Grante::FactorType("pairwise", card2, w2));
+
+    unsigned int W = 3;
+    unsigned int H = 2;
+    std::vector<unsigned int> vc(W * H, 2);
+    Grante::FactorGraph fg(&model, vc);
+    std::vector<unsigned int> label(vc.size());
+    for (unsigned int vi = 0; vi < vc.size(); ++vi) {
+        label[vi] = vi % 2;
+        std::vector<double> data(2);
+        data[0] = randn(e1);
+        data[1] = 1.0;
+        std::vector<unsigned int> var_index1(1, vi);
+        fg.AddFactor(new Grante::Factor(model.FindFactorType("unary"),
+            var_index1, data));
+    }
+    std::vector<double> data2;
+    for (unsigned int y = 0; y < H; ++y) {
+        for (unsigned int x = 0; x < W; ++x) {
+            std::vector<unsigned int> var_index2(2, y * W + x);
+            if (x + 1 < W) {
+                var_index2[1] = y * W + x + 1;
+                fg.AddFactor(new Grante::Factor(
+                    model.FindFactorType("pairwise"), var_index2, data2));
+            }
+            if (y + 1 < H) {
+                var_index2[1] = (y + 1) * W + x;
+                fg.AddFactor(new Grante::Factor(
+                    model.FindFactorType("pairwise"), var_index2, data2));
+            }
+        }
+    }
+    fg.ForwardMap();
+    Grante::FactorGraphObservation obs(label);
+
+    // Exact likelihood gradient, \nabla_w E(y_obs) - E_p[\nabla_w E(y)]
+    const std::vector<Grante::Factor*>& factors = fg.Factors();
+    std::vector<std::vector<double> > obs_marginals(factors.size());
+    for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+        obs_marginals[fi].assign(factors[fi]->Type()->ProdCardinalities(), 0.0);
+        obs_marginals[fi][factors[fi]->ComputeAbsoluteIndex(label)] = 1.0;
+    }
+    Grante::BruteForceExactInference binf(&fg);
+    binf.PerformInference();
+    gradient_type grad_exact;
+    ClearGradient(model, grad_exact);
+    AddBackwardMap(&fg, obs_marginals, 1.0, grad_exact);
+    AddBackwardMap(&fg, binf.Marginals(), -1.0, grad_exact);
+
+    // At fixed weights the persistent chains sample the model distribution,
+    // with and without a tempering ladder.  Averaging the gradients of many
+    // calls estimates the likelihood gradient; the tolerance is about ten
+    // standard deviations of the sampling error.
+    Grante::ContrastiveDivergence cd(&model, 1);
+    unsigned int particle_count = 20;
+    unsigned int call_count = 4000;
+    for (unsigned int levels = 1; levels <= 3; levels += 2) {
+        std::vector<double> inv_temps(1, 1.0);
+        if (levels == 3) {
+            inv_temps.push_back(0.5);
+            inv_temps.push_back(0.1);
+        }
+        std::vector<std::vector<unsigned int> > particles(
+            particle_count * levels, label);
+
+        // Burn-in of the chains started at the observation
+        gradient_type grad;
+        ClearGradient(model, grad);
+        for (unsigned int ci = 0; ci < 50; ++ci) {
+            cd.ComputeGradientFullyObservedPersistent(grad, &fg, &obs,
+                particles, inv_temps);
+        }
+
+        ClearGradient(model, grad);
+        for (unsigned int ci = 0; ci < call_count; ++ci) {
+            cd.ComputeGradientFullyObservedPersistent(grad, &fg, &obs,
+                particles, inv_temps);
+        }
+        ASSERT_EQ(particle_count * levels, particles.size());
+
+        for (gradient_type::const_iterator gi = grad_exact.begin();
+            gi != grad_exact.end(); ++gi) {
+            const std::vector<double>& g = grad[gi->first];
+            ASSERT_EQ(gi->second.size(), g.size());
+            for (unsigned int wi = 0; wi < g.size(); ++wi) {
+                EXPECT_THAT(g[wi] / static_cast<double>(call_count),
+                    testing::DoubleNear(gi->second[wi], 0.1));
+            }
+        }
+    }
+}
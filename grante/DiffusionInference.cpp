@@ -7,13 +7,14 @@
 #include <cassert>
 #include <limits>
 
-#include "LogSumExp.h"
+#include "VectorMath.h"
 #include "DiffusionInference.h"
 
 namespace Grante {
 
-DiffusionInference::DiffusionInference(const FactorGraph* fg)
-	: InferenceMethod(fg), min_sum(false),
+DiffusionInference::DiffusionInference(const FactorGraph* fg,
+	Precision precision)
+	: InferenceMethod(fg), min_sum(false), precision(precision),
 	primal_sol_lb(-std::numeric_limits<double>::infinity()),
 	verbose(false), max_iter(100), conv_tol(1.0e-5) {
 }
@@ -23,266 +24,309 @@ DiffusionInference::~DiffusionInference() {
 
 InferenceMethod* DiffusionInference::Produce(
 	const FactorGraph* fg) const {
-	return (new DiffusionInference(fg));
+	return (new DiffusionInference(fg, precision));
 }
 
 void DiffusionInference::PerformInference() {
-	if (min_sum == false) {
-		PerformInferenceSumProduct();
-		return;
+	if (adj_start.empty())
+		InitializeStructure();
+	if (precision == SinglePrecision) {
+		PerformDiffusion(phi_single, phi_u_single);
+	} else {
+		PerformDiffusion(phi, phi_u);
+	}
+}
+
+template <typename S>
+void DiffusionInference::PerformDiffusion(std::vector<S>& rphi,
+	std::vector<S>& rphi_u) {
+	// 1. Setup flat reparametrization, sign-flipped for sum-product
+	InitializeEnergies(rphi, rphi_u, min_sum == false);
+
+	// 2. Perform n-ary diffusion (Algorithm 1 in Werner CVPR 2008).
+	// A factor defines a set of (A,B,.) tripplets, where A is the set of
+	// adjacent variables to that factor, and B is a single variable of the
+	// factor.  This is a specific choice of J in Section 3.1 of Werner CVPR
+	// 2008.  (It is the simplest, but not the strongest possible.)  All
+	// tripplets with the same B are updated at once.
+	//    min-sum: conv is the increase of the lower bound,
+	//    sum-product: conv is the total change of the reparametrization.
+	double lb_abs = 0.0;
+	if (min_sum)
+		primal_sol_lb = ComputeLowerBound(rphi, rphi_u, lb_abs);
+	double conv = std::numeric_limits<double>::infinity();
+	for (unsigned int iter = 1; (max_iter == 0 || iter < max_iter) &&
+		conv >= conv_tol; ++iter) {
+		double change = 0.0;
+		for (unsigned int ci = 0; ci < color_vars.size(); ++ci) {
+			const std::vector<unsigned int>& cvars = color_vars[ci];
+			int cvar_count = static_cast<int>(cvars.size());
+			#pragma omp parallel
+			{
+				std::vector<double> t_scratch;
+				#pragma omp for schedule(dynamic, 64) reduction(+:change)
+				for (int cvi = 0; cvi < cvar_count; ++cvi)
+					change += UpdateVariable(rphi, rphi_u, cvars[cvi],
+						t_scratch);
+			}
+		}
+
+		if (min_sum) {
+			double lb_prev = primal_sol_lb;
+			primal_sol_lb = ComputeLowerBound(rphi, rphi_u, lb_abs);
+			// Monotonic ascent, up to round-off in the summation and in the
+			// stored reparametrization
+			assert(primal_sol_lb >= lb_prev - std::max(1.0e-10,
+				16.0 * std::numeric_limits<S>::epsilon()) * lb_abs);
+			conv = primal_sol_lb - lb_prev;
+		} else {
+			conv = change;
+		}
+		if (verbose) {
+			std::cout << "iter " << iter;
+			if (min_sum)
+				std::cout << ", lb " << primal_sol_lb;
+			std::cout << ", conv " << conv << std::endl;
+		}
 	}
 
-	// 1. Setup unary energies
+	// 3. Min-sum: construct primal solution from the unaries
 	const std::vector<unsigned int>& var_card = fg->Cardinalities();
-	size_t var_count = var_card.size();
-	std::vector<std::vector<double> > phi_u(var_count);
-	for (size_t vi = 0; vi < var_count; ++vi) {
-		phi_u[vi].resize(var_card[vi]);
-		std::fill(phi_u[vi].begin(), phi_u[vi].end(), 0.0);
+	int var_count = static_cast<int>(var_card.size());
+	if (min_sum) {
+		primal_sol.resize(var_count);
+		#pragma omp parallel for schedule(static)
+		for (int vi = 0; vi < var_count; ++vi) {
+			const S* tphi_u = &rphi_u[var_offset[vi]];
+			primal_sol[vi] = static_cast<unsigned int>(
+				std::min_element(tphi_u, tphi_u + var_card[vi]) - tphi_u);
+		}
+		return;
 	}
 
-	// 2. Initialize: copy all energies (except unaries)
-	// The energies will be modified through the course of the algorithm and
-	// we need exactly one unary factor for each variable.  Because this is
-	// not guaranteed in the original model, we explicitly represent unary
-	// factors (phi_u) and merge all original unary factors into these.
+	// 3. Sum-product: produce marginals and log_z
 	const std::vector<Factor*>& factors = fg->Factors();
-	size_t fac_count = factors.size();
-	std::vector<std::vector<double> > phi(fac_count);
-	std::vector<unsigned int> phi_minelem(fac_count);
-	primal_sol_lb = 0.0;
-	for (size_t fi = 0; fi < fac_count; ++fi) {
+	int fac_count = static_cast<int>(factors.size());
+	double log_z_sum = 0.0;
+	marginals.resize(fac_count);
+	#pragma omp parallel for schedule(dynamic, 64) reduction(+:log_z_sum)
+	for (int fi = 0; fi < fac_count; ++fi) {
 		const Factor* fac = factors[fi];
+		const S* phi_cur;
+		size_t phi_cur_size;
 		if (fac->Variables().size() > 1) {
-			phi[fi] = fac->Energies();
-			// Find minimum and add to global lower bound
-			phi_minelem[fi] = static_cast<unsigned int>(
-				std::min_element(phi[fi].begin(), phi[fi].end())
-					- phi[fi].begin());
-			primal_sol_lb += phi[fi][phi_minelem[fi]];
-			continue;
+			phi_cur = &rphi[fac_offset[fi]];
+			phi_cur_size = fac_offset[fi+1] - fac_offset[fi];
+		} else {
+			unsigned int vi = fac->Variables()[0];
+			phi_cur = &rphi_u[var_offset[vi]];
+			phi_cur_size = var_card[vi];
 		}
 
-		// Add to separate unary factor
-		unsigned int vi = fac->Variables()[0];
-		std::transform(factors[fi]->Energies().begin(),
-			factors[fi]->Energies().end(),
-			phi_u[vi].begin(), phi_u[vi].begin(),
-			std::plus<double>());
+		// Local log-partition function and marginals
+		marginals[fi].assign(phi_cur, phi_cur + phi_cur_size);
+		log_z_sum += VectorMath::NormalizeLog(&marginals[fi][0],
+			phi_cur_size);
 	}
+	log_z = log_z_sum;
+}
+
+void DiffusionInference::InitializeStructure() {
+	const std::vector<unsigned int>& var_card = fg->Cardinalities();
+	size_t var_count = var_card.size();
+	const std::vector<Factor*>& factors = fg->Factors();
+	size_t fac_count = factors.size();
+
+	var_offset.resize(var_count + 1);
+	var_offset[0] = 0;
+	for (size_t vi = 0; vi < var_count; ++vi)
+		var_offset[vi+1] = var_offset[vi] + var_card[vi];
 
-	// 3. Construct primal solution (primal_sol and phi_minelem)
-	primal_sol.resize(var_count);
-	for (size_t vi = 0; vi < var_count; ++vi) {
-		primal_sol[vi] = static_cast<unsigned int>(
-			std::min_element(phi_u[vi].begin(), phi_u[vi].end())
-				- phi_u[vi].begin());
-		primal_sol_lb += phi_u[vi][primal_sol[vi]];
+	// Factor offsets and variable-factor adjacency
+	fac_offset.resize(fac_count + 1);
+	fac_offset[0] = 0;
+	adj_start.assign(var_count + 1, 0);
+	for (size_t fi = 0; fi < fac_count; ++fi) {
+		const std::vector<unsigned int>& fac_vars = factors[fi]->Variables();
+		size_t tphi_size = 0;
+		if (fac_vars.size() > 1) {
+			tphi_size = factors[fi]->Type()->ProdCardinalities();
+			for (size_t fvi = 0; fvi < fac_vars.size(); ++fvi)
+				adj_start[fac_vars[fvi]+1] += 1;
+		}
+		fac_offset[fi+1] = fac_offset[fi] + tphi_size;
 	}
+	for (size_t vi = 0; vi < var_count; ++vi)
+		adj_start[vi+1] += adj_start[vi];
 
-	// 4. Perform n-ary min-sum diffusion (Algorithm 1 in Werner CVPR 2008)
-	double conv = std::numeric_limits<double>::infinity();
-	double lb_prev = -std::numeric_limits<double>::infinity();
-	for (unsigned int iter = 1; (max_iter == 0 || iter < max_iter) &&
-		conv >= conv_tol; ++iter) {
-		conv = primal_sol_lb - lb_prev;
+	adj_fac.resize(adj_start[var_count]);
+	adj_stride.resize(adj_start[var_count]);
+	std::vector<unsigned int> adj_pos(adj_start.begin(), adj_start.end() - 1);
+	for (size_t fi = 0; fi < fac_count; ++fi) {
+		const std::vector<unsigned int>& fac_vars = factors[fi]->Variables();
+		if (fac_vars.size() <= 1)
+			continue;
 
-		if (verbose) {
-			std::cout << "iter " << iter << ", lb " << primal_sol_lb
-				<< ", prev lb " << lb_prev << ", conv " << conv << std::endl;
+		const std::vector<unsigned int>& fac_card =
+			factors[fi]->Type()->Cardinalities();
+		size_t stride = 1;
+		for (size_t fvi = 0; fvi < fac_vars.size(); ++fvi) {
+			unsigned int ai = adj_pos[fac_vars[fvi]];
+			adj_pos[fac_vars[fvi]] += 1;
+			adj_fac[ai] = static_cast<unsigned int>(fi);
+			adj_stride[ai] = stride;
+			stride *= fac_card[fvi];
 		}
-		lb_prev = primal_sol_lb;
-
-		// A factor defines a set of (A,B,.) tripplets, where A is the set of
-		// adjacent variables to that factor, and B is a single variable of
-		// the factor.  This is a specific choice of J in Section 3.1 of
-		// Werner CVPR 2008.  (It is the simplest, but not the strongest
-		// possible.)
-		for (unsigned int fi = 0; fi < fac_count; ++fi) {
-			// Unary factor -> skip
-			if (phi[fi].empty())
-				continue;
-
-			const FactorType* ftype = factors[fi]->Type();
-			const std::vector<unsigned int>& fac_vars =
-				factors[fi]->Variables();
-			std::vector<double>& tphi = phi[fi];	// \theta_A^{\phi}
-			size_t tphi_size = tphi.size();
-
-			for (size_t fvi = 0; fvi < fac_vars.size(); ++fvi) {
-				// A: fac_vars, B: fac_vars[fvi]
-				unsigned int B = fac_vars[fvi];
-				unsigned int card_vi = var_card[B];
-
-				// Initialization with +inf is correct for min-sum
-				std::vector<double> msum(card_vi,
-					std::numeric_limits<double>::infinity());
-
-				// Find min-marginals/log-sum-exp of A for all x_B
-				for (size_t ei = 0; ei < tphi_size; ++ei) {
-					unsigned int var_state =
-						ftype->LinearIndexToVariableState(ei, fvi);
-					// min-marginals
-					msum[var_state] = std::min(msum[var_state], tphi[ei]);
-				}
-				// Compute min-sum/sum-product diffusion update
-				primal_sol_lb -= phi_u[B][primal_sol[B]];
-				double phi_u_min = std::numeric_limits<double>::infinity();
-				unsigned int phi_u_min_idx = 0;
-
-				for (unsigned int var_state = 0; var_state < card_vi;
-					++var_state) {
-					msum[var_state] = 0.5 * (phi_u[B][var_state]
-						- msum[var_state]);
-					// Apply update to unary
-					phi_u[B][var_state] -= msum[var_state];
-
-					// Keep track of unary min-index
-					if (phi_u[B][var_state] < phi_u_min) {
-						phi_u_min = phi_u[B][var_state];
-						phi_u_min_idx = var_state;
-					}
-				}
-				primal_sol_lb += phi_u[B][phi_u_min_idx];
-				primal_sol[B] = phi_u_min_idx;
-
-				// Apply update to factor A
-				primal_sol_lb -= tphi[phi_minelem[fi]];
-				double phi_min = std::numeric_limits<double>::infinity();
-				unsigned int phi_min_idx = 0;
-
-				for (size_t ei = 0; ei < tphi_size; ++ei) {
-					unsigned int var_state =
-						ftype->LinearIndexToVariableState(ei, fvi);
-					tphi[ei] += msum[var_state];
-
-					// Keep track of factor min-index
-					if (tphi[ei] < phi_min) {
-						phi_min = tphi[ei];
-						phi_min_idx = static_cast<unsigned int>(ei);
-					}
-				}
-				primal_sol_lb += tphi[phi_min_idx];
-				phi_minelem[fi] = phi_min_idx;
+	}
+
+	// Greedy coloring of the variables, two variables are adjacent if they
+	// share a factor
+	std::vector<unsigned int> var_color(var_count,
+		std::numeric_limits<unsigned int>::max());
+	std::vector<unsigned int> color_mark;
+	color_vars.clear();
+	for (unsigned int vi = 0; vi < var_count; ++vi) {
+		for (unsigned int ai = adj_start[vi]; ai < adj_start[vi+1]; ++ai) {
+			const std::vector<unsigned int>& fvars =
+				factors[adj_fac[ai]]->Variables();
+			for (unsigned int fvi = 0; fvi < fvars.size(); ++fvi) {
+				if (var_color[fvars[fvi]] < color_mark.size())
+					color_mark[var_color[fvars[fvi]]] = vi;
 			}
 		}
+		unsigned int color = 0;
+		while (color < color_mark.size() && color_mark[color] == vi)
+			color += 1;
+		if (color == color_mark.size()) {
+			color_mark.push_back(std::numeric_limits<unsigned int>::max());
+			color_vars.push_back(std::vector<unsigned int>());
+		}
+		var_color[vi] = color;
+		color_vars[color].push_back(vi);
 	}
 }
 
-void DiffusionInference::PerformInferenceSumProduct() {
-	// 1. Setup unary energies
-	const std::vector<unsigned int>& var_card = fg->Cardinalities();
-	size_t var_count = var_card.size();
-	std::vector<std::vector<double> > phi_u(var_count);
-	for (size_t vi = 0; vi < var_count; ++vi) {
-		phi_u[vi].resize(var_card[vi]);
-		std::fill(phi_u[vi].begin(), phi_u[vi].end(), 0.0);
-	}
-
-	// 2. Initialize: copy all energies (except unaries) and flip sign
+template <typename S>
+void DiffusionInference::InitializeEnergies(std::vector<S>& rphi,
+	std::vector<S>& rphi_u, bool negate) const {
+	// The energies will be modified through the course of the algorithm and
+	// we need exactly one unary factor for each variable.  Because this is
+	// not guaranteed in the original model, we explicitly represent unary
+	// factors (phi_u) and merge all original unary factors into these.
 	const std::vector<Factor*>& factors = fg->Factors();
-	size_t fac_count = factors.size();
-	std::vector<std::vector<double> > phi(fac_count);
-	for (size_t fi = 0; fi < fac_count; ++fi) {
-		const Factor* fac = factors[fi];
-		if (fac->Variables().size() > 1) {
-			phi[fi] = fac->Energies();
-			for (size_t ei = 0; ei < phi[fi].size(); ++ei)
-				phi[fi][ei] *= -1.0;	// flip sign
+	double sign = negate ? -1.0 : 1.0;
+	rphi.resize(fac_offset.back());
+	rphi_u.resize(var_offset.back());
+	std::vector<double> unary(var_offset.back(), 0.0);
+	for (size_t fi = 0; fi < factors.size(); ++fi) {
+		const std::vector<double>& energies = factors[fi]->Energies();
+		const std::vector<unsigned int>& fac_vars = factors[fi]->Variables();
+		if (fac_vars.size() > 1) {
+			S* tphi = &rphi[fac_offset[fi]];
+			for (size_t ei = 0; ei < energies.size(); ++ei)
+				tphi[ei] = static_cast<S>(sign * energies[ei]);
 			continue;
 		}
 
-		// Add to separate unary factor (sign-flipped)
-		unsigned int vi = fac->Variables()[0];
-		for (size_t vsi = 0; vsi < phi_u[vi].size(); ++vsi)
-			phi_u[vi][vsi] -= factors[fi]->Energies()[vsi];
+		// Add to separate unary factor
+		double* tphi_u = &unary[var_offset[fac_vars[0]]];
+		for (size_t ei = 0; ei < energies.size(); ++ei)
+			tphi_u[ei] += sign * energies[ei];
 	}
-
-	// 4. Perform n-ary min-sum diffusion (Algorithm 1 in Werner CVPR 2008)
-	double conv = std::numeric_limits<double>::infinity();
-	for (unsigned int iter = 1; (max_iter == 0 || iter < max_iter) &&
-		conv >= conv_tol; ++iter) {
-		if (verbose) {
-			// double F = ComputeSumProductObjective(phi, phi_u);
-			std::cout << "iter " << iter << ", conv " << conv
-				<< std::endl;
+	if (unary_overlay != 0) {
+		for (size_t vi = 0; vi < unary_overlay->size(); ++vi) {
+			const std::vector<double>& ov = (*unary_overlay)[vi];
+			double* tphi_u = &unary[var_offset[vi]];
+			for (size_t si = 0; si < ov.size(); ++si)
+				tphi_u[si] += sign * ov[si];
 		}
-		conv = 0.0;
-
-		// A factor defines a set of (A,B,.) tripplets, where A is the set of
-		// adjacent variables to that factor, and B is a single variable of
-		// the factor.  This is a specific choice of J in Section 3.1 of
-		// Werner CVPR 2008.  (It is the simplest, but not the strongest
-		// possible.)
-		for (size_t fi = 0; fi < fac_count; ++fi) {
-			// Unary factor -> skip
-			if (phi[fi].empty())
-				continue;
-
-			const FactorType* ftype = factors[fi]->Type();
-			const std::vector<unsigned int>& fac_vars =
-				factors[fi]->Variables();
-			std::vector<double>& tphi = phi[fi];	// \theta_A^{\phi}
-			size_t tphi_size = tphi.size();
-
-			for (size_t fvi = 0; fvi < fac_vars.size(); ++fvi) {
-				// A: fac_vars, B: fac_vars[fvi]
-				unsigned int B = fac_vars[fvi];
-				unsigned int card_vi = var_card[B];
-
-				// Initialization with +inf is correct for min-sum, -inf for
-				// sum-product.
-				//    min-sum: computing min-marginals,
-				//    sum-product: computing factor log-sum-exp.
-				std::vector<double> msum(card_vi,
-					-std::numeric_limits<double>::infinity());
-
-				// Find min-marginals/log-sum-exp of A for all x_B
-				for (size_t ei = 0; ei < tphi_size; ++ei) {
-					unsigned int var_state =
-						ftype->LinearIndexToVariableState(ei, fvi);
-					// log-sum-exp
-					msum[var_state] = std::log(
-						std::exp(msum[var_state]) + std::exp(tphi[ei]));
-				}
-				// Compute min-sum/sum-product diffusion update
-				for (size_t var_state = 0; var_state < card_vi;
-					++var_state) {
-					msum[var_state] = 0.5 * (phi_u[B][var_state]
-						- msum[var_state]);
-					conv += std::fabs(msum[var_state]);
-
-					// Apply update to unary
-					phi_u[B][var_state] -= msum[var_state];
-				}
-
-				// Apply update to factor A
-				// sum-product
-				for (size_t ei = 0; ei < tphi_size; ++ei) {
-					unsigned int var_state =
-						ftype->LinearIndexToVariableState(ei, fvi);
-					tphi[ei] += msum[var_state];
-				}
-			}
+	}
+	std::copy(unary.begin(), unary.end(), rphi_u.begin());
+}
+
+template <typename S>
+double DiffusionInference::UpdateVariable(std::vector<S>& rphi,
+	std::vector<S>& rphi_u, unsigned int vi,
+	std::vector<double>& scratch) const {
+	unsigned int adj_count = adj_start[vi+1] - adj_start[vi];
+	if (adj_count == 0)
+		return (0.0);
+
+	// scratch: [target, marginalization scratch, adj_count marginals]
+	unsigned int card = fg->Cardinalities()[vi];
+	scratch.resize((adj_count + 2) * card);
+	double* target = &scratch[0];
+	double* mscratch = target + card;
+	double* msum = mscratch + card;
+
+	// Sum the unary and all min-marginals/log-sum-exp marginals
+	S* tphi_u = &rphi_u[var_offset[vi]];
+	std::copy(tphi_u, tphi_u + card, target);
+	for (unsigned int aci = 0; aci < adj_count; ++aci) {
+		unsigned int ai = adj_start[vi] + aci;
+		unsigned int fi = adj_fac[ai];
+		const S* tphi = &rphi[fac_offset[fi]];
+		size_t tphi_size = fac_offset[fi+1] - fac_offset[fi];
+		double* cur_msum = msum + aci*card;
+		if (min_sum) {
+			VectorMath::StridedMin(tphi, tphi_size, card, adj_stride[ai],
+				cur_msum);
+		} else {
+			VectorMath::StridedLogSumExp(tphi, tphi_size, card,
+				adj_stride[ai], cur_msum, mscratch);
 		}
+		for (unsigned int si = 0; si < card; ++si)
+			target[si] += cur_msum[si];
 	}
 
-	// Produce marginals and log_z
-	log_z = 0.0;
-	marginals.resize(fac_count);
-	for (size_t fi = 0; fi < fac_count; ++fi) {
-		const Factor* fac = factors[fi];
-		marginals[fi].resize(fac->Type()->ProdCardinalities());
-		std::vector<double>& phi_cur = (fac->Variables().size() > 1) ?
-			phi[fi] : phi_u[fac->Variables()[0]];
+	// Distribute equally among the unary and the factors
+	double scale = 1.0 / static_cast<double>(adj_count + 1);
+	for (unsigned int si = 0; si < card; ++si)
+		target[si] *= scale;
+
+	double change = 0.0;
+	for (unsigned int aci = 0; aci < adj_count; ++aci) {
+		unsigned int ai = adj_start[vi] + aci;
+		unsigned int fi = adj_fac[ai];
+		double* cur_msum = msum + aci*card;
+		for (unsigned int si = 0; si < card; ++si) {
+			cur_msum[si] = target[si] - cur_msum[si];
+			change += std::fabs(cur_msum[si]);
+		}
+		VectorMath::StridedAdd(&rphi[fac_offset[fi]],
+			fac_offset[fi+1] - fac_offset[fi], card, adj_stride[ai], cur_msum);
+	}
+	std::copy(target, target + card, tphi_u);
 
-		// Compute local log-partition function
-		double cur_logz = LogSumExp::Compute(phi_cur);
+	return (change);
+}
 
-		log_z += cur_logz;
-		for (size_t ei = 0; ei < phi_cur.size(); ++ei)
-			marginals[fi][ei] = std::exp(phi_cur[ei] - cur_logz);
+template <typename S>
+double DiffusionInference::ComputeLowerBound(const std::vector<S>& rphi,
+	const std::vector<S>& rphi_u, double& lb_abs) const {
+	const std::vector<unsigned int>& var_card = fg->Cardinalities();
+	int fac_count = static_cast<int>(fac_offset.size()) - 1;
+	int var_count = static_cast<int>(var_card.size());
+	double lb = 0.0;
+	double lb_abs_sum = 0.0;
+	#pragma omp parallel for schedule(static) reduction(+:lb,lb_abs_sum)
+	for (int fi = 0; fi < fac_count; ++fi) {
+		size_t tphi_size = fac_offset[fi+1] - fac_offset[fi];
+		if (tphi_size == 0)
+			continue;
+		double phi_min = VectorMath::Min(&rphi[fac_offset[fi]], tphi_size);
+		lb += phi_min;
+		lb_abs_sum += std::fabs(phi_min);
 	}
+	#pragma omp parallel for schedule(static) reduction(+:lb,lb_abs_sum)
+	for (int vi = 0; vi < var_count; ++vi) {
+		double phi_u_min =
+			VectorMath::Min(&rphi_u[var_offset[vi]], var_card[vi]);
+		lb += phi_u_min;
+		lb_abs_sum += std::fabs(phi_u_min);
+	}
+	lb_abs = lb_abs_sum;
+	return (lb);
 }
 
 void DiffusionInference::ClearInferenceResult() {
@@ -326,23 +370,11 @@ double DiffusionInference::MinimizeEnergy(
 	min_sum = false;
 	state = primal_sol;
 
-	return (fg->EvaluateEnergy(state));
+	return (fg->EvaluateEnergy(state) + EvaluateOverlayEnergy(state));
 }
 
-double DiffusionInference::ComputeSumProductObjective(
-	const std::vector<std::vector<double> >& phi,
-	const std::vector<std::vector<double> >& phi_u) const {
-	double F = 0.0;
-	const std::vector<Factor*>& factors = fg->Factors();
-	size_t fac_count = factors.size();
-	for (size_t fi = 0; fi < fac_count; ++fi) {
-		const Factor* fac = factors[fi];
-		const std::vector<double>& phi_cur = (fac->Variables().size() > 1) ?
-			phi[fi] : phi_u[fac->Variables()[0]];
-
-		F += LogSumExp::Compute(phi_cur);
-	}
-	return (F);
+bool DiffusionInference::SupportsUnaryOverlay() const {
+	return (true);
 }
 
 }
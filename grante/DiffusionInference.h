@@ -19,10 +19,30 @@ namespace Grante {
  * 2. Tomas Werner, "Fixed Points of Loopy Belief Propagation as Zero
  *    Gradients of a Function of Reparameterizations", CTU-CMP-2010-05
  *    techreport, 2010. (sum-product diffusion)
+ *
+ * The reparametrization is stored in flat buffers.  Each diffusion update
+ * averages the min-marginals (log-sum-exp marginals for sum-product) of all
+ * factors adjacent to one variable with its unary, which monotonically
+ * increases the dual bound.  The variables are greedily colored such that
+ * no two variables of one color share a factor; all variables of one color
+ * are updated in parallel.  The result does not depend on the number of
+ * threads.
+ *
+ * With single precision the reparametrization is stored as float, halving
+ * the memory and memory traffic of the updates.  Marginalization and the
+ * bound are computed in double precision and all results are double.  The
+ * factor energies in FactorGraph remain double; this is currently the only
+ * inference method with a single precision path.
  */
 class DiffusionInference : public InferenceMethod {
 public:
-	DiffusionInference(const FactorGraph* fg);
+	enum Precision {
+		DoublePrecision = 0,
+		SinglePrecision,
+	};
+
+	explicit DiffusionInference(const FactorGraph* fg,
+		Precision precision = DoublePrecision);
 
 	virtual ~DiffusionInference();
 
@@ -53,9 +73,13 @@ public:
 
 	virtual double MinimizeEnergy(std::vector<unsigned int>& state);
 
+	virtual bool SupportsUnaryOverlay() const;
+
 private:
 	// True if energy minimization is to be performed
 	bool min_sum;
+	// Storage precision of the reparametrization
+	Precision precision;
 
 	// Primal solution and lower bound on the optimal energy
 	std::vector<unsigned int> primal_sol;
@@ -71,11 +95,50 @@ private:
 	// Inference result 2: upper bound on the log-partition function
 	double log_z;
 
-	void PerformInferenceSumProduct();
-
-	double ComputeSumProductObjective(
-		const std::vector<std::vector<double> >& phi,
-		const std::vector<std::vector<double> >& phi_u) const;
+	// Reparametrized factor energies (sign-flipped for sum-product), factor
+	// fi occupies phi[fac_offset[fi]] to phi[fac_offset[fi+1]-1].  Unary
+	// factors are empty, they are merged into the explicit unaries phi_u,
+	// variable vi occupying phi_u[var_offset[vi]] to
+	// phi_u[var_offset[vi+1]-1].  Single precision uses phi_single and
+	// phi_u_single instead.
+	std::vector<size_t> fac_offset;
+	std::vector<double> phi;
+	std::vector<size_t> var_offset;
+	std::vector<double> phi_u;
+	std::vector<float> phi_single;
+	std::vector<float> phi_u_single;
+
+	// Non-unary factors adjacent to variable vi: adj_fac[adj_start[vi]] to
+	// adj_fac[adj_start[vi+1]-1], adj_stride is the stride of vi in the
+	// energy table of the factor.
+	std::vector<unsigned int> adj_start;
+	std::vector<unsigned int> adj_fac;
+	std::vector<size_t> adj_stride;
+
+	// Variable coloring, color_vars[c] are the variables of color c
+	std::vector<std::vector<unsigned int> > color_vars;
+
+	// Compute offsets, adjacencies and the coloring (once)
+	void InitializeStructure();
+
+	// Diffusion on the reparametrization tphi, tphi_u of scalar type S
+	template <typename S>
+	void PerformDiffusion(std::vector<S>& tphi, std::vector<S>& tphi_u);
+	// Copy the factor energies into tphi and tphi_u
+	template <typename S>
+	void InitializeEnergies(std::vector<S>& tphi, std::vector<S>& tphi_u,
+		bool negate) const;
+
+	// Diffusion update of variable vi, return the sum of absolute changes of
+	// the factor reparametrizations.
+	template <typename S>
+	double UpdateVariable(std::vector<S>& tphi, std::vector<S>& tphi_u,
+		unsigned int vi, std::vector<double>& scratch) const;
+	// sum of the minimum reparametrized energies, a lower bound on the
+	// optimal energy.  lb_abs is the sum of their absolute values.
+	template <typename S>
+	double ComputeLowerBound(const std::vector<S>& tphi,
+		const std::vector<S>& tphi_u, double& lb_abs) const;
 };
 
 }
@@ -0,0 +1,116 @@
+
+#include "grante/DiffusionInference.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "grante/Factor.h"
+#include "grante/FactorGraph.h"
+#include "grante/FactorGraphModel.h"
+#include "grante/FactorType.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Create a 4-by-4 grid with three states per variable and random energies
+// given directly as factor data.  If tree is true, only the horizontal edges
+// and the vertical edges of the first column are added.
+Grante::FactorGraph* CreateRandomGrid(Grante::FactorGraphModel& model,
+    unsigned int seed, bool tree) {
+    std::vector<unsigned int> card1(1, 3);
+    std::vector<double> w;
+    model.AddFactorType(new Grante::FactorType("unary", card1, w));
+    std::vector<unsigned int> card2(2, 3);
+    model.AddFactorType(new Grante::FactorType("pairwise", card2, w));
+
+    std::default_random_engine e1(seed);
+    std::uniform_real_distribution<double> randu(-1.0, 1.0);
+
+    unsigned int N = 4;
+    std::vector<unsigned int> vc(N * N, 3);
+    Grante::FactorGraph* fg = new Grante::FactorGraph(&model, vc);
+    std::vector<double> data_u(3);
+    std::vector<double> data_p(9);
+    for (unsigned int y = 0; y < N; ++y) {
+        for (unsigned int x = 0; x < N; ++x) {
+            unsigned int vi = y * N + x;
+            for (unsigned int di = 0; di < data_u.size(); ++di)
+                data_u[di] = randu(e1);
+            std::vector<unsigned int> var_index1(1, vi);
+            fg->AddFactor(new Grante::Factor(model.FindFactorType("unary"),
+                var_index1, data_u));
+
+            std::vector<unsigned int> var_index2(2, vi);
+            if (x + 1 < N) {
+                var_index2[1] = vi + 1;
+                for (unsigned int di = 0; di < data_p.size(); ++di)
+                    data_p[di] = randu(e1);
+                fg->AddFactor(new Grante::Factor(
+                    model.FindFactorType("pairwise"), var_index2, data_p));
+            }
+            if (y + 1 < N && (tree == false || x == 0)) {
+                var_index2[1] = vi + N;
+                for (unsigned int di = 0; di < data_p.size(); ++di)
+                    data_p[di] = randu(e1);
+                fg->AddFactor(new Grante::Factor(
+                    model.FindFactorType("pairwise"), var_index2, data_p));
+            }
+        }
+    }
+    fg->ForwardMap();
+
+    return (fg);
+}
+
+}
+
+TEST(DiffusionInference, SinglePrecisionAgreesWithDouble) {
+    for (unsigned int seed = 0; seed < 20; ++seed) {
+        // The relaxation is tight on trees, so both precisions should find
+        // the same minimizer; on loopy graphs the rounded primal solution can
+        // flip at near-ties of the reparametrization.
+        bool tree = (seed % 2) == 0;
+        Grante::FactorGraphModel model;
+        Grante::FactorGraph* fg = CreateRandomGrid(model, seed, tree);
+
+        Grante::DiffusionInference dinf(fg,
+            Grante::DiffusionInference::DoublePrecision);
+        dinf.SetParameters(false, 200, 1.0e-6);
+        Grante::DiffusionInference sinf(fg,
+            Grante::DiffusionInference::SinglePrecision);
+        sinf.SetParameters(false, 200, 1.0e-6);
+
+        // Min-sum
+        std::vector<unsigned int> dstate;
+        std::vector<unsigned int> sstate;
+        double denergy = dinf.MinimizeEnergy(dstate);
+        double senergy = sinf.MinimizeEnergy(sstate);
+        ASSERT_EQ(dstate.size(), sstate.size());
+        EXPECT_EQ(fg->EvaluateEnergy(sstate), senergy);
+        if (tree) {
+            EXPECT_EQ(dstate, sstate);
+            EXPECT_THAT(senergy, testing::DoubleNear(denergy, 1.0e-9));
+        }
+
+        // Sum-product: marginals and log-partition bound
+        dinf.PerformInference();
+        sinf.PerformInference();
+        EXPECT_THAT(sinf.LogPartitionFunction(), testing::DoubleNear(
+            dinf.LogPartitionFunction(),
+            1.0e-4 * (1.0 + std::fabs(dinf.LogPartitionFunction()))));
+
+        const std::vector<std::vector<double> >& dmarg = dinf.Marginals();
+        const std::vector<std::vector<double> >& smarg = sinf.Marginals();
+        ASSERT_EQ(dmarg.size(), smarg.size());
+        for (unsigned int fi = 0; fi < dmarg.size(); ++fi) {
+            ASSERT_EQ(dmarg[fi].size(), smarg[fi].size());
+            for (unsigned int si = 0; si < dmarg[fi].size(); ++si)
+                EXPECT_THAT(smarg[fi][si],
+                    testing::DoubleNear(dmarg[fi][si], 1.0e-4));
+        }
+        delete fg;
+    }
+}
+
@@ -1,6 +1,7 @@
 
 #include <algorithm>
 #include <map>
+#include <limits>
 #include <cassert>
 
 #include "DisjointSetBT.h"
@@ -52,10 +52,12 @@ void ExpectationMaximization::SetupTrainingData(
 	// Decompose each training instance into E- and M-subgraphs necessary for
 	// E/M steps.
 	size_t sample_count = training_data.size();
-	fi_to_efi.clear();
-	fi_to_efi.resize(sample_count);
-	hidden_efi.clear();
-	hidden_efi.resize(sample_count);
+	e_fac_orig.clear();
+	e_fac_orig.resize(sample_count);
+	e_fac_hidden.clear();
+	e_fac_hidden.resize(sample_count);
+	E_log_z.assign(sample_count, 0.0);
+	E_entropy.assign(sample_count, 0.0);
 	for (size_t si = 0; si < sample_count; ++si) {
 		// TODO: right now only discrete observations are supported
 		assert(training_data[si].second->Type() ==
@@ -80,8 +82,13 @@ void ExpectationMaximization::SetupTrainingData(
 			training_data[si].first, training_data[si].second,
 			fg_e_var_new_to_orig, fg_e_fac_new_to_orig);
 		E_fg.push_back(fg_e);
-		// Instantiate inference method on hidden-induced subgraph
-		E_inf.push_back(hidden_inference_methods[si]->Produce(fg_e));
+		// Instantiate inference method on hidden-induced subgraph.  The
+		// energies change only a little between EM iterations, so start
+		// each E-step from the result of the previous one.
+		InferenceMethod* inf_e = hidden_inference_methods[si]->Produce(fg_e);
+		if (inf_e->SupportsWarmStart())
+			inf_e->SetWarmStart(true);
+		E_inf.push_back(inf_e);
 
 		// 3. Build M-graph: the full factor graph.
 		const std::vector<Factor*>& factors =
@@ -114,15 +121,18 @@ void ExpectationMaximization::SetupTrainingData(
 			std::pair<FactorGraph*, const FactorGraphObservation*>(
 				training_data[si].first, fg_m_obs));
 
-		// Build mapping between factor indices and factor index in E-graph.
-		// This is needed for efficiently updating expectations in the M-graph
-		// during EM learning.
-		for (unsigned int efi = 0; efi < fg_e_fac_new_to_orig.size(); ++efi) {
-			// Cross- and hidden factors
-			fi_to_efi[si].insert(std::pair<unsigned int, unsigned int>(
-				fg_e_fac_new_to_orig[efi], efi));
+		// Build mapping between factor indices in the E-graph and the
+		// M-graph.  This is needed for efficiently updating expectations in
+		// the M-graph during EM learning.
+		std::vector<bool> is_hidden(factors.size(), false);
+		for (std::vector<unsigned int>::const_iterator
+			hfi = hiddenfactors.begin(); hfi != hiddenfactors.end(); ++hfi) {
+			is_hidden[*hfi] = true;
 		}
-		hidden_efi[si].insert(hiddenfactors.begin(), hiddenfactors.end());
+		e_fac_orig[si] = fg_e_fac_new_to_orig;
+		e_fac_hidden[si].resize(fg_e_fac_new_to_orig.size());
+		for (unsigned int efi = 0; efi < fg_e_fac_new_to_orig.size(); ++efi)
+			e_fac_hidden[si][efi] = is_hidden[fg_e_fac_new_to_orig[efi]];
 	}
 
 	// Setup M-step parameter estimation method
@@ -225,8 +235,8 @@ void ExpectationMaximization::Train(double conv_tol, unsigned int max_iter,
 }
 
 double ExpectationMaximization::ComputeHiddenVariableExpectations() {
-	double Hy = 0.0;
 	assert(E_fg.size() == E_inf.size());
+	assert(E_log_z.size() == E_fg.size() && E_entropy.size() == E_fg.size());
 	int E_fg_size = static_cast<int>(E_fg.size());
 	#pragma omp parallel for schedule(dynamic)
 	for (int si = 0; si < E_fg_size; ++si) {
@@ -234,60 +244,61 @@ double ExpectationMaximization::ComputeHiddenVariableExpectations() {
 		E_fg[si]->ForwardMap();
 		// Compute marginals (expectations)
 		E_inf[si]->PerformInference();
-		#pragma omp critical
-		{
-			// TODO: do we need to perform a correction here?  That is, when
-			// we condition the factor graph we throw away all the fully
-			// observed factors which incur a constant energy, but the
-			// log-sum-exp equality says we should add it here, right?
-			// Yes, this is the case!
-			// TODO: in the conditioning functions, return the constant, then
-			// add it here, (see LogSumExp as to how)
-			// The problem when not doing this is that the EM objective, which
-			// is a lower bound on the marginal likelihood can have the wrong
-			// sign.
-
-			// (3.45) in Wainwright:
-			// log Z = sup_\mu [<\theta,\mu> + H(\mu)]
-			//       = sup_\mu [-E(\mu) + H(\mu)]
-			Hy += E_inf[si]->LogPartitionFunction();
-		}
+
+		// TODO: do we need to perform a correction here?  That is, when we
+		// condition the factor graph we throw away all the fully observed
+		// factors which incur a constant energy, but the log-sum-exp
+		// equality says we should add it here, right?
+		// Yes, this is the case!
+		// TODO: in the conditioning functions, return the constant, then
+		// add it here, (see LogSumExp as to how)
+		// The problem when not doing this is that the EM objective, which is
+		// a lower bound on the marginal likelihood can have the wrong sign.
+
+		// (3.45) in Wainwright:
+		// log Z = sup_\mu [<\theta,\mu> + H(\mu)]
+		//       = sup_\mu [-E(\mu) + H(\mu)]
+		E_log_z[si] = E_inf[si]->LogPartitionFunction();
+		// The parameters do not change until the next E-step, so the entropy
+		// can be taken from the same inference result
+		E_entropy[si] = E_inf[si]->Entropy();
 	}
+
+	// Sum in instance order for reproducible results
+	double Hy = 0.0;
+	for (int si = 0; si < E_fg_size; ++si)
+		Hy += E_log_z[si];
+
 	return (Hy);
 }
 
-double ExpectationMaximization::ComputeHiddenVariableEntropies() {
+double ExpectationMaximization::ComputeHiddenVariableEntropies() const {
 	double Hmu = 0.0;
-	assert(E_fg.size() == E_inf.size());
-	int E_fg_size = static_cast<int>(E_fg.size());
-	for (int si = 0; si < E_fg_size; ++si) {
-		// Parameters in the model have changed, update energies
-		E_fg[si]->ForwardMap();
-		// Compute marginals (expectations)
-		E_inf[si]->PerformInference();
-		Hmu += E_inf[si]->Entropy();
-	}
+	for (size_t si = 0; si < E_entropy.size(); ++si)
+		Hmu += E_entropy[si];
+
 	return (Hmu);
 }
 
 double ExpectationMaximization::UpdateMExpectationTargets() {
-	double expected_M_energy = 0.0;
+	int fg_m_size = static_cast<int>(fg_m_training_data.size());
+	std::vector<double> M_energy(fg_m_size, 0.0);
 
 	// For each observed factor graph
-	for (unsigned int n = 0; n < fg_m_training_data.size(); ++n) {
-		// Update expectations of all cross- and hidden-factors
+	#pragma omp parallel for schedule(dynamic)
+	for (int n = 0; n < fg_m_size; ++n) {
+		// Update expectations of all cross- and hidden-factors in place
 		std::vector<std::vector<double> >& fg_m_expects =
 			const_cast<FactorGraphObservation*>(fg_m_training_data[n].second)->Expectation();
 		const std::vector<Factor*>& e_factors = E_fg[n]->Factors();
-		for (fi_to_efi_t::const_iterator fi_i = fi_to_efi[n].begin();
-			fi_i != fi_to_efi[n].end(); ++fi_i) {
-			unsigned int fi = fi_i->first;
-			unsigned int efi = fi_i->second;
+		const std::vector<unsigned int>& fac_orig = e_fac_orig[n];
+		for (unsigned int efi = 0; efi < fac_orig.size(); ++efi) {
+			unsigned int fi = fac_orig[efi];
 			const std::vector<double>& ef_marg = E_inf[n]->Marginal(efi);
 
 			// Two cases:
 			// 1. Hidden factor: copy the entire marginal
-			if (hidden_efi[n].count(fi) > 0) {
+			if (e_fac_hidden[n][efi]) {
 				// Copy
 				assert(fg_m_expects[fi].size() == ef_marg.size());
 				std::copy(ef_marg.begin(), ef_marg.end(),
@@ -303,10 +314,15 @@ double ExpectationMaximization::UpdateMExpectationTargets() {
 			ftab.ExtendMarginals(e_factors[efi], ef_marg,
 				fg_m_expects[fi], false);
 		}
-		expected_M_energy +=
-			fg_m_training_data[n].first->EvaluateEnergy(fg_m_expects);
+		// The M-step may have released the energies of the M-graph
+		fg_m_training_data[n].first->ForwardMap();
+		M_energy[n] = fg_m_training_data[n].first->EvaluateEnergy(fg_m_expects);
 	}
 
+	double expected_M_energy = 0.0;
+	for (int n = 0; n < fg_m_size; ++n)
+		expected_M_energy += M_energy[n];
+
 	return (expected_M_energy);
 }
 
@@ -5,7 +5,6 @@
 #include <vector>
 #include <map>
 #include <utility>
-#include <unordered_map>
 
 #include "FactorGraphModel.h"
 #include "FactorGraphPartialObservation.h"
@@ -99,22 +98,30 @@ private:
 	std::vector<ParameterEstimationMethod::labeled_instance_type>
 		fg_m_training_data;
 
-	// fi_to_efi[fg_n] is a map from the factor indices in the M-graph to the
-	// factor index in the E-graph.  This map holds only the factor indices of
-	// cross factors.
-	typedef std::unordered_map<unsigned int, unsigned int> fi_to_efi_t;
-	std::vector<fi_to_efi_t> fi_to_efi;
-	typedef std::unordered_set<unsigned int> hidden_efi_t;
-	std::vector<hidden_efi_t> hidden_efi;
+	// e_fac_orig[fg_n][efi] is the factor index in the M-graph of the
+	// factor efi in the E-graph.  e_fac_hidden[fg_n][efi] is true if efi is
+	// a factor between hidden variables and false if it is a cross factor.
+	std::vector<std::vector<unsigned int> > e_fac_orig;
+	std::vector<std::vector<bool> > e_fac_hidden;
+
+	// Results of the last E-step for each instance: the log-partition
+	// function and the entropy of the hidden variable distribution.
+	std::vector<double> E_log_z;
+	std::vector<double> E_entropy;
 
 	// E-step: compute expectations of hidden variables under current
-	// parameters.
+	// parameters.  The instances are processed in parallel and the
+	// inference methods are warm-started from the previous E-step if they
+	// support it.
 	// Return the sum of log-partition functions of the conditioned models,
 	// A_y(theta) in Wainwright (6.9).  See also (3.45) in Wainwright.
 	double ComputeHiddenVariableExpectations();
-	double ComputeHiddenVariableEntropies();
+	// Return the sum of the entropies of the hidden variable distributions
+	// of the last E-step.
+	double ComputeHiddenVariableEntropies() const;
 
-	// Update the target label used during the M-step.
+	// Update the target label used during the M-step.  The expectations of
+	// the M-step observations are overwritten in place, in parallel.
 	// Return \sum_n -E_n(M_expects)
 	double UpdateMExpectationTargets();
 
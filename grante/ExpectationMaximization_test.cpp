@@ -0,0 +1,181 @@
+
+#include "grante/ExpectationMaximization.h"
+
+#include <random>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "grante/BeliefPropagation.h"
+#include "grante/Factor.h"
+#include "grante/FactorGraph.h"
+#include "grante/FactorGraphModel.h"
+#include "grante/FactorGraphPartialObservation.h"
+#include "grante/FactorType.h"
+#include "grante/LogSumExp.h"
+#include "grante/MaximumLikelihood.h"
+#include "grante/NormalPrior.h"
+#include "grante/TreeInference.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Small chain training problem with hidden variables: binary labels, unary
+// factors on a noisy feature and a bias, and a data-independent pairwise
+// factor.  Every odd variable of a chain is hidden.  The instances are the
+// same for every call.
+class HiddenChainProblem {
+public:
+    HiddenChainProblem() {
+        std::vector<unsigned int> card1(1, 2);
+        std::vector<double> w1(2 * 2, 0.0);
+        model.AddFactorType(new Grante::FactorType("unary", card1, w1));
+        std::vector<unsigned int> card2(2, 2);
+        std::vector<double> w2(4, 0.0);
+        model.AddFactorType(new Grante::FactorType("pairwise", card2, w2));
+
+        std::default_random_engine e1(7);
+        std::normal_distribution<double> randn(0.0, 1.0);
+        unsigned int N = 8;
+        unsigned int length = 7;
+        for (unsigned int n = 0; n < N; ++n) {
+            std::vector<unsigned int> vc(length, 2);
+            Grante::FactorGraph* fg = new Grante::FactorGraph(&model, vc);
+            std::vector<unsigned int> var_subset;
+            std::vector<unsigned int> var_state;
+            unsigned int y = n % 2;
+            for (unsigned int vi = 0; vi < length; ++vi) {
+                if (randn(e1) > 1.0)
+                    y = 1 - y;
+                if (vi % 2 == 0) {
+                    var_subset.push_back(vi);
+                    var_state.push_back(y);
+                }
+                std::vector<double> data(2);
+                data[0] = (y == 1 ? 1.0 : -1.0) + randn(e1);
+                data[1] = 1.0;
+                std::vector<unsigned int> var_index1(1, vi);
+                fg->AddFactor(new Grante::Factor(
+                    model.FindFactorType("unary"), var_index1, data));
+                if (vi > 0) {
+                    std::vector<unsigned int> var_index2(2);
+                    var_index2[0] = vi - 1;
+                    var_index2[1] = vi;
+                    std::vector<double> data2;
+                    fg->AddFactor(new Grante::Factor(
+                        model.FindFactorType("pairwise"), var_index2, data2));
+                }
+            }
+            fgs.push_back(fg);
+            pobs.push_back(new Grante::FactorGraphPartialObservation(
+                var_subset, var_state));
+            observed_inference_methods.push_back(new Grante::TreeInference(fg));
+        }
+    }
+
+    ~HiddenChainProblem() {
+        for (unsigned int n = 0; n < fgs.size(); ++n) {
+            delete observed_inference_methods[n];
+            delete pobs[n];
+            delete fgs[n];
+        }
+    }
+
+    // Run max_iter EM iterations.  The E-steps use the given inference
+    // method, which is produced for each conditioned instance.
+    void Train(const Grante::InferenceMethod* hidden_inference,
+        unsigned int max_iter) {
+        Grante::ExpectationMaximization em(&model,
+            new Grante::MaximumLikelihood(&model));
+        em.AddPrior("unary", new Grante::NormalPrior(1.0, 4));
+        em.AddPrior("pairwise", new Grante::NormalPrior(1.0, 4));
+
+        std::vector<Grante::ExpectationMaximization::
+            partially_labeled_instance_type> training_data;
+        std::vector<Grante::InferenceMethod*> hidden_inference_methods;
+        for (unsigned int n = 0; n < fgs.size(); ++n) {
+            training_data.push_back(Grante::ExpectationMaximization::
+                partially_labeled_instance_type(fgs[n], pobs[n]));
+            hidden_inference_methods.push_back(
+                const_cast<Grante::InferenceMethod*>(hidden_inference));
+        }
+        em.SetupTrainingData(training_data, hidden_inference_methods,
+            observed_inference_methods);
+        em.Train(0.0, max_iter, 1.0e-8, 500);
+    }
+
+    // Incomplete negative log-likelihood of the partial observations,
+    //    (1/N) \sum_n [log Z_n - log Z_n(observed)].
+    double IncompleteNegLogLikelihood() {
+        double nll = 0.0;
+        for (unsigned int n = 0; n < fgs.size(); ++n) {
+            fgs[n]->ForwardMap();
+            Grante::TreeInference tinf(fgs[n]);
+            tinf.PerformInference();
+            nll += tinf.LogPartitionFunction();
+
+            // Sum over all completions of the observed variables
+            const std::vector<unsigned int>& var_subset =
+                pobs[n]->ObservedVariableSet();
+            const std::vector<unsigned int>& var_state =
+                pobs[n]->ObservedVariableState();
+            std::vector<unsigned int> hidden;
+            std::vector<unsigned int> state(fgs[n]->Cardinalities().size(), 0);
+            std::vector<bool> observed(state.size(), false);
+            for (unsigned int oi = 0; oi < var_subset.size(); ++oi) {
+                state[var_subset[oi]] = var_state[oi];
+                observed[var_subset[oi]] = true;
+            }
+            for (unsigned int vi = 0; vi < state.size(); ++vi) {
+                if (observed[vi] == false)
+                    hidden.push_back(vi);
+            }
+            std::vector<double> neg_energies;
+            for (unsigned int hi = 0; hi < (1u << hidden.size()); ++hi) {
+                for (unsigned int hvi = 0; hvi < hidden.size(); ++hvi)
+                    state[hidden[hvi]] = (hi >> hvi) & 1;
+                neg_energies.push_back(-fgs[n]->EvaluateEnergy(state));
+            }
+            nll -= Grante::LogSumExp::Compute(neg_energies);
+        }
+        return (nll / static_cast<double>(fgs.size()));
+    }
+
+    Grante::FactorGraphModel model;
+    std::vector<Grante::FactorGraph*> fgs;
+    std::vector<const Grante::FactorGraphPartialObservation*> pobs;
+    std::vector<Grante::InferenceMethod*> observed_inference_methods;
+};
+
+}
+
+TEST(ExpectationMaximization, WarmStartMatchesColdStart) {
+    // Belief propagation is exact on chains and is warm started from the
+    // previous E-step, tree inference always starts from scratch
+    HiddenChainProblem prob_warm;
+    Grante::BeliefPropagation bp(prob_warm.fgs[0]);
+    ASSERT_TRUE(bp.SupportsWarmStart());
+    double nll_warm_init = prob_warm.IncompleteNegLogLikelihood();
+    prob_warm.Train(&bp, 4);
+    double nll_warm = prob_warm.IncompleteNegLogLikelihood();
+
+    HiddenChainProblem prob_cold;
+    Grante::TreeInference tinf(prob_cold.fgs[0]);
+    ASSERT_FALSE(tinf.SupportsWarmStart());
+    prob_cold.Train(&tinf, 4);
+    double nll_cold = prob_cold.IncompleteNegLogLikelihood();
+
+    // Training made progress on the objective
+    EXPECT_LT(nll_warm, nll_warm_init - 1.0e-2);
+    EXPECT_THAT(nll_warm, testing::DoubleNear(nll_cold, 1.0e-5));
+
+    for (unsigned int fti = 0; fti < prob_warm.model.FactorTypes().size();
+        ++fti) {
+        const std::vector<double>& w_warm =
+            prob_warm.model.FactorTypes()[fti]->Weights();
+        const std::vector<double>& w_cold =
+            prob_cold.model.FactorTypes()[fti]->Weights();
+        ASSERT_EQ(w_cold.size(), w_warm.size());
+        for (unsigned int wi = 0; wi < w_warm.size(); ++wi)
+            EXPECT_THAT(w_warm[wi], testing::DoubleNear(w_cold[wi], 1.0e-4));
+    }
+}
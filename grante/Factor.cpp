@@ -13,13 +13,15 @@ namespace Grante {
 
 // private
 Factor::Factor()
-	: factor_type(0), data_source(0) {
+	: factor_type(0), data_source(0),
+	cond_index(std::numeric_limits<unsigned int>::max()) {
 }
 
 Factor::Factor(const FactorType* ftype,
 	const std::vector<unsigned int>& var_index,
 	const std::vector<double>& data)
-	: factor_type(ftype), var_index(var_index), data_source(0), H(data) {
+	: factor_type(ftype), var_index(var_index), data_source(0), H(data),
+	cond_index(std::numeric_limits<unsigned int>::max()) {
 	assert(ftype != 0);
 	assert(ftype->Cardinalities().size() == var_index.size());
 
@@ -34,7 +36,8 @@ Factor::Factor(const FactorType* ftype,
 	const std::vector<double>& data_elem,
 	const std::vector<unsigned int>& data_idx)
 	: factor_type(ftype), var_index(var_index), data_source(0),
-	H(data_elem), H_index(data_idx) {
+	H(data_elem), H_index(data_idx),
+	cond_index(std::numeric_limits<unsigned int>::max()) {
 	assert(ftype != 0);
 	assert(ftype->Cardinalities().size() == var_index.size());
 	assert(data_elem.size() == data_idx.size());
@@ -46,7 +49,8 @@ Factor::Factor(const FactorType* ftype,
 Factor::Factor(const FactorType* ftype,
 	const std::vector<unsigned int>& var_index,
 	const FactorDataSource* data_source)
-	: factor_type(ftype), var_index(var_index), data_source(data_source) {
+	: factor_type(ftype), var_index(var_index), data_source(data_source),
+	cond_index(std::numeric_limits<unsigned int>::max()) {
 	assert(ftype != 0);
 	assert(ftype->Cardinalities().size() == var_index.size());
 	assert(data_source != 0);
@@ -195,6 +199,12 @@ void Factor::BackwardMap(const std::vector<double>& marginals,
 	factor_type->BackwardMap(this, marginals, parameter_gradient, mult);
 }
 
+void Factor::SparseBackwardMap(const std::vector<double>& marginals,
+	std::vector<std::pair<unsigned int, double> >& parameter_gradient,
+	double mult) const {
+	factor_type->SparseBackwardMap(this, marginals, parameter_gradient, mult);
+}
+
 double Factor::TotalCorrelation(void) const {
 	double max_tc = 0.0;
 	return (TotalCorrelation(max_tc));
@@ -257,6 +267,10 @@ double Factor::TotalCorrelation(double& max_tc) const {
 	return (Hsep - Hjoint);
 }
 
+unsigned int Factor::ConditioningIndex() const {
+	return (cond_index);
+}
+
 
 }
 
@@ -3,6 +3,7 @@
 #define GRANTE_FACTOR_H
 
 #include <vector>
+#include <utility>
 
 #include <boost/serialization/serialization.hpp>
 #include <boost/serialization/vector.hpp>
@@ -87,6 +88,10 @@ public:
 	// See FactorType::BackwardMap
 	void BackwardMap(const std::vector<double>& marginals,
 		std::vector<double>& parameter_gradient, double mult = 1.0) const;
+	// See FactorType::SparseBackwardMap
+	void SparseBackwardMap(const std::vector<double>& marginals,
+		std::vector<std::pair<unsigned int, double> >& parameter_gradient,
+		double mult = 1.0) const;
 
 	// Compute the total correlation of a single given factor as a measure of
 	// dependence between multiple variables.  This measure can be used to
@@ -102,6 +107,10 @@ public:
 	double TotalCorrelation(void) const;
 	double TotalCorrelation(double& max_tc) const;
 
+	// For a factor created by a FactorConditioningTable, the dense index of
+	// the factor into the side arrays of the table.
+	unsigned int ConditioningIndex() const;
+
 private:
 	const FactorType* factor_type;
 
@@ -121,6 +130,10 @@ private:
 	// If H_index.empty() == false, then H is specified as sparse vector
 	std::vector<unsigned int> H_index;
 
+	// Set by FactorConditioningTable, not serialized
+	unsigned int cond_index;
+	friend class FactorConditioningTable;
+
 	Factor();
 
 	friend class boost::serialization::access;
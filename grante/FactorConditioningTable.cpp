@@ -31,18 +31,9 @@ Factor* FactorConditioningTable::ConditionAndAddFactor(Factor* full_factor,
 		assert(condition_var_state[cvi] < fac_card[condition_var_set[cvi]]);
 	}
 
-	// Construct the conditioned factor type
-	ConditionedFactorType* cft = AddCFT(new ConditionedFactorType(
-		full_factor->Type(), condition_var_set, this));
-
-	// Construct conditioned factor
-	std::vector<double> data_dummy;
-	Factor* fac = new Factor(cft, var_index, data_dummy);
-
-	// Insert factor mapping and conditioning data (states)
-	new_to_original_factormap[fac] = full_factor;
-	new_to_condstate.insert(std::pair<const Factor*, std::vector<unsigned int> >
-		(fac, condition_var_state));
+	// Construct conditioned factor and insert conditioning data (states)
+	Factor* fac = AddFactor(full_factor, condition_var_set, var_index, false);
+	cond_state.back() = condition_var_state;
 
 	return (fac);
 }
@@ -51,176 +42,108 @@ Factor* FactorConditioningTable::ConditionAndAddFactor(Factor* full_factor,
 	const std::vector<unsigned int>& condition_var_set,
 	const std::vector<double>& condition_var_expectations,
 	const std::vector<unsigned int>& var_index) {
-	// Construct the conditioned factor type
-	ConditionedFactorType* cft = AddCFT(new ConditionedFactorType(
-		full_factor->Type(), condition_var_set, this));
-
-	// Construct conditioned factor
-	std::vector<double> data_dummy;
-	Factor* fac = new Factor(cft, var_index, data_dummy);
-
-	// Insert factor mapping and conditioning data (expectations)
-	new_to_original_factormap[fac] = full_factor;
-	new_to_condexpect.insert(std::pair<const Factor*, std::vector<double> >
-		(fac, condition_var_expectations));
+	// Construct conditioned factor and insert conditioning data
+	// (expectations)
+	Factor* fac = AddFactor(full_factor, condition_var_set, var_index, true);
+	assert(condition_var_expectations.size() == static_cast<
+		const ConditionedFactorType*>(fac->Type())->ConditionedOffsets().size());
+	cond_expect.back() = condition_var_expectations;
 
 	return (fac);
 }
 
 Factor* FactorConditioningTable::OriginalFactor(
 	const Factor* new_factor) const {
-	std::unordered_map<const Factor*, Factor*>::const_iterator
-		ofi = new_to_original_factormap.find(new_factor);
-	assert(ofi != new_to_original_factormap.end());
-
-	return (ofi->second);
+	return (orig_factor[Index(new_factor)]);
 }
 
 void FactorConditioningTable::UpdateConditioningInformation(
 	const Factor* new_factor,
 	const std::vector<unsigned int>& condition_var_state) {
-	// Find the old conditioning information (state)
-	new_to_condstate_t::iterator cvi = new_to_condstate.find(new_factor);
-	assert(cvi != new_to_condstate.end());
-	assert(condition_var_state.size() == cvi->second.size());
-
-	// Update
+	// Update the old conditioning information (state)
+	unsigned int ci = Index(new_factor);
+	assert(cond_by_expect[ci] == false);
+	assert(condition_var_state.size() == cond_state[ci].size());
 	std::copy(condition_var_state.begin(), condition_var_state.end(),
-		cvi->second.begin());
+		cond_state[ci].begin());
 }
 
 void FactorConditioningTable::UpdateConditioningInformation(
 	const Factor* new_factor,
 	const std::vector<double>& condition_var_expectations) {
-	// Find the old conditioning information (expectation)
-	new_to_condexpect_t::iterator cei = new_to_condexpect.find(new_factor);
-	assert(cei != new_to_condexpect.end());
-	assert(condition_var_expectations.size() == cei->second.size());
-
-	// Update
+	// Update the old conditioning information (expectation)
+	unsigned int ci = Index(new_factor);
+	assert(cond_by_expect[ci]);
+	assert(condition_var_expectations.size() == cond_expect[ci].size());
 	std::copy(condition_var_expectations.begin(),
-		condition_var_expectations.end(), cei->second.begin());
+		condition_var_expectations.end(), cond_expect[ci].begin());
 }
 
 void FactorConditioningTable::ConditionEnergies(const Factor* new_factor,
 	const std::vector<double>& orig_energies,
 	std::vector<double>& new_energies) const {
-	// Obtain variable indices conditioned on
 	const ConditionedFactorType* cft =
-		dynamic_cast<const ConditionedFactorType*>(new_factor->Type());
-	// TODO: this is not elegant and might be inefficient.  We should either
-	// move the condition function into the ConditionedFactorType
-	// TODO: can safely use static_cast here
-	assert(cft != 0);
-	const std::vector<unsigned int>& cv_index =
-		cft->ConditionedVariableIndices();
-
-	// Obtain states of variables conditioned on
-	new_to_condstate_t::const_iterator cdi_s = new_to_condstate.find(new_factor);
-	new_to_condexpect_t::const_iterator cdi_e =
-		new_to_condexpect.find(new_factor);
-	assert(cdi_s == new_to_condstate.end() || cdi_e == new_to_condexpect.end());
-	if (cdi_s != new_to_condstate.end()) {
-		// Conditioned by state
-		const std::vector<unsigned int>& cv_data = cdi_s->second;
-		assert(cv_index.size() == cv_data.size());
-
-		// Condition energy table
-		unsigned int nei = 0;
-		const FactorType* base_ft = cft->BaseType();
-		for (unsigned int oei = 0; oei < orig_energies.size(); ++oei) {
-			// Test whether oei is an index that corresponds to the conditioned
-			// variables
-			if (IsIndexMatchingConditioning(base_ft, cv_index, cv_data, oei)
-				== false)
-				continue;
-
-			// Does match -> copy energy
-			assert(nei < new_energies.size());
-			new_energies[nei] = orig_energies[oei];
-			nei += 1;
-		}
-		assert(nei == new_energies.size());
-	} else if (cdi_e != new_to_condexpect.end()) {
-		// Conditioned by expectation
-		const std::vector<double>& cv_expect = cdi_e->second;
-
-		// Weighted summation
+		static_cast<const ConditionedFactorType*>(new_factor->Type());
+	const std::vector<unsigned int>& uncond_offset =
+		cft->UnconditionedOffsets();
+	assert(new_energies.size() == uncond_offset.size());
+	assert(orig_energies.size() == cft->BaseType()->ProdCardinalities());
+
+	unsigned int ci = Index(new_factor);
+	if (cond_by_expect[ci] == false) {
+		// Conditioned by state: gather the energies
+		const double* orig_e =
+			&orig_energies[cft->ConditionedOffset(cond_state[ci])];
+		for (size_t nei = 0; nei < uncond_offset.size(); ++nei)
+			new_energies[nei] = orig_e[uncond_offset[nei]];
+	} else {
+		// Conditioned by expectation: weighted summation
+		const std::vector<double>& cv_expect = cond_expect[ci];
+		const std::vector<unsigned int>& cond_offset =
+			cft->ConditionedOffsets();
+		assert(cv_expect.size() == cond_offset.size());
 		std::fill(new_energies.begin(), new_energies.end(), 0.0);
-		const FactorType* base_ft = cft->BaseType();
-		for (unsigned int oei = 0; oei < orig_energies.size(); ++oei) {
-			// Map oei into conditioned and unconditioned index parts
-			unsigned int cei = IndexMapConditioned(base_ft, cv_index, oei);
-			unsigned int nei = IndexMapUnconditioned(base_ft, cv_index, oei);
-			assert(cei < cv_expect.size());
-			assert(nei < new_energies.size());
-			new_energies[nei] += cv_expect[cei] * orig_energies[oei];
+		for (size_t cei = 0; cei < cond_offset.size(); ++cei) {
+			const double* orig_e = &orig_energies[cond_offset[cei]];
+			double cv_e = cv_expect[cei];
+			for (size_t nei = 0; nei < uncond_offset.size(); ++nei)
+				new_energies[nei] += cv_e * orig_e[uncond_offset[nei]];
 		}
-	} else {
-		// This should not happen
-		assert(0);
 	}
 }
 
 void FactorConditioningTable::ExtendMarginals(const Factor* new_factor,
 	const std::vector<double>& marginals,
 	std::vector<double>& ext_marginals, bool replicate) const {
-	// Clear extended marginals
-	std::fill(ext_marginals.begin(), ext_marginals.end(), 0.0);
-
-	// Obtain variable indices conditioned on (TODO, see above)
 	const ConditionedFactorType* cft =
-		dynamic_cast<const ConditionedFactorType*>(new_factor->Type());
-	assert(cft != 0);
-	assert(marginals.size() == cft->ProdCardinalities());
-	const std::vector<unsigned int>& cv_index =
-		cft->ConditionedVariableIndices();
-
-	// Obtain states/expectations of variables conditioned on
-	new_to_condstate_t::const_iterator cdi_s = new_to_condstate.find(new_factor);
-	new_to_condexpect_t::const_iterator cdi_e =
-		new_to_condexpect.find(new_factor);
-	assert(cdi_s == new_to_condstate.end() || cdi_e == new_to_condexpect.end());
-	const FactorType* base_ft = cft->BaseType();
-	assert(ext_marginals.size() == base_ft->ProdCardinalities());
-	if (cdi_s != new_to_condstate.end()) {
-		// Conditioning on state
-		const std::vector<unsigned int>& cv_data = cdi_s->second;
-		assert(cv_index.size() == cv_data.size());
+		static_cast<const ConditionedFactorType*>(new_factor->Type());
+	const std::vector<unsigned int>& uncond_offset =
+		cft->UnconditionedOffsets();
+	assert(marginals.size() == uncond_offset.size());
+	assert(ext_marginals.size() == cft->BaseType()->ProdCardinalities());
+
+	unsigned int ci = Index(new_factor);
+	if (cond_by_expect[ci] == false) {
+		// Conditioning on state: scatter the marginals, all other entries
+		// are zero
 		assert(replicate == false);
-
-		// Extend marginals
-		unsigned int nei = 0;
-		for (unsigned int oei = 0; oei < ext_marginals.size(); ++oei) {
-			// Test whether oei is an index that corresponds to the conditioned
-			// variables
-			if (IsIndexMatchingConditioning(base_ft, cv_index, cv_data, oei) == false)
-				continue;
-
-			// Does match -> copy marginal
-			assert(nei < marginals.size());
-			ext_marginals[oei] = marginals[nei];
-			nei += 1;
-		}
-		assert(nei == marginals.size());
-	} else if (cdi_e != new_to_condexpect.end()) {
-		// Conditioned by expectation
-		const std::vector<double>& cv_expect = cdi_e->second;
-		for (unsigned int oei = 0; oei < ext_marginals.size(); ++oei) {
-			// Map oei into conditioned and unconditioned index parts
-			unsigned int nei = IndexMapUnconditioned(base_ft, cv_index, oei);
-			assert(nei < marginals.size());
-			if (replicate) {
-				ext_marginals[oei] = marginals[nei];
-			} else {
-				unsigned int cei = IndexMapConditioned(base_ft, cv_index, oei);
-				assert(cei < cv_expect.size());
-				ext_marginals[oei] = cv_expect[cei] * marginals[nei];
-			}
-		}
+		std::fill(ext_marginals.begin(), ext_marginals.end(), 0.0);
+		double* ext_m =
+			&ext_marginals[cft->ConditionedOffset(cond_state[ci])];
+		for (size_t nei = 0; nei < uncond_offset.size(); ++nei)
+			ext_m[uncond_offset[nei]] = marginals[nei];
 	} else {
-		// This should not happen
-		assert(0);
+		// Conditioned by expectation: every entry is written
+		const std::vector<double>& cv_expect = cond_expect[ci];
+		const std::vector<unsigned int>& cond_offset =
+			cft->ConditionedOffsets();
+		assert(cv_expect.size() == cond_offset.size());
+		for (size_t cei = 0; cei < cond_offset.size(); ++cei) {
+			double* ext_m = &ext_marginals[cond_offset[cei]];
+			double cv_e = replicate ? 1.0 : cv_expect[cei];
+			for (size_t nei = 0; nei < uncond_offset.size(); ++nei)
+				ext_m[uncond_offset[nei]] = cv_e * marginals[nei];
+		}
 	}
 }
 
@@ -228,37 +151,18 @@ void FactorConditioningTable::ProjectExtendedMarginalsCond(
 	const Factor* new_factor, const std::vector<double>& ext_marginals,
 	std::vector<double>& cond_var_expect) const {
 	const ConditionedFactorType* cft =
-		dynamic_cast<const ConditionedFactorType*>(new_factor->Type());
-	const FactorType* base_ft = cft->BaseType();
-	assert(cond_var_expect.size() ==
-		(base_ft->ProdCardinalities() / cft->ProdCardinalities()));
-	assert(ext_marginals.size() == base_ft->ProdCardinalities());
-	const std::vector<unsigned int>& cv_index =
-		cft->ConditionedVariableIndices();
-
-	// Copy a subset of the full marginals
-	// TODO: this should be more efficient, especially for two-factors
-	std::fill(cond_var_expect.begin(), cond_var_expect.end(), 0.0);
-	for (unsigned int oei = 0; oei < ext_marginals.size(); ++oei) {
-		unsigned int cei = IndexMapConditioned(base_ft, cv_index, oei);
-		// Will be written multiple times but all marginals should be equal
-		cond_var_expect[cei] = ext_marginals[oei];
-	}
-}
-
-bool FactorConditioningTable::IsIndexMatchingConditioning(
-	const FactorType* base_ft, const std::vector<unsigned int>& cv_index,
-	const std::vector<unsigned int>& cv_data, unsigned int oei) const {
-	bool matches_conditioning = true;
-	for (unsigned int cond_id = 0; cond_id < cv_index.size(); ++cond_id) {
-		unsigned int oei_cond_var_state =
-			base_ft->LinearIndexToVariableState(oei, cv_index[cond_id]);
-		if (oei_cond_var_state != cv_data[cond_id]) {
-			matches_conditioning = false;
-			break;
-		}
-	}
-	return (matches_conditioning);
+		static_cast<const ConditionedFactorType*>(new_factor->Type());
+	const std::vector<unsigned int>& cond_offset = cft->ConditionedOffsets();
+	assert(cond_var_expect.size() == cond_offset.size());
+	assert(ext_marginals.size() == cft->BaseType()->ProdCardinalities());
+
+	// Copy a subset of the full marginals: all marginals for the same
+	// conditioned state should be equal, take the one with the largest
+	// original index.  UnconditionedOffsets() is increasing, so this is the
+	// entry of its last element.
+	unsigned int last_offset = cft->UnconditionedOffsets().back();
+	for (size_t cei = 0; cei < cond_offset.size(); ++cei)
+		cond_var_expect[cei] = ext_marginals[cond_offset[cei] + last_offset];
 }
 
 // Map original energy index into conditioning expectation table index
@@ -301,6 +205,34 @@ unsigned int FactorConditioningTable::IndexMapUnconditioned(
 	return (nei);
 }
 
+Factor* FactorConditioningTable::AddFactor(Factor* full_factor,
+	const std::vector<unsigned int>& condition_var_set,
+	const std::vector<unsigned int>& var_index, bool by_expect) {
+	// Construct the conditioned factor type
+	ConditionedFactorType* cft = AddCFT(new ConditionedFactorType(
+		full_factor->Type(), condition_var_set, this));
+
+	// Construct conditioned factor
+	std::vector<double> data_dummy;
+	Factor* fac = new Factor(cft, var_index, data_dummy);
+
+	// Assign the next dense index and extend the side arrays
+	fac->cond_index = static_cast<unsigned int>(orig_factor.size());
+	orig_factor.push_back(full_factor);
+	cond_by_expect.push_back(by_expect);
+	cond_state.push_back(std::vector<unsigned int>());
+	cond_expect.push_back(std::vector<double>());
+
+	return (fac);
+}
+
+unsigned int FactorConditioningTable::Index(const Factor* new_factor) const {
+	unsigned int ci = new_factor->ConditioningIndex();
+	assert(ci < orig_factor.size());
+
+	return (ci);
+}
+
 ConditionedFactorType* FactorConditioningTable::AddCFT(
 	ConditionedFactorType* cft) {
 	// Attempt to locate it in the table of conditioned factors
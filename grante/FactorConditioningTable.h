@@ -3,7 +3,6 @@
 #define GRANTE_FACTORCONDITIONINGTABLE_H
 
 #include <vector>
-#include <unordered_map>
 #include <unordered_set>
 #include <functional>
 
@@ -14,6 +13,12 @@ namespace Grante {
 
 /* Efficient lookup table used for providing conditioned factor types
  * information about which factors are conditioned on which states.
+ *
+ * Each conditioned factor created by this table carries a dense index
+ * (Factor::ConditioningIndex) into flat side arrays holding its original
+ * factor and conditioning information.  Together with the gather tables of
+ * ConditionedFactorType, conditioning energies and extending marginals
+ * require no lookups or index arithmetic per table entry.
  */
 class FactorConditioningTable {
 public:
@@ -66,14 +71,19 @@ public:
 		std::vector<double>& new_energies) const;
 
 	// Extend the conditional marginals to the full marginals of the original
-	// factor type using the conditioning states.
+	// factor type using the conditioning states.  If replicate is true and
+	// the factor is conditioned by expectation, the conditional marginals
+	// are replicated for all conditioning states instead of being weighted
+	// by the conditioning expectations.
 	void ExtendMarginals(const Factor* new_factor,
 		const std::vector<double>& marginals,
 		std::vector<double>& ext_marginals, bool replicate = false) const;
 
 	// Project a table of full extended marginals onto the conditioned-on
 	// expectations cond_var_expect.  The full marginals need not be proper
-	// marginals.
+	// marginals, but they must be constant over the unconditioned states
+	// for each conditioned state; only one entry per conditioned state is
+	// read.
 	void ProjectExtendedMarginalsCond(const Factor* new_factor,
 		const std::vector<double>& ext_marginals,
 		std::vector<double>& cond_var_expect) const;
@@ -95,17 +105,17 @@ public:
 		const std::vector<unsigned int>& cv_index, unsigned int oei);
 
 private:
-	// new_to_original_factormap[conditioned_factor] = original_factor
-	std::unordered_map<const Factor*, Factor*> new_to_original_factormap;
-	typedef std::unordered_map<const Factor*, std::vector<unsigned int> >
-		new_to_condstate_t;
-	typedef std::unordered_map<const Factor*, std::vector<double> >
-		new_to_condexpect_t;
-	// new_to_condstate[conditioned_factor] = conditioning states
-	new_to_condstate_t new_to_condstate;
-	// new_to_condexpect[conditioned_factor] = partial marginal distribution
-	//    of variables conditioned on
-	new_to_condexpect_t new_to_condexpect;
+	// Side arrays, indexed by the conditioning index of a conditioned factor
+	// orig_factor[ci] = original_factor
+	std::vector<Factor*> orig_factor;
+	// cond_by_expect[ci] is true if the factor is conditioned on a partial
+	// marginal distribution instead of states
+	std::vector<bool> cond_by_expect;
+	// cond_state[ci] = conditioning states
+	std::vector<std::vector<unsigned int> > cond_state;
+	// cond_expect[ci] = partial marginal distribution of variables
+	//    conditioned on
+	std::vector<std::vector<double> > cond_expect;
 
 	// True semantic equality check for the conditioned factor type table
 	struct condfac_t_eq {
@@ -123,19 +133,13 @@ private:
 		ConditionedFactorType::condfac_tp_hash, condfac_t_eq> condfac_table_t;
 	condfac_table_t condfac_table;
 
-	// Predicate: is the energy indexed by 'oei' part of the conditioned
-	// factor energy table?
-	//
-	// base_ft: The factor type of the original, unconditioned factor.
-	// cv_index: The conditioning variable indices, base_ft factor-relative.
-	// cv_data: The states conditioned on.
-	// oei: The index into the energy table of the original unconditioned
-	//    factor.
-	//
-	// Return true if 'oei' appears in the conditioned table, false otherwise.
-	bool IsIndexMatchingConditioning(const FactorType* base_ft,
-		const std::vector<unsigned int>& cv_index,
-		const std::vector<unsigned int>& cv_data, unsigned int oei) const;
+	// Create the conditioned factor and its side array entries
+	Factor* AddFactor(Factor* full_factor,
+		const std::vector<unsigned int>& condition_var_set,
+		const std::vector<unsigned int>& var_index, bool by_expect);
+
+	// Return the conditioning index of new_factor
+	unsigned int Index(const Factor* new_factor) const;
 
 	// Attempt to add a new conditioned factor type.  If it is already
 	// present, the passed object is deleted.
@@ -1,12 +1,11 @@
 
 #include <algorithm>
-#include <numeric>
 #include <limits>
 #include <cmath>
 #include <cassert>
 
 #include "FactorType.h"
-#include "LogSumExp.h"
+#include "VectorMath.h"
 
 namespace Grante {
 
@@ -95,6 +94,10 @@ unsigned int FactorType::LinearIndexToVariableState(size_t ei,
 	return ((ei / prod_cumcard[var_index]) % cardinalities[var_index]);
 }
 
+size_t FactorType::VariableStride(size_t var_index) const {
+	return (prod_cumcard[var_index]);
+}
+
 size_t FactorType::LinearIndexChangeVariableState(size_t ei,
 	unsigned int var_index, unsigned int var_value) const {
 	assert(var_value < cardinalities[var_index]);
@@ -288,6 +291,85 @@ void FactorType::BackwardMap(const std::vector<double>& factor_data,
 	}
 }
 
+void FactorType::SparseBackwardMap(const Factor* factor,
+	const std::vector<double>& marginals,
+	sparse_gradient_type& parameter_gradient, double mult) const {
+	if (w.empty())
+		return;	// No parameters
+
+	if (data_size == 0) {
+		assert(prod_card == w.size());
+		for (unsigned int ei = 0; ei < prod_card; ++ei) {
+			if (marginals[ei] == 0.0)
+				continue;
+			parameter_gradient.push_back(
+				std::make_pair(ei, mult * marginals[ei]));
+		}
+		return;
+	}
+
+	// Tensor outer product with the non-zero data elements
+	const std::vector<double>& H = factor->Data();
+	const std::vector<unsigned int>& H_index = factor->DataSparseIndex();
+	assert((data_size * prod_card) == w.size());
+	for (unsigned int ei = 0; ei < prod_card; ++ei) {
+		if (marginals[ei] == 0.0)
+			continue;
+		unsigned int wbase = static_cast<unsigned int>(ei*data_size);
+		double mult_ei = mult * marginals[ei];
+		if (H_index.empty()) {
+			assert(H.size() == data_size);
+			for (unsigned int di = 0; di < data_size; ++di) {
+				if (H[di] == 0.0)
+					continue;
+				parameter_gradient.push_back(
+					std::make_pair(wbase + di, mult_ei * H[di]));
+			}
+		} else {
+			for (unsigned int n = 0; n < H_index.size(); ++n) {
+				parameter_gradient.push_back(
+					std::make_pair(wbase + H_index[n], mult_ei * H[n]));
+			}
+		}
+	}
+}
+
+void FactorType::ParameterSupport(const Factor* factor,
+	std::vector<unsigned int>& support) const {
+	if (w.empty())
+		return;
+
+	const std::vector<unsigned int>& H_index = factor->DataSparseIndex();
+	if (data_size == 0 || H_index.empty()) {
+		DenseParameterSupport(support);
+		return;
+	}
+	for (unsigned int ei = 0; ei < prod_card; ++ei) {
+		unsigned int wbase = static_cast<unsigned int>(ei*data_size);
+		for (unsigned int n = 0; n < H_index.size(); ++n)
+			support.push_back(wbase + H_index[n]);
+	}
+}
+
+void FactorType::DenseSparseBackwardMap(const Factor* factor,
+	const std::vector<double>& marginals,
+	sparse_gradient_type& parameter_gradient, double mult) const {
+	std::vector<double> dense_gradient(WeightDimension(), 0.0);
+	BackwardMap(factor, marginals, dense_gradient, mult);
+	for (unsigned int wi = 0; wi < dense_gradient.size(); ++wi) {
+		if (dense_gradient[wi] == 0.0)
+			continue;
+		parameter_gradient.push_back(std::make_pair(wi, dense_gradient[wi]));
+	}
+}
+
+void FactorType::DenseParameterSupport(
+	std::vector<unsigned int>& support) const {
+	unsigned int wdim = WeightDimension();
+	for (unsigned int wi = 0; wi < wdim; ++wi)
+		support.push_back(wi);
+}
+
 void FactorType::ComputeBPMessage(const Factor* factor,
 	unsigned int vi, unsigned int fvi_to,
 	const std::vector<unsigned int>& msglist_for_factor_cur,
@@ -298,50 +380,38 @@ void FactorType::ComputeBPMessage(const Factor* factor,
 	const std::vector<double>& energies = factor->Energies();
 	size_t energies_size = energies.size();
 	std::vector<double> msum_xn(energies_size);
-	size_t card_vi = msg.size();
-	std::vector<double> msum_xn_max(card_vi,
-		-std::numeric_limits<double>::infinity());
-
-	// For x_n
-	for (size_t ei = 0; ei < energies_size; ++ei) {
+	for (size_t ei = 0; ei < energies_size; ++ei)
 		msum_xn[ei] = -energies[ei];
 
-		// Sum adjacent variables of this factor
-		for (size_t fvi = 0; fvi < msglist_for_factor_cur.size(); ++fvi) {
-			// The messages are ordered according to the factor
-			// variable order, that is fvi is the factor-relative
-			// variable index.
-			unsigned int var_msg_index = msglist_for_factor_cur[fvi];
-			unsigned int var_index = msg_for_factor_srcvar[var_msg_index];
-
-			// Skip over message from this variable
-			if (var_index == vi)
-				continue;
-
-			// + log q_{v->f}(v_state)
-			unsigned int var_state = LinearIndexToVariableState(ei, fvi);
-			msum_xn[ei] += msg_for_factor[var_msg_index][var_state];
-		}
-
-		// Compute maximum over state of xn for stable log-sum-exp.
-		unsigned int xn_state = LinearIndexToVariableState(ei, fvi_to);
-		if (msum_xn[ei] > msum_xn_max[xn_state])
-			msum_xn_max[xn_state] = msum_xn[ei];
+	// Sum adjacent variables of this factor
+	for (size_t fvi = 0; fvi < msglist_for_factor_cur.size(); ++fvi) {
+		// The messages are ordered according to the factor variable order,
+		// that is fvi is the factor-relative variable index.
+		unsigned int var_msg_index = msglist_for_factor_cur[fvi];
+		unsigned int var_index = msg_for_factor_srcvar[var_msg_index];
+
+		// Skip over message from this variable
+		if (var_index == vi)
+			continue;
+
+		// + log q_{v->f}(v_state)
+		VectorMath::StridedAdd(&msum_xn[0], energies_size,
+			cardinalities[fvi], prod_cumcard[fvi],
+			&msg_for_factor[var_msg_index][0]);
 	}
 
-	std::fill(msg.begin(), msg.end(), 0.0);
+	size_t card_vi = msg.size();
+	assert(card_vi == cardinalities[fvi_to]);
 	if (min_sum) {
 		// Message: maximum negative energy value (minimum energy)
 		// over domain of xn
-		std::copy(msum_xn_max.begin(), msum_xn_max.end(), msg.begin());
+		VectorMath::StridedMax(&msum_xn[0], energies_size, card_vi,
+			prod_cumcard[fvi_to], &msg[0]);
 	} else {
 		// Log-sum-exp (numerically stable), correctly split along msum_xn
-		for (size_t ei = 0; ei < energies_size; ++ei) {
-			unsigned int xn_state = LinearIndexToVariableState(ei, fvi_to);
-			msg[xn_state] += std::exp(msum_xn[ei] - msum_xn_max[xn_state]);
-		}
-		for (size_t xn_state = 0; xn_state < card_vi; ++xn_state)
-			msg[xn_state] = msum_xn_max[xn_state] + std::log(msg[xn_state]);
+		std::vector<double> msum_xn_max(card_vi);
+		VectorMath::StridedLogSumExp(&msum_xn[0], energies_size, card_vi,
+			prod_cumcard[fvi_to], &msg[0], &msum_xn_max[0]);
 	}
 }
 
@@ -357,33 +427,40 @@ double FactorType::ComputeBPMarginal(const Factor* factor,
 	// Compute marginals for target factor:
 	//   P_f(x) = exp(-E(x) + sum_{var} loq q_{var->f}(x_var) - log_z)
 	size_t energies_size = energies.size();
-	double marg_max_diff = -std::numeric_limits<double>::infinity();
-	for (size_t ei = 0; ei < energies_size; ++ei) {
+	for (size_t ei = 0; ei < energies_size; ++ei)
 		M[ei] = -energies[ei];
+	for (size_t mli = 0; mli < msglist_for_factor_cur.size(); ++mli) {
+		assert(msglist_for_factor_cur[mli] < msg_for_factor.size());
+
+		// + log q_{v->f}(v_state)
+		const std::vector<double>& msg =
+			msg_for_factor[msglist_for_factor_cur[mli]];
+		VectorMath::StridedAdd(&M[0], energies_size, cardinalities[mli],
+			prod_cumcard[mli], &msg[0]);
+	}
 
-		for (size_t mli = 0; mli < msglist_for_factor_cur.size(); ++mli) {
-			assert(msglist_for_factor_cur[mli] < msg_for_factor.size());
-
-			// + log q_{v->f}(v_state)
-			const std::vector<double>& msg =
-				msg_for_factor[msglist_for_factor_cur[mli]];
-			unsigned int from_var_state =
-				LinearIndexToVariableState(ei, mli);
-			M[ei] += msg[from_var_state];
+	if (min_sum) {
+		// Shift by the mean of the finite entries; entries excluded by
+		// evidence are -infinity.
+		double z_fi = 0.0;
+		size_t z_count = 0;
+		for (size_t ei = 0; ei < energies_size; ++ei) {
+			if (std::isfinite(M[ei])) {
+				z_fi += M[ei];
+				z_count += 1;
+			}
 		}
+		if (z_count > 0)
+			z_fi /= static_cast<double>(z_count);
+		for (size_t ei = 0; ei < energies_size; ++ei)
+			M[ei] -= z_fi;
+	} else {
+		VectorMath::NormalizeLog(&M[0], energies_size);
 	}
 
-	double z_fi = min_sum ? (std::accumulate(M.begin(), M.end(), 0.0)
-		/ static_cast<double>(M.size()))
-		: LogSumExp::Compute(M);
+	// Keep track of the maximum marginal change
+	double marg_max_diff = -std::numeric_limits<double>::infinity();
 	for (size_t ei = 0; ei < energies_size; ++ei) {
-		if (min_sum) {
-			M[ei] -= z_fi;
-		} else {
-			M[ei] = std::exp(M[ei] - z_fi);
-		}
-
-		// Keep track of the maximum marginal change
 		double diff_M = std::fabs(M[ei] - marginal[ei]);
 		if (diff_M > marg_max_diff)
 			marg_max_diff = diff_M;
@@ -4,6 +4,7 @@
 
 #include <vector>
 #include <string>
+#include <utility>
 
 #include <boost/serialization/serialization.hpp>
 
@@ -42,6 +43,10 @@ namespace Grante {
  */
 class FactorType {
 public:
+	// Sparse parameter gradient, (weight index, value) pairs.
+	typedef std::vector<std::pair<unsigned int, double> >
+		sparse_gradient_type;
+
 	// Create a new factor type.
 	//
 	// name: Textual description of the factor type.
@@ -102,6 +107,11 @@ public:
 	//    0 <= var_index < Cardinalities.size().
 	unsigned int LinearIndexToVariableState(size_t ei, size_t var_index) const;
 
+	// Distance between linear indices that differ only in the state of the
+	// given variable by one.  The linear index ei has state
+	// (ei / VariableStride(var_index)) % Cardinalities()[var_index].
+	size_t VariableStride(size_t var_index) const;
+
 	// Changes a single index dimension to another value.
 	//
 	// ei: The linear index to be changed.
@@ -140,6 +150,25 @@ public:
 		const std::vector<double>& marginals,
 		std::vector<double>& parameter_gradient, double mult = 1.0) const;
 
+	// Sparse backward map:
+	//    Same as BackwardMap, but the gradient from this factor is appended
+	//    to parameter_gradient as (weight index, value) pairs.  Indices may
+	//    repeat.  For the canonical maps and sparse factor data, the work is
+	//    proportional to the number of non-zero data elements times the
+	//    number of non-zero marginals.
+	//
+	// In case BackwardMap is overwritten, this method and ParameterSupport
+	// must be overwritten as well, possibly using DenseSparseBackwardMap and
+	// DenseParameterSupport.
+	virtual void SparseBackwardMap(const Factor* factor,
+		const std::vector<double>& marginals,
+		sparse_gradient_type& parameter_gradient, double mult = 1.0) const;
+
+	// Append to support the indices of all weights that the energies of the
+	// given factor depend on.  Indices may repeat.
+	virtual void ParameterSupport(const Factor* factor,
+		std::vector<unsigned int>& support) const;
+
 	// Compute factor-to-variable message vector of the form,
 	//    r_{m->n}(x_n) = log sum_{x_m \ n} exp(
 	//       -E(x_m) + sum_{n' \in N(m) \ n} q_{n'->m}(x_{n'}) )
@@ -248,6 +277,14 @@ protected:
 	// Initialize prod_card and prod_cumcard
 	void InitializeProdCard();
 
+	// Sparse backward map and parameter support for factor types whose
+	// parameters are not sparse: BackwardMap into a dense temporary, and all
+	// weight indices, respectively.
+	void DenseSparseBackwardMap(const Factor* factor,
+		const std::vector<double>& marginals,
+		sparse_gradient_type& parameter_gradient, double mult) const;
+	void DenseParameterSupport(std::vector<unsigned int>& support) const;
+
 	// canonical dense version
 	void ForwardMap(const std::vector<double>& factor_data,
 		std::vector<double>& energies) const;
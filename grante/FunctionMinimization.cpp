@@ -90,7 +90,8 @@ double FunctionMinimization::BarzilaiBorweinMinimize(
 		double alpha = grad_norm;	// Initialization heuristic
 		if (iter == 0) {
 			// First iteration: assert feasibility by line search
-			WolfeLineSearch linesearch(&prob, x, grad, grad, obj, 1e-4, 0.9);
+			WolfeLineSearch linesearch(&prob, x, grad, grad, 1e-4, 0.9);
+			linesearch.Reset(obj);
 			linesearch.ComputeStepLength(alpha);
 			alpha = 1.0 / alpha;
 		}
@@ -140,8 +141,24 @@ double FunctionMinimization::LimitedMemoryBFGSMinimize(
 	std::vector<double> xprev(dim);
 	std::vector<double> gradprev(dim);
 
-	// List of previous s,y,rho_i
-	lbfgs_mem_type lbfgs_mem;
+	// Ring buffer of the previous s_i, y_i, rho_i.  Slot k occupies
+	// mem_s[k*dim] to mem_s[(k+1)*dim-1], likewise for mem_y.  mem_head is
+	// the most recent of the mem_size entries, the entries precede it
+	// cyclically.  One slot more than lbfgs_m is kept such that a new pair
+	// can be computed in place before it is accepted.  The block is reserved
+	// once and grows with the number of entries, it is never reallocated.
+	unsigned int mem_cap = lbfgs_m + 1;
+	std::vector<double> mem_s;
+	std::vector<double> mem_y;
+	mem_s.reserve(static_cast<size_t>(mem_cap) * dim);
+	mem_y.reserve(static_cast<size_t>(mem_cap) * dim);
+	std::vector<double> mem_rho(mem_cap);
+	std::vector<double> mem_alpha(mem_cap);
+	unsigned int mem_head = 0;
+	unsigned int mem_size = 0;
+
+	// The line search refers to x, gradprev and grad and is reused
+	WolfeLineSearch linesearch(&prob, x, gradprev, grad, 1e-4, 0.9);
 
 	boost::timer total_timer;
 	double obj = std::numeric_limits<double>::signaling_NaN();
@@ -194,7 +211,7 @@ double FunctionMinimization::LimitedMemoryBFGSMinimize(
 			// LBFGS memory size
 			std::cout << std::setiosflags(std::ios::left)
 				<< std::setiosflags(std::ios::adjustfield)
-				<< std::setw(6) << lbfgs_mem.size() << "  ";
+				<< std::setw(6) << mem_size << "  ";
 			std::cout << std::setiosflags(std::ios::left)
 				<< std::setiosflags(std::ios::adjustfield)
 				<< std::setw(6) << ls_evals << "  ";
@@ -210,34 +227,36 @@ double FunctionMinimization::LimitedMemoryBFGSMinimize(
 
 		// Insert differential information into Hessian approximation
 		if (iter > 0 && is_restart == false) {
-			// xprev: s_k
-			std::transform(x.begin(), x.end(), xprev.begin(),
-				xprev.begin(), _1 - _2);
-			// gradprev: y_k
-			std::transform(grad.begin(), grad.end(), gradprev.begin(),
-				gradprev.begin(), _1 - _2);
+			// Candidate slot: the free slot following the most recent entry
+			unsigned int slot = (mem_size == 0) ? 0 : (mem_head + 1) % mem_cap;
+			if (mem_s.size() < static_cast<size_t>(slot + 1) * dim) {
+				mem_s.resize(static_cast<size_t>(slot + 1) * dim);
+				mem_y.resize(static_cast<size_t>(slot + 1) * dim);
+			}
+			double* s_k = &mem_s[static_cast<size_t>(slot) * dim];
+			double* y_k = &mem_y[static_cast<size_t>(slot) * dim];
+
+			// s_k = x - xprev, y_k = grad - gradprev
+			double ys_p = 0.0;
+			double yy_p = 0.0;
+			DifferenceProducts(&x[0], &xprev[0], &grad[0], &gradprev[0],
+				s_k, y_k, dim, ys_p, yy_p);
 
 			// Heuristically ensure stability by ignoring unstable updates.
 			// As to what entails 'unstable' there exist different opinions.
 			// TODO: replace with true damped-Newton update (in inverse H
 			// form used by L-BFGS)
-			double ys_p = std::inner_product(xprev.begin(), xprev.end(),
-				gradprev.begin(), 0.0);
-			double yy_p = std::inner_product(gradprev.begin(), gradprev.end(),
-				gradprev.begin(), 0.0);
 //			if (ys_p >= 1.0e-12) {
 			if (ys_p >= 1.0e-12*yy_p) {
 #if 0
 				std::cout << "    lbfgs update with ys_p " << ys_p
 					<< std::endl;
 #endif
-				double rho = 1.0 / ys_p;
-				lbfgs_mem.push_front(lbfgs_mem_type::value_type(
-					xprev, gradprev, rho));
-
-				// Remove old element from the lbfgs memory, if necessary
-				if (lbfgs_mem.size() > lbfgs_m)
-					lbfgs_mem.pop_back();
+				// Commit the slot, dropping the oldest entry if the memory
+				// is full
+				mem_rho[slot] = 1.0 / ys_p;
+				mem_head = slot;
+				mem_size = std::min(mem_size + 1, lbfgs_m);
 			} else {
 				std::cout << "    LBFGS update too large (ys "
 					<< ys_p << ", yy " << yy_p << ")" << std::endl;
@@ -247,42 +266,46 @@ double FunctionMinimization::LimitedMemoryBFGSMinimize(
 		std::copy(x.begin(), x.end(), xprev.begin());
 		std::copy(grad.begin(), grad.end(), gradprev.begin());
 
-		// Compute new ascent direction H_k \nabla_x f(x_k)
-		// Recent-to-oldest
-		std::list<double> alpha_list;
-		for (lbfgs_mem_type::const_iterator li = lbfgs_mem.begin();
-			li != lbfgs_mem.end(); ++li) {
-			// alpha_i = rho_i s_i' q
-			double alpha_i = li->get<2>() * std::inner_product(
-				grad.begin(), grad.end(), li->get<0>().begin(), 0.0);
-			// q <= q - alpha_i y_i
-			std::transform(grad.begin(), grad.end(), li->get<1>().begin(),
-				grad.begin(), _1 - alpha_i * _2);
-			alpha_list.push_back(alpha_i);
+		// Compute new ascent direction H_k \nabla_x f(x_k) by the two-loop
+		// recursion.  Each update of q is fused with the inner product of
+		// the next entry.
+		// Recent-to-oldest: alpha_i = rho_i s_i' q, q <- q - alpha_i y_i
+		double* q = &grad[0];
+		if (mem_size > 0) {
+			double sq = Dot(&mem_s[static_cast<size_t>(mem_head) * dim], q, dim);
+			for (unsigned int mi = 0; mi < mem_size; ++mi) {
+				unsigned int slot = (mem_head + mem_cap - mi) % mem_cap;
+				unsigned int slot_older = (slot + mem_cap - 1) % mem_cap;
+				mem_alpha[slot] = mem_rho[slot] * sq;
+				const double* s_older = (mi + 1 < mem_size) ?
+					&mem_s[static_cast<size_t>(slot_older) * dim] : 0;
+				sq = AxpyDot(-mem_alpha[slot],
+					&mem_y[static_cast<size_t>(slot) * dim], q, s_older, dim);
+			}
 		}
 		// Diagonal scaling: q = H^0 q
 		double gamma = 1.0;
-		if (iter > 0 && is_restart == false && lbfgs_mem.empty() == false) {
-			lbfgs_mem_type::const_iterator li_last = lbfgs_mem.begin();
-
+		if (iter > 0 && is_restart == false && mem_size > 0) {
 			// gamma = (s_{k-1}' y_{k-1}) / (y_{k-1}' y_{k-1})
-			gamma = std::inner_product(li_last->get<0>().begin(),
-				li_last->get<0>().end(), li_last->get<1>().begin(), 0.0);
-			gamma /= std::inner_product(li_last->get<1>().begin(),
-				li_last->get<1>().end(), li_last->get<1>().begin(), 0.0);
+			const double* y_last = &mem_y[static_cast<size_t>(mem_head) * dim];
+			gamma = 1.0 / (mem_rho[mem_head] * Dot(y_last, y_last, dim));
+		}
+		// Oldest-to-recent: beta = rho_i y_i' q, q <- q + (alpha_i-beta) s_i
+		const double* y_oldest = 0;
+		if (mem_size > 0) {
+			unsigned int slot_oldest =
+				(mem_head + mem_cap - (mem_size - 1)) % mem_cap;
+			y_oldest = &mem_y[static_cast<size_t>(slot_oldest) * dim];
 		}
-		std::transform(grad.begin(), grad.end(), grad.begin(), gamma * _1);
-		// Reverse: oldest-to-recent
-		std::list<double>::const_reverse_iterator ai = alpha_list.rbegin();
-		for (lbfgs_mem_type::const_reverse_iterator li = lbfgs_mem.rbegin();
-			li != lbfgs_mem.rend(); ++li, ++ai) {
-			// beta = rho_i y_i' q
-			double beta = li->get<2>() * std::inner_product(
-				grad.begin(), grad.end(), li->get<1>().begin(), 0.0);
-
-			// q <- q + (alpha_i-beta)*s_i
-			std::transform(grad.begin(), grad.end(), li->get<0>().begin(),
-				grad.begin(), _1 + (*ai-beta)*_2);
+		double yq = ScaleDot(gamma, q, y_oldest, dim);
+		for (unsigned int mi = mem_size; mi-- > 0; ) {
+			unsigned int slot = (mem_head + mem_cap - mi) % mem_cap;
+			unsigned int slot_newer = (slot + 1) % mem_cap;
+			double beta = mem_rho[slot] * yq;
+			const double* y_newer = (mi > 0) ?
+				&mem_y[static_cast<size_t>(slot_newer) * dim] : 0;
+			yq = AxpyDot(mem_alpha[slot] - beta,
+				&mem_s[static_cast<size_t>(slot) * dim], q, y_newer, dim);
 		}
 		// Now 'grad' contains an adjusted gradient direction
 		is_restart = false;
@@ -323,7 +346,7 @@ double FunctionMinimization::LimitedMemoryBFGSMinimize(
 		}
 
 		// Perform linesearch in descent direction
-		WolfeLineSearch linesearch(&prob, x, gradprev, grad, obj, 1e-4, 0.9);
+		linesearch.Reset(obj);
 		//SimpleLineSearch linesearch(&prob, x, gradprev, grad, obj);
 		double alpha = 1.0;
 		// Be very careful on the first step
@@ -597,33 +620,102 @@ bool FunctionMinimization::CheckDerivative(FunctionMinimizationProblem& prob,
 }
 
 double FunctionMinimization::EuclideanNorm(const std::vector<double>& vec) {
-	double rs = 0.0;
-	for (std::vector<double>::const_iterator vi = vec.begin();
-		vi != vec.end(); ++vi) {
-		rs += (*vi) * (*vi);
+	return (std::sqrt(Dot(&vec[0], &vec[0], vec.size())));
+}
+
+// The kernels are parallelized for large vectors only.  The reductions use
+// a static schedule, hence the results are deterministic for a given number
+// of threads.
+double FunctionMinimization::Dot(const double* x, const double* y,
+	size_t n) {
+	std::ptrdiff_t sn = static_cast<std::ptrdiff_t>(n);
+	double r = 0.0;
+	#pragma omp parallel for schedule(static) reduction(+:r) \
+		if(n >= parallel_threshold)
+	for (std::ptrdiff_t i = 0; i < sn; ++i)
+		r += x[i] * y[i];
+	return (r);
+}
+
+double FunctionMinimization::AxpyDot(double a, const double* x, double* y,
+	const double* z, size_t n) {
+	std::ptrdiff_t sn = static_cast<std::ptrdiff_t>(n);
+	double r = 0.0;
+	if (z == 0) {
+		#pragma omp parallel for schedule(static) if(n >= parallel_threshold)
+		for (std::ptrdiff_t i = 0; i < sn; ++i)
+			y[i] += a * x[i];
+	} else {
+		#pragma omp parallel for schedule(static) reduction(+:r) \
+			if(n >= parallel_threshold)
+		for (std::ptrdiff_t i = 0; i < sn; ++i) {
+			y[i] += a * x[i];
+			r += z[i] * y[i];
+		}
+	}
+	return (r);
+}
+
+double FunctionMinimization::ScaleDot(double a, double* x, const double* z,
+	size_t n) {
+	std::ptrdiff_t sn = static_cast<std::ptrdiff_t>(n);
+	double r = 0.0;
+	if (z == 0) {
+		#pragma omp parallel for schedule(static) if(n >= parallel_threshold)
+		for (std::ptrdiff_t i = 0; i < sn; ++i)
+			x[i] *= a;
+	} else {
+		#pragma omp parallel for schedule(static) reduction(+:r) \
+			if(n >= parallel_threshold)
+		for (std::ptrdiff_t i = 0; i < sn; ++i) {
+			x[i] *= a;
+			r += z[i] * x[i];
+		}
+	}
+	return (r);
+}
+
+void FunctionMinimization::DifferenceProducts(const double* x,
+	const double* xprev, const double* g, const double* gprev,
+	double* s, double* y, size_t n, double& ys, double& yy) {
+	std::ptrdiff_t sn = static_cast<std::ptrdiff_t>(n);
+	double r_ys = 0.0;
+	double r_yy = 0.0;
+	#pragma omp parallel for schedule(static) reduction(+:r_ys,r_yy) \
+		if(n >= parallel_threshold)
+	for (std::ptrdiff_t i = 0; i < sn; ++i) {
+		s[i] = x[i] - xprev[i];
+		y[i] = g[i] - gprev[i];
+		r_ys += y[i] * s[i];
+		r_yy += y[i] * y[i];
 	}
-	return (sqrt(rs));
+	ys = r_ys;
+	yy = r_yy;
 }
 
 // Wolfe line-search method, see [Nocedal&Wright], page 60.
 FunctionMinimization::WolfeLineSearch::WolfeLineSearch(
 	FunctionMinimizationProblem* prob, const std::vector<double>& x0,
 	const std::vector<double>& x0_grad,
-	const std::vector<double>& H_grad, double x0_fval,
-	double c1, double c2)
+	const std::vector<double>& H_grad, double c1, double c2)
 	: prob(prob), x0(x0), x0_grad(x0_grad), H_grad(H_grad),
-		x0_fval(x0_fval), x0_phi_grad(0),
-		evaluation_count(0),
+		x0_fval(std::numeric_limits<double>::signaling_NaN()),
+		x0_phi_grad(0), evaluation_count(0),
 		xalpha_val(std::numeric_limits<double>::signaling_NaN()),
 		c1(c1), c2(c2)
 {
 	assert(x0.size() > 0);
 	xalpha.resize(x0.size());
 	xalphagrad.resize(x0.size());
+}
+
+void FunctionMinimization::WolfeLineSearch::Reset(double x0_fval) {
+	this->x0_fval = x0_fval;
+	evaluation_count = 0;
+	xalpha_val = std::numeric_limits<double>::signaling_NaN();
 
 	// phi'(0) = - p' \nabla_x f(x_k)
-	x0_phi_grad = -std::inner_product(x0_grad.begin(), x0_grad.end(),
-		H_grad.begin(), 0.0);
+	x0_phi_grad = -Dot(&x0_grad[0], &H_grad[0], x0_grad.size());
 	assert(x0_phi_grad < 0.0);
 }
 
@@ -740,8 +832,10 @@ unsigned int FunctionMinimization::WolfeLineSearch::ComputeStepLengthUpdate(
 		Evaluate(alpha, d1, d2);
 	}
 	assert(xalpha_val == alpha);
-	x_out = xalpha;
-	grad_out = xalphagrad;
+	// The buffers are exchanged, x_out and grad_out may be x0 and H_grad
+	x_out.swap(xalpha);
+	grad_out.swap(xalphagrad);
+	xalpha_val = std::numeric_limits<double>::signaling_NaN();
 	fval_out = xalphaobj;
 
 	return (ecount);
@@ -751,6 +845,7 @@ unsigned int FunctionMinimization::WolfeLineSearch::ComputeStepLengthUpdate(
 void FunctionMinimization::WolfeLineSearch::Evaluate(
 	double alpha, double& phi_fval, double& phi_grad) {
 	// x(alpha) = x - alpha*p
+	assert(xalpha.size() == x0.size());
 	std::transform(x0.begin(), x0.end(), H_grad.begin(),
 		xalpha.begin(), _1 - alpha * _2);
 	std::fill(xalphagrad.begin(), xalphagrad.end(), 0.0);
@@ -763,8 +858,7 @@ void FunctionMinimization::WolfeLineSearch::Evaluate(
 	xalpha_val = alpha;	// save alpha
 
 	// Univariate derivative is projection onto ascent direction
-	phi_grad = -std::inner_product(xalphagrad.begin(), xalphagrad.end(),
-		H_grad.begin(), 0.0);
+	phi_grad = -Dot(&xalphagrad[0], &H_grad[0], xalphagrad.size());
 	evaluation_count += 1;
 #if 0
 	std::cout << "   phi(" << alpha << ") = " << phi_fval << ", grad "
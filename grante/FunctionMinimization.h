@@ -3,9 +3,7 @@
 #define GRANTE_FUNCTIONMINIMIZATION_H
 
 #include <vector>
-#include <list>
-
-#include <boost/tuple/tuple.hpp>
+#include <cstddef>
 
 #include "FunctionMinimizationProblem.h"
 
@@ -85,19 +83,33 @@ public:
 		double dim_eps = 1e-8, double grad_tol = 1e-5);
 
 private:
-	// list of (s_k, y_k, rho_k)
-	typedef std::list<boost::tuple<std::vector<double>, std::vector<double>, double> >
-		lbfgs_mem_type;
-
 	static double EuclideanNorm(const std::vector<double>& vec);
 
+	// Vector kernels of L-BFGS, multi-threaded for n >= parallel_threshold.
+	//
+	// Return x'y
+	static double Dot(const double* x, const double* y, size_t n);
+	// y <- y + a*x, return z'y (zero if z is null)
+	static double AxpyDot(double a, const double* x, double* y,
+		const double* z, size_t n);
+	// x <- a*x, return z'x (zero if z is null)
+	static double ScaleDot(double a, double* x, const double* z, size_t n);
+	// s = x - xprev, y = g - gprev, ys = y's, yy = y'y
+	static void DifferenceProducts(const double* x, const double* xprev,
+		const double* g, const double* gprev, double* s, double* y,
+		size_t n, double& ys, double& yy);
+	static const size_t parallel_threshold = 65536;
+
 	class WolfeLineSearch {
 	public:
-		// TODO doc
+		// The line search refers to the following vectors, which must
+		// remain valid.  Their contents may change between line searches,
+		// such that one object and its buffers can be reused for all
+		// iterations.
+		//
 		// x0: Current iterate x_k,
 		// x0_grad: \nabla_x f(x_k),
 		// H_grad: H \nabla_x f(x_k), ascent direction
-		// x0_fval: f(x_k)
 		//
 		// c1: constant related to Armijo condition (larger: stricter)
 		// c2: constant related to curvature condition (lower: stricter),
@@ -105,21 +117,26 @@ private:
 		WolfeLineSearch(FunctionMinimizationProblem* prob,
 			const std::vector<double>& x0,
 			const std::vector<double>& x0_grad,
-			const std::vector<double>& H_grad, double x0_fval,
+			const std::vector<double>& H_grad,
 			double c1 = 1.0e-4, double c2 = 0.9);
 
+		// Start a new line search at the current x0, x0_grad and H_grad,
+		// x0_fval: f(x_k).
+		void Reset(double x0_fval);
+
 		// The initial stepsize tried must be given in alpha.
 		// Returns the number of evaluations and alpha in its argument.
 		unsigned int ComputeStepLength(double& alpha);
+		// x_out and grad_out may be the vectors x0 and H_grad refer to.
 		unsigned int ComputeStepLengthUpdate(
 			std::vector<double>& x_out, std::vector<double>& grad_out,
 			double& fval_out, double& alpha_out);
 
 	private:
 		FunctionMinimizationProblem* prob;
-		const std::vector<double> x0;
-		const std::vector<double> x0_grad;
-		const std::vector<double> H_grad;
+		const std::vector<double>& x0;
+		const std::vector<double>& x0_grad;
+		const std::vector<double>& H_grad;
 		double x0_fval;
 		double x0_phi_grad;
 
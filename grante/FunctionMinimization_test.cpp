@@ -0,0 +1,81 @@
+
+#include "grante/FunctionMinimization.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "grante/FunctionMinimizationProblem.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Ill-conditioned quadratic 0.5 x'Ax - b'x with tridiagonal A, diagonal
+// 1+i and off-diagonal 0.5, and minimizer x_opt[i] = sin(i).
+class TridiagonalQuadratic : public Grante::FunctionMinimizationProblem {
+public:
+    explicit TridiagonalQuadratic(unsigned int dim)
+        : dim(dim), eval_count(0), x_opt(dim), b(dim) {
+        for (unsigned int i = 0; i < dim; ++i)
+            x_opt[i] = std::sin(static_cast<double>(i));
+        Multiply(x_opt, b);
+    }
+
+    virtual double Eval(const std::vector<double>& x,
+        std::vector<double>& grad) {
+        eval_count += 1;
+        Multiply(x, grad);
+        double obj = 0.0;
+        for (unsigned int i = 0; i < dim; ++i) {
+            obj += 0.5 * x[i] * grad[i] - b[i] * x[i];
+            grad[i] -= b[i];
+        }
+        return (obj);
+    }
+    virtual unsigned int Dimensions() const {
+        return (dim);
+    }
+    virtual void ProvideStartingPoint(std::vector<double>& x0) const {
+        std::fill(x0.begin(), x0.end(), 0.0);
+    }
+
+    unsigned int dim;
+    unsigned int eval_count;
+    std::vector<double> x_opt;
+
+private:
+    std::vector<double> b;
+
+    void Multiply(const std::vector<double>& x, std::vector<double>& y) const {
+        for (unsigned int i = 0; i < dim; ++i) {
+            y[i] = (1.0 + i) * x[i];
+            if (i > 0)
+                y[i] += 0.5 * x[i-1];
+            if (i + 1 < dim)
+                y[i] += 0.5 * x[i+1];
+        }
+    }
+};
+
+}
+
+TEST(FunctionMinimization, LimitedMemoryBFGSMemoryWraps) {
+    // A memory of three entries wraps around after four iterations
+    TridiagonalQuadratic prob(40);
+    std::vector<double> x;
+    Grante::FunctionMinimization::LimitedMemoryBFGSMinimize(prob, x,
+        1.0e-4, 1000, false, 3);
+
+    EXPECT_GT(prob.eval_count, 12u);
+    ASSERT_EQ(prob.dim, x.size());
+    std::vector<double> grad(prob.dim);
+    prob.Eval(x, grad);
+    double grad_norm = 0.0;
+    for (unsigned int i = 0; i < prob.dim; ++i)
+        grad_norm += grad[i] * grad[i];
+    EXPECT_LT(std::sqrt(grad_norm), 1.0e-4);
+    for (unsigned int i = 0; i < prob.dim; ++i)
+        EXPECT_THAT(x[i], testing::DoubleNear(prob.x_opt[i], 1.0e-3));
+}
+
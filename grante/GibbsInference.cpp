@@ -65,6 +65,12 @@ void GibbsInference::PerformBurninPhase() {
 	//     ii) annealing run for burnin_sweeps/2 sweeps,
 	//    iii) burnin_sweeps/2 regular Gibbs sweeps.
 	gibbs.SetStateUniformRandom();
+	if (evidence.empty()) {
+		// Release the variables fixed by earlier evidence
+		gibbs.SetFixedVariableIndices();
+	} else {
+		gibbs.SetFixedVariableStates(evidence);
+	}
 	if (burnin_sweeps > 0) {
 		unsigned int burnin_anneal = burnin_sweeps / 2;
 		if (burnin_anneal > 1) {
@@ -125,5 +131,9 @@ double GibbsInference::MinimizeEnergy(std::vector<unsigned int>& state) {
 	return (std::numeric_limits<double>::signaling_NaN());
 }
 
+bool GibbsInference::SupportsEvidence() const {
+	return (true);
+}
+
 }
 
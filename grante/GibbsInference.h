@@ -46,6 +46,9 @@ public:
 	// NOT IMPLEMENTED
 	virtual double MinimizeEnergy(std::vector<unsigned int>& state);
 
+	// Observed variables are fixed in the sampler
+	virtual bool SupportsEvidence() const;
+
 private:
 	// Inference result: estimated marginal distributions for all factors
 	std::vector<std::vector<double> > marginals;
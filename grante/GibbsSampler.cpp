@@ -1,5 +1,6 @@
 
 #include <algorithm>
+#include <limits>
 #include <cmath>
 #include <cassert>
 
@@ -13,11 +14,15 @@ GibbsSampler::GibbsSampler(const FactorGraph* fg)
 		randu(rgen, rdestu), fgu(fg), inv_temperature(1.0),
 		rgen_vc(RandomSource::GetGlobalRandomSeed()),
 		dest_vc(0, static_cast<boost::uint32_t>(fg->Cardinalities().size()-1)),
-		rand_vc(rgen_vc, dest_vc)
+		rand_vc(rgen_vc, dest_vc),
+		binary_mode(BinaryPackedModel::IsBinaryPairwise(fg))
 {
 	// Initialize state
 	state.resize(fg->Cardinalities().size());
 	std::fill(state.begin(), state.end(), 0);
+
+	if (binary_mode)
+		binary = BinaryPackedModel(fg);
 }
 
 void GibbsSampler::Sweep(unsigned int sweep_count) {
@@ -43,6 +48,10 @@ void GibbsSampler::Sweep(unsigned int sweep_count) {
 		}
 		return;
 	}
+	if (binary_mode) {
+		SweepBinary(sweep_count);
+		return;
+	}
 
 	// Order variables randomly
 	std::vector<unsigned int> vec(var_count);
@@ -50,7 +59,7 @@ void GibbsSampler::Sweep(unsigned int sweep_count) {
 		vec[vi] = vi;
 
 	for (unsigned int sweep = 0; sweep < sweep_count; ++sweep) {
-		RandomSource::ShuffleRandom(vec);
+		RandomSource::ShuffleRandom(vec, rand_vc.engine());
 		for (unsigned int cvi = 0; cvi < var_count; ++cvi) {
 			unsigned int vi = vec[cvi];
 			assert(vi < var_count);
@@ -66,6 +75,32 @@ void GibbsSampler::Sweep(unsigned int sweep_count) {
 	}
 }
 
+void GibbsSampler::SweepBinary(unsigned int sweep_count) {
+	binary.UpdateEnergies(fg);
+	BinaryPackedModel::Pack(state, packed_state);
+
+	unsigned int var_count = static_cast<unsigned int>(state.size());
+	std::vector<unsigned int> vec(var_count);
+	for (unsigned int vi = 0; vi < var_count; ++vi)
+		vec[vi] = vi;
+
+	for (unsigned int sweep = 0; sweep < sweep_count; ++sweep) {
+		RandomSource::ShuffleRandom(vec, rand_vc.engine());
+		for (unsigned int cvi = 0; cvi < var_count; ++cvi) {
+			unsigned int vi = vec[cvi];
+			if (fixed_variables.empty() == false &&
+				fixed_variables.count(vi) > 0)
+				continue;
+
+			// p(y_i=1) = 1 / (1 + exp(beta (E(y_i=1) - E(y_i=0))))
+			double field = binary.LocalField(packed_state, vi);
+			double p1 = 1.0 / (1.0 + std::exp(inv_temperature * field));
+			BinaryPackedModel::SetBit(packed_state, vi, randu() < p1 ? 1 : 0);
+		}
+	}
+	BinaryPackedModel::Unpack(packed_state, state);
+}
+
 const std::vector<unsigned int>& GibbsSampler::State() const {
 	return (state);
 }
@@ -97,6 +132,22 @@ void GibbsSampler::SetFixedVariableIndices(
 	fixed_variables.insert(var_indices.begin(), var_indices.end());
 }
 
+void GibbsSampler::SetFixedVariableStates(
+	const std::vector<unsigned int>& evidence) {
+	if (evidence.empty())
+		return;
+
+	assert(evidence.size() == state.size());
+	fixed_variables.clear();
+	for (unsigned int vi = 0; vi < evidence.size(); ++vi) {
+		if (evidence[vi] == std::numeric_limits<unsigned int>::max())
+			continue;
+
+		state[vi] = evidence[vi];
+		fixed_variables.insert(vi);
+	}
+}
+
 void GibbsSampler::SetInverseTemperature(double inv_temperature) {
 	this->inv_temperature = inv_temperature;
 }
@@ -105,6 +156,12 @@ double GibbsSampler::InverseTemperature(void) const {
 	return (inv_temperature);
 }
 
+void GibbsSampler::SetRandomSeed(boost::uint32_t seed) {
+	// The variate generators hold their own copy of the engines
+	randu.engine().seed(seed);
+	rand_vc.engine().seed(seed ^ 0x9e3779b9u);
+}
+
 unsigned int GibbsSampler::SampleSite(unsigned int var_index) const {
 	unsigned int var_card = fg->Cardinalities()[var_index];
 	std::vector<double> cond_dist_unnorm(var_card);
@@ -9,11 +9,17 @@
 
 #include "FactorGraph.h"
 #include "FactorGraphUtility.h"
+#include "BinaryPackedModel.h"
 
 namespace Grante {
 
 /* A simple Gibbs sampler doing fixed-order sweeps on general factor graphs.
  * Used for debugging other algorithms.
+ *
+ * If all variables are binary and all factors are unary or pairwise, the
+ * sweeps run on a bit-packed state using the reparametrized local fields of
+ * BinaryPackedModel.  The factor energies are re-read at the start of each
+ * call to Sweep.
  */
 class GibbsSampler {
 public:
@@ -48,12 +54,24 @@ public:
 	// Fixing applies only to the Sweep method.
 	void SetFixedVariableIndices();
 	void SetFixedVariableIndices(const std::vector<unsigned int>& var_indices);
+	// Set the observed variables to their observed states and fix them,
+	// releasing all other variables.  evidence is given per variable as
+	// returned by InferenceMethod::Evidence().  An empty vector leaves the
+	// fixed variables unchanged, such that variables fixed by
+	// SetFixedVariableIndices remain fixed.
+	void SetFixedVariableStates(const std::vector<unsigned int>& evidence);
 
 	// Set temperature: 1.0 is the original distribution, 0.0 the uniform
 	// distribution.
 	void SetInverseTemperature(double inv_temperature);
 	double InverseTemperature(void) const;
 
+	// Reseed all random number generators of the sampler.  Two samplers on
+	// the same factor graph with the same seed and state produce the same
+	// sequence of states, independent of any other sampler; this allows
+	// reproducible per-chain random streams in multi-threaded code.
+	void SetRandomSeed(boost::uint32_t seed);
+
 private:
 	const FactorGraph* fg;
 	bool metropolized;
@@ -78,7 +96,13 @@ private:
 	boost::variate_generator<boost::mt19937,
 		boost::uniform_int<boost::uint32_t> > rand_vc;
 
+	// Specialized sweeps for binary pairwise models
+	bool binary_mode;
+	BinaryPackedModel binary;
+	std::vector<BinaryPackedModel::word_type> packed_state;
+
 	unsigned int SampleSiteUniform(unsigned int var_index) const;
+	void SweepBinary(unsigned int sweep_count);
 };
 
 }
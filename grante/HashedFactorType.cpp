@@ -0,0 +1,143 @@
+
+#include <algorithm>
+#include <cassert>
+
+#include "HashedFactorType.h"
+#include "Factor.h"
+
+namespace Grante {
+
+HashedFactorType::HashedFactorType(const std::string& name,
+	const std::vector<unsigned int>& card,
+	unsigned int table_size, unsigned int seed)
+	: FactorType(name, card, 0), table_size(table_size), seed(seed) {
+	assert(table_size >= 1);
+	w.resize(table_size);
+	std::fill(w.begin(), w.end(), 0.0);
+}
+
+HashedFactorType::~HashedFactorType() {
+}
+
+bool HashedFactorType::IsDataDependent() const {
+	return (true);
+}
+
+void HashedFactorType::ForwardMap(const Factor* factor,
+	std::vector<double>& energies) const {
+	assert(energies.size() == prod_card);
+	assert(w.size() == table_size);
+	std::fill(energies.begin(), energies.end(), 0.0);
+
+	const std::vector<double>& H = factor->Data();
+	const std::vector<unsigned int>& H_index = factor->DataSparseIndex();
+	assert(H_index.empty() || H_index.size() == H.size());
+	for (unsigned int n = 0; n < H.size(); ++n) {
+		if (H[n] == 0.0)
+			continue;
+
+		boost::uint64_t fhash = FeatureHash(H_index.empty() ? n : H_index[n]);
+		for (unsigned int ei = 0; ei < prod_card; ++ei) {
+			double sign;
+			unsigned int wi = HashedIndex(fhash, ei, sign);
+			energies[ei] += sign * H[n] * w[wi];
+		}
+	}
+}
+
+void HashedFactorType::BackwardMap(const Factor* factor,
+	const std::vector<double>& marginals,
+	std::vector<double>& parameter_gradient, double mult) const {
+	assert(marginals.size() == prod_card);
+	assert(parameter_gradient.size() == table_size);
+
+	const std::vector<double>& H = factor->Data();
+	const std::vector<unsigned int>& H_index = factor->DataSparseIndex();
+	for (unsigned int n = 0; n < H.size(); ++n) {
+		if (H[n] == 0.0)
+			continue;
+
+		boost::uint64_t fhash = FeatureHash(H_index.empty() ? n : H_index[n]);
+		for (unsigned int ei = 0; ei < prod_card; ++ei) {
+			if (marginals[ei] == 0.0)
+				continue;
+
+			double sign;
+			unsigned int wi = HashedIndex(fhash, ei, sign);
+			parameter_gradient[wi] += mult * sign * H[n] * marginals[ei];
+		}
+	}
+}
+
+void HashedFactorType::SparseBackwardMap(const Factor* factor,
+	const std::vector<double>& marginals,
+	sparse_gradient_type& parameter_gradient, double mult) const {
+	assert(marginals.size() == prod_card);
+
+	const std::vector<double>& H = factor->Data();
+	const std::vector<unsigned int>& H_index = factor->DataSparseIndex();
+	for (unsigned int n = 0; n < H.size(); ++n) {
+		if (H[n] == 0.0)
+			continue;
+
+		boost::uint64_t fhash = FeatureHash(H_index.empty() ? n : H_index[n]);
+		for (unsigned int ei = 0; ei < prod_card; ++ei) {
+			if (marginals[ei] == 0.0)
+				continue;
+
+			double sign;
+			unsigned int wi = HashedIndex(fhash, ei, sign);
+			parameter_gradient.push_back(std::make_pair(wi,
+				mult * sign * H[n] * marginals[ei]));
+		}
+	}
+}
+
+void HashedFactorType::ParameterSupport(const Factor* factor,
+	std::vector<unsigned int>& support) const {
+	const std::vector<double>& H = factor->Data();
+	const std::vector<unsigned int>& H_index = factor->DataSparseIndex();
+	for (unsigned int n = 0; n < H.size(); ++n) {
+		if (H[n] == 0.0)
+			continue;
+
+		boost::uint64_t fhash = FeatureHash(H_index.empty() ? n : H_index[n]);
+		for (unsigned int ei = 0; ei < prod_card; ++ei) {
+			double sign;
+			support.push_back(HashedIndex(fhash, ei, sign));
+		}
+	}
+}
+
+unsigned int HashedFactorType::FeatureIndex(boost::uint64_t feature_id) {
+	boost::uint64_t h = Mix(feature_id);
+	return (static_cast<unsigned int>(h ^ (h >> 32)));
+}
+
+boost::uint64_t HashedFactorType::FeatureHash(unsigned int feature) const {
+	return (Mix(static_cast<boost::uint64_t>(feature) +
+		seed * 0x9e3779b97f4a7c15ULL));
+}
+
+unsigned int HashedFactorType::HashedIndex(boost::uint64_t feature_hash,
+	unsigned int ei, double& sign) const {
+	boost::uint64_t h = Mix(feature_hash ^
+		((static_cast<boost::uint64_t>(ei) + 1) * 0xc2b2ae3d27d4eb4fULL));
+
+	// Lowest bit is the sign, the remaining bits the index
+	sign = (h & 1) ? -1.0 : 1.0;
+	return (static_cast<unsigned int>((h >> 1) % table_size));
+}
+
+boost::uint64_t HashedFactorType::Mix(boost::uint64_t key) {
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	key *= 0xc4ceb9fe1a85ec53ULL;
+	key ^= key >> 33;
+
+	return (key);
+}
+
+}
+
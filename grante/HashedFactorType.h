@@ -0,0 +1,86 @@
+
+#ifndef GRANTE_HASHEDFACTORTYPE_H
+#define GRANTE_HASHEDFACTORTYPE_H
+
+#include <vector>
+#include <string>
+
+#include <boost/cstdint.hpp>
+
+#include "FactorType.h"
+
+namespace Grante {
+
+/* Linear factor type using the hashing trick for very large sparse input
+ * spaces.  Instead of one weight per (data element, energy table entry)
+ * pair, each pair is hashed into a weight table of fixed size,
+ *
+ *    E(y) = sum_f H(f) s(f,y) w[h(f,y)],
+ *
+ * where f ranges over the non-zero data elements of the factor, h(f,y) is a
+ * hash in {0,...,table_size-1} and s(f,y) in {-1,1} is a second, independent
+ * hash.  The random sign makes collisions cancel in expectation, see
+ *
+ * [Weinberger2009] Kilian Weinberger, Anirban Dasgupta, John Langford, Alex
+ *    Smola, Josh Attenberg, "Feature Hashing for Large Scale Multitask
+ *    Learning", ICML 2009.
+ *
+ * The factor data is normally sparse, where the sparse index of a data
+ * element is its feature id.  There is no fixed data size; dense factor
+ * data is treated as sparse data with feature ids 0,1,....  The work of all
+ * maps is proportional to the number of non-zero data elements times the
+ * size of the energy table, and the sparse backward map touches only the
+ * hashed weights.
+ */
+class HashedFactorType : public FactorType {
+public:
+	// name, card: As for FactorType,
+	// table_size: The number of weights, >=1,
+	// seed: Seed of the hash functions.  Factor types with different seeds
+	//    have different collisions.
+	//
+	// The weights are initialized to zero.
+	HashedFactorType(const std::string& name,
+		const std::vector<unsigned int>& card,
+		unsigned int table_size, unsigned int seed = 0);
+
+	virtual ~HashedFactorType();
+
+	virtual bool IsDataDependent() const;
+
+	virtual void ForwardMap(const Factor* factor,
+		std::vector<double>& energies) const;
+
+	virtual void BackwardMap(const Factor* factor,
+		const std::vector<double>& marginals,
+		std::vector<double>& parameter_gradient, double mult = 1.0) const;
+	virtual void SparseBackwardMap(const Factor* factor,
+		const std::vector<double>& marginals,
+		sparse_gradient_type& parameter_gradient, double mult = 1.0) const;
+	virtual void ParameterSupport(const Factor* factor,
+		std::vector<unsigned int>& support) const;
+
+	// Fold a 64-bit feature id into a sparse factor data index.  Factor data
+	// indices have 32 bits, so distinct ids may collide, but much less often
+	// than they collide in the weight table.
+	static unsigned int FeatureIndex(boost::uint64_t feature_id);
+
+private:
+	unsigned int table_size;
+	boost::uint64_t seed;
+
+	// Seeded hash of feature f, computed once per data element
+	boost::uint64_t FeatureHash(unsigned int feature) const;
+	// Return the weight index h(f,ei) for the feature hash of f and energy
+	// table entry ei, and set sign to s(f,ei).
+	unsigned int HashedIndex(boost::uint64_t feature_hash, unsigned int ei,
+		double& sign) const;
+
+	// 64-bit finalizer of MurmurHash3
+	static boost::uint64_t Mix(boost::uint64_t key);
+};
+
+}
+
+#endif
+
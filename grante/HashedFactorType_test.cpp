@@ -0,0 +1,106 @@
+
+#include "grante/HashedFactorType.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "grante/Factor.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Check that the gradient maps are the adjoint of the linear forward map:
+// for every weight index wi, the energies of the unit weight vector e_wi
+// paired with the marginals give the parameter gradient entry wi.
+void ExpectForwardBackwardConsistent(Grante::HashedFactorType* ft,
+    const Grante::Factor& factor, const std::vector<double>& marginals) {
+    unsigned int table_size = static_cast<unsigned int>(ft->Weights().size());
+    std::vector<double> grad(table_size, 0.0);
+    ft->BackwardMap(&factor, marginals, grad, 2.0);
+
+    // Sparse gradient agrees with the dense gradient
+    Grante::FactorType::sparse_gradient_type sgrad;
+    ft->SparseBackwardMap(&factor, marginals, sgrad, 2.0);
+    std::vector<double> sgrad_dense(table_size, 0.0);
+    for (unsigned int gi = 0; gi < sgrad.size(); ++gi) {
+        ASSERT_LT(sgrad[gi].first, table_size);
+        sgrad_dense[sgrad[gi].first] += sgrad[gi].second;
+    }
+
+    std::vector<unsigned int> support;
+    ft->ParameterSupport(&factor, support);
+    std::vector<double> energies(ft->ProdCardinalities());
+    for (unsigned int wi = 0; wi < table_size; ++wi) {
+        std::fill(ft->Weights().begin(), ft->Weights().end(), 0.0);
+        ft->Weights()[wi] = 1.0;
+        ft->ForwardMap(&factor, energies);
+        double dE = 0.0;
+        for (unsigned int ei = 0; ei < energies.size(); ++ei)
+            dE += marginals[ei] * energies[ei];
+
+        EXPECT_THAT(grad[wi], testing::DoubleNear(2.0 * dE, 1.0e-12));
+        EXPECT_THAT(sgrad_dense[wi], testing::DoubleNear(grad[wi], 1.0e-12));
+
+        // Weights outside the support do not change the energies
+        if (std::find(support.begin(), support.end(), wi) == support.end()) {
+            for (unsigned int ei = 0; ei < energies.size(); ++ei)
+                EXPECT_EQ(0.0, energies[ei]);
+        }
+    }
+}
+
+}
+
+TEST(HashedFactorType, ForwardMapMatchesGradient) {
+    std::vector<unsigned int> card;
+    card.push_back(3);
+    card.push_back(2);
+    // A small table forces collisions between the hashed weights
+    Grante::HashedFactorType ft("hashed", card, 7, 3);
+    ASSERT_EQ(7, ft.Weights().size());
+
+    std::default_random_engine e1(13);
+    std::normal_distribution<double> randn(0.0, 1.0);
+    std::vector<double> marginals(ft.ProdCardinalities());
+    for (unsigned int ei = 0; ei < marginals.size(); ++ei)
+        marginals[ei] = randn(e1);
+
+    std::vector<unsigned int> var_index;
+    var_index.push_back(0);
+    var_index.push_back(1);
+
+    // Sparse data with large feature ids and an explicit zero element
+    std::vector<double> data_elem;
+    std::vector<unsigned int> data_idx;
+    for (unsigned int fi = 0; fi < 5; ++fi) {
+        data_elem.push_back(fi == 2 ? 0.0 : randn(e1));
+        data_idx.push_back(Grante::HashedFactorType::FeatureIndex(
+            1000003ULL * (fi + 1)));
+    }
+    Grante::Factor factor_sparse(&ft, var_index, data_elem, data_idx);
+    ExpectForwardBackwardConsistent(&ft, factor_sparse, marginals);
+
+    // Dense data, where the feature ids are the data indices
+    std::vector<double> data(4);
+    for (unsigned int di = 0; di < data.size(); ++di)
+        data[di] = randn(e1);
+    Grante::Factor factor_dense(&ft, var_index, data);
+    ExpectForwardBackwardConsistent(&ft, factor_dense, marginals);
+
+    // The energies are linear in the weights
+    for (unsigned int wi = 0; wi < ft.Weights().size(); ++wi)
+        ft.Weights()[wi] = randn(e1);
+    std::vector<double> energies(ft.ProdCardinalities());
+    ft.ForwardMap(&factor_dense, energies);
+    std::vector<double> grad(ft.Weights().size(), 0.0);
+    ft.BackwardMap(&factor_dense, marginals, grad);
+    double muE = 0.0;
+    for (unsigned int ei = 0; ei < energies.size(); ++ei)
+        muE += marginals[ei] * energies[ei];
+    double gw = 0.0;
+    for (unsigned int wi = 0; wi < grad.size(); ++wi)
+        gw += grad[wi] * ft.Weights()[wi];
+    EXPECT_THAT(gw, testing::DoubleNear(muE, 1.0e-12));
+}
@@ -1,4 +1,7 @@
 
+#include <vector>
+#include <algorithm>
+#include <limits>
 #include <cassert>
 
 #include "InferenceMethod.h"
@@ -6,7 +9,7 @@
 namespace Grante {
 
 InferenceMethod::InferenceMethod(const FactorGraph* fg)
-	: fg(fg) {
+	: fg(fg), unary_overlay(0), warm_start(false) {
 }
 
 InferenceMethod::~InferenceMethod() {
@@ -14,7 +17,129 @@ InferenceMethod::~InferenceMethod() {
 
 double InferenceMethod::Entropy() const {
 	assert(Marginals().size() == fg->Factors().size());
-	return (LogPartitionFunction() + fg->EvaluateEnergy(Marginals()));
+	return (LogPartitionFunction() + fg->EvaluateEnergy(Marginals()) +
+		EvaluateOverlayEnergy(Marginals()));
+}
+
+bool InferenceMethod::SupportsUnaryOverlay() const {
+	return (false);
+}
+
+void InferenceMethod::SetUnaryOverlay(
+	const std::vector<std::vector<double> >* overlay) {
+	assert(overlay == 0 || SupportsUnaryOverlay());
+#ifndef NDEBUG
+	if (overlay != 0) {
+		const std::vector<unsigned int>& card = fg->Cardinalities();
+		assert(overlay->size() == card.size());
+		for (size_t vi = 0; vi < card.size(); ++vi)
+			assert((*overlay)[vi].size() == card[vi]);
+	}
+#endif
+	unary_overlay = overlay;
+}
+
+const std::vector<std::vector<double> >*
+InferenceMethod::UnaryOverlay() const {
+	return (unary_overlay);
+}
+
+bool InferenceMethod::SupportsWarmStart() const {
+	return (false);
+}
+
+void InferenceMethod::SetWarmStart(bool warm_start) {
+	assert(warm_start == false || SupportsWarmStart());
+	this->warm_start = warm_start;
+}
+
+bool InferenceMethod::WarmStart() const {
+	return (warm_start);
+}
+
+bool InferenceMethod::SupportsEvidence() const {
+	return (false);
+}
+
+void InferenceMethod::SetEvidence(const std::vector<unsigned int>& var_index,
+	const std::vector<unsigned int>& state) {
+	assert(SupportsEvidence());
+	assert(var_index.size() == state.size());
+	const std::vector<unsigned int>& card = fg->Cardinalities();
+
+	// The buffer keeps its capacity, so repeated queries do not allocate
+	evidence.assign(card.size(), std::numeric_limits<unsigned int>::max());
+	for (size_t oi = 0; oi < var_index.size(); ++oi) {
+		assert(var_index[oi] < card.size());
+		assert(state[oi] < card[var_index[oi]]);
+		evidence[var_index[oi]] = state[oi];
+	}
+}
+
+void InferenceMethod::ClearEvidence() {
+	evidence.clear();
+}
+
+const std::vector<unsigned int>& InferenceMethod::Evidence() const {
+	return (evidence);
+}
+
+bool InferenceMethod::IsObserved(unsigned int vi) const {
+	return (evidence.empty() == false &&
+		evidence[vi] != std::numeric_limits<unsigned int>::max());
+}
+
+void InferenceMethod::ClampLogTable(unsigned int vi,
+	std::vector<double>& log_table) const {
+	if (IsObserved(vi) == false)
+		return;
+
+	assert(evidence[vi] < log_table.size());
+	double observed = log_table[evidence[vi]];
+	std::fill(log_table.begin(), log_table.end(),
+		-std::numeric_limits<double>::infinity());
+	log_table[evidence[vi]] = observed;
+}
+
+double InferenceMethod::EvaluateOverlayEnergy(
+	const std::vector<unsigned int>& state) const {
+	if (unary_overlay == 0)
+		return (0.0);
+
+	assert(state.size() == unary_overlay->size());
+	double energy = 0.0;
+	for (size_t vi = 0; vi < state.size(); ++vi)
+		energy += (*unary_overlay)[vi][state[vi]];
+	return (energy);
+}
+
+double InferenceMethod::EvaluateOverlayEnergy(
+	const std::vector<std::vector<double> >& marginals) const {
+	if (unary_overlay == 0)
+		return (0.0);
+
+	// Take the variable marginal from the first factor containing the
+	// variable
+	const std::vector<Factor*>& factors = fg->Factors();
+	assert(marginals.size() == factors.size());
+	std::vector<int> var_is_done(unary_overlay->size(), 0);
+	double energy = 0.0;
+	for (size_t fi = 0; fi < factors.size(); ++fi) {
+		const std::vector<unsigned int>& fac_vars = factors[fi]->Variables();
+		for (size_t fvi = 0; fvi < fac_vars.size(); ++fvi) {
+			unsigned int vi = fac_vars[fvi];
+			if (var_is_done[vi] != 0)
+				continue;
+
+			const std::vector<double>& ov = (*unary_overlay)[vi];
+			for (size_t ei = 0; ei < marginals[fi].size(); ++ei) {
+				energy += marginals[fi][ei] *
+					ov[factors[fi]->ComputeVariableState(ei, fvi)];
+			}
+			var_is_done[vi] = 1;
+		}
+	}
+	return (energy);
 }
 
 }
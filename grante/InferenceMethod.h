@@ -68,8 +68,74 @@ public:
 	// PerformInference() must have been called prior to calling this method.
 	virtual double Entropy() const;
 
+	// Unary energy overlay: overlay[vi][si] is added to the energy of every
+	// state with y_vi = si, in addition to the factor energies.  The factor
+	// graph remains unchanged, hence its energies can be reused, e.g. for
+	// loss-augmented inference.  The overlay applies to all following
+	// inference calls until it is removed by setting a null pointer.  The
+	// object does not take ownership and the overlay must remain valid while
+	// it is set.
+	//
+	// Only methods for which SupportsUnaryOverlay() returns true accept an
+	// overlay; for all others the overlay must be added to the factor
+	// energies.
+	virtual bool SupportsUnaryOverlay() const;
+	void SetUnaryOverlay(const std::vector<std::vector<double> >* overlay);
+	const std::vector<std::vector<double> >* UnaryOverlay() const;
+
+	// Warm start: if enabled, each inference call starts from the internal
+	// state (eg. messages) left by the previous call instead of the default
+	// initialization.  This is useful if the factor energies change only a
+	// little between calls, as in the iterations of a learning method.  Exact
+	// methods are unaffected; approximate methods may converge to a
+	// different solution.  Disabled by default.
+	//
+	// Only methods for which SupportsWarmStart() returns true can be warm
+	// started.
+	virtual bool SupportsWarmStart() const;
+	void SetWarmStart(bool warm_start);
+	bool WarmStart() const;
+
+	// Evidence: clamp the variables var_index[i] to the states state[i].  All
+	// following inference calls are performed on the conditional
+	// distribution p(y_U | y_O) of the remaining variables; the factor graph
+	// remains unchanged.  The marginals place zero probability on all states
+	// inconsistent with the evidence, LogPartitionFunction() is the log of
+	// the conditional normalizer, and samples and minimizers contain the
+	// observed states.  In contrast to Conditioning::ConditionFactorGraph,
+	// setting new evidence requires no graph construction, which allows many
+	// evidence queries to be answered with the same object.
+	//
+	// Only methods for which SupportsEvidence() returns true accept evidence.
+	virtual bool SupportsEvidence() const;
+	void SetEvidence(const std::vector<unsigned int>& var_index,
+		const std::vector<unsigned int>& state);
+	void ClearEvidence();
+	// Return the per-variable evidence: [vi] is the observed state of
+	// variable vi, or std::numeric_limits<unsigned int>::max() if vi is not
+	// observed.  Empty if no evidence is set.
+	const std::vector<unsigned int>& Evidence() const;
+
 protected:
 	const FactorGraph* fg;
+	// Null if no overlay is set
+	const std::vector<std::vector<double> >* unary_overlay;
+	bool warm_start;
+	// Empty if no evidence is set, see Evidence()
+	std::vector<unsigned int> evidence;
+
+	// Return true if variable vi is observed
+	bool IsObserved(unsigned int vi) const;
+	// Clamp a log-domain table over the states of variable vi to the
+	// evidence: if vi is observed, all entries but the observed state are
+	// set to -infinity, otherwise the table remains unchanged.
+	void ClampLogTable(unsigned int vi, std::vector<double>& log_table) const;
+
+	// Overlay energy of a state, zero if no overlay is set
+	double EvaluateOverlayEnergy(const std::vector<unsigned int>& state) const;
+	// Expected overlay energy under the given factor marginals
+	double EvaluateOverlayEnergy(
+		const std::vector<std::vector<double> >& marginals) const;
 };
 
 }
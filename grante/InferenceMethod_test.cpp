@@ -0,0 +1,337 @@
+
+#include "grante/InferenceMethod.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <omp.h>
+
+#include "gmock/gmock.h"
+#include "grante/BeliefPropagation.h"
+#include "grante/BlockGibbsInference.h"
+#include "grante/BruteForceExactInference.h"
+#include "grante/Factor.h"
+#include "grante/FactorConditioningTable.h"
+#include "grante/FactorGraph.h"
+#include "grante/FactorGraphModel.h"
+#include "grante/FactorType.h"
+#include "grante/LinearProgrammingMAPInference.h"
+#include "grante/NaiveMeanFieldInference.h"
+#include "grante/SwendsenWangInference.h"
+#include "grante/SwendsenWangSampler.h"
+#include "grante/TreeInference.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Create a 2-by-3 grid of ternary variables with random energies given as
+// factor data.  If loopy is false, only the horizontal edges and the
+// vertical edge of the first column are added, giving a tree.  If overlay is
+// non-null, one additional unary factor per variable carries the overlay
+// energies.
+Grante::FactorGraph* CreateGrid(Grante::FactorGraphModel& model,
+    bool loopy, const std::vector<std::vector<double> >* overlay) {
+    std::vector<unsigned int> card1(1, 3);
+    std::vector<double> w;
+    model.AddFactorType(new Grante::FactorType("unary", card1, w));
+    std::vector<unsigned int> card2(2, 3);
+    model.AddFactorType(new Grante::FactorType("pairwise", card2, w));
+
+    std::default_random_engine e1(7);
+    std::uniform_real_distribution<double> randu(-1.0, 1.0);
+
+    unsigned int W = 3;
+    unsigned int H = 2;
+    std::vector<unsigned int> vc(W * H, 3);
+    Grante::FactorGraph* fg = new Grante::FactorGraph(&model, vc);
+    std::vector<double> data_u(3);
+    std::vector<double> data_p(9);
+    for (unsigned int y = 0; y < H; ++y) {
+        for (unsigned int x = 0; x < W; ++x) {
+            unsigned int vi = y * W + x;
+            for (unsigned int di = 0; di < data_u.size(); ++di)
+                data_u[di] = randu(e1);
+            std::vector<unsigned int> var_index1(1, vi);
+            fg->AddFactor(new Grante::Factor(model.FindFactorType("unary"),
+                var_index1, data_u));
+
+            std::vector<unsigned int> var_index2(2, vi);
+            if (x + 1 < W) {
+                var_index2[1] = vi + 1;
+                for (unsigned int di = 0; di < data_p.size(); ++di)
+                    data_p[di] = randu(e1);
+                fg->AddFactor(new Grante::Factor(
+                    model.FindFactorType("pairwise"), var_index2, data_p));
+            }
+            if (y + 1 < H && (loopy || x == 0)) {
+                var_index2[1] = vi + W;
+                for (unsigned int di = 0; di < data_p.size(); ++di)
+                    data_p[di] = randu(e1);
+                fg->AddFactor(new Grante::Factor(
+                    model.FindFactorType("pairwise"), var_index2, data_p));
+            }
+        }
+    }
+    if (overlay != 0) {
+        for (unsigned int vi = 0; vi < vc.size(); ++vi) {
+            std::vector<unsigned int> var_index1(1, vi);
+            fg->AddFactor(new Grante::Factor(model.FindFactorType("unary"),
+                var_index1, (*overlay)[vi]));
+        }
+    }
+    fg->ForwardMap();
+
+    return (fg);
+}
+
+// Compare the marginals of the first fcount factors computed by inf with the
+// marginals of inf_ref.  Both inference results must be available.
+void ExpectMarginalsNear(const Grante::InferenceMethod* inf,
+    const Grante::InferenceMethod* inf_ref, unsigned int fcount, double tol) {
+    for (unsigned int fi = 0; fi < fcount; ++fi) {
+        const std::vector<double>& marg = inf->Marginal(fi);
+        const std::vector<double>& marg_ref = inf_ref->Marginal(fi);
+        ASSERT_EQ(marg_ref.size(), marg.size());
+        for (unsigned int si = 0; si < marg.size(); ++si)
+            EXPECT_THAT(marg[si], testing::DoubleNear(marg_ref[si], tol));
+    }
+}
+
+// Compare inference with a unary overlay set on inf against inference on
+// the explicitly augmented factor graph using inf_aug.  The factors of the
+// original graph come first in the augmented graph.
+void CompareOverlay(Grante::InferenceMethod* inf,
+    Grante::InferenceMethod* inf_aug,
+    const std::vector<std::vector<double> >& overlay, unsigned int fcount,
+    double tol) {
+    ASSERT_TRUE(inf->SupportsUnaryOverlay());
+    inf->SetUnaryOverlay(&overlay);
+
+    inf->PerformInference();
+    inf_aug->PerformInference();
+    EXPECT_THAT(inf->LogPartitionFunction(),
+        testing::DoubleNear(inf_aug->LogPartitionFunction(), tol));
+    for (unsigned int fi = 0; fi < fcount; ++fi) {
+        const std::vector<double>& marg = inf->Marginal(fi);
+        const std::vector<double>& marg_aug = inf_aug->Marginal(fi);
+        ASSERT_EQ(marg_aug.size(), marg.size());
+        for (unsigned int si = 0; si < marg.size(); ++si)
+            EXPECT_THAT(marg[si], testing::DoubleNear(marg_aug[si], tol));
+    }
+
+    std::vector<unsigned int> state;
+    std::vector<unsigned int> state_aug;
+    double energy = inf->MinimizeEnergy(state);
+    double energy_aug = inf_aug->MinimizeEnergy(state_aug);
+    EXPECT_EQ(state_aug, state);
+    EXPECT_THAT(energy, testing::DoubleNear(energy_aug, tol));
+
+    // Removing the overlay restores the original distribution
+    inf->SetUnaryOverlay(0);
+    inf->PerformInference();
+    EXPECT_GT(std::fabs(inf->LogPartitionFunction() -
+        inf_aug->LogPartitionFunction()), 1.0e-3);
+}
+
+}
+
+TEST(InferenceMethod, UnaryOverlayMatchesAugmentedEnergies) {
+    std::default_random_engine e1(11);
+    std::uniform_real_distribution<double> randu(-1.0, 1.0);
+    std::vector<std::vector<double> > overlay(6, std::vector<double>(3));
+    for (unsigned int vi = 0; vi < overlay.size(); ++vi)
+        for (unsigned int si = 0; si < overlay[vi].size(); ++si)
+            overlay[vi][si] = randu(e1);
+
+    for (unsigned int loopy = 0; loopy <= 1; ++loopy) {
+        Grante::FactorGraphModel model;
+        Grante::FactorGraph* fg = CreateGrid(model, loopy != 0, 0);
+        Grante::FactorGraphModel model_aug;
+        Grante::FactorGraph* fg_aug =
+            CreateGrid(model_aug, loopy != 0, &overlay);
+        unsigned int fcount = static_cast<unsigned int>(fg->Factors().size());
+
+        Grante::BruteForceExactInference binf(fg);
+        Grante::BruteForceExactInference binf_aug(fg_aug);
+        CompareOverlay(&binf, &binf_aug, overlay, fcount, 1.0e-9);
+
+        Grante::BeliefPropagation bpinf(fg);
+        Grante::BeliefPropagation bpinf_aug(fg_aug);
+        CompareOverlay(&bpinf, &bpinf_aug, overlay, fcount, 1.0e-6);
+
+        if (loopy == 0) {
+            Grante::TreeInference tinf(fg);
+            Grante::TreeInference tinf_aug(fg_aug);
+            CompareOverlay(&tinf, &tinf_aug, overlay, fcount, 1.0e-9);
+        }
+        delete fg_aug;
+        delete fg;
+    }
+}
+
+
+TEST(InferenceMethod, BlockGibbsMatchesExactMarginals) {
+    // On the tree the whole graph is a single block and each sweep draws an
+    // exact sample.  On the loopy grid the blocks are sampled conditioned on
+    // each other.  The tolerance is about ten standard deviations of the
+    // sampling error.
+    for (unsigned int loopy = 0; loopy <= 1; ++loopy) {
+        Grante::FactorGraphModel model;
+        Grante::FactorGraph* fg = CreateGrid(model, loopy != 0, 0);
+        unsigned int fcount = static_cast<unsigned int>(fg->Factors().size());
+        Grante::BruteForceExactInference binf(fg);
+        binf.PerformInference();
+
+        Grante::FactorConditioningTable fcond_tab;
+        Grante::BlockGibbsInference bginf(fg, &fcond_tab);
+        if (loopy == 0) {
+            EXPECT_EQ(1, bginf.BlockCount());
+        } else {
+            EXPECT_LE(2, bginf.BlockCount());
+        }
+        bginf.SetSamplingParameters(50, 0, 20000);
+        bginf.PerformInference();
+        ExpectMarginalsNear(&bginf, &binf, fcount, 0.03);
+        delete fg;
+    }
+}
+
+TEST(InferenceMethod, SwendsenWangClusterSweepMatchesExactMarginals) {
+    Grante::FactorGraphModel model;
+    Grante::FactorGraph* fg = CreateGrid(model, true, 0);
+    unsigned int fcount = static_cast<unsigned int>(fg->Factors().size());
+    Grante::BruteForceExactInference binf(fg);
+    binf.PerformInference();
+
+    // Full cluster sweeps relabel the clusters of one color in parallel.
+    // Successive sweeps are correlated, the tolerance is several times the
+    // largest sampling error seen over repeated runs.
+    std::vector<double> qf;
+    Grante::SwendsenWangSampler::ComputeFactorProb(fg, qf);
+    int max_threads = omp_get_max_threads();
+    for (int thread_count = 1; thread_count <= 4; thread_count *= 4) {
+        omp_set_num_threads(thread_count);
+        Grante::SwendsenWangInference swinf(fg, qf);
+        swinf.SetSamplingParameters(false, 50, 0, 40000, false, true);
+        swinf.PerformInference();
+        ExpectMarginalsNear(&swinf, &binf, fcount, 0.05);
+    }
+    omp_set_num_threads(max_threads);
+    delete fg;
+}
+
+TEST(InferenceMethod, ParallelNaiveMeanFieldMatchesSerial) {
+    Grante::FactorGraphModel model;
+    Grante::FactorGraph* fg = CreateGrid(model, true, 0);
+    unsigned int fcount = static_cast<unsigned int>(fg->Factors().size());
+    Grante::BruteForceExactInference binf(fg);
+    binf.PerformInference();
+
+    Grante::NaiveMeanFieldInference mf_serial(fg);
+    mf_serial.SetParameters(false, 1.0e-12, 0);
+    mf_serial.PerformInference();
+    EXPECT_LE(mf_serial.LogPartitionFunction(),
+        binf.LogPartitionFunction() + 1.0e-9);
+
+    // The color-parallel schedule visits the variables in a different order
+    // but reaches the same fixed point.  Its result does not depend on the
+    // number of threads.
+    int max_threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    Grante::NaiveMeanFieldInference mf_par1(fg);
+    mf_par1.SetParameters(false, 1.0e-12, 0, true);
+    mf_par1.PerformInference();
+    EXPECT_THAT(mf_par1.LogPartitionFunction(),
+        testing::DoubleNear(mf_serial.LogPartitionFunction(), 1.0e-9));
+    ExpectMarginalsNear(&mf_par1, &mf_serial, fcount, 1.0e-6);
+
+    omp_set_num_threads(4);
+    Grante::NaiveMeanFieldInference mf_par4(fg);
+    mf_par4.SetParameters(false, 1.0e-12, 0, true);
+    mf_par4.PerformInference();
+    EXPECT_EQ(mf_par1.LogPartitionFunction(), mf_par4.LogPartitionFunction());
+    ExpectMarginalsNear(&mf_par4, &mf_par1, fcount, 0.0);
+    omp_set_num_threads(max_threads);
+    delete fg;
+}
+
+TEST(InferenceMethod, SmoothedLPDualBoundsExactLP) {
+    // Loopy 3x3 grid of binary variables with attractive Potts interactions.
+    // The energy is submodular, so the LP relaxation is tight and the exact
+    // LP value is the minimum energy.
+    Grante::FactorGraphModel model;
+    std::vector<unsigned int> card1(1, 2);
+    std::vector<double> w;
+    model.AddFactorType(new Grante::FactorType("unary", card1, w));
+    std::vector<unsigned int> card2(2, 2);
+    model.AddFactorType(new Grante::FactorType("pairwise", card2, w));
+
+    std::default_random_engine e1(23);
+    std::uniform_real_distribution<double> randu(-1.0, 1.0);
+    unsigned int W = 3;
+    std::vector<unsigned int> vc(W * W, 2);
+    Grante::FactorGraph fg(&model, vc);
+    std::vector<double> data_u(2);
+    std::vector<double> data_p(4, 0.0);
+    for (unsigned int y = 0; y < W; ++y) {
+        for (unsigned int x = 0; x < W; ++x) {
+            unsigned int vi = y * W + x;
+            data_u[0] = randu(e1);
+            data_u[1] = randu(e1);
+            std::vector<unsigned int> var_index1(1, vi);
+            fg.AddFactor(new Grante::Factor(model.FindFactorType("unary"),
+                var_index1, data_u));
+
+            std::vector<unsigned int> var_index2(2, vi);
+            for (unsigned int dir = 0; dir < 2; ++dir) {
+                if ((dir == 0 && x + 1 == W) || (dir == 1 && y + 1 == W))
+                    continue;
+                var_index2[1] = (dir == 0) ? (vi + 1) : (vi + W);
+                data_p[1] = data_p[2] = 0.5 * (randu(e1) + 1.0);
+                fg.AddFactor(new Grante::Factor(
+                    model.FindFactorType("pairwise"), var_index2, data_p));
+            }
+        }
+    }
+    fg.ForwardMap();
+
+    Grante::BruteForceExactInference binf(&fg);
+    std::vector<unsigned int> state_exact;
+    double energy_exact = binf.MinimizeEnergy(state_exact);
+
+    // The smoothed dual and the unsmoothed dual are below the LP value.  The
+    // trees are solved in parallel, the result does not depend on the
+    // number of threads.
+    int max_threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    Grante::LinearProgrammingMAPInference lpinf(&fg);
+    lpinf.SetParameters(1000, 1.0e-8);
+    lpinf.SetDualUpdate(
+        Grante::LinearProgrammingMAPInference::SmoothedAcceleratedUpdate,
+        1.0e-3);
+    std::vector<unsigned int> state;
+    double energy = lpinf.MinimizeEnergy(state);
+    double dual = lpinf.DualBound();
+    EXPECT_LE(dual, energy_exact + 1.0e-9);
+    EXPECT_GT(dual, energy_exact - 1.0e-4);
+    EXPECT_THAT(energy, testing::DoubleNear(energy_exact, 1.0e-9));
+    EXPECT_EQ(state_exact, state);
+
+    omp_set_num_threads(4);
+    Grante::LinearProgrammingMAPInference lpinf4(&fg);
+    lpinf4.SetParameters(1000, 1.0e-8);
+    lpinf4.SetDualUpdate(
+        Grante::LinearProgrammingMAPInference::SmoothedAcceleratedUpdate,
+        1.0e-3);
+    double energy4 = lpinf4.MinimizeEnergy(state);
+    EXPECT_EQ(energy, energy4);
+    EXPECT_EQ(dual, lpinf4.DualBound());
+    omp_set_num_threads(max_threads);
+
+    // The subgradient dual is below the LP value as well
+    Grante::LinearProgrammingMAPInference lpinf_subg(&fg);
+    lpinf_subg.SetParameters(1000, 1.0e-8);
+    lpinf_subg.MinimizeEnergy(state);
+    EXPECT_LE(lpinf_subg.DualBound(), energy_exact + 1.0e-9);
+}
@@ -49,5 +49,19 @@ void LaplacePrior::EvaluateProximalOperator(const std::vector<double>& u,
 	}
 }
 
+bool LaplacePrior::HasProximalOperator() const {
+	return (true);
+}
+
+double LaplacePrior::EvaluateRepeatedProximalOperator(double u, double L,
+	unsigned int count) const {
+	double sub = static_cast<double>(count) / (L * 2.0 * sigma * sigma);
+	double p = std::fabs(u) - sub;
+	if (p < 0.0)
+		return (0.0);
+
+	return (u < 0.0 ? -p : p);
+}
+
 }
 
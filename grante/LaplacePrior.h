@@ -23,6 +23,10 @@ public:
 
 	virtual void EvaluateProximalOperator(const std::vector<double>& u,
 		double L, std::vector<double>& wprox) const;
+	virtual bool HasProximalOperator() const;
+	// Soft-thresholding composes additively in the threshold
+	virtual double EvaluateRepeatedProximalOperator(double u, double L,
+		unsigned int count) const;
 
 private:
 	double sigma;
@@ -17,36 +17,75 @@ double Likelihood::ComputeNegLogLikelihood(const FactorGraph* fg,
 	const std::vector<std::vector<double> >& marginals, double log_z,
 	std::unordered_map<std::string, std::vector<double> >&
 		parameter_gradient) const {
+	return (NegLogLikelihood(fg, obs, marginals, log_z, parameter_gradient));
+}
+
+double Likelihood::ComputeNegLogLikelihood(const FactorGraph* fg,
+	const FactorGraphObservation* obs,
+	const std::vector<std::vector<double> >& marginals, double log_z,
+	std::unordered_map<std::string, FactorType::sparse_gradient_type>&
+		parameter_gradient) const {
+	return (NegLogLikelihood(fg, obs, marginals, log_z, parameter_gradient));
+}
+
+double Likelihood::ComputeObservationEnergy(const FactorGraph* fg,
+	const FactorGraphObservation* obs,
+	std::unordered_map<std::string, std::vector<double> >&
+		parameter_gradient, double scale) const {
+	return (ObservationEnergy(fg, obs, parameter_gradient, scale));
+}
+
+double Likelihood::ComputeObservationEnergy(const FactorGraph* fg,
+	const std::vector<unsigned int>& observed_state,
+	std::unordered_map<std::string, std::vector<double> >&
+		parameter_gradient, double scale) const {
+	return (ObservationEnergy(fg, observed_state, parameter_gradient, scale));
+}
+
+double Likelihood::ComputeObservationEnergy(const FactorGraph* fg,
+	const std::vector<std::vector<double> >& observed_expectations,
+	std::unordered_map<std::string, std::vector<double> >&
+		parameter_gradient, double scale) const {
+	return (ObservationEnergy(fg, observed_expectations,
+		parameter_gradient, scale));
+}
+
+template <typename G>
+double Likelihood::NegLogLikelihood(const FactorGraph* fg,
+	const FactorGraphObservation* obs,
+	const std::vector<std::vector<double> >& marginals, double log_z,
+	std::unordered_map<std::string, G>& parameter_gradient) const {
 
 	// PART 1: E(y_n;x_n,w) term
-	double nloglikelihood = ComputeObservationEnergy(fg, obs,
-		parameter_gradient);
+	double nloglikelihood = ObservationEnergy(fg, obs,
+		parameter_gradient, 1.0);
 
 	// PART 2: -log Z term
-	nloglikelihood += ComputeNegLogLikelihoodNegLogZTerm(fg, marginals,
-		log_z, parameter_gradient);
+	nloglikelihood += NegLogZTerm(fg, marginals, log_z, parameter_gradient);
 
 	return (nloglikelihood);
 }
 
-double Likelihood::ComputeObservationEnergy(const FactorGraph* fg,
+template <typename G>
+double Likelihood::ObservationEnergy(const FactorGraph* fg,
 	const FactorGraphObservation* obs,
-	std::unordered_map<std::string, std::vector<double> >&
-		parameter_gradient, double scale) const {
+	std::unordered_map<std::string, G>& parameter_gradient,
+	double scale) const {
 	if (obs->Type() == FactorGraphObservation::DiscreteLabelingType) {
-		return (ComputeObservationEnergy(fg, obs->State(),
+		return (ObservationEnergy(fg, obs->State(),
 			parameter_gradient, scale));
 	} else {
 		assert(obs->Type() == FactorGraphObservation::ExpectationType);
-		return (ComputeObservationEnergy(fg, obs->Expectation(),
+		return (ObservationEnergy(fg, obs->Expectation(),
 			parameter_gradient, scale));
 	}
 }
 
-double Likelihood::ComputeObservationEnergy(const FactorGraph* fg,
+template <typename G>
+double Likelihood::ObservationEnergy(const FactorGraph* fg,
 	const std::vector<unsigned int>& observed_state,
-	std::unordered_map<std::string, std::vector<double> >&
-		parameter_gradient, double scale) const {
+	std::unordered_map<std::string, G>& parameter_gradient,
+	double scale) const {
 	// PART 1: Compute energy gradient of observations
 	assert(observed_state.size() == fg->Cardinalities().size());
 
@@ -76,7 +115,7 @@ double Likelihood::ComputeObservationEnergy(const FactorGraph* fg,
 		unsigned int ei = factor->ComputeAbsoluteIndex(observed_state);
 		assert(ei < temp_f_m.size());
 		temp_f_m[ei] = 1.0;
-		factor->BackwardMap(temp_f_m,
+		AddBackwardMap(factor, temp_f_m,
 			parameter_gradient[factor->Type()->Name()], scale);
 		temp_f_m[ei] = 0.0;
 
@@ -85,10 +124,11 @@ double Likelihood::ComputeObservationEnergy(const FactorGraph* fg,
 	return (scale * nloglikelihood);
 }
 
-double Likelihood::ComputeObservationEnergy(const FactorGraph* fg,
+template <typename G>
+double Likelihood::ObservationEnergy(const FactorGraph* fg,
 	const std::vector<std::vector<double> >& observed_expectations,
-	std::unordered_map<std::string, std::vector<double> >&
-		parameter_gradient, double scale) const {
+	std::unordered_map<std::string, G>& parameter_gradient,
+	double scale) const {
 	assert(fg->Factors().size() == observed_expectations.size());
 
 	// PART 1: Compute energy from the expectation
@@ -100,7 +140,7 @@ double Likelihood::ComputeObservationEnergy(const FactorGraph* fg,
 		assert(observed_expectations[fi].size() ==
 			factors[fi]->Energies().size());
 
-		factors[fi]->BackwardMap(observed_expectations[fi],
+		AddBackwardMap(factors[fi], observed_expectations[fi],
 			parameter_gradient[factors[fi]->Type()->Name()], scale);
 
 		nloglikelihood += std::inner_product(
@@ -110,19 +150,30 @@ double Likelihood::ComputeObservationEnergy(const FactorGraph* fg,
 	return (scale * nloglikelihood);
 }
 
-double Likelihood::ComputeNegLogLikelihoodNegLogZTerm(
-	const FactorGraph* fg,
+template <typename G>
+double Likelihood::NegLogZTerm(const FactorGraph* fg,
 	const std::vector<std::vector<double> >& marginals, double log_z,
-	std::unordered_map<std::string, std::vector<double> >&
-		parameter_gradient) const {
+	std::unordered_map<std::string, G>& parameter_gradient) const {
 	const std::vector<Factor*>& factors = fg->Factors();
 	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
 		// \nabla_w: - \expect_{y~p(y|x,w)}[ \nabla_w E(y;x,w) ]
-		factors[fi]->BackwardMap(marginals[fi],
+		AddBackwardMap(factors[fi], marginals[fi],
 			parameter_gradient[factors[fi]->Type()->Name()], -1.0);
 	}
 	return (log_z);
 }
 
+void Likelihood::AddBackwardMap(const Factor* factor,
+	const std::vector<double>& marginals,
+	std::vector<double>& parameter_gradient, double mult) {
+	factor->BackwardMap(marginals, parameter_gradient, mult);
+}
+
+void Likelihood::AddBackwardMap(const Factor* factor,
+	const std::vector<double>& marginals,
+	FactorType::sparse_gradient_type& parameter_gradient, double mult) {
+	factor->SparseBackwardMap(marginals, parameter_gradient, mult);
+}
+
 }
 
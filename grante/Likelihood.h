@@ -47,6 +47,14 @@ public:
 		std::unordered_map<std::string, std::vector<double> >&
 			parameter_gradient) const;
 
+	// Same as above, but the gradient is appended as (weight index, value)
+	// pairs, see FactorType::SparseBackwardMap.
+	double ComputeNegLogLikelihood(const FactorGraph* fg,
+		const FactorGraphObservation* obs,
+		const std::vector<std::vector<double> >& marginals, double log_z,
+		std::unordered_map<std::string, FactorType::sparse_gradient_type>&
+			parameter_gradient) const;
+
 	// Compute the energy of an observation and its gradient.  This is the
 	// first term of the negative log-likelihood objective.
 	//
@@ -81,11 +89,41 @@ public:
 private:
 	const FactorGraphModel* fg_model;
 
+	// The computations above for a dense (std::vector<double>) or sparse
+	// (FactorType::sparse_gradient_type) gradient G.
+	template <typename G>
+	double NegLogLikelihood(const FactorGraph* fg,
+		const FactorGraphObservation* obs,
+		const std::vector<std::vector<double> >& marginals, double log_z,
+		std::unordered_map<std::string, G>& parameter_gradient) const;
+	template <typename G>
+	double ObservationEnergy(const FactorGraph* fg,
+		const FactorGraphObservation* obs,
+		std::unordered_map<std::string, G>& parameter_gradient,
+		double scale) const;
+	template <typename G>
+	double ObservationEnergy(const FactorGraph* fg,
+		const std::vector<unsigned int>& observed_state,
+		std::unordered_map<std::string, G>& parameter_gradient,
+		double scale) const;
+	template <typename G>
+	double ObservationEnergy(const FactorGraph* fg,
+		const std::vector<std::vector<double> >& observed_expectations,
+		std::unordered_map<std::string, G>& parameter_gradient,
+		double scale) const;
+
 	// Compute -log Z and its gradient
-	double ComputeNegLogLikelihoodNegLogZTerm(const FactorGraph* fg,
+	template <typename G>
+	double NegLogZTerm(const FactorGraph* fg,
 		const std::vector<std::vector<double> >& marginals, double log_z,
-		std::unordered_map<std::string, std::vector<double> >&
-			parameter_gradient) const;
+		std::unordered_map<std::string, G>& parameter_gradient) const;
+
+	static void AddBackwardMap(const Factor* factor,
+		const std::vector<double>& marginals,
+		std::vector<double>& parameter_gradient, double mult);
+	static void AddBackwardMap(const Factor* factor,
+		const std::vector<double>& marginals,
+		FactorType::sparse_gradient_type& parameter_gradient, double mult);
 };
 
 }
@@ -85,6 +85,17 @@ void LinearFactorType::BackwardMap(const Factor* factor,
 	}
 }
 
+void LinearFactorType::SparseBackwardMap(const Factor* factor,
+	const std::vector<double>& marginals,
+	sparse_gradient_type& parameter_gradient, double mult) const {
+	DenseSparseBackwardMap(factor, marginals, parameter_gradient, mult);
+}
+
+void LinearFactorType::ParameterSupport(const Factor* factor,
+	std::vector<unsigned int>& support) const {
+	DenseParameterSupport(support);
+}
+
 // private: dense general linear version
 void LinearFactorType::ForwardMap(const std::vector<double>& factor_data,
 	std::vector<double>& energies) const {
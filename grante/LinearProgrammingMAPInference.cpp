@@ -18,7 +18,8 @@ namespace Grante {
 LinearProgrammingMAPInference::LinearProgrammingMAPInference(
 	const FactorGraph* fg, bool verbose)
 	: InferenceMethod(fg), verbose(verbose), max_iter(100), conv_tol(1.0e-6),
-		primal_best_energy(0.0), T(0) {
+		update_type(SubgradientUpdate), smoothing(0.01),
+		primal_best_energy(0.0), dual_best_energy(0.0), T(0) {
 	// Check each variable has at least one unary factors attached
 	size_t var_count = fg->Cardinalities().size();
 	std::vector<int> has_unary(var_count, -1);
@@ -100,7 +101,12 @@ LinearProgrammingMAPInference::~LinearProgrammingMAPInference() {
 
 InferenceMethod* LinearProgrammingMAPInference::Produce(
 	const FactorGraph* new_fg) const {
-	return (new LinearProgrammingMAPInference(new_fg));
+	LinearProgrammingMAPInference* lpinf =
+		new LinearProgrammingMAPInference(new_fg, verbose);
+	lpinf->SetParameters(max_iter, conv_tol);
+	lpinf->SetDualUpdate(update_type, smoothing);
+
+	return (lpinf);
 }
 
 void LinearProgrammingMAPInference::SetParameters(
@@ -110,6 +116,13 @@ void LinearProgrammingMAPInference::SetParameters(
 	this->conv_tol = conv_tol;
 }
 
+void LinearProgrammingMAPInference::SetDualUpdate(
+	DualUpdateType update_type, double smoothing) {
+	assert(smoothing > 0.0);
+	this->update_type = update_type;
+	this->smoothing = smoothing;
+}
+
 void LinearProgrammingMAPInference::PerformInference() {
 	// Distribute energies uniformly over decomposed trees
 	for (size_t t = 0; t < T; ++t)
@@ -121,6 +134,7 @@ void LinearProgrammingMAPInference::PerformInference() {
 	primal_best.resize(var_count);
 	std::fill(primal_best.begin(), primal_best.end(), 0);
 	primal_best_energy = std::numeric_limits<double>::infinity();
+	dual_best_energy = -std::numeric_limits<double>::infinity();
 
 	// Initialize relaxed solution
 #if 0
@@ -132,6 +146,10 @@ void LinearProgrammingMAPInference::PerformInference() {
 	}
 	relaxed_sol_energy = -std::numeric_limits<double>::infinity();
 #endif
+	if (update_type == SmoothedAcceleratedUpdate) {
+		PerformInferenceSmoothed();
+		return;
+	}
 
 	// \lambda_{t,vi,state} = 0
 	std::vector<std::vector<double> > sol_avg(var_count);
@@ -156,37 +174,46 @@ void LinearProgrammingMAPInference::PerformInference() {
 
 	// Iterate
 	double sol_step = 1.0 / static_cast<double>(T);
+	std::vector<double> t_obj(T);
+	std::vector<double> t_primal_energy(T);
 	for (int iter = 1; max_iter == 0 || iter <= static_cast<int>(max_iter);
 		++iter) {
 		// Clear averaged solution
 		for (unsigned int vi = 0; vi < var_count; ++vi)
 			std::fill(sol_avg[vi].begin(), sol_avg[vi].end(), 0.0);
 
-		// Perform inference for all submodels
+		// Perform inference for all submodels, the trees are independent
+		int tree_count = static_cast<int>(T);
+		#pragma omp parallel for schedule(dynamic)
+		for (int t = 0; t < tree_count; ++t) {
+			t_obj[t] = tree_inf[t]->MinimizeEnergy(cur_sol_t[t]);
+			t_primal_energy[t] = fg->EvaluateEnergy(cur_sol_t[t]);
+		}
+
+		// Dual objective is simply the sum of all tree objectives.
+		// Identify best feasible integral labeling (in tree order).
 		double dual_obj = 0.0;
 		bool new_primal_best = false;
 		for (unsigned int t = 0; t < T; ++t) {
-			double t_obj = tree_inf[t]->MinimizeEnergy(cur_sol_t[t]);
-
-			// Dual objective is simply the sum of all tree objectives
-			dual_obj += t_obj;
-
-			// Produce averaged solution (primal infeasible)
-			for (unsigned int vi = 0; vi < var_count; ++vi)
-				sol_avg[vi][cur_sol_t[t][vi]] += sol_step;
-
-			// Identify best feasible integral labeling
-			double t_primal_energy = fg->EvaluateEnergy(cur_sol_t[t]);
-			if (t_primal_energy < primal_best_energy) {
+			dual_obj += t_obj[t];
+			if (t_primal_energy[t] < primal_best_energy) {
 				std::copy(cur_sol_t[t].begin(), cur_sol_t[t].end(),
 					primal_best.begin());
-				primal_best_energy = t_primal_energy;
+				primal_best_energy = t_primal_energy[t];
 				new_primal_best = true;
 			}
 		}
 
+		// Produce averaged solution (primal infeasible)
+		#pragma omp parallel for
+		for (int vi = 0; vi < static_cast<int>(var_count); ++vi) {
+			for (unsigned int t = 0; t < T; ++t)
+				sol_avg[vi][cur_sol_t[t][vi]] += sol_step;
+		}
+
 		if (dual_obj > dual_obj_best)
 			dual_obj_best = dual_obj;
+		dual_best_energy = dual_obj_best;
 
 		// Initial delta: half the primal-dual gap
 		if (delta < 0.0)
@@ -252,10 +279,10 @@ void LinearProgrammingMAPInference::PerformInference() {
 
 		// Compute step size
 		double subgradient_norm = 0.0;
-		for (size_t t = 0; t < T; ++t) {
-			for (unsigned int vi = 0; vi < var_count; ++vi) {
-				// Obtain a unary factor of the variable
-				unsigned int vi_card = var_card[vi];
+		#pragma omp parallel for reduction(+:subgradient_norm)
+		for (int vi = 0; vi < static_cast<int>(var_count); ++vi) {
+			unsigned int vi_card = var_card[vi];
+			for (size_t t = 0; t < T; ++t) {
 				for (unsigned int vs = 0; vs < vi_card; ++vs) {
 					subgradient_norm += std::pow(
 						(cur_sol_t[t][vi] == vs ? 1.0 : 0.0)
@@ -285,7 +312,8 @@ void LinearProgrammingMAPInference::PerformInference() {
 
 		// Update Lagrange multipliers implicitly by directly updating the
 		// energies of the trees in the decomposition
-		for (unsigned int t = 0; t < T; ++t) {
+		#pragma omp parallel for
+		for (int t = 0; t < tree_count; ++t) {
 			const std::vector<Factor*>& factors = trees[t]->FG()->Factors();
 			for (unsigned int vi = 0; vi < var_count; ++vi) {
 				// Obtain a unary factor of the variable
@@ -305,6 +333,251 @@ void LinearProgrammingMAPInference::PerformInference() {
 	}
 }
 
+void LinearProgrammingMAPInference::PerformInferenceSmoothed() {
+	const std::vector<unsigned int>& var_card = fg->Cardinalities();
+	size_t var_count = var_card.size();
+
+	// Offsets of the variable states in the flat multiplier vectors
+	std::vector<unsigned int> var_offset(var_count + 1, 0);
+	for (size_t vi = 0; vi < var_count; ++vi)
+		var_offset[vi+1] = var_offset[vi] + var_card[vi];
+
+	// Tree energies without multipliers
+	std::vector<std::vector<std::vector<double> > > base_energies(T);
+	for (size_t t = 0; t < T; ++t) {
+		const std::vector<Factor*>& factors = trees[t]->FG()->Factors();
+		base_energies[t].resize(factors.size());
+		for (size_t tfi = 0; tfi < factors.size(); ++tfi)
+			base_energies[t][tfi] = factors[tfi]->Energies();
+	}
+
+	// The smoothed dual is at most temperature*smooth_bound below the dual
+	double smooth_bound = 0.0;
+	for (size_t vi = 0; vi < var_count; ++vi)
+		smooth_bound += std::log(static_cast<double>(var_card[vi]));
+	smooth_bound *= static_cast<double>(T);
+
+	// Accelerated gradient ascent with backtracking on the Lipschitz
+	// constant L and adaptive restart.  All multiplier vectors remain in the
+	// subspace sum_t lambda[t] = 0 because the gradients do.
+	std::vector<std::vector<double> > x(T,
+		std::vector<double>(var_offset[var_count], 0.0));
+	std::vector<std::vector<double> > x_new(x);
+	std::vector<std::vector<double> > y(x);
+	std::vector<std::vector<double> > grad_x(x);
+	std::vector<std::vector<double> > grad_y(x);
+
+	// The temperature starts high and is lowered as the duality gap shrinks,
+	// such that the smoothing error is a fraction of the gap, but not below
+	// 'smoothing'.
+	double dual_best = DecodeTrees(base_energies, var_offset, x);
+	double temperature = std::max(smoothing,
+		0.5 * (primal_best_energy - dual_best) / smooth_bound);
+	double d_y = EvaluateSmoothedDual(base_energies, var_offset, y,
+		temperature, grad_y);
+	double d_x = d_y;
+	grad_x = grad_y;
+	double L = 1.0 / temperature;
+	double theta = 1.0;
+	for (int iter = 1; max_iter == 0 || iter <= static_cast<int>(max_iter);
+		++iter) {
+		double grad_y_norm2 = 0.0;
+		for (size_t t = 0; t < T; ++t) {
+			grad_y_norm2 += std::inner_product(grad_y[t].begin(),
+				grad_y[t].end(), grad_y[t].begin(), 0.0);
+		}
+
+		// Ascent step from y, increase L until sufficient ascent
+		double d_x_new;
+		while (true) {
+			for (size_t t = 0; t < T; ++t) {
+				for (size_t ki = 0; ki < x_new[t].size(); ++ki)
+					x_new[t][ki] = y[t][ki] + grad_y[t][ki] / L;
+			}
+			d_x_new = EvaluateSmoothedDual(base_energies, var_offset,
+				x_new, temperature, grad_x);
+			if (d_x_new >= d_y + 0.5 * grad_y_norm2 / L -
+				1.0e-12 * fabs(d_y))
+				break;
+			L *= 2.0;
+		}
+		dual_best = std::max(dual_best, d_x_new);
+
+		// Momentum, restart if the objective decreased
+		double theta_next = 0.5 * (1.0 + std::sqrt(1.0 + 4.0 * theta * theta));
+		double beta = (theta - 1.0) / theta_next;
+		if (d_x_new < d_x) {
+			theta_next = 1.0;
+			beta = 0.0;
+		}
+		x.swap(x_new);
+		d_x = d_x_new;
+		theta = theta_next;
+
+		// Periodically decode the unsmoothed trees: labelings and the
+		// unsmoothed dual bound
+		bool decode = (iter % 10) == 0;
+		if (decode)
+			dual_best = std::max(dual_best, DecodeTrees(base_energies,
+				var_offset, x));
+
+		double dgap = primal_best_energy - dual_best;
+		double convergence_measure = dgap / (fabs(dual_best) + 1.0e-5);
+		if (verbose) {
+			std::cout << "iter " << iter << ", primal " << primal_best_energy
+				<< ", smoothed dual " << d_x << ", best dual " << dual_best
+				<< ", gap " << dgap << ", temp " << temperature
+				<< std::endl;
+		}
+		if (grad_y_norm2 <= 1.0e-10 || convergence_measure <= conv_tol) {
+			if (verbose) {
+				std::cout << "Converged, grad norm^2 " << grad_y_norm2
+					<< ", conv " << convergence_measure << std::endl;
+			}
+			break;
+		}
+
+		// Lower the temperature, restarting the momentum
+		double temp_target = std::max(smoothing, 0.5 * dgap / smooth_bound);
+		if (decode && temp_target < 0.5 * temperature) {
+			L *= temperature / temp_target;
+			temperature = temp_target;
+			beta = 0.0;
+			theta = 1.0;
+			d_x = EvaluateSmoothedDual(base_energies, var_offset, x,
+				temperature, grad_x);
+		}
+
+		// Next extrapolation point
+		if (beta == 0.0) {
+			y = x;
+			grad_y = grad_x;
+			d_y = d_x;
+		} else {
+			for (size_t t = 0; t < T; ++t) {
+				for (size_t ki = 0; ki < y[t].size(); ++ki)
+					y[t][ki] = x[t][ki] + beta * (x[t][ki] - x_new[t][ki]);
+			}
+			d_y = EvaluateSmoothedDual(base_energies, var_offset, y,
+				temperature, grad_y);
+		}
+
+		// Allow the step size to grow again
+		L *= 0.8;
+	}
+
+	// Leave the trees at the unsmoothed multipliers x
+	dual_best_energy = std::max(dual_best,
+		DecodeTrees(base_energies, var_offset, x));
+}
+
+double LinearProgrammingMAPInference::DecodeTrees(
+	const std::vector<std::vector<std::vector<double> > >& base_energies,
+	const std::vector<unsigned int>& var_offset,
+	const std::vector<std::vector<double> >& lambda) {
+	SetTreeEnergies(base_energies, var_offset, lambda, 1.0);
+
+	std::vector<std::vector<unsigned int> > cur_sol_t(T);
+	std::vector<double> t_obj(T);
+	std::vector<double> t_primal_energy(T);
+	int tree_count = static_cast<int>(T);
+	#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < tree_count; ++t) {
+		t_obj[t] = tree_inf[t]->MinimizeEnergy(cur_sol_t[t]);
+		t_primal_energy[t] = fg->EvaluateEnergy(cur_sol_t[t]);
+	}
+	for (size_t t = 0; t < T; ++t) {
+		if (t_primal_energy[t] < primal_best_energy) {
+			primal_best = cur_sol_t[t];
+			primal_best_energy = t_primal_energy[t];
+		}
+	}
+	return (std::accumulate(t_obj.begin(), t_obj.end(), 0.0));
+}
+
+void LinearProgrammingMAPInference::SetTreeEnergies(
+	const std::vector<std::vector<std::vector<double> > >& base_energies,
+	const std::vector<unsigned int>& var_offset,
+	const std::vector<std::vector<double> >& lambda, double temperature) {
+	size_t var_count = var_offset.size() - 1;
+	double inv_temp = 1.0 / temperature;
+	int tree_count = static_cast<int>(T);
+	#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < tree_count; ++t) {
+		const std::vector<Factor*>& factors = trees[t]->FG()->Factors();
+		for (size_t tfi = 0; tfi < factors.size(); ++tfi)
+			factors[tfi]->Energies() = base_energies[t][tfi];
+
+		for (unsigned int vi = 0; vi < var_count; ++vi) {
+			std::vector<double>& t_fi_energies =
+				factors[tree_var_to_factor_map[t][vi]]->Energies();
+			for (unsigned int vs = 0; vs < t_fi_energies.size(); ++vs)
+				t_fi_energies[vs] += lambda[t][var_offset[vi] + vs];
+		}
+		if (temperature == 1.0)
+			continue;
+
+		for (size_t tfi = 0; tfi < factors.size(); ++tfi) {
+			std::vector<double>& energies = factors[tfi]->Energies();
+			std::transform(energies.begin(), energies.end(),
+				energies.begin(), _1 * inv_temp);
+		}
+	}
+}
+
+double LinearProgrammingMAPInference::EvaluateSmoothedDual(
+	const std::vector<std::vector<std::vector<double> > >& base_energies,
+	const std::vector<unsigned int>& var_offset,
+	const std::vector<std::vector<double> >& lambda, double temperature,
+	std::vector<std::vector<double> >& grad) {
+	size_t var_count = var_offset.size() - 1;
+	SetTreeEnergies(base_energies, var_offset, lambda, temperature);
+
+	// Smoothed tree minima -temperature * log Z_t and unary marginals
+	std::vector<double> t_obj(T);
+	int tree_count = static_cast<int>(T);
+	#pragma omp parallel for schedule(dynamic)
+	for (int t = 0; t < tree_count; ++t) {
+		tree_inf[t]->PerformInference();
+		t_obj[t] = -temperature * tree_inf[t]->LogPartitionFunction();
+		for (unsigned int vi = 0; vi < var_count; ++vi) {
+			const std::vector<double>& marg =
+				tree_inf[t]->Marginal(tree_var_to_factor_map[t][vi]);
+			std::copy(marg.begin(), marg.end(),
+				grad[t].begin() + var_offset[vi]);
+		}
+		tree_inf[t]->ClearInferenceResult();
+	}
+	double dual_obj = std::accumulate(t_obj.begin(), t_obj.end(), 0.0);
+
+	// Gradient is the deviation from the mean marginals, round the mean
+	// marginals to a labeling
+	std::vector<unsigned int> labeling(var_count);
+	double t_scale = 1.0 / static_cast<double>(T);
+	#pragma omp parallel for
+	for (int vi = 0; vi < static_cast<int>(var_count); ++vi) {
+		double mean_max = -1.0;
+		for (unsigned int ki = var_offset[vi]; ki < var_offset[vi+1]; ++ki) {
+			double mean = 0.0;
+			for (size_t t = 0; t < T; ++t)
+				mean += grad[t][ki];
+			mean *= t_scale;
+			for (size_t t = 0; t < T; ++t)
+				grad[t][ki] -= mean;
+			if (mean > mean_max) {
+				mean_max = mean;
+				labeling[vi] = ki - var_offset[vi];
+			}
+		}
+	}
+	double labeling_energy = fg->EvaluateEnergy(labeling);
+	if (labeling_energy < primal_best_energy) {
+		primal_best = labeling;
+		primal_best_energy = labeling_energy;
+	}
+	return (dual_obj);
+}
+
 void LinearProgrammingMAPInference::ClearInferenceResult() {
 #if 0
 	relaxed_sol.clear();
@@ -348,5 +621,9 @@ double LinearProgrammingMAPInference::MinimizeEnergy(
 	return (primal_best_energy);
 }
 
+double LinearProgrammingMAPInference::DualBound() const {
+	return (dual_best_energy);
+}
+
 }
 
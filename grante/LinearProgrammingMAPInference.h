@@ -16,9 +16,32 @@ namespace Grante {
  * additionally provides a labeling with energy greater than or equal to the
  * optimal labeling and a fractional labeling defined on the same index set as
  * the marginals.
+ *
+ * The tree subproblems of one iteration are independent and solved in
+ * parallel.  Two dual update schemes are available:
+ *    1. Subgradient ascent with a path-based target level step size
+ *       (default),
+ *    2. Accelerated gradient ascent on the entropy-smoothed dual
+ *       [Savchynskyy2011] with adaptive restart [ODonoghue2012], where each
+ *       tree is solved by sum-product at a temperature that is lowered as
+ *       the duality gap shrinks.
+ *       The smoothed dual is a lower bound on the dual.  Labelings are
+ *       obtained by rounding the averaged tree marginals.
+ *
+ * References
+ * [Savchynskyy2011] Bogdan Savchynskyy, Joerg Kappes, Stefan Schmidt and
+ *    Christoph Schnoerr, "A Study of Nesterov's Scheme for Lagrangian
+ *    Decomposition and MAP Labeling", CVPR 2011.
+ * [ODonoghue2012] Brendan O'Donoghue and Emmanuel Candes, "Adaptive Restart
+ *    for Accelerated Gradient Schemes", 2012.
  */
 class LinearProgrammingMAPInference : public InferenceMethod {
 public:
+	enum DualUpdateType {
+		SubgradientUpdate = 0,
+		SmoothedAcceleratedUpdate,
+	};
+
 	/* Note: right now this class works only on factor graphs that have at
 	 * least one unary factor for each variable.
 	 */
@@ -34,6 +57,16 @@ public:
 	// conv_tol: Convergence tolerance, default: 1.0e-6.
 	void SetParameters(unsigned int max_iter, double conv_tol);
 
+	// Set the dual update scheme.
+	//
+	// update_type: SubgradientUpdate or SmoothedAcceleratedUpdate,
+	//    default: SubgradientUpdate,
+	// smoothing: minimum temperature of the smoothed dual.  The temperature
+	//    is adapted to the duality gap and lowered down to this value.  The
+	//    smoothed dual is at most temperature times the sum of the
+	//    log-cardinalities of the trees below the dual.  Default: 0.01.
+	void SetDualUpdate(DualUpdateType update_type, double smoothing = 0.01);
+
 	virtual void PerformInference();
 	virtual void ClearInferenceResult();
 
@@ -52,6 +85,10 @@ public:
 	// energies.
 	virtual double MinimizeEnergy(std::vector<unsigned int>& state);
 
+	// Return the best dual objective found by the last inference call, a
+	// lower bound on the minimum energy.
+	double DualBound() const;
+
 private:
 	bool verbose;
 
@@ -60,9 +97,14 @@ private:
 	// Convergence tolerance: duality_grap / abs(dual_obj)
 	double conv_tol;
 
+	DualUpdateType update_type;
+	double smoothing;
+
 	// Primal feasible labeling and its energy
 	std::vector<unsigned int> primal_best;
 	double primal_best_energy;
+	// Best dual objective, dual_best_energy <= primal_best_energy
+	double dual_best_energy;
 
 	// (Infeasible) primal LP solution and its energy.  We always have
 	// relaxed_sol_energy <= primal_best_energy.
@@ -85,6 +127,36 @@ private:
 
 	// The actual tree min-sum inference objects
 	std::vector<TreeInference*> tree_inf;
+
+	// Accelerated gradient ascent on the smoothed dual
+	void PerformInferenceSmoothed();
+
+	// Set the energies of all trees to base_energies plus multipliers
+	// lambda[t] on the unary factors, all divided by temperature.
+	// lambda[t][var_offset[vi]+vs] is the multiplier of tree t, variable vi
+	// and state vs.
+	void SetTreeEnergies(
+		const std::vector<std::vector<std::vector<double> > >& base_energies,
+		const std::vector<unsigned int>& var_offset,
+		const std::vector<std::vector<double> >& lambda,
+		double temperature);
+
+	// Evaluate the dual smoothed at the given temperature at lambda and its
+	// gradient, which is the deviation of the tree unary marginals from
+	// their mean.  The rounded mean marginals are used to update the primal
+	// solution.
+	double EvaluateSmoothedDual(
+		const std::vector<std::vector<std::vector<double> > >& base_energies,
+		const std::vector<unsigned int>& var_offset,
+		const std::vector<std::vector<double> >& lambda, double temperature,
+		std::vector<std::vector<double> >& grad);
+
+	// Minimize the unsmoothed tree energies at lambda, update the primal
+	// solution from the tree labelings and return the dual objective.
+	double DecodeTrees(
+		const std::vector<std::vector<std::vector<double> > >& base_energies,
+		const std::vector<unsigned int>& var_offset,
+		const std::vector<std::vector<double> >& lambda);
 };
 
 }
@@ -1,30 +1,62 @@
 
 #include <algorithm>
+#include <limits>
 #include <cmath>
 
 #include "LogSumExp.h"
+#include "VectorMath.h"
 
 namespace Grante {
 
 double LogSumExp::Compute(const std::vector<double>& x) {
-	double xmax = *std::max_element(x.begin(), x.end());
-	double lse = 0.0;
-	for (std::vector<double>::const_iterator xi = x.begin();
-		xi != x.end(); ++xi) {
-		lse += std::exp(*xi - xmax);
-	}
-	return (xmax + std::log(lse));
+	return (VectorMath::LogSumExp(&x[0], x.size()));
 }
 
 double LogSumExp::ComputeNeg(const std::vector<double>& x) {
-	double xmax = -*std::min_element(x.begin(), x.end());
-	double lse = 0.0;
-	for (std::vector<double>::const_iterator xi = x.begin();
-		xi != x.end(); ++xi) {
-		lse += std::exp(-*xi - xmax);
+	return (VectorMath::LogSumExpNeg(&x[0], x.size()));
+}
+
+LogSumExpAccumulator::LogSumExpAccumulator()
+	: xmax(-std::numeric_limits<double>::infinity()), sum(0.0) {
+}
+
+double LogSumExpAccumulator::Add(double x) {
+	if (x == -std::numeric_limits<double>::infinity())
+		return (1.0);
+
+	if (x <= xmax) {
+		sum += std::exp(x - xmax);
+		return (1.0);
 	}
-	return (xmax + std::log(lse));
+	// New maximum: rescale the current sum to the new reference
+	double scale = std::exp(xmax - x);
+	sum = sum*scale + 1.0;
+	xmax = x;
+	return (scale);
 }
 
+void LogSumExpAccumulator::Add(const LogSumExpAccumulator& other) {
+	if (other.xmax == -std::numeric_limits<double>::infinity())
+		return;
+
+	if (other.xmax <= xmax) {
+		sum += other.sum * std::exp(other.xmax - xmax);
+	} else {
+		sum = sum*std::exp(xmax - other.xmax) + other.sum;
+		xmax = other.xmax;
+	}
 }
 
+double LogSumExpAccumulator::Max() const {
+	return (xmax);
+}
+
+double LogSumExpAccumulator::ScaledSum() const {
+	return (sum);
+}
+
+double LogSumExpAccumulator::LogSum() const {
+	return (xmax + std::log(sum));
+}
+
+}
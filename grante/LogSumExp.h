@@ -17,6 +17,36 @@ public:
 	static double ComputeNeg(const std::vector<double>& x);
 };
 
+/* Streaming computation of log sum_i exp(x_i), adding one element at a
+ * time without storing the elements.  The sum is kept relative to the
+ * largest element seen so far.  Two accumulators can be merged, so partial
+ * sums computed on different threads can be combined in a numerically
+ * stable way.
+ */
+class LogSumExpAccumulator {
+public:
+	LogSumExpAccumulator();
+
+	// Add the element x.  The return value is the factor by which the
+	// previous ScaledSum() has been rescaled, i.e. 1.0 if Max() did not
+	// change.  Callers accumulating quantities weighted by
+	// exp(x_i - Max()) must rescale them by this factor.
+	double Add(double x);
+	// Merge the elements of another accumulator into this one.
+	void Add(const LogSumExpAccumulator& other);
+
+	// Largest element added so far, -inf if no element has been added.
+	double Max() const;
+	// sum_i exp(x_i - Max())
+	double ScaledSum() const;
+	// log sum_i exp(x_i)
+	double LogSum() const;
+
+private:
+	double xmax;
+	double sum;
+};
+
 }
 
 #endif
@@ -4,6 +4,10 @@
 #include <iostream>
 #include <cassert>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <boost/timer.hpp>
 
 #include "Conditioning.h"
@@ -21,6 +25,7 @@ MaximumCompositeLikelihood::MaximumCompositeLikelihood(
 	FactorGraphModel* fg_model, int decomp)
 	: ParameterEstimationMethod(fg_model), decomp(decomp), mle(fg_model) {
 	assert(decomp >= -1);
+	ftab.push_back(new FactorConditioningTable());
 }
 
 MaximumCompositeLikelihood::~MaximumCompositeLikelihood() {
@@ -30,6 +35,9 @@ MaximumCompositeLikelihood::~MaximumCompositeLikelihood() {
 		delete (comp_training_data[cn].second);
 		delete (comp_inference_methods[cn]);
 	}
+	// The conditioned factor graphs are deleted, now delete the tables
+	for (unsigned int ti = 0; ti < ftab.size(); ++ti)
+		delete (ftab[ti]);
 }
 
 void MaximumCompositeLikelihood::SetOptimizationMethod(
@@ -37,6 +45,11 @@ void MaximumCompositeLikelihood::SetOptimizationMethod(
 	mle.SetOptimizationMethod(opt_method);
 }
 
+void MaximumCompositeLikelihood::SetStochasticParameters(double step_size,
+	unsigned int batch_size) {
+	mle.SetStochasticParameters(step_size, batch_size);
+}
+
 MaximumLikelihood::MLEProblem* MaximumCompositeLikelihood::GetLearnProblem() {
 	return (mle.GetLearnProblem());
 }
@@ -60,69 +73,101 @@ void MaximumCompositeLikelihood::SetupTrainingData(
 	// Produce composite factor graphs
 	boost::timer decomp_timer;
 	int training_data_size = static_cast<int>(training_data.size());
-	fg_cc_var_label.resize(cover_count * training_data_size);
-	fg_cc_count.resize(cover_count * training_data_size);
-	fg_orig_index.resize(cover_count * training_data_size);
-	std::fill(fg_cc_count.begin(), fg_cc_count.end(), 0);
-	unsigned int cn = 0;
-	for (int n = 0; n < training_data_size; ++n) {
-		FactorGraph* fg = training_data[n].first;
-		size_t var_count = fg->Cardinalities().size();
-
-		// Get observation
-		const FactorGraphObservation* obs = training_data[n].second;
+	int decomp_count = static_cast<int>(cover_count) * training_data_size;
+
+	// 1. Draw the random factor weights of all decompositions in order, as
+	// the global random sampler can not be used concurrently.
+	std::vector<std::vector<double> > factor_weight(decomp_count);
+	if (decomp != DecomposePseudolikelihood) {
+		boost::uniform_real<double> uniform_dist(0.0, 1.0);
+		boost::variate_generator<boost::mt19937&,
+			boost::uniform_real<double> >
+			rgen(RandomSource::GlobalRandomSampler(), uniform_dist);
+		for (int cn = 0; cn < decomp_count; ++cn) {
+			const FactorGraph* fg = training_data[cn / cover_count].first;
+			factor_weight[cn].resize(fg->Factors().size());
+			if (decomp == DecomposeUniform) {
+				// Use constant weights
+				std::fill(factor_weight[cn].begin(),
+					factor_weight[cn].end(), 1.0);
+			} else {
+				// Use uniform random weights
+				for (unsigned int fi = 0; fi < factor_weight[cn].size(); ++fi)
+					factor_weight[cn][fi] = rgen();
+			}
+		}
+	}
 
-		// Obtain one or more decomposition(s)
-		for (unsigned int cover_iter = 0; cover_iter < cover_count;
-			++cover_iter) {
+	// 2. Decompose all instances in parallel.  cc_var_label[cn] is the
+	// connected-component label of each variable in decomposition cn of
+	// instance cn/cover_count.
+	std::vector<std::vector<unsigned int> > cc_var_label(decomp_count);
+	std::vector<unsigned int> cc_count(decomp_count, 0);
+	#pragma omp parallel for schedule(dynamic)
+	for (int cn = 0; cn < decomp_count; ++cn) {
+		const FactorGraph* fg = training_data[cn / cover_count].first;
+		std::vector<bool> factor_is_removed;
+		if (decomp == DecomposePseudolikelihood) {
+			factor_is_removed.resize(fg->Factors().size());
+			std::fill(factor_is_removed.begin(),
+				factor_is_removed.end(), true);
+		} else {
 			VAcyclicDecomposition vac(fg);
-			std::vector<bool> factor_is_removed;
+			vac.ComputeDecompositionSP(factor_weight[cn], factor_is_removed);
+		}
 
-			if (decomp == DecomposePseudolikelihood) {
-				factor_is_removed.resize(fg->Factors().size());
-				std::fill(factor_is_removed.begin(),
-					factor_is_removed.end(), true);
-			} else {
-				std::vector<double> factor_weight(fg->Factors().size(), 0.0);
-				if (decomp == DecomposeUniform) {
-					// Use constant weights
-					std::fill(factor_weight.begin(), factor_weight.end(), 1.0);
-				} else {
-					// Use uniform random weights
-					boost::uniform_real<double> uniform_dist(0.0, 1.0);
-					boost::variate_generator<boost::mt19937&,
-						boost::uniform_real<double> >
-						rgen(RandomSource::GlobalRandomSampler(), uniform_dist);
-
-					for (unsigned int fi = 0; fi < factor_weight.size(); ++fi)
-						factor_weight[fi] = rgen();
-				}
-				vac.ComputeDecompositionSP(factor_weight, factor_is_removed);
-			}
+		// Shatter factor graph into trees
+		cc_count[cn] = FactorGraphStructurizer::ConnectedComponents(
+			fg, factor_is_removed, cc_var_label[cn]);
+	}
+
+	// 3. Allocate the components, in order of instance, decomposition and
+	// connected component
+	std::vector<unsigned int> cc_base(decomp_count + 1, 0);
+	for (int cn = 0; cn < decomp_count; ++cn)
+		cc_base[cn + 1] = cc_base[cn] + cc_count[cn];
+	unsigned int comp_count = cc_base[decomp_count];
+	comp_training_data.resize(comp_count);
+	comp_inference_methods.resize(comp_count);
+	comp_orig_index.resize(comp_count);
+	comp_ftab.resize(comp_count);
+	comp_var_new_to_orig.resize(comp_count);
+	comp_fac_new_to_orig.resize(comp_count);
+	for (int cn = 0; cn < decomp_count; ++cn) {
+		for (unsigned int cti = cc_base[cn]; cti < cc_base[cn + 1]; ++cti)
+			comp_orig_index[cti] = cn / cover_count;
+	}
 
-			// Shatter factor graph into trees
-			fg_cc_count[cn] += FactorGraphStructurizer::ConnectedComponents(
-				fg, factor_is_removed, fg_cc_var_label[cn]);
-#if 0
-			std::cout << "MCL, instance " << n << " decomposed into " << cc_count
-				<< " components" << std::endl;
+	// 4. Condition in parallel, each thread using its own table
+	int thread_count = 1;
+#ifdef _OPENMP
+	thread_count = omp_get_max_threads();
+#endif
+	while (static_cast<int>(ftab.size()) < thread_count)
+		ftab.push_back(new FactorConditioningTable());
+
+	#pragma omp parallel for schedule(dynamic) num_threads(thread_count)
+	for (int cn = 0; cn < decomp_count; ++cn) {
+		unsigned int ti = 0;
+#ifdef _OPENMP
+		ti = omp_get_thread_num();
 #endif
+		unsigned int n = cn / cover_count;
+		const FactorGraph* fg = training_data[n].first;
+		size_t var_count = fg->Cardinalities().size();
 
-			// Add each component as separate factor graph
-			for (unsigned int ci = 0; ci < fg_cc_count[cn]; ++ci) {
-				std::vector<unsigned int> cond_var_set;
-				cond_var_set.reserve(var_count);
+		// Add each component as separate factor graph
+		for (unsigned int ci = 0; ci < cc_count[cn]; ++ci) {
+			std::vector<unsigned int> cond_var_set;
+			cond_var_set.reserve(var_count);
 
-				// Add all variables not in this component to the conditioning set
-				for (size_t vi = 0; vi < var_count; ++vi) {
-					if (fg_cc_var_label[cn][vi] != ci)
-						cond_var_set.push_back(static_cast<unsigned int>(vi));
-				}
-				AddTrainingComponentCond(fg, obs, inference_methods[n],
-					cond_var_set);
+			// Add all variables not in this component to the conditioning set
+			for (size_t vi = 0; vi < var_count; ++vi) {
+				if (cc_var_label[cn][vi] != ci)
+					cond_var_set.push_back(static_cast<unsigned int>(vi));
 			}
-			fg_orig_index[cn] = n;
-			cn += 1;
+			ConditionComponent(fg, training_data[n].second,
+				inference_methods[n], cond_var_set, ti, cc_base[cn] + ci);
 		}
 	}
 	std::cout << "MCL, decomposed " << training_data.size() << " instances "
@@ -167,15 +212,31 @@ void MaximumCompositeLikelihood::AddTrainingComponentCond(
 	const FactorGraph* fg, const FactorGraphObservation* obs,
 	InferenceMethod* inference_method,
 	const std::vector<unsigned int>& cond_var_set) {
+	unsigned int cti = static_cast<unsigned int>(comp_training_data.size());
+	comp_training_data.resize(cti + 1);
+	comp_inference_methods.resize(cti + 1);
+	comp_ftab.resize(cti + 1);
+	comp_var_new_to_orig.resize(cti + 1);
+	comp_fac_new_to_orig.resize(cti + 1);
+	ConditionComponent(fg, obs, inference_method, cond_var_set, 0, cti);
+}
+
+void MaximumCompositeLikelihood::ConditionComponent(const FactorGraph* fg,
+	const FactorGraphObservation* obs, InferenceMethod* inference_method,
+	const std::vector<unsigned int>& cond_var_set, unsigned int ti,
+	unsigned int cti) {
+	assert(ti < ftab.size());
+	assert(cti < comp_training_data.size());
+
 	// Create partial observation from full observation
 	FactorGraphPartialObservation* pobs =
 		CreatePartialObservationCond(fg, obs, cond_var_set);
 
 	// Condition
-	std::vector<unsigned int> var_new_to_orig;
-	std::vector<unsigned int> fac_new_to_orig;
+	std::vector<unsigned int>& var_new_to_orig = comp_var_new_to_orig[cti];
+	std::vector<unsigned int>& fac_new_to_orig = comp_fac_new_to_orig[cti];
 	FactorGraph* fg_cond = Conditioning::ConditionFactorGraph(
-		&ftab, fg, pobs, var_new_to_orig, fac_new_to_orig);
+		ftab[ti], fg, pobs, var_new_to_orig, fac_new_to_orig);
 	delete (pobs);
 
 	FactorGraphObservation* new_obs =
@@ -183,32 +244,55 @@ void MaximumCompositeLikelihood::AddTrainingComponentCond(
 			var_new_to_orig, fac_new_to_orig);
 
 	// Build derived composite training set
-	comp_training_data.push_back(labeled_instance_type(fg_cond, new_obs));
+	comp_training_data[cti] = labeled_instance_type(fg_cond, new_obs);
+	comp_ftab[cti] = ti;
 	assert(inference_method != 0);
-	comp_inference_methods.push_back(inference_method->Produce(fg_cond));
+	comp_inference_methods[cti] = inference_method->Produce(fg_cond);
 }
 
 void MaximumCompositeLikelihood::UpdateTrainingComponentCond(
 	const FactorGraph* fg, const FactorGraphObservation* obs,
-	const std::vector<unsigned int>& cond_var_set,
 	unsigned int cti) {
 	assert(cti < comp_training_data.size());
-
-	// Create partial observation from full observation
-	FactorGraphPartialObservation* pobs =
-		CreatePartialObservationCond(fg, obs, cond_var_set);
-
-	// Obtain variable and factor maps
-	std::vector<unsigned int> var_new_to_orig;
-	std::vector<unsigned int> fac_new_to_orig;
-	FactorGraph* fg_cond = Conditioning::ConditionFactorGraph(
-		&ftab, fg, pobs, var_new_to_orig, fac_new_to_orig);
-	delete (pobs);
+	const FactorGraph* fg_cond = comp_training_data[cti].first;
+	FactorConditioningTable* ctab = ftab[comp_ftab[cti]];
+	const std::vector<unsigned int>& fac_new_to_orig =
+		comp_fac_new_to_orig[cti];
+
+	// Update the conditioning information of all cross-factors
+	const std::vector<Factor*>& factors = fg->Factors();
+	const std::vector<Factor*>& cond_factors = fg_cond->Factors();
+	assert(cond_factors.size() == fac_new_to_orig.size());
+	std::vector<unsigned int> cond_state;
+	std::vector<double> cond_e;
+	for (size_t nfi = 0; nfi < cond_factors.size(); ++nfi) {
+		const ConditionedFactorType* cft =
+			static_cast<const ConditionedFactorType*>(
+				cond_factors[nfi]->Type());
+		const std::vector<unsigned int>& cond_fvar =
+			cft->ConditionedVariableIndices();
+		if (cond_fvar.empty())
+			continue;	// Unconditioned, nothing to update
+
+		const Factor* ofac = factors[fac_new_to_orig[nfi]];
+		if (obs->Type() == FactorGraphObservation::DiscreteLabelingType) {
+			const std::vector<unsigned int>& obs_state = obs->State();
+			const std::vector<unsigned int>& fac_vars = ofac->Variables();
+			cond_state.resize(cond_fvar.size());
+			for (unsigned int cvi = 0; cvi < cond_fvar.size(); ++cvi)
+				cond_state[cvi] = obs_state[fac_vars[cond_fvar[cvi]]];
+			ctab->UpdateConditioningInformation(cond_factors[nfi], cond_state);
+		} else {
+			assert(obs->Type() == FactorGraphObservation::ExpectationType);
+			MarginalizeUnconditioned(ofac, cond_fvar,
+				obs->Expectation()[fac_new_to_orig[nfi]], cond_e);
+			ctab->UpdateConditioningInformation(cond_factors[nfi], cond_e);
+		}
+	}
 
 	FactorGraphObservation* new_obs =
 		CreatePartialObservationUncond(fg, fg_cond, obs,
-			var_new_to_orig, fac_new_to_orig);
-	delete (fg_cond);
+			comp_var_new_to_orig[cti], fac_new_to_orig);
 
 	// Update observation
 	assert(comp_training_data[cti].second->Type() == new_obs->Type());
@@ -268,18 +352,14 @@ MaximumCompositeLikelihood::CreatePartialObservationCond(
 			// Check whether this factor is a cross factor
 			const std::vector<unsigned int>& fac_vars =
 				factors[fi]->Variables();
-			const std::vector<unsigned int>& fac_card =
-				factors[fi]->Cardinalities();
 
 			bool has_cond = false;
 			bool has_uncond = false;
 			std::vector<unsigned int> cond_fvar;
-			unsigned int cond_card = 1;
 			for (unsigned int fvi = 0; fvi < fac_vars.size(); ++fvi) {
 				if (cond_var_set_u.count(fac_vars[fvi]) > 0) {
 					has_cond = true;
 					cond_fvar.push_back(fvi);
-					cond_card *= fac_card[fvi];
 				} else {
 					has_uncond = true;
 				}
@@ -289,21 +369,9 @@ MaximumCompositeLikelihood::CreatePartialObservationCond(
 
 			// This factor is a cross-factor
 			fac_subset.push_back(fi);
-			const std::vector<double>& m_e = expect[fi];
-			std::vector<double> obs_e_fi(cond_card, 0.0);
-			for (unsigned int oei = 0; oei < m_e.size(); ++oei) {
-				// oei: index in original factor expectations,
-				// cei: index into conditioning expectations.
-				unsigned int cei =
-					FactorConditioningTable::IndexMapConditioned(
-						factors[fi]->Type(), cond_fvar, oei);
-				assert(cei < obs_e_fi.size());
-
-				// Marginalize out unconditioned variables
-				obs_e_fi[cei] += m_e[oei];
-			}
-			assert(std::fabs(std::accumulate(obs_e_fi.begin(),
-				obs_e_fi.end(), 0.0) - 1.0) <= 1.0e-8);
+			std::vector<double> obs_e_fi;
+			MarginalizeUnconditioned(factors[fi], cond_fvar, expect[fi],
+				obs_e_fi);
 			obs_e.push_back(obs_e_fi);
 		}
 		return (new FactorGraphPartialObservation(cond_var_set,
@@ -340,7 +408,6 @@ MaximumCompositeLikelihood::CreatePartialObservationUncond(
 
 		// For each conditioned factor
 		const std::vector<std::vector<double> >& expect = obs->Expectation();
-		const std::vector<Factor*>& factors = fg->Factors();
 		const std::vector<Factor*>& cond_factors = fg_cond->Factors();
 		std::vector<std::vector<double> > obs_e;
 		for (size_t nfi = 0; nfi < new_fac_count; ++nfi) {
@@ -360,18 +427,19 @@ MaximumCompositeLikelihood::CreatePartialObservationUncond(
 				assert(m_e.size() == obs_e_fi.size());
 				std::copy(m_e.begin(), m_e.end(), obs_e_fi.begin());
 			} else {
-				// Conditioned factor
-				for (unsigned int oei = 0; oei < m_e.size(); ++oei) {
-					// oei: index in original factor expectations,
-					// nei: index in remaining unconditioned variable
-					//    'ground-truth' expectations.
-					unsigned int nei =
-						FactorConditioningTable::IndexMapUnconditioned(
-							factors[ofi]->Type(), cond_fvar, oei);
-					assert(nei < obs_e_fi.size());
-
-					// Marginalize out conditioned variables
-					obs_e_fi[nei] += m_e[oei];
+				// Conditioned factor: marginalize out conditioned variables.
+				// cei: joint state of the conditioned variables,
+				// nei: index in remaining unconditioned variable
+				//    'ground-truth' expectations.
+				const std::vector<unsigned int>& cond_offset =
+					cft->ConditionedOffsets();
+				const std::vector<unsigned int>& uncond_offset =
+					cft->UnconditionedOffsets();
+				assert(m_e.size() == cond_offset.size()*uncond_offset.size());
+				for (size_t cei = 0; cei < cond_offset.size(); ++cei) {
+					const double* m_e_c = &m_e[cond_offset[cei]];
+					for (size_t nei = 0; nei < uncond_offset.size(); ++nei)
+						obs_e_fi[nei] += m_e_c[uncond_offset[nei]];
 				}
 			}
 			assert(std::fabs(std::accumulate(obs_e_fi.begin(),
@@ -384,6 +452,30 @@ MaximumCompositeLikelihood::CreatePartialObservationUncond(
 	return (0);
 }
 
+void MaximumCompositeLikelihood::MarginalizeUnconditioned(
+	const Factor* factor, const std::vector<unsigned int>& cond_fvar,
+	const std::vector<double>& m_e, std::vector<double>& cond_e) {
+	const std::vector<unsigned int>& fac_card = factor->Cardinalities();
+	unsigned int cond_card = 1;
+	for (unsigned int cvi = 0; cvi < cond_fvar.size(); ++cvi)
+		cond_card *= fac_card[cond_fvar[cvi]];
+
+	cond_e.resize(cond_card);
+	std::fill(cond_e.begin(), cond_e.end(), 0.0);
+	for (unsigned int oei = 0; oei < m_e.size(); ++oei) {
+		// oei: index in original factor expectations,
+		// cei: index into conditioning expectations.
+		unsigned int cei = FactorConditioningTable::IndexMapConditioned(
+			factor->Type(), cond_fvar, oei);
+		assert(cei < cond_e.size());
+
+		// Marginalize out unconditioned variables
+		cond_e[cei] += m_e[oei];
+	}
+	assert(std::fabs(std::accumulate(cond_e.begin(),
+		cond_e.end(), 0.0) - 1.0) <= 1.0e-8);
+}
+
 void MaximumCompositeLikelihood::AddPrior(const std::string& factor_type,
 	Prior* prior) {
 	mle.AddPrior(factor_type, prior);
@@ -396,30 +488,18 @@ double MaximumCompositeLikelihood::Train(double conv_tol, unsigned int max_iter)
 
 void MaximumCompositeLikelihood::UpdateTrainingLabeling(
 	const std::vector<labeled_instance_type>& training_update) {
-	assert(fg_orig_index.size() == comp_training_data.size());
+	assert(comp_orig_index.size() == comp_training_data.size());
 
 	// For all decomposed components
-	for (unsigned int cn = 0; cn < fg_orig_index.size(); ++cn) {
+	int comp_count = static_cast<int>(comp_training_data.size());
+	#pragma omp parallel for schedule(dynamic)
+	for (int cti = 0; cti < comp_count; ++cti) {
 		// Original factor graph index
-		unsigned int n = fg_orig_index[cn];
+		unsigned int n = comp_orig_index[cti];
 		assert(n < training_update.size());
 
-		FactorGraph* fg = training_update[n].first;
-		const FactorGraphObservation* obs = training_update[n].second;
-		size_t var_count = fg->Cardinalities().size();
-
-		// Update each component of the current decomposition
-		for (unsigned int ci = 0; ci < fg_cc_count[cn]; ++ci) {
-			std::vector<unsigned int> cond_var_set;
-			cond_var_set.reserve(var_count);
-
-			// Add all variables not in this component to the conditioning set
-			for (size_t vi = 0; vi < var_count; ++vi) {
-				if (fg_cc_var_label[cn][vi] != ci)
-					cond_var_set.push_back(static_cast<unsigned int>(vi));
-			}
-			UpdateTrainingComponentCond(fg, obs, cond_var_set, cn);
-		}
+		UpdateTrainingComponentCond(training_update[n].first,
+			training_update[n].second, cti);
 	}
 
 	// Update fully observed components
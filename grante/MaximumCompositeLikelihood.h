@@ -50,16 +50,23 @@ public:
 
 	void SetOptimizationMethod(
 		MaximumLikelihood::MLEOptimizationMethod opt_method);
+	// See MaximumLikelihood::SetStochasticParameters
+	void SetStochasticParameters(double step_size, unsigned int batch_size);
 
 	// FIXME: remove
 	MaximumLikelihood::MLEProblem* GetLearnProblem();
 
 	// Decompose given factor graphs and initialize training data and
-	// inference methods.
+	// inference methods.  The instances are decomposed and conditioned in
+	// parallel.
 	virtual void SetupTrainingData(
 		const std::vector<labeled_instance_type>& training_data,
 		const std::vector<InferenceMethod*> inference_methods);
 
+	// Update the conditioning states (or expectations) and observations of
+	// all components in place; the conditioned factor graphs are kept.  The
+	// factor graphs must be the same as the ones passed to
+	// SetupTrainingData.
 	virtual void UpdateTrainingLabeling(
 		const std::vector<labeled_instance_type>& training_update);
 
@@ -91,22 +98,34 @@ protected:
 private:
 	MaximumLikelihood mle;
 
-	FactorConditioningTable ftab;
-	// fg_orig_index: The fg_orig_index[i] contains the original training
-	//    instance index for the component i.
-	// fg_cc_var_label: The original connected-component variable label
-	//    output from the v-acyclic decomposition.  Needed to relate the
-	//    original factor graph variables to the MCLE components.
-	// fg_cc_count: Number of components in the i'th factor graph
-	//    decomposition.
-	std::vector<unsigned int> fg_orig_index;
-	std::vector<std::vector<unsigned int> > fg_cc_var_label;
-	std::vector<unsigned int> fg_cc_count;
+	// Conditioning tables.  SetupTrainingData conditions in parallel and
+	// uses one table per thread, such that no table is accessed
+	// concurrently.  All factors of one component are in the same table.
+	std::vector<FactorConditioningTable*> ftab;
 
 	// Component training data (decomposed original graphs)
 	std::vector<labeled_instance_type> comp_training_data;
 	std::vector<InferenceMethod*> comp_inference_methods;
 
+	// For each component in comp_training_data,
+	// comp_orig_index: The original training instance index.  Only set by
+	//    SetupTrainingData and required for UpdateTrainingLabeling.
+	// comp_ftab: Index into ftab of the table the component is conditioned
+	//    with.
+	// comp_var_new_to_orig, comp_fac_new_to_orig: The variable and factor
+	//    maps from the conditioned to the original factor graph.
+	std::vector<unsigned int> comp_orig_index;
+	std::vector<unsigned int> comp_ftab;
+	std::vector<std::vector<unsigned int> > comp_var_new_to_orig;
+	std::vector<std::vector<unsigned int> > comp_fac_new_to_orig;
+
+	// Condition fg on cond_var_set using ftab[ti] and store the result as
+	// component cti.  The component storage must already be allocated.
+	void ConditionComponent(const FactorGraph* fg,
+		const FactorGraphObservation* obs, InferenceMethod* inference_method,
+		const std::vector<unsigned int>& cond_var_set, unsigned int ti,
+		unsigned int cti);
+
 	// Produce the partial information used for conditioning.
 	FactorGraphPartialObservation* CreatePartialObservationCond(
 		const FactorGraph* fg, const FactorGraphObservation* obs,
@@ -120,10 +139,18 @@ private:
 		const std::vector<unsigned int>& var_new_to_orig,
 		const std::vector<unsigned int>& fac_new_to_orig) const;
 
-	// cti: absolute index in comp_training_data.
+	// Sum the factor expectation m_e over the unconditioned variables of
+	// factor, leaving the expectation cond_e of the factor-relative
+	// conditioned variables cond_fvar.
+	static void MarginalizeUnconditioned(const Factor* factor,
+		const std::vector<unsigned int>& cond_fvar,
+		const std::vector<double>& m_e, std::vector<double>& cond_e);
+
+	// Update the conditioning information and the observation of component
+	// cti in place, for the new observation obs of its original factor
+	// graph fg.  Safe to call concurrently for different components.
 	void UpdateTrainingComponentCond(
 		const FactorGraph* fg, const FactorGraphObservation* obs,
-		const std::vector<unsigned int>& cond_var_set,
 		unsigned int cti);
 };
 
@@ -0,0 +1,210 @@
+
+#include "grante/MaximumCompositeLikelihood.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <omp.h>
+
+#include "gmock/gmock.h"
+#include "grante/Factor.h"
+#include "grante/FactorGraph.h"
+#include "grante/FactorGraphModel.h"
+#include "grante/FactorGraphObservation.h"
+#include "grante/FactorType.h"
+#include "grante/TreeInference.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+void ExpectVectorNear(const std::vector<double>& actual,
+    const std::vector<double>& expected, double tol) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (unsigned int i = 0; i < actual.size(); ++i)
+        EXPECT_THAT(actual[i], testing::DoubleNear(expected[i], tol));
+}
+
+// Loopy 3x4 grid training problem: ternary labels, unary factors on a noisy
+// feature and a bias, and a data-independent pairwise factor.  The
+// instances are the same for every call.
+class GridProblem {
+public:
+    GridProblem() : tinf(0) {
+        std::vector<unsigned int> card1(1, 3);
+        std::vector<double> w1(3 * 2, 0.0);
+        model.AddFactorType(new Grante::FactorType("unary", card1, w1));
+        std::vector<unsigned int> card2(2, 3);
+        std::vector<double> w2(9, 0.0);
+        model.AddFactorType(new Grante::FactorType("pairwise", card2, w2));
+
+        std::default_random_engine e1(17);
+        std::normal_distribution<double> randn(0.0, 1.0);
+        std::uniform_int_distribution<unsigned int> randlabel(0, 2);
+        unsigned int N = 5;
+        unsigned int rows = 3;
+        unsigned int cols = 4;
+        for (unsigned int n = 0; n < N; ++n) {
+            std::vector<unsigned int> vc(rows * cols, 3);
+            Grante::FactorGraph* fg = new Grante::FactorGraph(&model, vc);
+            std::vector<unsigned int> label(vc.size());
+            std::vector<unsigned int> relabel(vc.size());
+            for (unsigned int vi = 0; vi < vc.size(); ++vi) {
+                label[vi] = randlabel(e1);
+                relabel[vi] = randlabel(e1);
+                std::vector<double> data(2);
+                data[0] = static_cast<double>(label[vi]) + randn(e1);
+                data[1] = 1.0;
+                std::vector<unsigned int> var_index1(1, vi);
+                fg->AddFactor(new Grante::Factor(
+                    model.FindFactorType("unary"), var_index1, data));
+            }
+            for (unsigned int r = 0; r < rows; ++r) {
+                for (unsigned int c = 0; c < cols; ++c) {
+                    std::vector<unsigned int> var_index2(2, r * cols + c);
+                    std::vector<double> data2;
+                    if (c + 1 < cols) {
+                        var_index2[1] = r * cols + c + 1;
+                        fg->AddFactor(new Grante::Factor(
+                            model.FindFactorType("pairwise"),
+                            var_index2, data2));
+                    }
+                    if (r + 1 < rows) {
+                        var_index2[1] = (r + 1) * cols + c;
+                        fg->AddFactor(new Grante::Factor(
+                            model.FindFactorType("pairwise"),
+                            var_index2, data2));
+                    }
+                }
+            }
+            fgs.push_back(fg);
+            training_data.push_back(
+                Grante::ParameterEstimationMethod::labeled_instance_type(
+                    fg, new Grante::FactorGraphObservation(label)));
+            training_update.push_back(
+                Grante::ParameterEstimationMethod::labeled_instance_type(
+                    fg, new Grante::FactorGraphObservation(relabel)));
+        }
+    }
+
+    ~GridProblem() {
+        for (unsigned int n = 0; n < fgs.size(); ++n) {
+            delete training_data[n].second;
+            delete training_update[n].second;
+            delete fgs[n];
+        }
+    }
+
+    // Decompose and condition the instances with the original labels, or
+    // with the new labels if relabeled is true
+    Grante::MaximumCompositeLikelihood* CreateTrainer(int decomp,
+        bool relabeled = false) {
+        Grante::MaximumCompositeLikelihood* mcl =
+            new Grante::MaximumCompositeLikelihood(&model, decomp);
+        std::vector<Grante::InferenceMethod*> inference_methods(
+            fgs.size(), &tinf);
+        mcl->SetupTrainingData(relabeled ? training_update : training_data,
+            inference_methods);
+
+        return (mcl);
+    }
+
+    // Composite likelihood objective and gradient at x
+    static double EvalObjective(Grante::MaximumCompositeLikelihood* mcl,
+        const std::vector<double>& x, std::vector<double>& grad) {
+        Grante::MaximumLikelihood::MLEProblem* prob = mcl->GetLearnProblem();
+        grad.assign(prob->Dimensions(), 0.0);
+        double obj = prob->EvalF(x, grad);
+        delete prob;
+
+        return (obj);
+    }
+
+    Grante::FactorGraphModel model;
+    std::vector<Grante::FactorGraph*> fgs;
+    // Original labels and new labels for the in-place relabeling
+    std::vector<Grante::ParameterEstimationMethod::labeled_instance_type>
+        training_data;
+    std::vector<Grante::ParameterEstimationMethod::labeled_instance_type>
+        training_update;
+
+    // Prototype for the inference on the tree-structured components
+    Grante::TreeInference tinf;
+};
+
+}
+
+TEST(MaximumCompositeLikelihood, ParallelMatchesSerial) {
+    GridProblem prob;
+    std::default_random_engine e1(29);
+    std::normal_distribution<double> randn(0.0, 1.0);
+    std::vector<double> x(6 + 9);
+    for (unsigned int d = 0; d < x.size(); ++d)
+        x[d] = randn(e1);
+
+    // The v-acyclic decompositions are randomized with a time-based seed,
+    // the pseudolikelihood decomposition is the same for every run
+    int max_threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    Grante::MaximumCompositeLikelihood* mcl = prob.CreateTrainer(
+        Grante::MaximumCompositeLikelihood::DecomposePseudolikelihood);
+    std::vector<double> grad_serial;
+    double obj_serial = GridProblem::EvalObjective(mcl, x, grad_serial);
+    mcl->UpdateTrainingLabeling(prob.training_update);
+    std::vector<double> grad_serial_update;
+    double obj_serial_update =
+        GridProblem::EvalObjective(mcl, x, grad_serial_update);
+    delete mcl;
+    EXPECT_GT(obj_serial, 0.0);
+
+    // In-place relabeling agrees with conditioning on the new labels
+    mcl = prob.CreateTrainer(
+        Grante::MaximumCompositeLikelihood::DecomposePseudolikelihood, true);
+    std::vector<double> grad;
+    double obj = GridProblem::EvalObjective(mcl, x, grad);
+    EXPECT_THAT(obj, testing::DoubleNear(obj_serial_update, 1.0e-10));
+    ExpectVectorNear(grad, grad_serial_update, 1.0e-10);
+    delete mcl;
+
+    // Parallel decomposition, conditioning and relabeling
+    for (int thread_count = 2; thread_count <= 4; thread_count *= 2) {
+        omp_set_num_threads(thread_count);
+        mcl = prob.CreateTrainer(
+            Grante::MaximumCompositeLikelihood::DecomposePseudolikelihood);
+        obj = GridProblem::EvalObjective(mcl, x, grad);
+        EXPECT_THAT(obj, testing::DoubleNear(obj_serial, 1.0e-10));
+        ExpectVectorNear(grad, grad_serial, 1.0e-10);
+
+        mcl->UpdateTrainingLabeling(prob.training_update);
+        obj = GridProblem::EvalObjective(mcl, x, grad);
+        EXPECT_THAT(obj, testing::DoubleNear(obj_serial_update, 1.0e-10));
+        ExpectVectorNear(grad, grad_serial_update, 1.0e-10);
+        delete mcl;
+    }
+    omp_set_num_threads(max_threads);
+}
+
+TEST(MaximumCompositeLikelihood, RelabelInPlace) {
+    GridProblem prob;
+    std::default_random_engine e1(31);
+    std::normal_distribution<double> randn(0.0, 1.0);
+    std::vector<double> x(6 + 9);
+    for (unsigned int d = 0; d < x.size(); ++d)
+        x[d] = randn(e1);
+
+    // Relabeling and restoring the labels keeps the decomposition
+    Grante::MaximumCompositeLikelihood* mcl = prob.CreateTrainer(
+        Grante::MaximumCompositeLikelihood::DecomposeRandomizedTwice);
+    std::vector<double> grad_orig;
+    double obj_orig = GridProblem::EvalObjective(mcl, x, grad_orig);
+    mcl->UpdateTrainingLabeling(prob.training_update);
+    std::vector<double> grad;
+    double obj_update = GridProblem::EvalObjective(mcl, x, grad);
+    EXPECT_GT(std::fabs(obj_update - obj_orig), 1.0e-3);
+
+    mcl->UpdateTrainingLabeling(prob.training_data);
+    double obj = GridProblem::EvalObjective(mcl, x, grad);
+    EXPECT_THAT(obj, testing::DoubleNear(obj_orig, 1.0e-10));
+    ExpectVectorNear(grad, grad_orig, 1.0e-10);
+    delete mcl;
+}
@@ -10,13 +10,15 @@
 #include "Likelihood.h"
 #include "FunctionMinimization.h"
 #include "CompositeMinimization.h"
+#include "StochasticFunctionMinimization.h"
 
 using namespace boost::lambda;
 
 namespace Grante {
 
 MaximumLikelihood::MaximumLikelihood(FactorGraphModel* fg_model)
-	: ParameterEstimationMethod(fg_model), opt_method(LBFGSMethod) {
+	: ParameterEstimationMethod(fg_model), opt_method(LBFGSMethod),
+		stochastic_step_size(1.0e-2), stochastic_batch_size(32) {
 }
 
 MaximumLikelihood::~MaximumLikelihood() {
@@ -27,6 +29,14 @@ void MaximumLikelihood::SetOptimizationMethod(
 	this->opt_method = opt_method;
 }
 
+void MaximumLikelihood::SetStochasticParameters(double step_size,
+	unsigned int batch_size) {
+	assert(step_size > 0.0);
+	assert(batch_size > 0);
+	stochastic_step_size = step_size;
+	stochastic_batch_size = batch_size;
+}
+
 MaximumLikelihood::MLEProblem* MaximumLikelihood::GetLearnProblem() {
 	return (new MLEProblem(this));
 }
@@ -61,6 +71,14 @@ double MaximumLikelihood::Train(double conv_tol, unsigned int max_iter) {
 		obj = CompositeMinimization::FISTAMinimize(
 			mle_prob, x_opt, conv_tol, max_iter, true);
 		break;
+	case (MomentumSGDMethod):
+	case (AdaGradMethod):
+	case (AdamMethod):
+	case (SVRGMethod):
+	case (SparseSGDMethod):
+		obj = MinimizeStochastic(mle_prob, opt_method, x_opt,
+			conv_tol, max_iter);
+		break;
 	default:
 		assert(0);
 		break;
@@ -72,6 +90,37 @@ double MaximumLikelihood::Train(double conv_tol, unsigned int max_iter) {
 	return (obj);
 }
 
+double MaximumLikelihood::MinimizeStochastic(MLEProblem& prob,
+	MLEOptimizationMethod method, std::vector<double>& x_opt,
+	double conv_tol, unsigned int max_epochs) {
+	StochasticFunctionMinimization::MiniBatchMethod mb_method =
+		StochasticFunctionMinimization::MomentumSGDMethod;
+	switch (method) {
+	case (MomentumSGDMethod):
+		mb_method = StochasticFunctionMinimization::MomentumSGDMethod;
+		break;
+	case (AdaGradMethod):
+		mb_method = StochasticFunctionMinimization::AdaGradMethod;
+		break;
+	case (AdamMethod):
+		mb_method = StochasticFunctionMinimization::AdamMethod;
+		break;
+	case (SVRGMethod):
+		mb_method = StochasticFunctionMinimization::SVRGMethod;
+		break;
+	case (SparseSGDMethod):
+		mb_method = StochasticFunctionMinimization::SparseSGDMethod;
+		break;
+	default:
+		assert(0);
+		break;
+	}
+	MLEStochasticProblem sprob(&prob);
+	return (StochasticFunctionMinimization::MiniBatchMinimize(sprob, x_opt,
+		mb_method, stochastic_step_size, stochastic_batch_size, conv_tol,
+		max_epochs, true));
+}
+
 // Function minimization part
 MaximumLikelihood::MLEProblem::MLEProblem(MaximumLikelihood* mle_base)
 	: mle_base(mle_base) {
@@ -81,9 +130,13 @@ MaximumLikelihood::MLEProblem::MLEProblem(MaximumLikelihood* mle_base)
 		mle_base->fg_model->FactorTypes();
 	for (std::vector<FactorType*>::const_iterator fti = factor_types.begin();
 		fti != factor_types.end(); ++fti) {
+		type_position[*fti] =
+			static_cast<unsigned int>(parameter_order.size());
+		parameter_offset.push_back(dim);
 		dim += (*fti)->WeightDimension();
 		parameter_order.push_back((*fti)->Name());
 	}
+	parameter_offset.push_back(dim);
 }
 
 MaximumLikelihood::MLEProblem::~MLEProblem() {
@@ -104,7 +157,10 @@ double MaximumLikelihood::MLEProblem::EvalF(const std::vector<double>& x,
 
 	// 3. Compute likelihood related parameter gradient:
 	//    \sum_{n=1}^N \nabla_w -log p(x_n;w)
-	double nll = EvaluateLikelihoodGradient(parameter_gradient);
+	std::vector<unsigned int> instances(mle_base->training_data.size());
+	for (unsigned int n = 0; n < instances.size(); ++n)
+		instances[n] = n;
+	double nll = EvaluateLikelihoodGradient(instances, parameter_gradient);
 
 	// Scale by 1/N to have: 1/N (\sum_{n=1}^N \nabla_w - log p(x_n;w))
 	double scale = 1.0 / static_cast<double>(mle_base->training_data.size());
@@ -124,6 +180,162 @@ double MaximumLikelihood::MLEProblem::EvalF(const std::vector<double>& x,
 	return (nll);
 }
 
+double MaximumLikelihood::MLEProblem::EvalMiniBatch(
+	const std::vector<unsigned int>& batch, const std::vector<double>& x,
+	std::vector<double>& grad) {
+	assert(x.size() == dim);
+	assert(grad.size() == dim);
+	assert(batch.empty() == false);
+	LinearToFactorWeights(x);
+
+	std::unordered_map<std::string, std::vector<double> >
+		parameter_gradient;
+	SetupParameterGradient(parameter_gradient);
+	double nll = EvaluateLikelihoodGradient(batch, parameter_gradient);
+
+	// Scale by 1/|B|
+	double scale = 1.0 / static_cast<double>(batch.size());
+	for (std::vector<std::string>::const_iterator
+		ft_name = parameter_order.begin();
+		ft_name != parameter_order.end(); ++ft_name) {
+		std::transform(parameter_gradient[*ft_name].begin(),
+			parameter_gradient[*ft_name].end(),
+			parameter_gradient[*ft_name].begin(), scale * _1);
+	}
+	std::fill(grad.begin(), grad.end(), 0.0);
+	AddParameterGradient(parameter_gradient, grad);
+
+	return (scale * nll);
+}
+
+size_t MaximumLikelihood::MLEProblem::NumberOfInstances() const {
+	return (mle_base->training_data.size());
+}
+
+bool MaximumLikelihood::MLEProblem::HasProximalOperator() const {
+	for (std::multimap<std::string, Prior*>::const_iterator
+		prior = mle_base->priors.begin();
+		prior != mle_base->priors.end(); ++prior) {
+		if (prior->second->HasProximalOperator() == false)
+			return (false);
+	}
+	return (true);
+}
+
+bool MaximumLikelihood::MLEProblem::HasSparseGradient() const {
+	return (true);
+}
+
+void MaximumLikelihood::MLEProblem::MiniBatchSupport(
+	const std::vector<unsigned int>& batch,
+	std::vector<unsigned int>& support) const {
+	support.clear();
+	std::vector<unsigned int> factor_support;
+	const FactorType* last_ft = 0;
+	unsigned int base_idx = 0;
+	for (std::vector<unsigned int>::const_iterator bi = batch.begin();
+		bi != batch.end(); ++bi) {
+		const std::vector<Factor*>& factors =
+			mle_base->training_data[*bi].first->Factors();
+		for (std::vector<Factor*>::const_iterator fi = factors.begin();
+			fi != factors.end(); ++fi) {
+			// Factors of one type are usually adjacent
+			const FactorType* ft = (*fi)->Type();
+			if (ft != last_ft) {
+				std::unordered_map<const FactorType*, unsigned int>::
+					const_iterator tpi = type_position.find(ft);
+				assert(tpi != type_position.end());
+				base_idx = parameter_offset[tpi->second];
+				last_ft = ft;
+			}
+			factor_support.clear();
+			ft->ParameterSupport(*fi, factor_support);
+			for (std::vector<unsigned int>::const_iterator
+				si = factor_support.begin(); si != factor_support.end(); ++si)
+				support.push_back(base_idx + *si);
+		}
+	}
+	std::sort(support.begin(), support.end());
+	support.erase(std::unique(support.begin(), support.end()),
+		support.end());
+}
+
+double MaximumLikelihood::MLEProblem::EvalMiniBatchSparse(
+	const std::vector<unsigned int>& batch,
+	const std::vector<unsigned int>& support, const std::vector<double>& x,
+	std::vector<std::pair<unsigned int, double> >& grad) {
+	assert(x.size() == dim);
+	assert(batch.empty() == false);
+	LinearToFactorWeights(x, support);
+
+	std::unordered_map<std::string, FactorType::sparse_gradient_type>
+		parameter_gradient;
+	double nll = EvaluateLikelihoodGradientSparse(batch, parameter_gradient);
+
+	// Scale by 1/|B| and convert to linear indices
+	double scale = 1.0 / static_cast<double>(batch.size());
+	grad.clear();
+	for (unsigned int ti = 0; ti < parameter_order.size(); ++ti) {
+		std::unordered_map<std::string,
+			FactorType::sparse_gradient_type>::const_iterator pgi =
+				parameter_gradient.find(parameter_order[ti]);
+		if (pgi == parameter_gradient.end())
+			continue;
+		for (FactorType::sparse_gradient_type::const_iterator
+			gi = pgi->second.begin(); gi != pgi->second.end(); ++gi) {
+			grad.push_back(std::make_pair(parameter_offset[ti] + gi->first,
+				scale * gi->second));
+		}
+	}
+
+	// Merge repeated indices
+	std::sort(grad.begin(), grad.end());
+	size_t gn = 0;
+	for (size_t gi = 0; gi < grad.size(); ++gi) {
+		if (gn > 0 && grad[gn-1].first == grad[gi].first) {
+			grad[gn-1].second += grad[gi].second;
+		} else {
+			grad[gn] = grad[gi];
+			gn += 1;
+		}
+	}
+	grad.resize(gn);
+
+	return (scale * nll);
+}
+
+void MaximumLikelihood::MLEProblem::EvalGLazyProximalOperator(
+	std::vector<double>& x, const std::vector<unsigned int>& coords,
+	const std::vector<unsigned int>& counts, double L) const {
+	assert(x.size() == dim);
+	assert(coords.size() == counts.size());
+	if (mle_base->priors.empty())
+		return;
+
+	// Scale L as in EvalGProximalOperator
+	double scale = 1.0 / static_cast<double>(mle_base->training_data.size());
+	L /= scale;
+
+	unsigned int ti = 0;
+	const Prior* prior = 0;
+	for (size_t ci = 0; ci < coords.size(); ++ci) {
+		assert(ci == 0 || coords[ci-1] < coords[ci]);
+		if (ci == 0 || coords[ci] >= parameter_offset[ti+1]) {
+			while (coords[ci] >= parameter_offset[ti+1])
+				ti += 1;
+
+			std::multimap<std::string, Prior*>::const_iterator pri =
+				mle_base->priors.find(parameter_order[ti]);
+			prior = (pri == mle_base->priors.end()) ? 0 : pri->second;
+		}
+		if (prior == 0 || counts[ci] == 0)
+			continue;	// no prior for this type
+
+		x[coords[ci]] = prior->EvaluateRepeatedProximalOperator(
+			x[coords[ci]], L, counts[ci]);
+	}
+}
+
 double MaximumLikelihood::MLEProblem::EvalG(const std::vector<double>& x,
 	std::vector<double>& subgrad) {
 	assert(x.size() == dim);
@@ -206,24 +418,24 @@ void MaximumLikelihood::MLEProblem::EvalGProximalOperator(
 }
 
 double MaximumLikelihood::MLEProblem::EvaluateLikelihoodGradient(
+	const std::vector<unsigned int>& instances,
 	std::unordered_map<std::string, std::vector<double> >&
 		parameter_gradient) {
 	// For each sample: run forward map, run inference, compute gradient
 	Likelihood lh(mle_base->fg_model);
 	double nll = 0.0;
-	int training_sample_count =
-		static_cast<int>(mle_base->training_data.size());
+	int instance_count = static_cast<int>(instances.size());
+	ForwardMapInstances(instances);
 
 	#pragma omp parallel for schedule(dynamic)
-	for (int n = 0; n < training_sample_count; ++n) {
+	for (int ii = 0; ii < instance_count; ++ii) {
+		unsigned int n = instances[ii];
+
 		// Get sample
 		FactorGraph* ts_fg = mle_base->training_data[n].first;
 		const FactorGraphObservation* ts_obs =
 			mle_base->training_data[n].second;
 
-		// Compute forward map: parameters (changed) to energies
-		ts_fg->ForwardMap();
-
 		// Compute marginals
 		InferenceMethod* ts_inf = mle_base->inference_methods[n];
 		ts_inf->ClearInferenceResult();
@@ -246,6 +458,61 @@ double MaximumLikelihood::MLEProblem::EvaluateLikelihoodGradient(
 	return (nll);
 }
 
+double MaximumLikelihood::MLEProblem::EvaluateLikelihoodGradientSparse(
+	const std::vector<unsigned int>& instances,
+	std::unordered_map<std::string, FactorType::sparse_gradient_type>&
+		parameter_gradient) {
+	Likelihood lh(mle_base->fg_model);
+	double nll = 0.0;
+	int instance_count = static_cast<int>(instances.size());
+	// Only the weights in the support of the instances are current
+	ForwardMapInstances(instances);
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int ii = 0; ii < instance_count; ++ii) {
+		unsigned int n = instances[ii];
+		FactorGraph* ts_fg = mle_base->training_data[n].first;
+		const FactorGraphObservation* ts_obs =
+			mle_base->training_data[n].second;
+
+		InferenceMethod* ts_inf = mle_base->inference_methods[n];
+		ts_inf->ClearInferenceResult();
+		ts_inf->PerformInference();
+
+		// The instance gradient is computed outside the critical section
+		std::unordered_map<std::string, FactorType::sparse_gradient_type>
+			instance_gradient;
+		double instance_nll = lh.ComputeNegLogLikelihood(ts_fg, ts_obs,
+			ts_inf->Marginals(), ts_inf->LogPartitionFunction(),
+			instance_gradient);
+
+		#pragma omp critical
+		{
+			nll += instance_nll;
+			for (std::unordered_map<std::string,
+				FactorType::sparse_gradient_type>::const_iterator
+				igi = instance_gradient.begin();
+				igi != instance_gradient.end(); ++igi) {
+				FactorType::sparse_gradient_type& pg =
+					parameter_gradient[igi->first];
+				pg.insert(pg.end(), igi->second.begin(), igi->second.end());
+			}
+		}
+
+		ts_inf->ClearInferenceResult();
+		ts_fg->EnergiesRelease();
+	}
+	return (nll);
+}
+
+void MaximumLikelihood::MLEProblem::ForwardMapInstances(
+	const std::vector<unsigned int>& instances) {
+	for (std::vector<unsigned int>::const_iterator ii = instances.begin();
+		ii != instances.end(); ++ii) {
+		mle_base->training_data[*ii].first->ForwardMap();
+	}
+}
+
 void MaximumLikelihood::MLEProblem::SetupParameterGradient(
 	std::unordered_map<std::string, std::vector<double> >&
 		parameter_gradient) const {
@@ -294,6 +561,20 @@ void MaximumLikelihood::MLEProblem::LinearToFactorWeights(
 	assert(base_idx == x.size());
 }
 
+void MaximumLikelihood::MLEProblem::LinearToFactorWeights(
+	const std::vector<double>& x, const std::vector<unsigned int>& support) {
+	unsigned int ti = 0;
+	std::vector<double>* w = 0;
+	for (size_t si = 0; si < support.size(); ++si) {
+		if (si == 0 || support[si] >= parameter_offset[ti+1]) {
+			while (support[si] >= parameter_offset[ti+1])
+				ti += 1;
+			w = &mle_base->fg_model->FactorTypes()[ti]->Weights();
+		}
+		(*w)[support[si] - parameter_offset[ti]] = x[support[si]];
+	}
+}
+
 unsigned int MaximumLikelihood::MLEProblem::Dimensions() const {
 	return (dim);
 }
@@ -317,5 +598,82 @@ void MaximumLikelihood::MLEProblem::ProvideStartingPoint(
 	assert(base_idx == x0.size());
 }
 
+// Stochastic view
+MaximumLikelihood::MLEStochasticProblem::MLEStochasticProblem(
+	MLEProblem* mle_prob)
+	: mle_prob(mle_prob) {
+}
+
+MaximumLikelihood::MLEStochasticProblem::~MLEStochasticProblem() {
+}
+
+double MaximumLikelihood::MLEStochasticProblem::Eval(unsigned int sample_id,
+	const std::vector<double>& x, std::vector<double>& grad) {
+	// The elements are 1/N -log p(x_n;w)
+	std::vector<unsigned int> batch(1, sample_id);
+	double scale = 1.0 / static_cast<double>(NumberOfElements());
+	double obj = mle_prob->EvalMiniBatch(batch, x, grad);
+	std::transform(grad.begin(), grad.end(), grad.begin(), scale * _1);
+
+	return (scale * obj);
+}
+
+unsigned int MaximumLikelihood::MLEStochasticProblem::Dimensions() const {
+	return (mle_prob->Dimensions());
+}
+
+size_t MaximumLikelihood::MLEStochasticProblem::NumberOfElements() const {
+	return (mle_prob->NumberOfInstances());
+}
+
+void MaximumLikelihood::MLEStochasticProblem::ProvideStartingPoint(
+	std::vector<double>& x0) const {
+	mle_prob->ProvideStartingPoint(x0);
+}
+
+double MaximumLikelihood::MLEStochasticProblem::EvalMiniBatch(
+	const std::vector<unsigned int>& batch, const std::vector<double>& x,
+	std::vector<double>& grad) {
+	return (mle_prob->EvalMiniBatch(batch, x, grad));
+}
+
+double MaximumLikelihood::MLEStochasticProblem::EvalG(
+	const std::vector<double>& x, std::vector<double>& subgrad) {
+	return (mle_prob->EvalG(x, subgrad));
+}
+
+bool MaximumLikelihood::MLEStochasticProblem::HasProximalOperator() const {
+	return (mle_prob->HasProximalOperator());
+}
+
+void MaximumLikelihood::MLEStochasticProblem::EvalGProximalOperator(
+	const std::vector<double>& u, double L,
+	std::vector<double>& wprox) const {
+	mle_prob->EvalGProximalOperator(u, L, wprox);
+}
+
+bool MaximumLikelihood::MLEStochasticProblem::HasSparseGradient() const {
+	return (mle_prob->HasSparseGradient());
+}
+
+void MaximumLikelihood::MLEStochasticProblem::MiniBatchSupport(
+	const std::vector<unsigned int>& batch,
+	std::vector<unsigned int>& support) {
+	mle_prob->MiniBatchSupport(batch, support);
+}
+
+double MaximumLikelihood::MLEStochasticProblem::EvalMiniBatchSparse(
+	const std::vector<unsigned int>& batch,
+	const std::vector<unsigned int>& support, const std::vector<double>& x,
+	sparse_vector_type& grad) {
+	return (mle_prob->EvalMiniBatchSparse(batch, support, x, grad));
+}
+
+void MaximumLikelihood::MLEStochasticProblem::EvalGLazyProximalOperator(
+	std::vector<double>& x, const std::vector<unsigned int>& coords,
+	const std::vector<unsigned int>& counts, double L) const {
+	mle_prob->EvalGLazyProximalOperator(x, coords, counts, L);
+}
+
 }
 
@@ -5,9 +5,11 @@
 #include <vector>
 #include <string>
 #include <unordered_map>
+#include <utility>
 
 #include "ParameterEstimationMethod.h"
 #include "CompositeMinimizationProblem.h"
+#include "StochasticFunctionMinimizationProblem.h"
 #include "InferenceMethod.h"
 
 namespace Grante {
@@ -23,9 +25,24 @@ public:
 		SimpleGradientMethod,
 		BarzilaiBorweinMethod,
 		FISTAMethod,
+		// Mini-batch stochastic methods, see
+		// StochasticFunctionMinimization::MiniBatchMinimize.  For these,
+		// max_iter in Train is the maximum number of epochs.
+		MomentumSGDMethod,
+		AdaGradMethod,
+		AdamMethod,
+		SVRGMethod,
+		SparseSGDMethod,
 	};
 	void SetOptimizationMethod(MLEOptimizationMethod opt_method);
 
+	// Set the parameters of the mini-batch stochastic methods.
+	//
+	// step_size: Base step size, >0, default: 1.0e-2.
+	// batch_size: Number of training instances per mini-batch, >0,
+	//    default: 32.
+	void SetStochasticParameters(double step_size, unsigned int batch_size);
+
 	// NOTE: training using multiple cores (OpenMP) is only safe if
 	// each factor graph is unique in the training set
 	virtual double Train(double conv_tol, unsigned int max_iter = 0);
@@ -33,6 +50,8 @@ public:
 
 //protected:
 	MLEOptimizationMethod opt_method;
+	double stochastic_step_size;
+	unsigned int stochastic_batch_size;
 
 	// Function minimization definition of Maximum Likelihood Estimation (MLE)
 	// The function minimized is:
@@ -53,23 +72,110 @@ public:
 		virtual void ProvideStartingPoint(std::vector<double>& x0) const;
 		void LinearToFactorWeights(const std::vector<double>& x);
 
+		// Unbiased estimate of EvalF from the training instances in batch,
+		//    1/|B| \sum_{n in B} -log p(x_n;w).
+		// The instances are processed in parallel.
+		double EvalMiniBatch(const std::vector<unsigned int>& batch,
+			const std::vector<double>& x, std::vector<double>& grad);
+		size_t NumberOfInstances() const;
+		// True if all priors implement the proximal operator
+		bool HasProximalOperator() const;
+
+		// Sparse variant of EvalMiniBatch, see
+		// StochasticFunctionMinimizationProblem::EvalMiniBatchSparse.  Only
+		// the weights in the support of the batch are set from x.
+		virtual bool HasSparseGradient() const;
+		void MiniBatchSupport(const std::vector<unsigned int>& batch,
+			std::vector<unsigned int>& support) const;
+		double EvalMiniBatchSparse(const std::vector<unsigned int>& batch,
+			const std::vector<unsigned int>& support,
+			const std::vector<double>& x,
+			std::vector<std::pair<unsigned int, double> >& grad);
+		// Proximal operator of the priors applied counts[i] times to
+		// coordinate coords[i] of x.  coords must be sorted.
+		void EvalGLazyProximalOperator(std::vector<double>& x,
+			const std::vector<unsigned int>& coords,
+			const std::vector<unsigned int>& counts, double L) const;
+
 	protected:
 		MaximumLikelihood* mle_base;
 		unsigned int dim;
 		std::vector<std::string> parameter_order;
-
+		// Linear index of the first weight of parameter_order[i]
+		std::vector<unsigned int> parameter_offset;
+		// Position in parameter_order of each factor type of the model
+		std::unordered_map<const FactorType*, unsigned int> type_position;
+
+		// Sparse variant of EvaluateLikelihoodGradient
+		virtual double EvaluateLikelihoodGradientSparse(
+			const std::vector<unsigned int>& instances,
+			std::unordered_map<std::string,
+				FactorType::sparse_gradient_type>& parameter_gradient);
+
+		// Compute \sum_{n in instances} -log p(x_n;w) and its gradient.
 		virtual double EvaluateLikelihoodGradient(
+			const std::vector<unsigned int>& instances,
 			std::unordered_map<std::string, std::vector<double> >&
 				parameter_gradient);
 
 	private:
+		// Compute the energies of the given training instances.  This is
+		// done serially before the instances are processed in parallel: the
+		// conditioned factors of different instances, such as the
+		// components of MaximumCompositeLikelihood, can share an original
+		// factor whose energies their forward map writes.
+		void ForwardMapInstances(const std::vector<unsigned int>& instances);
 		void SetupParameterGradient(std::unordered_map<std::string,
 			std::vector<double> >& parameter_gradient) const;
+		// Set only the weights with linear indices in the sorted support
+		void LinearToFactorWeights(const std::vector<double>& x,
+			const std::vector<unsigned int>& support);
 		void AddParameterGradient(const std::unordered_map<std::string,
 			std::vector<double> >& parameter_gradient,
 			std::vector<double>& grad) const;
 	};
 
+	// Stochastic view of an MLEProblem, the elements are the training
+	// instances and the prior is the composite term.
+	class MLEStochasticProblem : public StochasticFunctionMinimizationProblem {
+	public:
+		MLEStochasticProblem(MLEProblem* mle_prob);
+		virtual ~MLEStochasticProblem();
+
+		virtual double Eval(unsigned int sample_id,
+			const std::vector<double>& x, std::vector<double>& grad);
+		virtual unsigned int Dimensions() const;
+		virtual size_t NumberOfElements() const;
+		virtual void ProvideStartingPoint(std::vector<double>& x0) const;
+
+		virtual double EvalMiniBatch(const std::vector<unsigned int>& batch,
+			const std::vector<double>& x, std::vector<double>& grad);
+		virtual double EvalG(const std::vector<double>& x,
+			std::vector<double>& subgrad);
+		virtual bool HasProximalOperator() const;
+		virtual void EvalGProximalOperator(const std::vector<double>& u,
+			double L, std::vector<double>& wprox) const;
+
+		virtual bool HasSparseGradient() const;
+		virtual void MiniBatchSupport(const std::vector<unsigned int>& batch,
+			std::vector<unsigned int>& support);
+		virtual double EvalMiniBatchSparse(
+			const std::vector<unsigned int>& batch,
+			const std::vector<unsigned int>& support,
+			const std::vector<double>& x, sparse_vector_type& grad);
+		virtual void EvalGLazyProximalOperator(std::vector<double>& x,
+			const std::vector<unsigned int>& coords,
+			const std::vector<unsigned int>& counts, double L) const;
+
+	private:
+		MLEProblem* mle_prob;
+	};
+
+	// Minimize the given problem with one of the mini-batch stochastic
+	// methods and the current stochastic parameters.
+	double MinimizeStochastic(MLEProblem& prob, MLEOptimizationMethod method,
+		std::vector<double>& x_opt, double conv_tol, unsigned int max_epochs);
+
 	// FIXME: temporary
 	MLEProblem* GetLearnProblem();
 
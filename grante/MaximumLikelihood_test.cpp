@@ -0,0 +1,146 @@
+
+#include "grante/MaximumLikelihood.h"
+
+#include <random>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "grante/Factor.h"
+#include "grante/FactorGraph.h"
+#include "grante/FactorGraphModel.h"
+#include "grante/FactorGraphObservation.h"
+#include "grante/FactorType.h"
+#include "grante/TreeInference.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+void ExpectVectorNear(const std::vector<double>& actual,
+    const std::vector<double>& expected, double tol) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (unsigned int i = 0; i < actual.size(); ++i)
+        EXPECT_THAT(actual[i], testing::DoubleNear(expected[i], tol));
+}
+
+}
+
+TEST(MaximumLikelihood, MiniBatchMatchesFullBatch) {
+    Grante::FactorGraphModel model;
+    std::vector<unsigned int> card1(1, 3);
+    std::vector<double> w1(3 * 2, 0.0);
+    model.AddFactorType(new Grante::FactorType("unary", card1, w1));
+    std::vector<unsigned int> card2(2, 3);
+    std::vector<double> w2(9, 0.0);
+    model.AddFactorType(new Grante::FactorType("pairwise", card2, w2));
+
+    // Chains of varying length with random features and labels
+    std::default_random_engine e1(11);
+    std::normal_distribution<double> randn(0.0, 1.0);
+    std::uniform_int_distribution<unsigned int> randlabel(0, 2);
+    unsigned int N = 6;
+    std::vector<Grante::FactorGraph*> fgs;
+    std::vector<Grante::InferenceMethod*> inference_methods;
+    std::vector<Grante::ParameterEstimationMethod::labeled_instance_type>
+        training_data;
+    for (unsigned int n = 0; n < N; ++n) {
+        unsigned int length = 2 + n;
+        std::vector<unsigned int> vc(length, 3);
+        Grante::FactorGraph* fg = new Grante::FactorGraph(&model, vc);
+        std::vector<unsigned int> label(length);
+        for (unsigned int vi = 0; vi < length; ++vi) {
+            label[vi] = randlabel(e1);
+            std::vector<double> data(2);
+            data[0] = randn(e1);
+            data[1] = 1.0;
+            std::vector<unsigned int> var_index1(1, vi);
+            fg->AddFactor(new Grante::Factor(
+                model.FindFactorType("unary"), var_index1, data));
+            if (vi > 0) {
+                std::vector<unsigned int> var_index2(2);
+                var_index2[0] = vi - 1;
+                var_index2[1] = vi;
+                std::vector<double> data2;
+                fg->AddFactor(new Grante::Factor(
+                    model.FindFactorType("pairwise"), var_index2, data2));
+            }
+        }
+        fgs.push_back(fg);
+        inference_methods.push_back(new Grante::TreeInference(fg));
+        training_data.push_back(
+            Grante::ParameterEstimationMethod::labeled_instance_type(
+                fg, new Grante::FactorGraphObservation(label)));
+    }
+
+    Grante::MaximumLikelihood mle(&model);
+    mle.SetupTrainingData(training_data, inference_methods);
+    Grante::MaximumLikelihood::MLEProblem* prob = mle.GetLearnProblem();
+    Grante::MaximumLikelihood::MLEStochasticProblem sprob(prob);
+    unsigned int dim = sprob.Dimensions();
+    ASSERT_EQ(15, dim);
+    ASSERT_EQ(N, sprob.NumberOfElements());
+
+    std::vector<double> x(dim);
+    for (unsigned int d = 0; d < dim; ++d)
+        x[d] = randn(e1);
+
+    // Full batch objective, 1/N \sum_n -log p(x_n;w)
+    std::vector<double> grad_full(dim, 0.0);
+    double obj_full = prob->EvalF(x, grad_full);
+
+    // A mini-batch of all N instances, in a different order
+    std::vector<unsigned int> batch_all;
+    for (unsigned int n = N; n-- > 0; )
+        batch_all.push_back(n);
+    std::vector<double> grad_batch(dim);
+    double obj_batch = sprob.EvalMiniBatch(batch_all, x, grad_batch);
+    EXPECT_THAT(obj_batch, testing::DoubleNear(obj_full, 1.0e-10));
+    ExpectVectorNear(grad_batch, grad_full, 1.0e-10);
+
+    // Sparse evaluation of the same batch
+    std::vector<unsigned int> support;
+    sprob.MiniBatchSupport(batch_all, support);
+    Grante::StochasticFunctionMinimizationProblem::sparse_vector_type
+        grad_sparse;
+    double obj_sparse =
+        sprob.EvalMiniBatchSparse(batch_all, support, x, grad_sparse);
+    EXPECT_THAT(obj_sparse, testing::DoubleNear(obj_full, 1.0e-10));
+    std::vector<double> grad_sparse_dense(dim, 0.0);
+    for (unsigned int gi = 0; gi < grad_sparse.size(); ++gi)
+        grad_sparse_dense[grad_sparse[gi].first] += grad_sparse[gi].second;
+    ExpectVectorNear(grad_sparse_dense, grad_full, 1.0e-10);
+
+    // The elements sum to the full batch objective
+    double obj_sum = 0.0;
+    std::vector<double> grad_sum(dim, 0.0);
+    std::vector<double> grad_elem(dim);
+    for (unsigned int n = 0; n < N; ++n) {
+        obj_sum += sprob.Eval(n, x, grad_elem);
+        for (unsigned int d = 0; d < dim; ++d)
+            grad_sum[d] += grad_elem[d];
+    }
+    EXPECT_THAT(obj_sum, testing::DoubleNear(obj_full, 1.0e-10));
+    ExpectVectorNear(grad_sum, grad_full, 1.0e-10);
+
+    // A smaller mini-batch is scaled by N/|B|
+    std::vector<unsigned int> batch;
+    batch.push_back(4);
+    batch.push_back(1);
+    double obj_small = sprob.EvalMiniBatch(batch, x, grad_batch);
+    double obj_small_ref = 0.0;
+    std::vector<double> grad_small_ref(dim, 0.0);
+    double scale = static_cast<double>(N) / static_cast<double>(batch.size());
+    for (unsigned int bi = 0; bi < batch.size(); ++bi) {
+        obj_small_ref += scale * sprob.Eval(batch[bi], x, grad_elem);
+        for (unsigned int d = 0; d < dim; ++d)
+            grad_small_ref[d] += scale * grad_elem[d];
+    }
+    EXPECT_THAT(obj_small, testing::DoubleNear(obj_small_ref, 1.0e-10));
+    ExpectVectorNear(grad_batch, grad_small_ref, 1.0e-10);
+
+    delete prob;
+    for (unsigned int n = 0; n < N; ++n) {
+        delete training_data[n].second;
+        delete inference_methods[n];
+        delete fgs[n];
+    }
+}
@@ -1,9 +1,15 @@
 
 #include <iostream>
 #include <algorithm>
+#include <functional>
+#include <numeric>
 #include <limits>
 #include <cassert>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include "FunctionMinimization.h"
 #include "CompositeMinimization.h"
 #include "MaximumPseudolikelihood.h"
@@ -55,6 +61,14 @@ double MaximumPseudolikelihood::Train(double conv_tol, unsigned int max_iter) {
 		obj = CompositeMinimization::FISTAMinimize(
 			mple_prob, x_opt, conv_tol, max_iter, true);
 		break;
+	case (MomentumSGDMethod):
+	case (AdaGradMethod):
+	case (AdamMethod):
+	case (SVRGMethod):
+	case (SparseSGDMethod):
+		obj = MinimizeStochastic(mple_prob, opt_method, x_opt,
+			conv_tol, max_iter);
+		break;
 	default:
 		assert(0);
 		break;
@@ -69,27 +83,63 @@ double MaximumPseudolikelihood::Train(double conv_tol, unsigned int max_iter) {
 MaximumPseudolikelihood::MPLEProblem::MPLEProblem(
 	MaximumPseudolikelihood* mple_base)
 	: MLEProblem(mple_base), mple_base(mple_base) {
-	// Initialize Gibbs sampler for computing single-site conditional
+	// Precompute the site adjacency for computing single-site conditional
 	// distributions
-	fgu.resize(mple_base->training_data.size());
-	for (unsigned int n = 0; n < mple_base->training_data.size(); ++n)
-		fgu[n] = new FactorGraphUtility(mple_base->training_data[n].first);
+	site_adj.resize(mple_base->training_data.size());
+	for (unsigned int n = 0; n < mple_base->training_data.size(); ++n) {
+		site_adj[n] = new Pseudolikelihood::SiteAdjacency(
+			mple_base->training_data[n].first);
+	}
 }
 
 MaximumPseudolikelihood::MPLEProblem::~MPLEProblem() {
-	for (unsigned int n = 0; n < fgu.size(); ++n)
-		delete(fgu[n]);
+	for (unsigned int n = 0; n < site_adj.size(); ++n)
+		delete(site_adj[n]);
+}
+
+bool MaximumPseudolikelihood::MPLEProblem::HasSparseGradient() const {
+	return (false);
 }
 
 double MaximumPseudolikelihood::MPLEProblem::EvaluateLikelihoodGradient(
+	const std::vector<unsigned int>& instances,
 	std::unordered_map<std::string, std::vector<double> >&
 		parameter_gradient) {
 
 	Pseudolikelihood plh(mple_base->fg_model);
+	int instance_count = static_cast<int>(instances.size());
+	int thread_count = 1;
+#ifdef _OPENMP
+	thread_count = std::max(1, std::min(omp_get_max_threads(),
+		instance_count));
+#endif
+
+	// Per-thread gradients, the gradient of thread 0 is parameter_gradient.
+	// With round-robin scheduling thread ti handles the instances ii with
+	// ii % thread_count == ti.  The gradients are summed in thread order and
+	// the objectives in instance order after the parallel loop, such that
+	// the result is deterministic for a given number of threads.
+	std::vector<std::unordered_map<std::string, std::vector<double> > >
+		thread_gradient(thread_count);
+	for (int ti = 1; ti < thread_count; ++ti) {
+		for (std::unordered_map<std::string, std::vector<double> >::
+			const_iterator pgi = parameter_gradient.begin();
+			pgi != parameter_gradient.end(); ++pgi) {
+			thread_gradient[ti][pgi->first] =
+				std::vector<double>(pgi->second.size(), 0.0);
+		}
+	}
+	std::vector<double> nll_ii(instance_count, 0.0);
 
 	// For each sample: run forward map, compute gradient
-	double nll = 0.0;
-	for (unsigned int n = 0; n < mple_base->training_data.size(); ++n) {
+	#pragma omp parallel for schedule(static, 1) num_threads(thread_count)
+	for (int ii = 0; ii < instance_count; ++ii) {
+		int ti = 0;
+#ifdef _OPENMP
+		ti = omp_get_thread_num();
+#endif
+		unsigned int n = instances[ii];
+
 		// Get sample
 		FactorGraph* ts_fg = mple_base->training_data[n].first;
 		const FactorGraphObservation* ts_obs =
@@ -99,12 +149,23 @@ double MaximumPseudolikelihood::MPLEProblem::EvaluateLikelihoodGradient(
 		ts_fg->ForwardMap();
 
 		// Compute log-pseudolikelihood and gradient
-		nll += plh.ComputeNegLogPseudolikelihood(ts_fg, fgu[n], ts_obs,
-			parameter_gradient);
+		nll_ii[ii] = plh.ComputeNegLogPseudolikelihood(ts_fg, site_adj[n],
+			ts_obs, ti == 0 ? parameter_gradient : thread_gradient[ti]);
 
 		// Conserve memory by destroying unused energies
 		ts_fg->EnergiesRelease();
 	}
+
+	for (int ti = 1; ti < thread_count; ++ti) {
+		for (std::unordered_map<std::string, std::vector<double> >::
+			iterator pgi = parameter_gradient.begin();
+			pgi != parameter_gradient.end(); ++pgi) {
+			const std::vector<double>& t_grad = thread_gradient[ti][pgi->first];
+			std::transform(pgi->second.begin(), pgi->second.end(),
+				t_grad.begin(), pgi->second.begin(), std::plus<double>());
+		}
+	}
+	double nll = std::accumulate(nll_ii.begin(), nll_ii.end(), 0.0);
 	return (nll);
 }
 
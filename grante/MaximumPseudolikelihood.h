@@ -6,7 +6,7 @@
 #include <vector>
 
 #include "MaximumLikelihood.h"
-#include "FactorGraphUtility.h"
+#include "Pseudolikelihood.h"
 
 namespace Grante {
 
@@ -32,17 +32,21 @@ public:
 		MPLEProblem(MaximumPseudolikelihood* mple_base);
 		virtual ~MPLEProblem();
 
+		// The pseudolikelihood gradient is computed densely
+		virtual bool HasSparseGradient() const;
+
 	protected:
 		MaximumPseudolikelihood* mple_base;
 
 		virtual double EvaluateLikelihoodGradient(
+			const std::vector<unsigned int>& instances,
 			std::unordered_map<std::string, std::vector<double> >&
 				parameter_gradient);
 
 	private:
-		// Keep an initialized Gibbs sampler for each training factor graph.
-		// This is used to compute single-site conditional distributions.
-		std::vector<FactorGraphUtility*> fgu;
+		// Precomputed variable strides of each training factor graph, used
+		// to compute single-site conditional distributions.
+		std::vector<Pseudolikelihood::SiteAdjacency*> site_adj;
 	};
 };
 
@@ -105,8 +105,15 @@ void MultichainGibbsInference::PerformInference() {
 
 void MultichainGibbsInference::PerformBurninPhase() {
 	// Overdispersed initialization with the distribution of maximum entropy
-	for (unsigned int ci = 0; ci < number_of_chains; ++ci)
+	for (unsigned int ci = 0; ci < number_of_chains; ++ci) {
 		chain_gibbs[ci].SetStateUniformRandom();
+		if (evidence.empty()) {
+			// Release the variables fixed by earlier evidence
+			chain_gibbs[ci].SetFixedVariableIndices();
+		} else {
+			chain_gibbs[ci].SetFixedVariableStates(evidence);
+		}
+	}
 
 	// Run chains until maximum per-dimension PSRF is below threshold
 	unsigned int sweep_steps = 10;
@@ -248,5 +255,9 @@ double MultichainGibbsInference::MinimizeEnergy(std::vector<unsigned int>& state
 	return (std::numeric_limits<double>::signaling_NaN());
 }
 
+bool MultichainGibbsInference::SupportsEvidence() const {
+	return (true);
+}
+
 }
 
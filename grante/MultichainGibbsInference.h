@@ -62,6 +62,9 @@ public:
 	// NOT IMPLEMENTED
 	virtual double MinimizeEnergy(std::vector<unsigned int>& state);
 
+	// Observed variables are fixed in the sampler
+	virtual bool SupportsEvidence() const;
+
 private:
 	// Marginal distribution means and variances for M chains
 	typedef std::vector<std::vector<double> > marginals_t;
@@ -1,9 +1,10 @@
 
+#include <algorithm>
 #include <limits>
 #include <cmath>
 #include <cassert>
 
-#include "LogSumExp.h"
+#include "VectorMath.h"
 #include "NaiveMeanFieldInference.h"
 
 namespace Grante {
@@ -11,7 +12,7 @@ namespace Grante {
 NaiveMeanFieldInference::NaiveMeanFieldInference(const FactorGraph* fg)
 	: InferenceMethod(fg), fgu(fg),
 	log_z(std::numeric_limits<double>::signaling_NaN()),
-	verbose(true), conv_tol(1.0e-6), max_iter(50) {
+	verbose(true), conv_tol(1.0e-6), max_iter(50), parallel(false) {
 }
 
 NaiveMeanFieldInference::~NaiveMeanFieldInference() {
@@ -20,53 +21,154 @@ NaiveMeanFieldInference::~NaiveMeanFieldInference() {
 InferenceMethod* NaiveMeanFieldInference::Produce(const FactorGraph* fg) const
 {
 	NaiveMeanFieldInference* nmf = new NaiveMeanFieldInference(fg);
-	nmf->SetParameters(verbose, conv_tol, max_iter);
+	nmf->SetParameters(verbose, conv_tol, max_iter, parallel);
 
 	return (nmf);
 }
 
 void NaiveMeanFieldInference::SetParameters(bool verbose, double conv_tol,
-	unsigned int max_iter) {
+	unsigned int max_iter, bool parallel) {
 	assert(conv_tol > 0.0);
 	this->verbose = verbose;
 	this->conv_tol = conv_tol;
 	this->max_iter = max_iter;
+	this->parallel = parallel;
 }
 
 void NaiveMeanFieldInference::PerformInference() {
 	// Setup variable distributions (we will construct the full factor
 	// marginals after everything else)
 	const std::vector<unsigned int>& card = fg->Cardinalities();
-	std::vector<std::vector<double> > vmarg(card.size());
-	for (unsigned int vi = 0; vi < card.size(); ++vi) {
-		vmarg[vi].resize(card[vi]);
-		std::fill(vmarg[vi].begin(), vmarg[vi].end(),
-			1.0 / static_cast<double>(card[vi]));
+	std::vector<std::vector<double> > vmarg;
+	if (warm_start && warm_vmarg.size() == card.size()) {
+		vmarg.swap(warm_vmarg);
+	} else {
+		vmarg.resize(card.size());
+		for (unsigned int vi = 0; vi < card.size(); ++vi) {
+			vmarg[vi].resize(card[vi]);
+			std::fill(vmarg[vi].begin(), vmarg[vi].end(),
+				1.0 / static_cast<double>(card[vi]));
+		}
+	}
+	// Observed variables have fixed point-mass distributions
+	if (evidence.empty() == false) {
+		for (unsigned int vi = 0; vi < card.size(); ++vi) {
+			if (IsObserved(vi) == false)
+				continue;
+			std::fill(vmarg[vi].begin(), vmarg[vi].end(), 0.0);
+			vmarg[vi][evidence[vi]] = 1.0;
+		}
 	}
+	if (parallel && color_vars.empty())
+		ComputeColoring();
 
 	// Iterate naive mean field on variables
 	double conv_measure = std::numeric_limits<double>::infinity();
 	log_z = -std::numeric_limits<double>::infinity();
+	std::vector<double> scratch;
+	std::vector<double> scratch2;
 	for (unsigned int iter = 1; (max_iter == 0 || iter <= max_iter) &&
 		conv_measure >= conv_tol; ++iter)
 	{
 		// Update all site distributions
-		for (unsigned int vi = 0; vi < card.size(); ++vi)
-			UpdateSite(vmarg, vi);
+		if (parallel) {
+			// Variables of one color do not share factors
+			for (unsigned int ci = 0; ci < color_vars.size(); ++ci) {
+				const std::vector<unsigned int>& cvars = color_vars[ci];
+				int cvar_count = static_cast<int>(cvars.size());
+				#pragma omp parallel
+				{
+					std::vector<double> t_scratch;
+					std::vector<double> t_scratch2;
+					#pragma omp for schedule(dynamic, 64)
+					for (int cvi = 0; cvi < cvar_count; ++cvi)
+						UpdateSite(vmarg, cvars[cvi], t_scratch, t_scratch2);
+				}
+			}
+		} else {
+			for (unsigned int vi = 0; vi < card.size(); ++vi)
+				UpdateSite(vmarg, vi, scratch, scratch2);
+		}
 
 		double log_z_prev = log_z;
 		log_z = ComputeLogPartitionFunction(vmarg);
-		assert(log_z >= log_z_prev);	// Monotonic ascent
+		// Monotonic ascent, up to round-off in the summation
+		assert(log_z >= log_z_prev - 1.0e-10 * std::fabs(log_z));
 		conv_measure = log_z - log_z_prev;
 	}
 
 	// Produce final approximate marginals
 	ProduceMarginals(vmarg);
+	if (warm_start)
+		warm_vmarg.swap(vmarg);
+}
+
+void NaiveMeanFieldInference::ComputeColoring() {
+	// Greedy coloring of the variables, two variables are adjacent if they
+	// share a factor
+	const std::vector<Factor*>& factors = fg->Factors();
+	size_t var_count = fg->Cardinalities().size();
+	std::vector<unsigned int> var_color(var_count,
+		std::numeric_limits<unsigned int>::max());
+	std::vector<unsigned int> color_mark;
+	color_vars.clear();
+	for (unsigned int vi = 0; vi < var_count; ++vi) {
+		const std::set<unsigned int>& adj = fgu.AdjacentFactors(vi);
+		for (std::set<unsigned int>::const_iterator afi = adj.begin();
+			afi != adj.end(); ++afi) {
+			const std::vector<unsigned int>& fvars = factors[*afi]->Variables();
+			for (unsigned int fvi = 0; fvi < fvars.size(); ++fvi) {
+				if (var_color[fvars[fvi]] < color_mark.size())
+					color_mark[var_color[fvars[fvi]]] = vi;
+			}
+		}
+		unsigned int color = 0;
+		while (color < color_mark.size() && color_mark[color] == vi)
+			color += 1;
+		if (color == color_mark.size()) {
+			color_mark.push_back(std::numeric_limits<unsigned int>::max());
+			color_vars.push_back(std::vector<unsigned int>());
+		}
+		var_color[vi] = color;
+		color_vars[color].push_back(vi);
+	}
+}
+
+void NaiveMeanFieldInference::ProductDistribution(const Factor* fac,
+	const std::vector<std::vector<double> >& vmarg, size_t skip_fvi,
+	std::vector<double>& prod, std::vector<double>& scratch) {
+	// The first variable runs fastest in the energy table, hence build the
+	// outer product starting from the last variable.
+	const std::vector<unsigned int>& fvars = fac->Variables();
+	const std::vector<unsigned int>& fcard = fac->Type()->Cardinalities();
+	prod.assign(1, 1.0);
+	for (size_t fvi = fvars.size(); fvi-- > 0; ) {
+		size_t var_card = fcard[fvi];
+		size_t prod_size = prod.size();
+		scratch.resize(prod_size * var_card);
+		if (fvi == skip_fvi) {
+			for (size_t pi = 0; pi < prod_size; ++pi)
+				std::fill(&scratch[pi*var_card], &scratch[pi*var_card] + var_card,
+					prod[pi]);
+		} else {
+			const double* q = &vmarg[fvars[fvi]][0];
+			for (size_t pi = 0; pi < prod_size; ++pi) {
+				double* dest = &scratch[pi*var_card];
+				for (size_t si = 0; si < var_card; ++si)
+					dest[si] = prod[pi] * q[si];
+			}
+		}
+		prod.swap(scratch);
+	}
 }
 
 // Update a site distribution analytically, (3.39) in [Nowozin2011].
 double NaiveMeanFieldInference::UpdateSite(
-	std::vector<std::vector<double> >& vmarg, unsigned int vi) const {
+	std::vector<std::vector<double> >& vmarg, unsigned int vi,
+	std::vector<double>& scratch, std::vector<double>& scratch2) const {
+	if (IsObserved(vi))
+		return (0.0);
+
 	std::vector<double> E_vi(vmarg[vi].size(), 1.0);
 
 	// Walk all adjacent factors
@@ -77,34 +179,42 @@ double NaiveMeanFieldInference::UpdateSite(
 		afi != adj.end(); ++afi) {
 		// Get information required from this factor
 		const Factor* fac = factors[*afi];
-		const FactorType* ftype = fac->Type();
 		const std::vector<unsigned int>& fvars = fac->Variables();
+		const std::vector<unsigned int>& fcard = fac->Type()->Cardinalities();
 		const std::vector<double>& E = fac->Energies();
 
-		// y_F in \mathcal{Y}_F
-		for (unsigned int ei = 0; ei < E.size(); ++ei) {
-			double P_vi = 1.0;	// \prod_{j in N(F) \ {i}} q_j(y_j)
-			unsigned int vi_state = std::numeric_limits<unsigned int>::max();
-			for (unsigned int fvi = 0; fvi < fvars.size(); ++fvi) {
-				// j in N(F) \ {i}
-				if (fvars[fvi] == vi) {
-					vi_state = ftype->LinearIndexToVariableState(ei, fvi);
-					continue;
-				}
-
-				unsigned int fvi_state =
-					ftype->LinearIndexToVariableState(ei, fvi);
-				P_vi *= vmarg[fvars[fvi]][fvi_state];	// q_j(y_j)
+		size_t vi_fvi = 0;
+		size_t stride = 1;	// table stride of variable vi
+		while (fvars[vi_fvi] != vi) {
+			stride *= fcard[vi_fvi];
+			vi_fvi += 1;
+		}
+		size_t vi_card = fcard[vi_fvi];
+
+		// \prod_{j in N(F) \ {i}} q_j(y_j), in table order
+		ProductDistribution(fac, vmarg, vi_fvi, scratch, scratch2);
+		const double* P_vi = &scratch[0];
+		const double* E_ptr = &E[0];
+
+		// y_F in \mathcal{Y}_F, contiguous runs of stride entries share the
+		// state of vi
+		for (size_t base = 0; base < E.size(); base += stride * vi_card) {
+			for (size_t vsi = 0; vsi < vi_card; ++vsi) {
+				size_t offset = base + vsi * stride;
+				double expect = 0.0;
+				for (size_t ii = 0; ii < stride; ++ii)
+					expect += P_vi[offset + ii] * E_ptr[offset + ii];
+				E_vi[vsi] -= expect;
 			}
-			E_vi[vi_state] -= P_vi * E[ei];
 		}
 	}
-	double lambda = -LogSumExp::Compute(E_vi);	// (3.40)
+	// Normalize, lambda = -log sum exp(E_vi), (3.40)
+	VectorMath::NormalizeLog(&E_vi[0], E_vi.size());
 
 	// Update distribution
 	double max_diff = -std::numeric_limits<double>::infinity();
 	for (unsigned int vsi = 0; vsi < E_vi.size(); ++vsi) {
-		double new_val = std::exp(E_vi[vsi] + lambda);
+		double new_val = E_vi[vsi];
 		max_diff = std::max(std::fabs(vmarg[vi][vsi] - new_val), max_diff);
 		vmarg[vi][vsi] = new_val;
 	}
@@ -117,27 +227,36 @@ double NaiveMeanFieldInference::ComputeLogPartitionFunction(
 	const std::vector<std::vector<double> >& vmarg) const {
 	// Compute the entropy, (3.32)
 	double lz = 0.0;
-	for (unsigned int vi = 0; vi < vmarg.size(); ++vi) {
+	int var_count = static_cast<int>(vmarg.size());
+	#pragma omp parallel for reduction(+:lz) if(parallel)
+	for (int vi = 0; vi < var_count; ++vi) {
 		for (unsigned int vsi = 0; vsi < vmarg[vi].size(); ++vsi) {
-			lz += vmarg[vi][vsi] * std::log(vmarg[vi][vsi]);
+			// 0 log 0 = 0, as for observed variables
+			if (vmarg[vi][vsi] > 0.0)
+				lz += vmarg[vi][vsi] * std::log(vmarg[vi][vsi]);
 		}
 	}
 
 	// Add the average energy as by the meanfield approximation to the factor
 	// marginals
 	const std::vector<Factor*>& factors = fg->Factors();
-	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
-		const Factor* fac = factors[fi];
-		const FactorType* ftype = fac->Type();
-		const std::vector<unsigned int>& fvars = fac->Variables();
-		const std::vector<double>& E = fac->Energies();
-
-		for (unsigned int ei = 0; ei < E.size(); ++ei) {
-			double P_vi = 1.0;	// q_F := \prod_{j in N(F)} q_j(y_j)
-			for (unsigned int fvi = 0; fvi < fvars.size(); ++fvi)
-				P_vi *= vmarg[fvars[fvi]][ftype->LinearIndexToVariableState(ei, fvi)];
-
-			lz += P_vi * E[ei];
+	int factor_count = static_cast<int>(factors.size());
+	#pragma omp parallel reduction(+:lz) if(parallel)
+	{
+		std::vector<double> q_F;
+		std::vector<double> scratch;
+		#pragma omp for schedule(dynamic, 64)
+		for (int fi = 0; fi < factor_count; ++fi) {
+			const Factor* fac = factors[fi];
+			const std::vector<double>& E = fac->Energies();
+
+			// q_F := \prod_{j in N(F)} q_j(y_j)
+			ProductDistribution(fac, vmarg, fac->Variables().size(),
+				q_F, scratch);
+			double expect = 0.0;
+			for (size_t ei = 0; ei < E.size(); ++ei)
+				expect += q_F[ei] * E[ei];
+			lz += expect;
 		}
 	}
 	return (-lz);
@@ -148,18 +267,14 @@ void NaiveMeanFieldInference::ProduceMarginals(
 	// Produce factor marginals by naive mean field approximation
 	const std::vector<Factor*>& factors = fg->Factors();
 	marginals.resize(factors.size());
-	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
-		marginals[fi].resize(factors[fi]->Type()->ProdCardinalities());
-		std::fill(marginals[fi].begin(), marginals[fi].end(), 1.0);
-
-		const Factor* fac = factors[fi];
-		const FactorType* ftype = fac->Type();
-		const std::vector<unsigned int>& fvars = fac->Variables();
-		for (unsigned int ei = 0; ei < marginals[fi].size(); ++ei) {
-			for (unsigned int fvi = 0; fvi < fvars.size(); ++fvi) {
-				marginals[fi][ei] *= vmarg[fvars[fvi]][
-					ftype->LinearIndexToVariableState(ei, fvi)];
-			}
+	int factor_count = static_cast<int>(factors.size());
+	#pragma omp parallel if(parallel)
+	{
+		std::vector<double> scratch;
+		#pragma omp for schedule(dynamic, 64)
+		for (int fi = 0; fi < factor_count; ++fi) {
+			ProductDistribution(factors[fi], vmarg,
+				factors[fi]->Variables().size(), marginals[fi], scratch);
 		}
 	}
 }
@@ -195,5 +310,13 @@ double NaiveMeanFieldInference::MinimizeEnergy(std::vector<unsigned int>& state)
 	return (std::numeric_limits<double>::signaling_NaN());
 }
 
+bool NaiveMeanFieldInference::SupportsWarmStart() const {
+	return (true);
+}
+
+bool NaiveMeanFieldInference::SupportsEvidence() const {
+	return (true);
+}
+
 }
 
@@ -18,6 +18,11 @@ namespace Grante {
  * [Nowozin2011] Sebastian Nowozin and Christoph H. Lampert, "Structured
  *    Learning and Prediction in Computer Vision", now FnT Graphics and
  *    Computer Vision, 2011.
+ *
+ * In parallel mode the variables are greedily colored such that no two
+ * variables of one color share a factor.  All variables of one color are
+ * updated concurrently; as their updates do not interact this is the same
+ * block-coordinate ascent as the serial schedule and remains monotonic.
  */
 class NaiveMeanFieldInference : public InferenceMethod {
 public:
@@ -32,8 +37,10 @@ public:
 	// conv_tol: Convergence tolerance wrt change in log_z.  Default: 1.0e-6,
 	// max_iter: Maximum number of mean field block-coordinate ascent
 	//    directions.  Use zero for no limit.  Default: 50.
+	// parallel: If true, update the variables color by color in parallel.
+	//    Default: false.
 	void SetParameters(bool verbose, double conv_tol,
-		unsigned int max_iter);
+		unsigned int max_iter, bool parallel = false);
 
 	// Perform block-coordinate mean field optimization to compute realizable
 	// marginals and bound on logZ
@@ -54,6 +61,11 @@ public:
 	// NOT IMPLEMENTED
 	virtual double MinimizeEnergy(std::vector<unsigned int>& state);
 
+	// Warm starts begin from the variable distributions of the previous call
+	virtual bool SupportsWarmStart() const;
+	// Observed variables keep point-mass distributions and are not updated
+	virtual bool SupportsEvidence() const;
+
 private:
 	FactorGraphUtility fgu;
 
@@ -63,14 +75,32 @@ private:
 	// Inference result: lower bound on the log-partition function
 	double log_z;
 
+	// Variable distributions kept for a warm start
+	std::vector<std::vector<double> > warm_vmarg;
+
 	// Parameters
 	bool verbose;
 	double conv_tol;
 	unsigned int max_iter;
+	bool parallel;
+
+	// Variable coloring for parallel updates, color_vars[c] are the
+	// variables of color c.  Computed on first use.
+	std::vector<std::vector<unsigned int> > color_vars;
 
-	// Update a single variable distribution
+	// Update a single variable distribution.  scratch and scratch2 are
+	// temporary buffers.
 	double UpdateSite(std::vector<std::vector<double> >& vmarg,
-		unsigned int vi) const;
+		unsigned int vi, std::vector<double>& scratch,
+		std::vector<double>& scratch2) const;
+
+	// Compute in prod the product distribution prod_j q_j(y_j) over all
+	// variables of the factor in table order, leaving out the variable at
+	// position skip_fvi (use fvars.size() to include all).
+	static void ProductDistribution(const Factor* fac,
+		const std::vector<std::vector<double> >& vmarg, size_t skip_fvi,
+		std::vector<double>& prod, std::vector<double>& scratch);
+	void ComputeColoring();
 
 	double ComputeLogPartitionFunction(
 		const std::vector<std::vector<double> >& vmarg) const;
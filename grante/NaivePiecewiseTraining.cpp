@@ -25,6 +25,11 @@ void NaivePiecewiseTraining::SetOptimizationMethod(
 	mle.SetOptimizationMethod(opt_method);
 }
 
+void NaivePiecewiseTraining::SetStochasticParameters(double step_size,
+	unsigned int batch_size) {
+	mle.SetStochasticParameters(step_size, batch_size);
+}
+
 MaximumLikelihood::MLEProblem* NaivePiecewiseTraining::GetLearnProblem() {
 	return (mle.GetLearnProblem());
 }
@@ -20,6 +20,8 @@ public:
 
 	void SetOptimizationMethod(
 		MaximumLikelihood::MLEOptimizationMethod opt_method);
+	// See MaximumLikelihood::SetStochasticParameters
+	void SetStochasticParameters(double step_size, unsigned int batch_size);
 
 	// FIXME: remove
 	MaximumLikelihood::MLEProblem* GetLearnProblem();
@@ -140,6 +140,17 @@ void NonlinearRBFFactorType::BackwardMap(const Factor* factor,
 	}
 }
 
+void NonlinearRBFFactorType::SparseBackwardMap(const Factor* factor,
+	const std::vector<double>& marginals,
+	sparse_gradient_type& parameter_gradient, double mult) const {
+	DenseSparseBackwardMap(factor, marginals, parameter_gradient, mult);
+}
+
+void NonlinearRBFFactorType::ParameterSupport(const Factor* factor,
+	std::vector<unsigned int>& support) const {
+	DenseParameterSupport(support);
+}
+
 const RBFNetwork& NonlinearRBFFactorType::Net() const {
 	return (rbfnet);
 }
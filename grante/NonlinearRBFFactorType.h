@@ -41,6 +41,11 @@ public:
 	virtual void BackwardMap(const Factor* factor,
 		const std::vector<double>& marginals,
 		std::vector<double>& parameter_gradient, double mult = 1.0) const;
+	virtual void SparseBackwardMap(const Factor* factor,
+		const std::vector<double>& marginals,
+		sparse_gradient_type& parameter_gradient, double mult = 1.0) const;
+	virtual void ParameterSupport(const Factor* factor,
+		std::vector<unsigned int>& support) const;
 
 	const RBFNetwork& Net() const;
 
@@ -44,6 +44,16 @@ void NormalPrior::EvaluateProximalOperator(const std::vector<double>& u,
 		[sfac](double ue) -> double { return (sfac*ue); });
 }
 
+bool NormalPrior::HasProximalOperator() const {
+	return (true);
+}
+
+double NormalPrior::EvaluateRepeatedProximalOperator(double u, double L,
+	unsigned int count) const {
+	double sfac = L / (1.0/(sigma*sigma) + L);
+	return (std::pow(sfac, static_cast<double>(count)) * u);
+}
+
 // Omega^*(u) = 0.5 sigma^2 u'u - dim*log(sigma sqrt(2 pi))
 //       w(u) = sigma^2 u  (not returned)
 // \nabla_u Omega^*(u) = sigma^2 u
@@ -61,5 +71,9 @@ double NormalPrior::EvaluateFenchelDual(const std::vector<double>& u,
 	return (0.5*sigma_squared*obj - logp_constant);
 }
 
+double NormalPrior::Sigma() const {
+	return (sigma);
+}
+
 }
 
@@ -26,12 +26,18 @@ public:
 	// wprox = (L/(sigma^-2 + L)) u.
 	virtual void EvaluateProximalOperator(const std::vector<double>& u,
 		double L, std::vector<double>& wprox) const;
+	virtual bool HasProximalOperator() const;
+	// (L/(sigma^-2 + L))^count u
+	virtual double EvaluateRepeatedProximalOperator(double u, double L,
+		unsigned int count) const;
 
 	// w_out = 1/(sigma^-2) u
 	// value: ( 1/(sigma^-2) - 1/(sigma^-4) ) * (u'*u)
 	virtual double EvaluateFenchelDual(const std::vector<double>& u,
 		std::vector<double>& w_out) const;
 
+	double Sigma() const;
+
 private:
 	double sigma;
 	double logp_constant;	// dim*log(sigma sqrt(2 pi))
@@ -47,6 +47,12 @@ void ParallelTemperingInference::PerformInference() {
 		std::fill(marginals[fi].begin(), marginals[fi].end(), 0.0);
 	}
 
+	if (levels <= BinaryPackedModel::ReplicaCount() &&
+		BinaryPackedModel::IsBinaryPairwise(fg)) {
+		PerformInferenceBinary();
+		return;
+	}
+
 	// 2. Setup temperature ladder
 	InitializeLadder(fg, levels, high_temp);
 	accept_prob.resize(levels - 1);
@@ -113,6 +119,61 @@ void ParallelTemperingInference::PerformInference() {
 	}
 }
 
+void ParallelTemperingInference::PerformInferenceBinary() {
+	InitializeLadder(0, levels, high_temp);
+	accept_prob.resize(levels - 1);
+	std::fill(accept_prob.begin(), accept_prob.end(), 0.0);
+	std::vector<double> accept_total(levels - 1, 0.0);
+
+	// Lane li of the replica set is the chain at ladder_inv_temp[li]
+	BinaryPackedModel binary(fg);
+	std::vector<BinaryPackedModel::word_type> replicas;
+	binary.RandomReplicas(replicas, randu.engine());
+
+	double sample_contribution = 1.0 / static_cast<double>(sample_count);
+	unsigned int si = 0;
+	while (si < (burnin_sweeps + sample_count)) {
+		if (randu() >= swap_probability) {
+			// Parallel step, all levels at once
+			binary.SweepReplicas(replicas, ladder_inv_temp,
+				randu.engine());
+		} else {
+			// Swapping step
+			unsigned int li = static_cast<unsigned int>(
+				static_cast<double>(levels - 1) * randu());
+			assert(li < (levels - 1));
+
+			double accept_swap_prob = std::exp(
+				(ladder_inv_temp[li] - ladder_inv_temp[li+1]) *
+				(binary.ReplicaEnergy(replicas, li) -
+					binary.ReplicaEnergy(replicas, li+1)));
+			accept_swap_prob = std::min(1.0, accept_swap_prob);
+
+			accept_total[li] += 1.0;
+			if (randu() >= accept_swap_prob)
+				continue;	// reject swap
+
+			accept_prob[li] += 1.0;
+			binary.SwapReplicas(replicas, li, li+1);
+			continue;
+		}
+		si += 1;
+
+		if (si <= burnin_sweeps)
+			continue;
+
+		// Add current sample of temperature one chain (lane zero)
+		binary.AccumulateReplicaMarginals(replicas, 1, sample_contribution,
+			marginals);
+	}
+	for (unsigned int li = 0; li < accept_prob.size(); ++li) {
+		accept_prob[li] /= accept_total[li];
+		std::cout << "   li " << li << ", temp "
+			<< (1.0 / ladder_inv_temp[li])
+			<< ", accept prob " << accept_prob[li] << std::endl;
+	}
+}
+
 void ParallelTemperingInference::Sample(
 	std::vector<std::vector<unsigned int> >& states,
 	unsigned int sample_count) {
@@ -130,14 +191,19 @@ void ParallelTemperingInference::InitializeLadder(const FactorGraph* fg,
 		static_cast<double>(levels - 1));
 	double temp = high_temp;
 
-	// Create ladder: TEMP[0]=1.0, TEMP[levels-1]=high_temp
-	ladder.resize(levels);
+	// Create ladder: TEMP[0]=1.0, TEMP[levels-1]=high_temp.  If fg is zero
+	// only the temperatures are computed.
+	ladder_inv_temp.resize(levels);
+	ladder.resize(fg != 0 ? levels : 0);
 	for (int li = levels - 1; li >= 0; --li) {
+		ladder_inv_temp[li] = 1.0 / temp;
+		temp *= alpha;	// Decrease temperature
+		if (fg == 0)
+			continue;
+
 		ladder[li] = new GibbsSampler(fg);
-		ladder[li]->SetInverseTemperature(1.0 / temp);
+		ladder[li]->SetInverseTemperature(ladder_inv_temp[li]);
 		ladder[li]->SetStateUniformRandom();
-
-		temp *= alpha;	// Decrease temperature
 	}
 }
 
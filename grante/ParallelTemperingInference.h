@@ -9,6 +9,7 @@
 #include "FactorGraph.h"
 #include "InferenceMethod.h"
 #include "GibbsSampler.h"
+#include "BinaryPackedModel.h"
 
 namespace Grante {
 
@@ -21,6 +22,10 @@ namespace Grante {
  * [Liu2004] Jun S. Liu, "Monte Carlo Strategies in Scientific Computing",
  *   Springer, 2004.
  *
+ * For binary pairwise models with at most 64 levels, all chains of the
+ * ladder are stored multi-spin coded in one bit-packed replica set and swept
+ * together, see BinaryPackedModel.
+ *
  * TODO: better temperature ladder.  Test acceptance rate functions on real models
  */
 class ParallelTemperingInference : public InferenceMethod {
@@ -77,6 +82,8 @@ private:
 
 	// Workhorse: the set of temperized Gibbs samplers
 	std::vector<GibbsSampler*> ladder;
+	// Inverse temperatures of the ladder, ladder_inv_temp[0] = 1.0
+	std::vector<double> ladder_inv_temp;
 
 	// Random number generation, for chain/swap selection
 	boost::mt19937 rgen;
@@ -96,6 +103,9 @@ private:
 	void InitializeLadder(const FactorGraph* fg, unsigned int levels,
 		double high_temp);
 	void DestroyLadder(void);
+
+	// Multi-spin coded ladder for binary pairwise models
+	void PerformInferenceBinary();
 };
 
 }
@@ -14,6 +14,21 @@ void Prior::EvaluateProximalOperator(const std::vector<double>& u,
 	assert(0);
 }
 
+bool Prior::HasProximalOperator() const {
+	return (false);
+}
+
+double Prior::EvaluateRepeatedProximalOperator(double u, double L,
+	unsigned int count) const {
+	std::vector<double> u_cur(1, u);
+	std::vector<double> wprox(1, u);
+	for (unsigned int ci = 0; ci < count; ++ci) {
+		EvaluateProximalOperator(u_cur, L, wprox);
+		u_cur[0] = wprox[0];
+	}
+	return (wprox[0]);
+}
+
 double Prior::EvaluateFenchelDual(const std::vector<double>& u,
 	std::vector<double>& w_out) const {
 	assert(0);
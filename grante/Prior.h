@@ -34,6 +34,16 @@ public:
 	// methods.
 	virtual void EvaluateProximalOperator(const std::vector<double>& u,
 		double L, std::vector<double>& wprox) const;
+	// Return true if EvaluateProximalOperator is implemented.
+	virtual bool HasProximalOperator() const;
+
+	// Apply the proximal operator count times to a single coordinate u and
+	// return the result.  This is only meaningful for priors that factorize
+	// over the coordinates and is used to apply skipped regularization
+	// steps lazily.  The default implementation calls
+	// EvaluateProximalOperator count times.
+	virtual double EvaluateRepeatedProximalOperator(double u, double L,
+		unsigned int count) const;
 
 	// Solve
 	//    sup_{w} <w,u> + log p(w)    (1)
@@ -1,8 +1,8 @@
 
-#include <cmath>
 #include <cassert>
 
 #include "Pseudolikelihood.h"
+#include "VectorMath.h"
 
 namespace Grante {
 
@@ -10,17 +10,51 @@ Pseudolikelihood::Pseudolikelihood(const FactorGraphModel* fg_model)
 	: fg_model(fg_model) {
 }
 
+Pseudolikelihood::SiteAdjacency::SiteAdjacency(const FactorGraph* fg) {
+	const std::vector<unsigned int>& var_card = fg->Cardinalities();
+	var_offset.resize(var_card.size() + 1);
+	var_offset[0] = 0;
+	for (unsigned int vi = 0; vi < var_card.size(); ++vi)
+		var_offset[vi + 1] = var_offset[vi] + var_card[vi];
+
+	const std::vector<Factor*>& factors = fg->Factors();
+	fac_start.resize(factors.size() + 1);
+	fac_type.resize(factors.size());
+	std::unordered_map<const FactorType*, unsigned int> type_index;
+	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+		const FactorType* ft = factors[fi]->Type();
+		std::unordered_map<const FactorType*, unsigned int>::const_iterator
+			tii = type_index.find(ft);
+		if (tii == type_index.end()) {
+			tii = type_index.insert(std::make_pair(ft,
+				static_cast<unsigned int>(types.size()))).first;
+			types.push_back(ft);
+			type_factor.push_back(fi);
+		}
+		fac_type[fi] = tii->second;
+
+		fac_start[fi] = static_cast<unsigned int>(ent_var.size());
+		const std::vector<unsigned int>& fac_vars = factors[fi]->Variables();
+		for (unsigned int fvi = 0; fvi < fac_vars.size(); ++fvi) {
+			ent_var.push_back(fac_vars[fvi]);
+			ent_stride.push_back(
+				static_cast<unsigned int>(ft->VariableStride(fvi)));
+		}
+	}
+	fac_start[factors.size()] = static_cast<unsigned int>(ent_var.size());
+}
+
 double Pseudolikelihood::ComputeNegLogPseudolikelihood(const FactorGraph* fg,
-	const FactorGraphUtility* fgu, const FactorGraphObservation* obs,
+	const SiteAdjacency* adj, const FactorGraphObservation* obs,
 	std::unordered_map<std::string, std::vector<double> >&
 		parameter_gradient) const
 {
 	if (obs->Type() == FactorGraphObservation::DiscreteLabelingType) {
-		return (ComputeNegLogPseudolikelihood(fg, fgu, obs->State(),
+		return (ComputeNegLogPseudolikelihood(fg, adj, obs->State(),
 			parameter_gradient));
 	} else {
 		assert(obs->Type() == FactorGraphObservation::ExpectationType);
-		return (ComputeNegLogPseudolikelihood(fg, fgu, obs->Expectation(),
+		return (ComputeNegLogPseudolikelihood(fg, adj, obs->Expectation(),
 			parameter_gradient));
 	}
 }
@@ -35,91 +69,114 @@ double Pseudolikelihood::ComputeNegLogPseudolikelihood(const FactorGraph* fg,
 //   - \expect_{y ~ p(y_i | y^*_{V \ {i}}, w)}[
 //        sum_{f in F(i)} \nabla_w f(y_i, y^*_{V \ {i}}, w)].
 double Pseudolikelihood::ComputeNegLogPseudolikelihood(const FactorGraph* fg,
-	const FactorGraphUtility* fgu,
+	const SiteAdjacency* adj,
 	const std::vector<unsigned int>& observed_state,
 	std::unordered_map<std::string, std::vector<double> >&
 		parameter_gradient) const
 {
-	assert(observed_state.size() == fg->Cardinalities().size());
-
-	// Prepare variable conditional marginal distributions
 	const std::vector<unsigned int>& var_card = fg->Cardinalities();
-	std::vector<std::vector<double> > cond_site_marginals(var_card.size());
-	std::vector<double> cond_log_z_sum(var_card.size());
-
-	// TODO: avoid copy
-	std::vector<unsigned int> state_cur(observed_state);
-	for (unsigned int vi = 0; vi < var_card.size(); ++vi) {
-		cond_site_marginals[vi].resize(var_card[vi], 0.0);
-		// Compute site marginals
-		cond_log_z_sum[vi] = fgu->ComputeConditionalSiteDistribution(
-			state_cur, vi, cond_site_marginals[vi]);
-
-		// Normalize
-		for (unsigned int vsi = 0; vsi < var_card[vi]; ++vsi)
-			cond_site_marginals[vi][vsi] /= cond_log_z_sum[vi];
-
-		// Local log partition function
-		cond_log_z_sum[vi] = std::log(cond_log_z_sum[vi]);
-	}
-
-	// Setup temporary marginal distributions (key is size)
-	std::unordered_map<size_t, std::vector<double> >
-		temp_marginals;
 	const std::vector<Factor*>& factors = fg->Factors();
-	for (std::vector<Factor*>::const_iterator fi = factors.begin();
-		fi != factors.end(); ++fi) {
-		const FactorType* fti = (*fi)->Type();
-		if (temp_marginals.find(fti->ProdCardinalities()) !=
-			temp_marginals.end())
-			continue;
-		temp_marginals[fti->ProdCardinalities()] =
-			std::vector<double>(fti->ProdCardinalities(), 0.0);
+	assert(observed_state.size() == var_card.size());
+	assert(adj->var_offset.size() == var_card.size() + 1);
+	assert(adj->fac_type.size() == factors.size());
+	const std::vector<unsigned int>& fac_start = adj->fac_start;
+	const std::vector<unsigned int>& ent_var = adj->ent_var;
+	const std::vector<unsigned int>& ent_stride = adj->ent_stride;
+	const std::vector<unsigned int>& var_offset = adj->var_offset;
+
+	// Energy table index of the observed state of each factor
+	std::vector<unsigned int> obs_index(factors.size(), 0);
+	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+		for (unsigned int ent = fac_start[fi]; ent < fac_start[fi+1]; ++ent)
+			obs_index[fi] += ent_stride[ent] * observed_state[ent_var[ent]];
 	}
 
+	// PART 1: Compute the negative energies
+	//    -sum_{f in F(i)} f(y_i, y^*_{V \ {i}}, w)
+	// of all sites in one pass over the factors.  The entries of the energy
+	// table of f that differ from y^* only in y_i are at stride
+	// VariableStride(i) from the observed entry.
+	std::vector<double> cond(var_offset[var_card.size()], 0.0);
 	double nll = 0.0;
+	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+		const std::vector<double>& energies = factors[fi]->Energies();
+		unsigned int ei_obs = obs_index[fi];
+		for (unsigned int ent = fac_start[fi]; ent < fac_start[fi+1]; ++ent) {
+			unsigned int vi = ent_var[ent];
+			unsigned int stride = ent_stride[ent];
+			const double* energies_vi =
+				&energies[ei_obs - observed_state[vi]*stride];
+			double* cond_vi = &cond[var_offset[vi]];
+			for (unsigned int vsi = 0; vsi < var_card[vi]; ++vsi)
+				cond_vi[vsi] -= energies_vi[vsi*stride];
+
+			// + f(y^*_i, w), once for every adjacent site
+			nll += energies[ei_obs];
+		}
+	}
 
-	// PART 1: Compute energy gradient of observations
-	// For all sites,
+	// Normalize to obtain p(y_i | y^*_{V \ {i}}, w) and add the local log
+	// partition functions
+	for (unsigned int vi = 0; vi < var_card.size(); ++vi)
+		nll += VectorMath::NormalizeLog(&cond[var_offset[vi]], var_card[vi]);
+
+	// PART 2: Gradient.  For each factor, collect
+	//    sum_{i in V(f)} [ 1{y^*} - p(y_i | y^*_{V \ {i}}, w) 1{y^*_{V\{i}}} ]
+	// into a single marginal table and backward map it.  Factor types that
+	// are not data dependent have the same backward map for all factors and
+	// their tables are summed over all factors.
 	double scale = 1.0 / static_cast<double>(var_card.size());
-	for (unsigned int vi = 0; vi < var_card.size(); ++vi) {
-		const std::set<unsigned int>& adj_factors =
-			fgu->AdjacentFactors(vi);
-
-		// For all adjacent factors,
-		for (std::set<unsigned int>::const_iterator afi = adj_factors.begin();
-			afi != adj_factors.end(); ++afi) {
-			// Get factor
-			const Factor* factor = factors[*afi];
-			const std::string& ftype_name = factor->Type()->Name();
-			std::vector<double>& temp_f_m =
-				temp_marginals[factor->Type()->ProdCardinalities()];
-
-			// Compute -log p(y^*_F|w)
-			unsigned int ei = factor->ComputeAbsoluteIndex(observed_state);
-			temp_f_m[ei] = 1.0;
-			factor->BackwardMap(temp_f_m, parameter_gradient[ftype_name], scale);
-			temp_f_m[ei] = 0.0;
-
-			// + f(y^*_i, w)
-			nll += scale * factor->Energies()[ei];
-
-			// Compute
-			// -E_{y~p(y_i|y^*_{V\{i}},w)}[\nabla_w f(y,y^*_{V\{i}},w)]
-			factor->ExpandVariableMarginalToFactorMarginal(observed_state,
-				vi, cond_site_marginals[vi], temp_f_m);
-			factor->BackwardMap(temp_f_m, parameter_gradient[ftype_name],
-				-scale);
-			std::fill(temp_f_m.begin(), temp_f_m.end(), 0.0);
+	const std::vector<const FactorType*>& types = adj->types;
+	std::vector<std::vector<double>*> type_gradient(types.size());
+	std::vector<std::vector<double> > type_marginals(types.size());
+	for (unsigned int ti = 0; ti < types.size(); ++ti) {
+		type_gradient[ti] = &parameter_gradient[types[ti]->Name()];
+		type_marginals[ti].resize(types[ti]->ProdCardinalities(), 0.0);
+	}
+	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+		unsigned int ti = adj->fac_type[fi];
+		std::vector<double>& fac_marginals = type_marginals[ti];
+		unsigned int ei_obs = obs_index[fi];
+		for (unsigned int ent = fac_start[fi]; ent < fac_start[fi+1]; ++ent) {
+			unsigned int vi = ent_var[ent];
+			unsigned int stride = ent_stride[ent];
+			double* marginals_vi =
+				&fac_marginals[ei_obs - observed_state[vi]*stride];
+			const double* cond_vi = &cond[var_offset[vi]];
+			for (unsigned int vsi = 0; vsi < var_card[vi]; ++vsi)
+				marginals_vi[vsi*stride] -= cond_vi[vsi];
+
+			fac_marginals[ei_obs] += 1.0;
 		}
-		nll += scale*cond_log_z_sum[vi];
+		if (types[ti]->IsDataDependent() == false)
+			continue;
+
+		factors[fi]->BackwardMap(fac_marginals, *type_gradient[ti], scale);
+
+		// Clear the modified entries
+		fac_marginals[ei_obs] = 0.0;
+		for (unsigned int ent = fac_start[fi]; ent < fac_start[fi+1]; ++ent) {
+			unsigned int vi = ent_var[ent];
+			unsigned int stride = ent_stride[ent];
+			double* marginals_vi =
+				&fac_marginals[ei_obs - observed_state[vi]*stride];
+			for (unsigned int vsi = 0; vsi < var_card[vi]; ++vsi)
+				marginals_vi[vsi*stride] = 0.0;
+		}
+	}
+	for (unsigned int ti = 0; ti < types.size(); ++ti) {
+		if (types[ti]->IsDataDependent())
+			continue;
+
+		factors[adj->type_factor[ti]]->BackwardMap(type_marginals[ti],
+			*type_gradient[ti], scale);
 	}
 
-	return (nll);
+	return (scale * nll);
 }
 
 double Pseudolikelihood::ComputeNegLogPseudolikelihood(const FactorGraph* fg,
-	const FactorGraphUtility* fgu,
+	const SiteAdjacency* adj,
 	const std::vector<std::vector<double> >& observed_expectations,
 	std::unordered_map<std::string, std::vector<double> >&
 		parameter_gradient) const
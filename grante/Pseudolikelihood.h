@@ -8,7 +8,6 @@
 
 #include "FactorGraphModel.h"
 #include "FactorGraph.h"
-#include "FactorGraphUtility.h"
 #include "FactorGraphObservation.h"
 
 namespace Grante {
@@ -18,17 +17,53 @@ namespace Grante {
  * This class is very similar to the Likelihood class, however only
  * the conditional marginal distributions of each variable is needed, not the
  * full joint marginal distribution of each factor.
+ *
+ * All site conditionals are computed in one pass over the factor energy
+ * tables, using the variable strides precomputed in a SiteAdjacency, and
+ * normalized with the vectorized kernels.  The gradient contributions of
+ * all sites adjacent to a factor are collected into one table, such that
+ * each factor is backward mapped once.  For factor types that are not data
+ * dependent the tables of all factors are summed and backward mapped once
+ * per factor type.
  */
 class Pseudolikelihood {
 public:
 	explicit Pseudolikelihood(const FactorGraphModel* fg_model);
 
-	// cond_site_marginals: [var_index] is a normalized distribution over the
-	//    site states.
-	// cond_log_z_sum: log-partition function of conditional p(y_i|y_{V\{i}})
-	//    distributions, summed over all i in V.
+	/* Variable strides of all factors of one factor graph, computed once
+	 * per graph.
+	 */
+	class SiteAdjacency {
+	public:
+		explicit SiteAdjacency(const FactorGraph* fg);
+
+	private:
+		friend class Pseudolikelihood;
+
+		// Factor fi has the variables ent_var[fac_start[fi]] to
+		// ent_var[fac_start[fi+1]-1], with stride ent_stride[.] in the
+		// energy table of the factor.
+		std::vector<unsigned int> fac_start;
+		std::vector<unsigned int> ent_var;
+		std::vector<unsigned int> ent_stride;
+
+		// The conditional of variable vi is stored at var_offset[vi] to
+		// var_offset[vi+1]-1 of a flat table.
+		std::vector<unsigned int> var_offset;
+
+		// fac_type[fi] is the index of the factor type of fi in types,
+		// type_factor[ti] is the first factor of type types[ti].
+		std::vector<unsigned int> fac_type;
+		std::vector<const FactorType*> types;
+		std::vector<unsigned int> type_factor;
+	};
+
+	// Compute the negative log-pseudolikelihood of the observation obs and
+	// add its gradient to parameter_gradient.  The energies of fg must be
+	// current and adj must have been computed for fg.  Only discrete
+	// labelings are supported.
 	double ComputeNegLogPseudolikelihood(const FactorGraph* fg,
-		const FactorGraphUtility* fgu,
+		const SiteAdjacency* adj,
 		const FactorGraphObservation* obs,
 		std::unordered_map<std::string, std::vector<double> >&
 			parameter_gradient) const;
@@ -37,13 +72,13 @@ private:
 	const FactorGraphModel* fg_model;
 
 	double ComputeNegLogPseudolikelihood(const FactorGraph* fg,
-		const FactorGraphUtility* fgu,
+		const SiteAdjacency* adj,
 		const std::vector<unsigned int>& observed_state,
 		std::unordered_map<std::string, std::vector<double> >&
 			parameter_gradient) const;
 
 	double ComputeNegLogPseudolikelihood(const FactorGraph* fg,
-		const FactorGraphUtility* fgu,
+		const SiteAdjacency* adj,
 		const std::vector<std::vector<double> >& observed_expectations,
 		std::unordered_map<std::string, std::vector<double> >&
 			parameter_gradient) const;
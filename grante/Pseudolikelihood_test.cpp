@@ -0,0 +1,209 @@
+
+#include "grante/Pseudolikelihood.h"
+
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <omp.h>
+
+#include "gmock/gmock.h"
+#include "grante/Factor.h"
+#include "grante/FactorGraph.h"
+#include "grante/FactorGraphModel.h"
+#include "grante/FactorGraphObservation.h"
+#include "grante/FactorType.h"
+#include "grante/MaximumPseudolikelihood.h"
+#include "grante/TreeInference.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+Grante::FactorType* CreateFactorType(const std::string& name,
+    unsigned int card0, unsigned int card1, const double* w,
+    unsigned int w_size) {
+    std::vector<unsigned int> card(1, card0);
+    if (card1 > 0)
+        card.push_back(card1);
+    return (new Grante::FactorType(name, card,
+        std::vector<double>(w, w + w_size)));
+}
+
+}
+
+// Three variables with cardinalities 2, 3 and 2, data-dependent and
+// data-independent unary and pairwise factors.  The reference values are
+// computed from the definition of the pseudolikelihood by enumerating the
+// conditionals of each variable, and are averaged over the variables.
+TEST(Pseudolikelihood, StoredValueAndGradient) {
+    Grante::FactorGraphModel model;
+    const double w_u2[] = { 0.3, -0.2, 0.7, 0.1 };
+    const double w_u3[] = { 0.0, 0.5, -0.4 };
+    const double w_p23[] = { 0.2, -0.3, 0.6, 0.1, -0.5, 0.4 };
+    const double w_p32[] = { 0.8, -0.6, 0.3, 0.2, -0.1, 0.5, 0.4, -0.3,
+        0.9, 0.05, -0.7, 0.25 };
+    model.AddFactorType(CreateFactorType("u2", 2, 0, w_u2, 4));
+    model.AddFactorType(CreateFactorType("u3", 3, 0, w_u3, 3));
+    model.AddFactorType(CreateFactorType("p23", 2, 3, w_p23, 6));
+    model.AddFactorType(CreateFactorType("p32", 3, 2, w_p32, 12));
+
+    std::vector<unsigned int> vc;
+    vc.push_back(2);
+    vc.push_back(3);
+    vc.push_back(2);
+    Grante::FactorGraph fg(&model, vc);
+    std::vector<unsigned int> var_index(1, 0);
+    std::vector<double> data(2);
+    data[0] = 0.5;
+    data[1] = -1.0;
+    fg.AddFactor(new Grante::Factor(model.FindFactorType("u2"),
+        var_index, data));
+    var_index[0] = 2;
+    data[0] = 1.5;
+    data[1] = 0.2;
+    fg.AddFactor(new Grante::Factor(model.FindFactorType("u2"),
+        var_index, data));
+    var_index[0] = 1;
+    data.clear();
+    fg.AddFactor(new Grante::Factor(model.FindFactorType("u3"),
+        var_index, data));
+    var_index[0] = 0;
+    var_index.push_back(1);
+    fg.AddFactor(new Grante::Factor(model.FindFactorType("p23"),
+        var_index, data));
+    var_index[0] = 1;
+    var_index[1] = 2;
+    data.push_back(2.0);
+    data.push_back(-0.5);
+    fg.AddFactor(new Grante::Factor(model.FindFactorType("p32"),
+        var_index, data));
+    fg.ForwardMap();
+
+    std::vector<unsigned int> state;
+    state.push_back(1);
+    state.push_back(2);
+    state.push_back(0);
+    Grante::FactorGraphObservation obs(state);
+
+    std::unordered_map<std::string, std::vector<double> > gradient;
+    const std::vector<Grante::FactorType*>& types = model.FactorTypes();
+    for (unsigned int ti = 0; ti < types.size(); ++ti) {
+        gradient[types[ti]->Name()].resize(
+            types[ti]->WeightDimension(), 0.0);
+    }
+    Grante::Pseudolikelihood pl(&model);
+    Grante::Pseudolikelihood::SiteAdjacency adj(&fg);
+    double nlpl = pl.ComputeNegLogPseudolikelihood(&fg, &adj, &obs,
+        gradient);
+    EXPECT_THAT(nlpl, testing::DoubleNear(0.7955086904611344, 1.0e-10));
+
+    std::unordered_map<std::string, std::vector<double> > gradient_ref;
+    const double g_u2[] = { 0.186147341589713, 0.27014390550178,
+        -0.186147341589713, -0.270143905501779 };
+    const double g_u3[] = { -0.0320001360584133, -0.0527593049848042,
+        0.0847594410432173 };
+    const double g_p23[] = { 0.0, -0.0320001360584133, 0.0,
+        -0.0527593049848042, -0.229991493709204, 0.314750934752421 };
+    const double g_p32[] = { -0.0640002721168266, 0.0160000680292066,
+        -0.105518609969608, 0.0263796524924021, 0.571043000012188,
+        -0.142760750003047, 0.0, 0.0, 0.0, 0.0, -0.401524117925754,
+        0.100381029481438 };
+    gradient_ref["u2"].assign(g_u2, g_u2 + 4);
+    gradient_ref["u3"].assign(g_u3, g_u3 + 3);
+    gradient_ref["p23"].assign(g_p23, g_p23 + 6);
+    gradient_ref["p32"].assign(g_p32, g_p32 + 12);
+    for (unsigned int ti = 0; ti < types.size(); ++ti) {
+        const std::vector<double>& g = gradient[types[ti]->Name()];
+        const std::vector<double>& g_ref = gradient_ref[types[ti]->Name()];
+        ASSERT_EQ(g_ref.size(), g.size());
+        for (unsigned int wi = 0; wi < g.size(); ++wi)
+            EXPECT_THAT(g[wi], testing::DoubleNear(g_ref[wi], 1.0e-10));
+    }
+}
+
+
+TEST(Pseudolikelihood, ParallelObjectiveMatchesSerial) {
+    std::vector<unsigned int> card1(1, 3);
+    std::vector<double> w1(3 * 2, 0.0);
+    Grante::FactorGraphModel model;
+    model.AddFactorType(new Grante::FactorType("unary", card1, w1));
+    std::vector<unsigned int> card2(2, 3);
+    std::vector<double> w2(9, 0.0);
+    model.AddFactorType(new Grante::FactorType("pairwise", card2, w2));
+
+    // Chains of varying length with random features and labels
+    std::default_random_engine e1(37);
+    std::normal_distribution<double> randn(0.0, 1.0);
+    std::uniform_int_distribution<unsigned int> randlabel(0, 2);
+    unsigned int N = 7;
+    std::vector<Grante::FactorGraph*> fgs;
+    std::vector<Grante::InferenceMethod*> inference_methods;
+    std::vector<Grante::ParameterEstimationMethod::labeled_instance_type>
+        training_data;
+    for (unsigned int n = 0; n < N; ++n) {
+        unsigned int length = 3 + n;
+        std::vector<unsigned int> vc(length, 3);
+        Grante::FactorGraph* fg = new Grante::FactorGraph(&model, vc);
+        std::vector<unsigned int> label(length);
+        for (unsigned int vi = 0; vi < length; ++vi) {
+            label[vi] = randlabel(e1);
+            std::vector<double> data(2);
+            data[0] = randn(e1);
+            data[1] = 1.0;
+            std::vector<unsigned int> var_index1(1, vi);
+            fg->AddFactor(new Grante::Factor(
+                model.FindFactorType("unary"), var_index1, data));
+            if (vi > 0) {
+                std::vector<unsigned int> var_index2(2);
+                var_index2[0] = vi - 1;
+                var_index2[1] = vi;
+                std::vector<double> data2;
+                fg->AddFactor(new Grante::Factor(
+                    model.FindFactorType("pairwise"), var_index2, data2));
+            }
+        }
+        fgs.push_back(fg);
+        inference_methods.push_back(new Grante::TreeInference(fg));
+        training_data.push_back(
+            Grante::ParameterEstimationMethod::labeled_instance_type(
+                fg, new Grante::FactorGraphObservation(label)));
+    }
+
+    Grante::MaximumPseudolikelihood mple(&model);
+    mple.SetupTrainingData(training_data, inference_methods);
+    Grante::MaximumPseudolikelihood::MPLEProblem* prob =
+        mple.GetLearnProblem();
+    std::vector<double> x(prob->Dimensions());
+    for (unsigned int d = 0; d < x.size(); ++d)
+        x[d] = randn(e1);
+
+    int max_threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    std::vector<double> grad_serial(x.size(), 0.0);
+    double obj_serial = prob->EvalF(x, grad_serial);
+
+    // The per-thread gradients are summed in a fixed order, so repeated
+    // evaluations with the same number of threads agree exactly.  Three
+    // threads do not divide the number of instances.
+    for (int thread_count = 2; thread_count <= 4; ++thread_count) {
+        omp_set_num_threads(thread_count);
+        std::vector<double> grad(x.size(), 0.0);
+        double obj = prob->EvalF(x, grad);
+        EXPECT_THAT(obj, testing::DoubleNear(obj_serial, 1.0e-12));
+        for (unsigned int d = 0; d < x.size(); ++d)
+            EXPECT_THAT(grad[d], testing::DoubleNear(grad_serial[d], 1.0e-12));
+
+        std::vector<double> grad_again(x.size(), 0.0);
+        EXPECT_EQ(obj, prob->EvalF(x, grad_again));
+        EXPECT_EQ(grad, grad_again);
+    }
+    omp_set_num_threads(max_threads);
+
+    delete prob;
+    for (unsigned int n = 0; n < N; ++n) {
+        delete training_data[n].second;
+        delete inference_methods[n];
+        delete fgs[n];
+    }
+}
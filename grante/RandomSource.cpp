@@ -53,6 +53,12 @@ void RandomSource::ShuffleRandom(std::vector<unsigned int>& vec) {
 	std::random_shuffle(vec.begin(), vec.end(), sr);
 }
 
+void RandomSource::ShuffleRandom(std::vector<unsigned int>& vec,
+	boost::mt19937& gen) {
+	shuffle_random sr(vec.size(), gen);
+	std::random_shuffle(vec.begin(), vec.end(), sr);
+}
+
 RandomSource::RandomSource() {
 }
 
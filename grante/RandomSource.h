@@ -14,6 +14,11 @@ public:
 
 	// Permute the given vector randomly
 	static void ShuffleRandom(std::vector<unsigned int>& vec);
+	// Permute the given vector randomly using the given generator.  This
+	// does not touch the global seed source and is safe to call from
+	// multiple threads as long as each thread uses its own generator.
+	static void ShuffleRandom(std::vector<unsigned int>& vec,
+		boost::mt19937& gen);
 
 private:
 	static boost::mt19937 random_sampler;
@@ -33,7 +38,7 @@ private:
 		size_t N;
 		boost::mt19937& gen;
 		boost::uniform_int<boost::uint32_t> dest;
-		boost::variate_generator<boost::mt19937,
+		boost::variate_generator<boost::mt19937&,
 			boost::uniform_int<boost::uint32_t> > rand;
 
 	public:
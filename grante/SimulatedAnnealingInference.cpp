@@ -3,7 +3,11 @@
 #include <cmath>
 #include <cassert>
 
+#include <boost/random.hpp>
+
+#include "RandomSource.h"
 #include "GibbsSampler.h"
+#include "BinaryPackedModel.h"
 #include "SimulatedAnnealingInference.h"
 
 namespace Grante {
@@ -33,6 +37,11 @@ void SimulatedAnnealingInference::SetParameters(unsigned int sa_steps,
 }
 
 void SimulatedAnnealingInference::PerformInference() {
+	if (BinaryPackedModel::IsBinaryPairwise(fg)) {
+		PerformInferenceBinary();
+		return;
+	}
+
 	// Initialize best solution
 	unsigned int var_count =
 		static_cast<unsigned int>(fg->Cardinalities().size());
@@ -76,6 +85,54 @@ void SimulatedAnnealingInference::PerformInference() {
 	}
 }
 
+void SimulatedAnnealingInference::PerformInferenceBinary() {
+	unsigned int var_count =
+		static_cast<unsigned int>(fg->Cardinalities().size());
+	primal_best.resize(var_count);
+	primal_best_energy = std::numeric_limits<double>::infinity();
+
+	BinaryPackedModel binary(fg);
+	std::vector<BinaryPackedModel::word_type> packed(
+		BinaryPackedModel::WordCount(var_count), 0);
+	std::vector<BinaryPackedModel::word_type> packed_best(packed);
+
+	boost::mt19937 rgen(RandomSource::GetGlobalRandomSeed());
+	boost::uniform_real<double> rdestu;	// range [0,1]
+	boost::variate_generator<boost::mt19937,
+		boost::uniform_real<double> > randu(rgen, rdestu);
+
+	// Same schedule as in the general case, the k=0 sweep at T0 is the
+	// initialization.
+	double alpha = std::exp(std::log(Tfinal / T0) /
+		static_cast<double>(sa_steps));
+	double cur_energy = binary.Energy(packed);
+	for (unsigned int k = 0; k <= sa_steps; ++k) {
+		double temperature = T0 * std::pow(alpha, static_cast<double>(k));
+		double inv_temperature = 1.0 / temperature;
+		if (k > 0)
+			cur_energy = binary.Energy(packed);
+		for (unsigned int vi = 0; vi < var_count; ++vi) {
+			double field = binary.LocalField(packed, vi);
+			double p1 = 1.0 / (1.0 + std::exp(inv_temperature * field));
+			unsigned int old_bit = BinaryPackedModel::GetBit(packed, vi);
+			unsigned int new_bit = (randu() < p1) ? 1 : 0;
+			if (new_bit != old_bit) {
+				BinaryPackedModel::SetBit(packed, vi, new_bit);
+				cur_energy += new_bit ? field : -field;
+			}
+			if (k > 0 && cur_energy < primal_best_energy) {
+				// Re-evaluate for numerical reasons
+				cur_energy = binary.Energy(packed);
+				if (cur_energy < primal_best_energy) {
+					primal_best_energy = cur_energy;
+					packed_best = packed;
+				}
+			}
+		}
+	}
+	BinaryPackedModel::Unpack(packed_best, primal_best);
+}
+
 void SimulatedAnnealingInference::ClearInferenceResult() {
 	// nothing to do
 }
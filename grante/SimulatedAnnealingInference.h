@@ -7,6 +7,9 @@
 namespace Grante {
 
 /* Simulated annealing approximate MAP inference
+ *
+ * For binary pairwise models the annealing runs on a bit-packed state, see
+ * BinaryPackedModel.
  */
 class SimulatedAnnealingInference : public InferenceMethod {
 public:
@@ -59,6 +62,8 @@ private:
 	// methods)
 	std::vector<double> dummy;
 	std::vector<std::vector<double> > dummy2;
+
+	void PerformInferenceBinary();
 };
 
 }
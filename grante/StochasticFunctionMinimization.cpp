@@ -12,6 +12,7 @@
 #include <boost/random.hpp>
 
 #include "StochasticFunctionMinimization.h"
+#include "RandomSource.h"
 
 namespace Grante {
 
@@ -65,43 +66,9 @@ double StochasticFunctionMinimization::StochasticSubgradientMethodMinimize(
 		avg_grad_norm = std::sqrt(avg_grad_norm);
 
 		// Output statistics
-		if (verbose && (epoch % 20 == 0)) {
-			std::cout << std::endl;
-			std::cout << "  iter     time        avg_obj  |avg_grad|" << std::endl;
-		}
-		if (verbose) {
-			std::ios_base::fmtflags original_format = std::cout.flags();
-			std::streamsize original_prec = std::cout.precision();
-
-			// Iteration
-			std::cout << std::setiosflags(std::ios::left)
-				<< std::setiosflags(std::ios::adjustfield)
-				<< std::setw(6) << epoch << "  ";
-			// Total runtime
-			std::cout << std::setiosflags(std::ios::left)
-				<< std::resetiosflags(std::ios::scientific)
-				<< std::setiosflags(std::ios::fixed)
-				<< std::setiosflags(std::ios::adjustfield)
-				<< std::setprecision(1)
-				<< std::setw(6) << total_timer.elapsed() << "s  ";
-			std::cout << std::resetiosflags(std::ios::fixed);
-
-			// Objective function
-			std::cout << std::setiosflags(std::ios::scientific)
-				<< std::setprecision(5)
-				<< std::setiosflags(std::ios::left)
-				<< std::setiosflags(std::ios::showpos)
-				<< std::setw(7) << avg_obj << "   ";
-			// Gradient norm
-			std::cout << std::setiosflags(std::ios::scientific)
-				<< std::setprecision(2)
-				<< std::resetiosflags(std::ios::showpos)
-				<< std::setiosflags(std::ios::left) << avg_grad_norm;
-			std::cout << std::endl;
-
-			std::cout.precision(original_prec);
-			std::cout.flags(original_format);
-		}
+		if (verbose)
+			PrintEpochStatistics(epoch, total_timer.elapsed(), avg_obj,
+				avg_grad_norm);
 
 		// Convergence check
 		if (avg_grad_norm < conv_tol)
@@ -112,5 +79,347 @@ double StochasticFunctionMinimization::StochasticSubgradientMethodMinimize(
 	return (avg_obj);	// This is not exact, but stochastic anyway
 }
 
+double StochasticFunctionMinimization::MiniBatchMinimize(
+	StochasticFunctionMinimizationProblem& prob, std::vector<double>& x_opt,
+	MiniBatchMethod method, double step_size, unsigned int batch_size,
+	double conv_tol, unsigned int max_epochs, bool verbose) {
+	assert(step_size > 0.0);
+	assert(batch_size > 0);
+	if (method == SparseSGDMethod && prob.HasSparseGradient()) {
+		return (LazySparseSGDMinimize(prob, x_opt, step_size, batch_size,
+			conv_tol, max_epochs, verbose));
+	}
+	unsigned int dim = prob.Dimensions();
+	size_t N = prob.NumberOfElements();
+	assert(N > 0);
+	if (batch_size > N)
+		batch_size = static_cast<unsigned int>(N);
+
+	// Initialize x
+	std::vector<double> x(dim);
+	prob.ProvideStartingPoint(x);
+
+	// The composite term is either handled by proximal steps or its
+	// subgradient is added to each gradient estimate
+	bool prox_steps = prob.HasProximalOperator() &&
+		(method == MomentumSGDMethod || method == SVRGMethod ||
+		method == SparseSGDMethod);
+	std::vector<double> no_grad;
+
+	// Elements are visited in random order, batch by batch
+	std::vector<unsigned int> order(N);
+	for (size_t n = 0; n < N; ++n)
+		order[n] = static_cast<unsigned int>(n);
+	std::vector<unsigned int> batch;
+	batch.reserve(batch_size);
+
+	std::vector<double> grad(dim, 0.0);
+	std::vector<double> avg_grad(dim, 0.0);
+	std::vector<double> u;
+	if (prox_steps)
+		u.resize(dim);
+
+	// Method state: m1 is the momentum velocity (MomentumSGD) or the first
+	// moment (Adam), m2 the accumulated (AdaGrad) or averaged (Adam) squared
+	// gradients.
+	std::vector<double> m1;
+	std::vector<double> m2;
+	if (method == MomentumSGDMethod || method == AdamMethod)
+		m1.resize(dim, 0.0);
+	if (method == AdaGradMethod || method == AdamMethod)
+		m2.resize(dim, 0.0);
+	const double momentum = 0.9;
+	const double beta1 = 0.9;
+	const double beta2 = 0.999;
+	const double eps = 1.0e-8;
+	double beta1_pow = 1.0;
+	double beta2_pow = 1.0;
+
+	// SVRG snapshot point, full gradient at the snapshot and mini-batch
+	// gradient at the snapshot
+	std::vector<double> x_snap;
+	std::vector<double> mu;
+	std::vector<double> grad_snap;
+	if (method == SVRGMethod) {
+		mu.resize(dim);
+		grad_snap.resize(dim);
+	}
+
+	boost::timer total_timer;
+	double avg_obj = 0.0;
+	for (unsigned int epoch = 0; max_epochs == 0 || epoch < max_epochs;
+		++epoch) {
+		double eta = step_size;
+		if (method == MomentumSGDMethod || method == SparseSGDMethod)
+			eta /= std::sqrt(static_cast<double>(epoch + 1));
+
+		double avg_grad_norm = 0.0;
+		if (method == SVRGMethod) {
+			// New snapshot, full gradient
+			x_snap = x;
+			avg_obj = prob.EvalMiniBatch(order, x_snap, mu);
+			avg_grad = mu;
+			avg_obj += prob.EvalG(x_snap, avg_grad);
+			for (unsigned int d = 0; d < dim; ++d)
+				avg_grad_norm += avg_grad[d]*avg_grad[d];
+			avg_grad_norm = std::sqrt(avg_grad_norm);
+
+			if (verbose)
+				PrintEpochStatistics(epoch, total_timer.elapsed(), avg_obj,
+					avg_grad_norm);
+			if (avg_grad_norm < conv_tol)
+				break;
+		} else {
+			avg_obj = 0.0;
+			std::fill(avg_grad.begin(), avg_grad.end(), 0.0);
+		}
+
+		RandomSource::ShuffleRandom(order);
+		unsigned int batch_count = 0;
+		for (size_t bi = 0; bi < N; bi += batch_size) {
+			batch.assign(order.begin() + bi,
+				order.begin() + std::min(N, bi + batch_size));
+
+			// Gradient estimate
+			double obj = prob.EvalMiniBatch(batch, x, grad);
+			if (method == SVRGMethod) {
+				prob.EvalMiniBatch(batch, x_snap, grad_snap);
+				for (unsigned int d = 0; d < dim; ++d)
+					grad[d] += mu[d] - grad_snap[d];
+			}
+			if (prox_steps == false)
+				obj += prob.EvalG(x, grad);
+
+			if (method != SVRGMethod) {
+				avg_obj += obj;
+				std::transform(grad.begin(), grad.end(), avg_grad.begin(),
+					avg_grad.begin(), std::plus<double>());
+			}
+			batch_count += 1;
+
+			// Update
+			switch (method) {
+			case (MomentumSGDMethod):
+				for (unsigned int d = 0; d < dim; ++d) {
+					m1[d] = momentum*m1[d] - eta*grad[d];
+					x[d] += m1[d];
+				}
+				break;
+			case (AdaGradMethod):
+				for (unsigned int d = 0; d < dim; ++d) {
+					m2[d] += grad[d]*grad[d];
+					x[d] -= eta * grad[d] / (std::sqrt(m2[d]) + eps);
+				}
+				break;
+			case (AdamMethod):
+			{
+				beta1_pow *= beta1;
+				beta2_pow *= beta2;
+				double eta_t = eta * std::sqrt(1.0 - beta2_pow) /
+					(1.0 - beta1_pow);
+				for (unsigned int d = 0; d < dim; ++d) {
+					m1[d] = beta1*m1[d] + (1.0 - beta1)*grad[d];
+					m2[d] = beta2*m2[d] + (1.0 - beta2)*grad[d]*grad[d];
+					x[d] -= eta_t * m1[d] / (std::sqrt(m2[d]) + eps);
+				}
+				break;
+			}
+			case (SVRGMethod):
+			case (SparseSGDMethod):
+				for (unsigned int d = 0; d < dim; ++d)
+					x[d] -= eta * grad[d];
+				break;
+			default:
+				assert(0);
+				break;
+			}
+			if (prox_steps) {
+				u = x;
+				prob.EvalGProximalOperator(u, 1.0 / eta, x);
+			}
+		}
+		if (method == SVRGMethod)
+			continue;
+
+		// Mean gradient and estimated objective of this epoch
+		avg_obj /= static_cast<double>(batch_count);
+		if (prox_steps)
+			avg_obj += prob.EvalG(x, no_grad);
+		for (unsigned int d = 0; d < dim; ++d) {
+			avg_grad[d] /= static_cast<double>(batch_count);
+			avg_grad_norm += avg_grad[d]*avg_grad[d];
+		}
+		avg_grad_norm = std::sqrt(avg_grad_norm);
+
+		if (verbose)
+			PrintEpochStatistics(epoch, total_timer.elapsed(), avg_obj,
+				avg_grad_norm);
+		if (avg_grad_norm < conv_tol)
+			break;
+	}
+
+	x_opt = x;
+	return (avg_obj);
+}
+
+double StochasticFunctionMinimization::LazySparseSGDMinimize(
+	StochasticFunctionMinimizationProblem& prob, std::vector<double>& x_opt,
+	double step_size, unsigned int batch_size, double conv_tol,
+	unsigned int max_epochs, bool verbose) {
+	unsigned int dim = prob.Dimensions();
+	size_t N = prob.NumberOfElements();
+	assert(N > 0);
+	if (batch_size > N)
+		batch_size = static_cast<unsigned int>(N);
+
+	// Initialize x
+	std::vector<double> x(dim);
+	prob.ProvideStartingPoint(x);
+
+	bool prox_steps = prob.HasProximalOperator();
+	std::vector<double> no_grad;
+	std::vector<double> g_grad;
+	if (prox_steps == false)
+		g_grad.resize(dim);
+
+	std::vector<unsigned int> order(N);
+	for (size_t n = 0; n < N; ++n)
+		order[n] = static_cast<unsigned int>(n);
+	std::vector<unsigned int> batch;
+	batch.reserve(batch_size);
+
+	// prox_count[d] is the number of proximal steps of this epoch that have
+	// been applied to coordinate d.  Coordinates outside the support of a
+	// mini-batch have zero gradient, and their proximal steps are deferred
+	// until the coordinate is read again or the epoch ends.
+	std::vector<unsigned int> prox_count(dim, 0);
+	std::vector<unsigned int> support;
+	std::vector<unsigned int> counts;
+	StochasticFunctionMinimizationProblem::sparse_vector_type grad;
+	std::vector<double> avg_grad(dim, 0.0);
+
+	boost::timer total_timer;
+	double avg_obj = 0.0;
+	for (unsigned int epoch = 0; max_epochs == 0 || epoch < max_epochs;
+		++epoch) {
+		double eta = step_size / std::sqrt(static_cast<double>(epoch + 1));
+		avg_obj = 0.0;
+		std::fill(avg_grad.begin(), avg_grad.end(), 0.0);
+
+		RandomSource::ShuffleRandom(order);
+		unsigned int step = 0;
+		for (size_t bi = 0; bi < N; bi += batch_size, ++step) {
+			batch.assign(order.begin() + bi,
+				order.begin() + std::min(N, bi + batch_size));
+			prob.MiniBatchSupport(batch, support);
+
+			// Catch up on the deferred proximal steps before reading x
+			if (prox_steps) {
+				counts.resize(support.size());
+				for (size_t si = 0; si < support.size(); ++si)
+					counts[si] = step - prox_count[support[si]];
+				prob.EvalGLazyProximalOperator(x, support, counts, 1.0 / eta);
+			}
+
+			double obj = prob.EvalMiniBatchSparse(batch, support, x, grad);
+			if (prox_steps == false) {
+				std::fill(g_grad.begin(), g_grad.end(), 0.0);
+				obj += prob.EvalG(x, g_grad);
+				for (unsigned int d = 0; d < dim; ++d) {
+					x[d] -= eta * g_grad[d];
+					avg_grad[d] += g_grad[d];
+				}
+			}
+			avg_obj += obj;
+
+			// Gradient step on the support
+			for (StochasticFunctionMinimizationProblem::sparse_vector_type::
+				const_iterator gi = grad.begin(); gi != grad.end(); ++gi) {
+				x[gi->first] -= eta * gi->second;
+				avg_grad[gi->first] += gi->second;
+			}
+			if (prox_steps) {
+				std::fill(counts.begin(), counts.end(), 1);
+				prob.EvalGLazyProximalOperator(x, support, counts, 1.0 / eta);
+				for (size_t si = 0; si < support.size(); ++si)
+					prox_count[support[si]] = step + 1;
+			}
+		}
+
+		// Apply the remaining proximal steps of this epoch
+		if (prox_steps) {
+			support.clear();
+			counts.clear();
+			for (unsigned int d = 0; d < dim; ++d) {
+				if (prox_count[d] == step)
+					continue;
+				support.push_back(d);
+				counts.push_back(step - prox_count[d]);
+			}
+			prob.EvalGLazyProximalOperator(x, support, counts, 1.0 / eta);
+			std::fill(prox_count.begin(), prox_count.end(), 0);
+		}
+
+		// Mean gradient and estimated objective of this epoch
+		avg_obj /= static_cast<double>(step);
+		if (prox_steps)
+			avg_obj += prob.EvalG(x, no_grad);
+		double avg_grad_norm = 0.0;
+		for (unsigned int d = 0; d < dim; ++d) {
+			avg_grad[d] /= static_cast<double>(step);
+			avg_grad_norm += avg_grad[d]*avg_grad[d];
+		}
+		avg_grad_norm = std::sqrt(avg_grad_norm);
+
+		if (verbose)
+			PrintEpochStatistics(epoch, total_timer.elapsed(), avg_obj,
+				avg_grad_norm);
+		if (avg_grad_norm < conv_tol)
+			break;
+	}
+
+	x_opt = x;
+	return (avg_obj);
+}
+
+void StochasticFunctionMinimization::PrintEpochStatistics(unsigned int epoch,
+	double elapsed, double avg_obj, double avg_grad_norm) {
+	if (epoch % 20 == 0) {
+		std::cout << std::endl;
+		std::cout << "  iter     time        avg_obj  |avg_grad|" << std::endl;
+	}
+	std::ios_base::fmtflags original_format = std::cout.flags();
+	std::streamsize original_prec = std::cout.precision();
+
+	// Iteration
+	std::cout << std::setiosflags(std::ios::left)
+		<< std::setiosflags(std::ios::adjustfield)
+		<< std::setw(6) << epoch << "  ";
+	// Total runtime
+	std::cout << std::setiosflags(std::ios::left)
+		<< std::resetiosflags(std::ios::scientific)
+		<< std::setiosflags(std::ios::fixed)
+		<< std::setiosflags(std::ios::adjustfield)
+		<< std::setprecision(1)
+		<< std::setw(6) << elapsed << "s  ";
+	std::cout << std::resetiosflags(std::ios::fixed);
+
+	// Objective function
+	std::cout << std::setiosflags(std::ios::scientific)
+		<< std::setprecision(5)
+		<< std::setiosflags(std::ios::left)
+		<< std::setiosflags(std::ios::showpos)
+		<< std::setw(7) << avg_obj << "   ";
+	// Gradient norm
+	std::cout << std::setiosflags(std::ios::scientific)
+		<< std::setprecision(2)
+		<< std::resetiosflags(std::ios::showpos)
+		<< std::setiosflags(std::ios::left) << avg_grad_norm;
+	std::cout << std::endl;
+
+	std::cout.precision(original_prec);
+	std::cout.flags(original_format);
+}
+
 }
 
@@ -28,6 +28,72 @@ public:
 		StochasticFunctionMinimizationProblem& prob,
 		std::vector<double>& x_opt, double conv_tol,
 		unsigned int max_epochs = 0, bool verbose = true);
+
+	enum MiniBatchMethod {
+		// Stochastic gradient descent with heavy-ball momentum 0.9 and step
+		// size step_size/sqrt(epoch+1).
+		MomentumSGDMethod = 0,
+		// AdaGrad, per-coordinate step sizes step_size/sqrt(sum_t g_t^2).
+		AdaGradMethod,
+		// Adam with beta1=0.9, beta2=0.999 and base step size step_size.
+		AdamMethod,
+		// Stochastic variance-reduced gradient with constant step size.  Each
+		// epoch evaluates the full gradient at a snapshot point once and
+		// then performs one pass of variance-reduced mini-batch steps, each
+		// evaluating the mini-batch at the iterate and the snapshot.
+		SVRGMethod,
+		// Proximal stochastic gradient descent without momentum, step size
+		// step_size/sqrt(epoch+1).  If the problem has sparse gradients, see
+		// StochasticFunctionMinimizationProblem::HasSparseGradient, only
+		// the coordinates in the support of each mini-batch are updated and
+		// the proximal steps are applied lazily, when a coordinate is next
+		// read.  The cost per step is then proportional to the support size
+		// instead of the dimension, with the same iterates as the dense
+		// method.  Without a proximal operator the subgradient of g is
+		// applied densely in each step.
+		SparseSGDMethod,
+	};
+
+	// Minimize \sum_i f_i(x) + g(x) using mini-batch stochastic gradients,
+	// see StochasticFunctionMinimizationProblem::EvalMiniBatch.  Each epoch
+	// visits all elements once in random order.
+	//
+	// The composite term g is handled by proximal steps for the
+	// MomentumSGDMethod and SVRGMethod, if the problem provides the
+	// proximal operator.  Otherwise, and always for the adaptive methods,
+	// the subgradient of g is added to each gradient estimate.
+	//
+	// prob: The stochastic minimization problem.
+	// x_opt: The resulting approximately optimal solution vector.  Does not
+	//    have to be initialized.
+	// method: The update rule, see MiniBatchMethod.
+	// step_size: Base step size, >0.
+	// batch_size: Number of elements per mini-batch, >0.
+	// conv_tol: The convergence tolerance as measured by the Euclidean norm
+	//    of the epoch-averaged gradient estimate (for SVRGMethod, the full
+	//    gradient at the snapshot point).
+	// max_epochs: The maximum number of epochs.  If zero (default), there
+	//    is no limit.
+	// verbose: If true some statistics are printed during optimization.
+	//
+	// The return value is the estimated objective function value.
+	static double MiniBatchMinimize(
+		StochasticFunctionMinimizationProblem& prob,
+		std::vector<double>& x_opt, MiniBatchMethod method,
+		double step_size, unsigned int batch_size, double conv_tol,
+		unsigned int max_epochs = 0, bool verbose = true);
+
+private:
+	// MiniBatchMinimize for the SparseSGDMethod and a problem with sparse
+	// gradients
+	static double LazySparseSGDMinimize(
+		StochasticFunctionMinimizationProblem& prob,
+		std::vector<double>& x_opt, double step_size,
+		unsigned int batch_size, double conv_tol, unsigned int max_epochs,
+		bool verbose);
+
+	static void PrintEpochStatistics(unsigned int epoch, double elapsed,
+		double avg_obj, double avg_grad_norm);
 };
 
 }
@@ -1,4 +1,7 @@
 
+#include <algorithm>
+#include <cassert>
+
 #include "StochasticFunctionMinimizationProblem.h"
 
 namespace Grante {
@@ -7,5 +10,64 @@ StochasticFunctionMinimizationProblem::~StochasticFunctionMinimizationProblem()
 {
 }
 
+double StochasticFunctionMinimizationProblem::EvalMiniBatch(
+	const std::vector<unsigned int>& batch, const std::vector<double>& x,
+	std::vector<double>& grad) {
+	assert(batch.empty() == false);
+	assert(grad.size() == x.size());
+	std::fill(grad.begin(), grad.end(), 0.0);
+
+	double scale = static_cast<double>(NumberOfElements()) /
+		static_cast<double>(batch.size());
+	std::vector<double> grad_i(x.size());
+	double obj = 0.0;
+	for (std::vector<unsigned int>::const_iterator bi = batch.begin();
+		bi != batch.end(); ++bi) {
+		obj += Eval(*bi, x, grad_i);
+		for (size_t d = 0; d < grad.size(); ++d)
+			grad[d] += scale * grad_i[d];
+	}
+	return (scale * obj);
+}
+
+double StochasticFunctionMinimizationProblem::EvalG(
+	const std::vector<double>& x, std::vector<double>& subgrad) {
+	return (0.0);
+}
+
+bool StochasticFunctionMinimizationProblem::HasProximalOperator() const {
+	return (false);
+}
+
+void StochasticFunctionMinimizationProblem::EvalGProximalOperator(
+	const std::vector<double>& u, double L,
+	std::vector<double>& wprox) const {
+	assert(0);
+}
+
+bool StochasticFunctionMinimizationProblem::HasSparseGradient() const {
+	return (false);
+}
+
+void StochasticFunctionMinimizationProblem::MiniBatchSupport(
+	const std::vector<unsigned int>& batch,
+	std::vector<unsigned int>& support) {
+	assert(0);
+}
+
+double StochasticFunctionMinimizationProblem::EvalMiniBatchSparse(
+	const std::vector<unsigned int>& batch,
+	const std::vector<unsigned int>& support, const std::vector<double>& x,
+	sparse_vector_type& grad) {
+	assert(0);
+	return (0.0);
+}
+
+void StochasticFunctionMinimizationProblem::EvalGLazyProximalOperator(
+	std::vector<double>& x, const std::vector<unsigned int>& coords,
+	const std::vector<unsigned int>& counts, double L) const {
+	assert(0);
+}
+
 }
 
@@ -3,6 +3,8 @@
 #define GRANTE_STOCHASTICFUNCMINPROBLEM_H
 
 #include <vector>
+#include <utility>
+#include <cstddef>
 
 namespace Grante {
 
@@ -15,6 +17,9 @@ namespace Grante {
  */
 class StochasticFunctionMinimizationProblem {
 public:
+	// Sparse vector, (index, value) pairs
+	typedef std::vector<std::pair<unsigned int, double> > sparse_vector_type;
+
 	virtual ~StochasticFunctionMinimizationProblem();
 
 	// Evaluate the function at a given query point for a given sample and
@@ -39,6 +44,60 @@ public:
 	// The provided vector must already have the correct dimension, i.e.
 	// x0.size() == Dimensions().
 	virtual void ProvideStartingPoint(std::vector<double>& x0) const = 0;
+
+	// Evaluate the function for a mini-batch of samples and return an
+	// unbiased estimate of the sum over all elements,
+	//    (N/|batch|) \sum_{i in batch} f_i(x),
+	// and its gradient, where N = NumberOfElements().
+	//
+	// batch: Distinct sample instance ids, not empty.
+	// x: The query point.
+	// grad: (output) the gradient estimate at x, grad.size()==Dimensions().
+	//
+	// The default implementation calls Eval for each sample in turn.
+	// Problems that can evaluate samples concurrently should override it.
+	virtual double EvalMiniBatch(const std::vector<unsigned int>& batch,
+		const std::vector<double>& x, std::vector<double>& grad);
+
+	// Optional composite term g(x), such that the minimized objective is
+	//    \sum_{i=1}^{N} f_i(x) + g(x).
+	// g is evaluated exactly and not part of the element functions.  If
+	// subgrad.empty() == false, a subgradient of g is added to subgrad.  The
+	// default is g(x) = 0.
+	virtual double EvalG(const std::vector<double>& x,
+		std::vector<double>& subgrad);
+
+	// Return true if EvalGProximalOperator is implemented (default: false).
+	virtual bool HasProximalOperator() const;
+
+	// Evaluate the proximal operator associated to g,
+	//    wprox = argmin_w g(w) + (1/2)*L*|w-u|^2.
+	virtual void EvalGProximalOperator(const std::vector<double>& u,
+		double L, std::vector<double>& wprox) const;
+
+	// Sparse gradients.  If HasSparseGradient returns true (default: false),
+	// the following three methods must be implemented.
+	virtual bool HasSparseGradient() const;
+
+	// Return in support the sorted coordinates of x that the mini-batch
+	// evaluation depends on.  The gradient is zero outside the support.
+	virtual void MiniBatchSupport(const std::vector<unsigned int>& batch,
+		std::vector<unsigned int>& support);
+
+	// Same as EvalMiniBatch, but only the coordinates of x in the support of
+	// the batch are read and the gradient is returned as (index, value)
+	// pairs with unique increasing indices.  support must be the result of
+	// MiniBatchSupport for the same batch.
+	virtual double EvalMiniBatchSparse(const std::vector<unsigned int>& batch,
+		const std::vector<unsigned int>& support,
+		const std::vector<double>& x, sparse_vector_type& grad);
+
+	// Apply the proximal operator of g counts[i] times to coordinate
+	// coords[i] of x, for all i, in-place.  This requires g to be separable
+	// over the coordinates and is only used if HasProximalOperator is true.
+	virtual void EvalGLazyProximalOperator(std::vector<double>& x,
+		const std::vector<unsigned int>& coords,
+		const std::vector<unsigned int>& counts, double L) const;
 };
 
 }
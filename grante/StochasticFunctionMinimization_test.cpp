@@ -0,0 +1,181 @@
+
+#include "grante/StochasticFunctionMinimization.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "grante/StochasticFunctionMinimizationProblem.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Sparse L1-regularized least squares,
+//    \sum_i 0.5 (<a_i,x> - b_i)^2 + lambda |x|_1,
+// where each a_i has two non-zero entries.  If sparse is false, the problem
+// does not report sparse gradients and the dense method is used.
+class SparseLassoProblem :
+    public Grante::StochasticFunctionMinimizationProblem {
+public:
+    SparseLassoProblem(bool sparse)
+        : sparse(sparse), dim(8), lambda(1.0) {
+        std::default_random_engine e1(13);
+        std::uniform_int_distribution<unsigned int> randi(0, dim - 1);
+        std::normal_distribution<double> randn(0.0, 1.0);
+        std::vector<double> x_true(dim, 0.0);
+        x_true[0] = 1.0;
+        x_true[3] = -2.0;
+        x_true[5] = 0.5;
+        for (unsigned int n = 0; n < 24; ++n) {
+            unsigned int i0 = randi(e1);
+            unsigned int i1 = randi(e1);
+            while (i1 == i0)
+                i1 = randi(e1);
+            if (i1 < i0)
+                std::swap(i0, i1);
+            std::vector<std::pair<unsigned int, double> > a;
+            a.push_back(std::make_pair(i0, randn(e1)));
+            a.push_back(std::make_pair(i1, randn(e1)));
+            A.push_back(a);
+            b.push_back(a[0].second * x_true[i0] +
+                a[1].second * x_true[i1] + 0.1 * randn(e1));
+        }
+    }
+
+    virtual double Eval(unsigned int sample_id, const std::vector<double>& x,
+        std::vector<double>& grad) {
+        std::fill(grad.begin(), grad.end(), 0.0);
+        const std::vector<std::pair<unsigned int, double> >& a = A[sample_id];
+        double r = -b[sample_id];
+        for (unsigned int ai = 0; ai < a.size(); ++ai)
+            r += a[ai].second * x[a[ai].first];
+        for (unsigned int ai = 0; ai < a.size(); ++ai)
+            grad[a[ai].first] += r * a[ai].second;
+        return (0.5 * r * r);
+    }
+    virtual unsigned int Dimensions() const {
+        return (dim);
+    }
+    virtual size_t NumberOfElements() const {
+        return (A.size());
+    }
+    virtual void ProvideStartingPoint(std::vector<double>& x0) const {
+        std::fill(x0.begin(), x0.end(), 0.0);
+    }
+
+    virtual double EvalG(const std::vector<double>& x,
+        std::vector<double>& subgrad) {
+        double g = 0.0;
+        for (unsigned int d = 0; d < dim; ++d) {
+            g += lambda * std::fabs(x[d]);
+            if (subgrad.empty() == false && x[d] != 0.0)
+                subgrad[d] += (x[d] > 0.0) ? lambda : -lambda;
+        }
+        return (g);
+    }
+    virtual bool HasProximalOperator() const {
+        return (true);
+    }
+    virtual void EvalGProximalOperator(const std::vector<double>& u,
+        double L, std::vector<double>& wprox) const {
+        for (unsigned int d = 0; d < dim; ++d)
+            wprox[d] = SoftThreshold(u[d], lambda / L);
+    }
+
+    virtual bool HasSparseGradient() const {
+        return (sparse);
+    }
+    virtual void MiniBatchSupport(const std::vector<unsigned int>& batch,
+        std::vector<unsigned int>& support) {
+        support.clear();
+        for (unsigned int bi = 0; bi < batch.size(); ++bi) {
+            for (unsigned int ai = 0; ai < A[batch[bi]].size(); ++ai)
+                support.push_back(A[batch[bi]][ai].first);
+        }
+        std::sort(support.begin(), support.end());
+        support.erase(std::unique(support.begin(), support.end()),
+            support.end());
+    }
+    virtual double EvalMiniBatchSparse(const std::vector<unsigned int>& batch,
+        const std::vector<unsigned int>& support,
+        const std::vector<double>& x, sparse_vector_type& grad) {
+        std::vector<double> dense_grad(dim);
+        double obj = EvalMiniBatch(batch, x, dense_grad);
+        grad.clear();
+        for (unsigned int si = 0; si < support.size(); ++si) {
+            grad.push_back(std::make_pair(support[si],
+                dense_grad[support[si]]));
+        }
+        return (obj);
+    }
+    virtual void EvalGLazyProximalOperator(std::vector<double>& x,
+        const std::vector<unsigned int>& coords,
+        const std::vector<unsigned int>& counts, double L) const {
+        // Repeated soft-thresholding is soft-thresholding by the sum
+        for (unsigned int ci = 0; ci < coords.size(); ++ci) {
+            x[coords[ci]] = SoftThreshold(x[coords[ci]],
+                counts[ci] * lambda / L);
+        }
+    }
+
+    // Minimize the full objective by proximal gradient descent
+    void Solve(std::vector<double>& x) {
+        x.assign(dim, 0.0);
+        std::vector<unsigned int> all(A.size());
+        for (unsigned int n = 0; n < all.size(); ++n)
+            all[n] = n;
+        std::vector<double> grad(dim);
+        std::vector<double> u(dim);
+        double L = 100.0;
+        for (unsigned int iter = 0; iter < 20000; ++iter) {
+            EvalMiniBatch(all, x, grad);
+            for (unsigned int d = 0; d < dim; ++d)
+                u[d] = x[d] - grad[d] / L;
+            EvalGProximalOperator(u, L, x);
+        }
+    }
+
+private:
+    bool sparse;
+    unsigned int dim;
+    double lambda;
+    std::vector<std::vector<std::pair<unsigned int, double> > > A;
+    std::vector<double> b;
+
+    static double SoftThreshold(double u, double t) {
+        if (u > t)
+            return (u - t);
+        else if (u < -t)
+            return (u + t);
+        return (0.0);
+    }
+};
+
+}
+
+TEST(StochasticFunctionMinimization, LazySparseSGDMatchesDense) {
+    SparseLassoProblem prob_dense(false);
+    std::vector<double> x_ref;
+    prob_dense.Solve(x_ref);
+
+    std::vector<double> x_dense;
+    Grante::StochasticFunctionMinimization::MiniBatchMinimize(prob_dense,
+        x_dense, Grante::StochasticFunctionMinimization::SparseSGDMethod,
+        0.05, 4, 0.0, 3000, false);
+
+    SparseLassoProblem prob_sparse(true);
+    std::vector<double> x_sparse;
+    Grante::StochasticFunctionMinimization::MiniBatchMinimize(prob_sparse,
+        x_sparse, Grante::StochasticFunctionMinimization::SparseSGDMethod,
+        0.05, 4, 0.0, 3000, false);
+
+    ASSERT_EQ(x_ref.size(), x_dense.size());
+    ASSERT_EQ(x_ref.size(), x_sparse.size());
+    for (unsigned int d = 0; d < x_ref.size(); ++d) {
+        EXPECT_THAT(x_dense[d], testing::DoubleNear(x_ref[d], 2.0e-2));
+        EXPECT_THAT(x_sparse[d], testing::DoubleNear(x_ref[d], 2.0e-2));
+    }
+}
+
@@ -76,5 +76,20 @@ void StructuredHammingLoss::PerformLossAugmentation(FactorGraph* fg,
 	}
 }
 
+bool StructuredHammingLoss::ComputeUnaryLossAugmentation(
+	const FactorGraph* fg, std::vector<std::vector<double> >& overlay,
+	double scale) const {
+	const std::vector<unsigned int>& y_truth_state = y_truth->State();
+	const std::vector<unsigned int>& card = fg->Cardinalities();
+	assert(card.size() == y_truth_state.size());
+
+	overlay.resize(card.size());
+	for (size_t vi = 0; vi < card.size(); ++vi) {
+		overlay[vi].assign(card[vi], scale * penalty_weights[vi]);
+		overlay[vi][y_truth_state[vi]] = 0.0;	// no penalty for the true state
+	}
+	return (true);
+}
+
 }
 
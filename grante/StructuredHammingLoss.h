@@ -28,6 +28,8 @@ public:
 	virtual double Eval(const std::vector<unsigned int>& y1_state) const;
 	virtual void PerformLossAugmentation(FactorGraph* fg,
 		double scale = 1.0) const;
+	virtual bool ComputeUnaryLossAugmentation(const FactorGraph* fg,
+		std::vector<std::vector<double> >& overlay, double scale = 1.0) const;
 
 private:
 	std::vector<double> penalty_weights;
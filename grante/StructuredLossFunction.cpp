@@ -12,6 +12,12 @@ StructuredLossFunction::~StructuredLossFunction() {
 	delete (y_truth);
 }
 
+bool StructuredLossFunction::ComputeUnaryLossAugmentation(
+	const FactorGraph* fg, std::vector<std::vector<double> >& overlay,
+	double scale) const {
+	return (false);
+}
+
 const FactorGraphObservation* StructuredLossFunction::Truth() const {
 	return (y_truth);
 }
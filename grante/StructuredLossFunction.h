@@ -33,6 +33,14 @@ public:
 	virtual void PerformLossAugmentation(FactorGraph* fg,
 		double scale) const = 0;
 
+	// Perform the same loss augmentation as a unary energy overlay for
+	// InferenceMethod::SetUnaryOverlay, leaving the energies of fg unchanged.
+	// This is possible if the loss decomposes over single variables.
+	// Return false if it does not, then PerformLossAugmentation has to be
+	// used.
+	virtual bool ComputeUnaryLossAugmentation(const FactorGraph* fg,
+		std::vector<std::vector<double> >& overlay, double scale) const;
+
 	const FactorGraphObservation* Truth() const;
 
 protected:
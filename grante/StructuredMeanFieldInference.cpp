@@ -3,6 +3,7 @@
 #include <numeric>
 #include <limits>
 #include <unordered_set>
+#include <unordered_map>
 
 #include <boost/lambda/lambda.hpp>
 
@@ -22,7 +23,7 @@ StructuredMeanFieldInference::StructuredMeanFieldInference(
 	DecompositionType decomp_type)
 	: InferenceMethod(fg), fcond_tab(fcond_tab),
 		log_z(std::numeric_limits<double>::signaling_NaN()),
-		verbose(true), conv_tol(1.0e-6), max_iter(50) {
+		verbose(true), conv_tol(1.0e-6), max_iter(50), parallel(false) {
 	// 1. Compute a v-acyclic decomposition of the factor graph
 	VAcyclicDecomposition vac(fg);
 	std::vector<double> factor_weight(fg->Factors().size(), 1.0);
@@ -49,7 +50,7 @@ StructuredMeanFieldInference::StructuredMeanFieldInference(
 	const std::vector<bool>& factor_is_removed)
 	: InferenceMethod(fg), fcond_tab(fcond_tab),
 		log_z(std::numeric_limits<double>::signaling_NaN()),
-		verbose(true), conv_tol(1.0e-6), max_iter(50) {
+		verbose(true), conv_tol(1.0e-6), max_iter(50), parallel(false) {
 	// TODO: assert this yields a v-acyclic decomposition
 	assert(factor_is_removed.size() == fg->Factors().size());
 	InitializeVAC(factor_is_removed);
@@ -66,10 +67,12 @@ StructuredMeanFieldInference::~StructuredMeanFieldInference() {
 
 void StructuredMeanFieldInference::InitializeVAC(
 	const std::vector<bool>& factor_is_removed) {
-	// Create simple factor to fi lookup table
+	// Create simple factor to fi lookup table, only used for setup
 	const std::vector<Factor*>& factors = fg->Factors();
+	std::unordered_map<const Factor*, unsigned int> fac_to_fi;
 	for (unsigned int fi = 0; fi < factors.size(); ++fi)
-		fac_to_fi.insert(std::pair<Factor*, unsigned int>(factors[fi], fi));
+		fac_to_fi.insert(
+			std::pair<const Factor*, unsigned int>(factors[fi], fi));
 
 	// Decompose factor graph into components
 	std::vector<unsigned int> cc_var_label;
@@ -79,6 +82,11 @@ void StructuredMeanFieldInference::InitializeVAC(
 	// Instantiate a conditioned factor graph for each connected component
 	mf_comp.resize(cc_count);
 	mf_comp_inf.resize(cc_count);
+	comp_orig_fi.resize(cc_count);
+	comp_is_mf.resize(cc_count);
+	fi_to_condfac.resize(factors.size());
+	fi_to_comp.assign(factors.size(),
+		std::pair<unsigned int, unsigned int>(cc_count, 0));
 	for (unsigned int ci = 0; ci < cc_count; ++ci) {
 		// Collect all variables in this component
 		std::vector<unsigned int> cond_var_set;
@@ -141,38 +149,66 @@ void StructuredMeanFieldInference::InitializeVAC(
 		mf_comp[ci] = fg_cond;
 		mf_comp_inf[ci] = new TreeInference(fg_cond);
 
-		// Collect all mean-field factors
+		// Collect all mean-field factors and index all component factors
 		std::unordered_set<unsigned int>
 			cond_fac_subset_hs(cond_fac_subset.begin(), cond_fac_subset.end());
 		const std::vector<Factor*>& comp_factors = fg_cond->Factors();
+		comp_orig_fi[ci].resize(comp_factors.size());
+		comp_is_mf[ci].resize(comp_factors.size());
 		for (unsigned int comp_fi = 0; comp_fi < comp_factors.size();
 			++comp_fi) {
 			Factor* comp_fac = comp_factors[comp_fi];
-			// Is conditioned?  No -> skip
-			if (cond_fac_subset_hs.count(
-				fac_to_fi[fcond_tab->OriginalFactor(comp_fac)]) == 0)
-				continue;
+			unsigned int orig_fi =
+				fac_to_fi[fcond_tab->OriginalFactor(comp_fac)];
+			comp_orig_fi[ci][comp_fi] = orig_fi;
+			std::pair<unsigned int, unsigned int> loc(ci, comp_fi);
+
+			// Is conditioned?
+			comp_is_mf[ci][comp_fi] = cond_fac_subset_hs.count(orig_fi) > 0;
+			if (comp_is_mf[ci][comp_fi]) {
+				fi_to_condfac[orig_fi].push_back(loc);
+			} else {
+				fi_to_comp[orig_fi] = loc;
+			}
+		}
+	}
+	ComputeComponentColoring();
+}
 
-			meanfield_factor_set.insert(comp_fac);
-			cfac_to_mfi[comp_fac] = ci;
-			cfac_to_cfi[comp_fac] = comp_fi;
+void StructuredMeanFieldInference::ComputeComponentColoring() {
+	// Two components interact if they share a split original factor
+	std::vector<std::unordered_set<unsigned int> > comp_adj(mf_comp.size());
+	for (unsigned int fi = 0; fi < fi_to_condfac.size(); ++fi) {
+		const std::vector<std::pair<unsigned int, unsigned int> >& cf =
+			fi_to_condfac[fi];
+		for (unsigned int i1 = 0; i1 < cf.size(); ++i1) {
+			for (unsigned int i2 = i1 + 1; i2 < cf.size(); ++i2) {
+				if (cf[i1].first == cf[i2].first)
+					continue;
+				comp_adj[cf[i1].first].insert(cf[i2].first);
+				comp_adj[cf[i2].first].insert(cf[i1].first);
+			}
 		}
 	}
 
-	// Create lookup tables needed during inference
+	// Greedy coloring
+	std::vector<unsigned int> comp_color(mf_comp.size(),
+		std::numeric_limits<unsigned int>::max());
+	color_comps.clear();
 	for (unsigned int mfi = 0; mfi < mf_comp.size(); ++mfi) {
-		const std::vector<Factor*>& mfi_factors = mf_comp[mfi]->Factors();
-		for (unsigned int comp_fi = 0; comp_fi < mfi_factors.size();
-			++comp_fi) {
-			Factor* new_factor = mfi_factors[comp_fi];
-			bool is_conditioned = meanfield_factor_set.count(new_factor) != 0;
-			if (is_conditioned == false)
-				continue;
-
-			unsigned int orig_fi =
-				fac_to_fi[fcond_tab->OriginalFactor(new_factor)];
-			fi_to_condfac[orig_fi].insert(new_factor);
+		std::vector<bool> color_used(color_comps.size(), false);
+		for (std::unordered_set<unsigned int>::const_iterator
+			ai = comp_adj[mfi].begin(); ai != comp_adj[mfi].end(); ++ai) {
+			if (comp_color[*ai] < color_comps.size())
+				color_used[comp_color[*ai]] = true;
 		}
+		unsigned int color = static_cast<unsigned int>(
+			std::find(color_used.begin(), color_used.end(), false) -
+			color_used.begin());
+		if (color == color_comps.size())
+			color_comps.push_back(std::vector<unsigned int>());
+		comp_color[mfi] = color;
+		color_comps[color].push_back(mfi);
 	}
 }
 
@@ -180,25 +216,41 @@ InferenceMethod* StructuredMeanFieldInference::Produce(
 	const FactorGraph* fg) const {
 	StructuredMeanFieldInference* smf =
 		new StructuredMeanFieldInference(fg, fcond_tab);
-	smf->SetParameters(verbose, conv_tol, max_iter);
+	smf->SetParameters(verbose, conv_tol, max_iter, parallel);
 
 	return (smf);
 }
 
 void StructuredMeanFieldInference::SetParameters(bool verbose,
-	double conv_tol, unsigned int max_iter) {
+	double conv_tol, unsigned int max_iter, bool parallel) {
 	this->verbose = verbose;
 	assert(conv_tol >= 0.0);
 	this->conv_tol = conv_tol;
 	this->max_iter = max_iter;
+	this->parallel = parallel;
 }
 
 void StructuredMeanFieldInference::PerformInference() {
 	// 1. Compute initial log partition function
 	log_z = 0.0;
-	for (unsigned int mfi = 0; mfi < mf_comp.size(); ++mfi) {
-		mf_comp[mfi]->ForwardMap();
-		mf_comp_inf[mfi]->PerformInference();
+	if (parallel) {
+		// The forward map of a split factor also forward maps its original
+		// factor, so only components of one color are mapped concurrently
+		for (unsigned int ci = 0; ci < color_comps.size(); ++ci) {
+			const std::vector<unsigned int>& comps = color_comps[ci];
+			int ccomp_count = static_cast<int>(comps.size());
+			#pragma omp parallel for schedule(dynamic)
+			for (int cci = 0; cci < ccomp_count; ++cci) {
+				unsigned int mfi = comps[cci];
+				mf_comp[mfi]->ForwardMap();
+				mf_comp_inf[mfi]->PerformInference();
+			}
+		}
+	} else {
+		for (unsigned int mfi = 0; mfi < mf_comp.size(); ++mfi) {
+			mf_comp[mfi]->ForwardMap();
+			mf_comp_inf[mfi]->PerformInference();
+		}
 	}
 
 	ProduceMarginals();
@@ -215,13 +267,28 @@ void StructuredMeanFieldInference::PerformInference() {
 		}
 
 		// For each component,
-		for (unsigned int mfi = 0; mfi < mf_comp.size(); ++mfi) {
-			// i) update all conditioning expectation information
-			UpdateComponentEnergies(mfi);
-			mf_comp[mfi]->ForwardMap();
-
-			// ii) Perform inference
-			mf_comp_inf[mfi]->PerformInference();
+		if (parallel) {
+			// Components of one color do not interact
+			for (unsigned int ci = 0; ci < color_comps.size(); ++ci) {
+				const std::vector<unsigned int>& comps = color_comps[ci];
+				int ccomp_count = static_cast<int>(comps.size());
+				#pragma omp parallel for schedule(dynamic)
+				for (int cci = 0; cci < ccomp_count; ++cci) {
+					unsigned int mfi = comps[cci];
+					UpdateComponentEnergies(mfi);
+					mf_comp[mfi]->ForwardMap();
+					mf_comp_inf[mfi]->PerformInference();
+				}
+			}
+		} else {
+			for (unsigned int mfi = 0; mfi < mf_comp.size(); ++mfi) {
+				// i) update all conditioning expectation information
+				UpdateComponentEnergies(mfi);
+				mf_comp[mfi]->ForwardMap();
+
+				// ii) Perform inference
+				mf_comp_inf[mfi]->PerformInference();
+			}
 		}
 		// Produce all marginals, either as copy or product
 		ProduceMarginals();
@@ -252,19 +319,15 @@ void StructuredMeanFieldInference::UpdateComponentEnergies(unsigned int mfi) {
 	// For each factor in mfi
 	for (unsigned int comp_fi = 0; comp_fi < mfi_factors.size();
 		++comp_fi) {
-		Factor* new_factor = mfi_factors[comp_fi];
-		bool is_conditioned = meanfield_factor_set.count(new_factor) != 0;
-		if (is_conditioned == false)
+		if (comp_is_mf[mfi][comp_fi] == false)
 			continue;	// Skip unconditioned factors
 
 		// It is a conditioned factor
-		Factor* orig_factor = fcond_tab->OriginalFactor(new_factor);
-		assert(orig_factor != 0);
-		assert(fac_to_fi.count(orig_factor) > 0);
-		unsigned int orig_fi = fac_to_fi[orig_factor];
-		assert(fi_to_condfac.count(orig_fi) > 0);
-		// Set of all factors derived by conditioning this original factor
-		const std::unordered_set<Factor*>& cond_facs =
+		Factor* new_factor = mfi_factors[comp_fi];
+		unsigned int orig_fi = comp_orig_fi[mfi][comp_fi];
+		const Factor* orig_factor = fg->Factors()[orig_fi];
+		// All factors derived by conditioning this original factor
+		const std::vector<std::pair<unsigned int, unsigned int> >& cond_facs =
 			fi_to_condfac[orig_fi];
 
 		// Schematic
@@ -279,27 +342,26 @@ void StructuredMeanFieldInference::UpdateComponentEnergies(unsigned int mfi) {
 		// these from the marginals of cond_facs \ {new_factor}, hence from H.
 		std::vector<double> ext_marginals(
 			orig_factor->Type()->ProdCardinalities(), 1.0);
+		std::vector<double> cfi_ext_marginals(ext_marginals.size());
 		size_t cond_expect_prodcard = 1;
-		for (std::unordered_set<Factor*>::const_iterator
-			cfi = cond_facs.begin(); cfi != cond_facs.end(); ++cfi) {
+		for (unsigned int cfi = 0; cfi < cond_facs.size(); ++cfi) {
 			// Ignore own marginals
-			if (*cfi == new_factor)
+			unsigned int cf_mfi = cond_facs[cfi].first;
+			unsigned int cf_comp_fi = cond_facs[cfi].second;
+			if (cf_mfi == mfi && cf_comp_fi == comp_fi)
 				continue;
 
 			// Obtain the conditional marginals
-			assert(cfac_to_mfi.find(new_factor) != cfac_to_mfi.end());
-			assert(cfac_to_cfi.find(new_factor) != cfac_to_cfi.end());
+			const Factor* cfac = mf_comp[cf_mfi]->Factors()[cf_comp_fi];
 			const std::vector<double>& cfi_marg =
-				mf_comp_inf[cfac_to_mfi[*cfi]]->Marginal(cfac_to_cfi[*cfi]);
+				mf_comp_inf[cf_mfi]->Marginal(cf_comp_fi);
 
 			// Extend and multiply
-			std::vector<double> cfi_ext_marginals(
-				orig_factor->Type()->ProdCardinalities(), 0.0);
-			fcond_tab->ExtendMarginals(*cfi, cfi_marg,
+			fcond_tab->ExtendMarginals(cfac, cfi_marg,
 				cfi_ext_marginals, true);
 			std::transform(cfi_ext_marginals.begin(), cfi_ext_marginals.end(),
 				ext_marginals.begin(), ext_marginals.begin(), _1 * _2);
-			cond_expect_prodcard *= (*cfi)->Type()->ProdCardinalities();
+			cond_expect_prodcard *= cfac->Type()->ProdCardinalities();
 		}
 
 		// Project to conditioned-on expectations
@@ -316,45 +378,40 @@ void StructuredMeanFieldInference::UpdateComponentEnergies(unsigned int mfi) {
 }
 
 void StructuredMeanFieldInference::ProduceMarginals() {
-	// Initialize all marginals to 1.0 because unconditioned factors will
-	// overwrite the marginals and conditioned factors multiply the values
-	// (factorial meanfield assumption).
+	// Unconditioned factors copy the component marginals, conditioned
+	// factors are the product of the extended marginals of all factors
+	// derived from them (factorial meanfield assumption).
 	const std::vector<Factor*>& factors = fg->Factors();
 	marginals.resize(factors.size());
-	std::unordered_map<Factor*, unsigned int> fac_to_fi;
-	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+	int factor_count = static_cast<int>(factors.size());
+	#pragma omp parallel for schedule(dynamic, 16) if(parallel)
+	for (int fi = 0; fi < factor_count; ++fi) {
 		marginals[fi].resize(factors[fi]->Type()->ProdCardinalities());
 		std::fill(marginals[fi].begin(), marginals[fi].end(), 1.0);
-		fac_to_fi.insert(std::pair<Factor*, unsigned int>(factors[fi], fi));
-	}
-	for (unsigned int mfi = 0; mfi < mf_comp.size(); ++mfi) {
-		const std::vector<Factor*>& mfi_factors = mf_comp[mfi]->Factors();
-		for (unsigned int comp_fi = 0; comp_fi < mfi_factors.size();
-			++comp_fi) {
-			Factor* new_factor = mfi_factors[comp_fi];
-			// Original factor index
-			unsigned int orig_fi =
-				fac_to_fi[fcond_tab->OriginalFactor(new_factor)];
-			// Marginal from the component (possibly conditioned)
+
+		unsigned int mfi = fi_to_comp[fi].first;
+		if (mfi < mf_comp.size()) {
+			// Unconditioned factor: copy marginals
 			const std::vector<double>& comp_marg =
-				mf_comp_inf[mfi]->Marginal(comp_fi);
-
-			bool is_conditioned = meanfield_factor_set.count(new_factor) != 0;
-			if (is_conditioned == false) {
-				// Unconditioned factor: copy marginals
-				assert(comp_marg.size() == marginals[orig_fi].size());
-				std::copy(comp_marg.begin(), comp_marg.end(),
-					marginals[orig_fi].begin());
-				continue;
-			}
+				mf_comp_inf[mfi]->Marginal(fi_to_comp[fi].second);
+			assert(comp_marg.size() == marginals[fi].size());
+			std::copy(comp_marg.begin(), comp_marg.end(),
+				marginals[fi].begin());
+		}
 
-			// Conditioned factor: extend to full marginals and multiply
-			std::vector<double> ext_marginals(marginals[orig_fi].size(), 0.0);
-			fcond_tab->ExtendMarginals(new_factor, comp_marg,
+		// Conditioned factor: extend to full marginals and multiply
+		const std::vector<std::pair<unsigned int, unsigned int> >& cond_facs =
+			fi_to_condfac[fi];
+		std::vector<double> ext_marginals(marginals[fi].size(), 0.0);
+		for (unsigned int cfi = 0; cfi < cond_facs.size(); ++cfi) {
+			unsigned int cf_mfi = cond_facs[cfi].first;
+			unsigned int cf_comp_fi = cond_facs[cfi].second;
+			fcond_tab->ExtendMarginals(
+				mf_comp[cf_mfi]->Factors()[cf_comp_fi],
+				mf_comp_inf[cf_mfi]->Marginal(cf_comp_fi),
 				ext_marginals, true);
 			std::transform(ext_marginals.begin(), ext_marginals.end(),
-				marginals[orig_fi].begin(), marginals[orig_fi].begin(),
-				_1 * _2);
+				marginals[fi].begin(), marginals[fi].begin(), _1 * _2);
 		}
 	}
 }
@@ -362,14 +419,18 @@ void StructuredMeanFieldInference::ProduceMarginals() {
 double StructuredMeanFieldInference::ComputeLogPartitionFunction() {
 	const std::vector<Factor*>& factors = fg->Factors();
 	double mu_theta = 0.0;
-	for (unsigned int fi = 0; fi < factors.size(); ++fi) {
+	int factor_count = static_cast<int>(factors.size());
+	#pragma omp parallel for reduction(+:mu_theta) if(parallel)
+	for (int fi = 0; fi < factor_count; ++fi) {
 		// <\theta,\mu>, where \theta=-E in our notation.
 		mu_theta -= std::inner_product(marginals[fi].begin(),
 			marginals[fi].end(), factors[fi]->Energies().begin(), 0.0);
 	}
 	// + \sum_m H_m(\mu)
 	double H_sum = 0.0;
-	for (unsigned int mfi = 0; mfi < mf_comp.size(); ++mfi)
+	int comp_count = static_cast<int>(mf_comp.size());
+	#pragma omp parallel for reduction(+:H_sum) if(parallel)
+	for (int mfi = 0; mfi < comp_count; ++mfi)
 		H_sum += mf_comp_inf[mfi]->Entropy();
 #if 0
 	std::cout << "mu_theta = " << mu_theta << std::endl;
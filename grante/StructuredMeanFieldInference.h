@@ -2,8 +2,8 @@
 #ifndef GRANTE_STRUCTURED_MEANFIELD_H
 #define GRANTE_STRUCTURED_MEANFIELD_H
 
-#include <unordered_set>
-#include <unordered_map>
+#include <vector>
+#include <utility>
 
 #include "FactorGraph.h"
 #include "FactorConditioningTable.h"
@@ -23,6 +23,12 @@ namespace Grante {
  * [Xing2003] Eric P. Xing, Michael I. Jordan, and Stuart Russell,
  *    "A generalized mean field algorithm for variational inference in
  *    exponential families", UAI 2003.
+ *
+ * Two components interact if a factor is split between them.  In parallel
+ * mode the component interaction graph is colored and all components of
+ * one color are updated concurrently.  Components of one color do not
+ * interact, hence this is the same block-coordinate ascent as the serial
+ * schedule.
  */
 class StructuredMeanFieldInference : public InferenceMethod {
 public:
@@ -57,8 +63,10 @@ public:
 	// conv_tol: Convergence tolerance wrt change in log_z.  Default: 1.0e-6,
 	// max_iter: Maximum number of mean field block-coordinate ascent
 	//    directions.  Use zero for no limit.  Default: 50.
+	// parallel: If true, update non-interacting components concurrently.
+	//    Default: false.
 	void SetParameters(bool verbose, double conv_tol,
-		unsigned int max_iter);
+		unsigned int max_iter, bool parallel = false);
 
 	// Perform block-coordinate mean field optimization to compute realizable
 	// marginals and bound on logZ
@@ -87,19 +95,23 @@ private:
 	// Mean field approximation component factor graphs
 	std::vector<FactorGraph*> mf_comp;
 	std::vector<TreeInference*> mf_comp_inf;
-	// fac_to_fi[orig_factor] is the factor index in the original factor graph
-	std::unordered_map<Factor*, unsigned int> fac_to_fi;
-	// For any cross-conditioned factor cfac we can locate its component as
-	// cfac_to_mfi[cfac] and its factor index in mf_comp[cfac_to_mfi[cfac]] as
-	// cfac_to_cfi[cfac].
-	std::unordered_map<Factor*, unsigned int> cfac_to_mfi;
-	std::unordered_map<Factor*, unsigned int> cfac_to_cfi;
-	// fi_to_condfac[orig_fi] is the set of conditioned factors derived from
-	// orig_fi.
-	std::unordered_map<unsigned int, std::unordered_set<Factor*> >
+	// comp_orig_fi[mfi][comp_fi] is the original factor index of factor
+	// comp_fi of component mfi.  comp_is_mf[mfi][comp_fi] is true if this
+	// factor is cross-conditioned on other components (a mean field factor).
+	std::vector<std::vector<unsigned int> > comp_orig_fi;
+	std::vector<std::vector<bool> > comp_is_mf;
+	// fi_to_condfac[orig_fi] are the (mfi, comp_fi) locations of all
+	// conditioned factors derived from orig_fi.
+	std::vector<std::vector<std::pair<unsigned int, unsigned int> > >
 		fi_to_condfac;
+	// fi_to_comp[orig_fi] is the (mfi, comp_fi) location of the
+	// unconditioned factor orig_fi, or mfi = mf_comp.size() if orig_fi is
+	// not contained in a single component.
+	std::vector<std::pair<unsigned int, unsigned int> > fi_to_comp;
 
-	std::unordered_set<Factor*> meanfield_factor_set;
+	// Coloring of the component interaction graph, color_comps[c] are the
+	// components of color c.
+	std::vector<std::vector<unsigned int> > color_comps;
 
 	// Inference result: realizable marginal distributions for all factors
 	std::vector<std::vector<double> > marginals;
@@ -111,11 +123,13 @@ private:
 	bool verbose;
 	double conv_tol;
 	unsigned int max_iter;
+	bool parallel;
 
 	// Initialize internal data structures using a v-acyclic decomposition.
 	// factor_is_removed[fi] is true if the factor is not retained.  If all
 	// elements are set to true, then this corresponds to naive mean field.
 	void InitializeVAC(const std::vector<bool>& factor_is_removed);
+	void ComputeComponentColoring();
 
 	// Update the energies of the component 'mfi' based on the inference
 	// result of all its neighboring components.
@@ -7,6 +7,10 @@
 #include <cmath>
 #include <cassert>
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <boost/timer.hpp>
 #include <boost/lambda/lambda.hpp>
 #include <boost/math/special_functions/fpclassify.hpp>
@@ -16,6 +20,8 @@
 #include "FunctionMinimization.h"
 #include "StochasticFunctionMinimization.h"
 #include "StructuredHammingLoss.h"
+#include "NormalPrior.h"
+#include "RandomSource.h"
 
 using namespace boost::lambda;
 
@@ -23,9 +29,10 @@ namespace Grante {
 
 StructuredSVM::StructuredSVM(FactorGraphModel* fg_model, double ssvm_C,
 	const std::string& opt_method)
-	: ParameterEstimationMethod(fg_model), ssvm_C(ssvm_C),
+	: ParameterEstimationMethod(fg_model), cache_size(0), ssvm_C(ssvm_C),
 		opt_method(opt_method) {
-	assert(opt_method == "stochastic" || opt_method == "bmrm");
+	assert(opt_method == "stochastic" || opt_method == "bmrm" ||
+		opt_method == "bcfw" || opt_method == "bcfw-parallel");
 }
 
 StructuredSVM::~StructuredSVM() {
@@ -55,6 +62,30 @@ void StructuredSVM::SetupTrainingData(
 	training_instances = instances;
 	loss_functions = loss;
 	this->inference_methods = inference_methods;
+	inference_cache.clear();
+}
+
+void StructuredSVM::SetInferenceCacheSize(unsigned int cache_size) {
+	this->cache_size = cache_size;
+	inference_cache.clear();
+}
+
+void StructuredSVM::UpdateInferenceCache(unsigned int n,
+	const std::vector<unsigned int>& y) {
+	assert(n < inference_cache.size());
+	std::vector<std::vector<unsigned int> >& cache = inference_cache[n];
+	std::vector<std::vector<unsigned int> >::iterator yi =
+		std::find(cache.begin(), cache.end(), y);
+	if (yi == cache.end()) {
+		// Insert, evicting the least recently used labeling
+		if (cache.size() < cache_size) {
+			cache.push_back(y);
+		} else {
+			cache.back() = y;
+		}
+		yi = cache.end() - 1;
+	}
+	std::rotate(cache.begin(), yi, yi + 1);
 }
 
 double StructuredSVM::Train(double conv_tol, unsigned int max_iter) {
@@ -72,6 +103,12 @@ double StructuredSVM::Train(double conv_tol, unsigned int max_iter) {
 		x_opt.resize(ssvm_prob.Dimensions());
 		std::fill(x_opt.begin(), x_opt.end(), 0.0);
 		ssvm_prob.FactorWeightsToLinear(x_opt);
+	} else if (opt_method == "bcfw" || opt_method == "bcfw-parallel") {
+		obj = TrainBCFW(&ssvm_prob, conv_tol, max_iter,
+			opt_method == "bcfw-parallel");
+		x_opt.resize(ssvm_prob.Dimensions());
+		std::fill(x_opt.begin(), x_opt.end(), 0.0);
+		ssvm_prob.FactorWeightsToLinear(x_opt);
 	} else {
 		assert(0);
 	}
@@ -89,26 +126,51 @@ double StructuredSVM::TrainBMRM(StructuredSVMProblem* ssvm_prob,
 	// Best (lowest) true feasible objective
 	double J_best = std::numeric_limits<double>::infinity();
 	double gap = std::numeric_limits<double>::infinity();
- std::vector<double> w_opt; 
+	inference_cache.resize(training_instances.size());
+	std::vector<double> w_opt;
 	for (unsigned int iter = 1; max_iter == 0 || iter <= max_iter; ++iter) {
 		std::cout << "BMRM iter " << iter << ", J_best " << J_best
 			<< ", gap " << gap << std::endl;
 
+		// Cached cutting plane: each cached labeling yields a linear lower
+		// bound on the hinge loss of its instance, hence the plane is valid.
+		// It is used if it improves the model at the current weights by at
+		// least conv_tol, otherwise the exact plane is computed.
+		double R_emp = 0.0;
+		bool is_exact = true;
+		if (cache_size > 0 && iter > 1) {
+			ssvm_prob->ClearParameterGradient();
+			double R_emp_cache = ssvm_prob->EvaluateLossGradient(true);
+			std::vector<double> w(ssvm_prob->Dimensions());
+			ssvm_prob->FactorWeightsToLinear(w);
+			double violation = R_emp_cache - bmrm.EvaluateModel(w);
+			std::cout << "   Cached cutting plane violation " << violation
+				<< std::endl;
+			if (violation >= conv_tol) {
+				R_emp = R_emp_cache;
+				is_exact = false;
+			}
+		}
+
 		// Compute: R_emp, subgradient of R_emp
-		ssvm_prob->ClearParameterGradient();
-		std::cout << "   Doing loss-augmented MAP inference." << std::endl;
-		boost::timer inf_timer;
-		double R_emp = ssvm_prob->EvaluateLossGradient();
-		std::cout << "   " << inf_timer.elapsed()
-			<< "s for loss-augmented MAP inference" << std::endl;
+		if (is_exact) {
+			ssvm_prob->ClearParameterGradient();
+			std::cout << "   Doing loss-augmented MAP inference." << std::endl;
+			boost::timer inf_timer;
+			R_emp = ssvm_prob->EvaluateLossGradient();
+			std::cout << "   " << inf_timer.elapsed()
+				<< "s for loss-augmented MAP inference" << std::endl;
+		}
 
 		// Enlarge cutting plane model
 		bmrm.AddCurrentSubgradient(R_emp);
 
 		// Compute exact objective and keep track of best feasible solution
-		double J_t_exact = R_emp + ssvm_prob->AddRegularizer();
-		if (J_t_exact < J_best)
-			J_best = J_t_exact;
+		if (is_exact) {
+			double J_t_exact = R_emp + ssvm_prob->AddRegularizer();
+			if (J_t_exact < J_best)
+				J_best = J_t_exact;
+		}
 
 		// Minimize cutting plane model
 		// std::vector<double> w_opt;
@@ -147,6 +209,134 @@ double StructuredSVM::TrainBMRM(StructuredSVMProblem* ssvm_prob,
 	return (J_best);
 }
 
+double StructuredSVM::TrainBCFW(StructuredSVMProblem* ssvm_prob,
+	double conv_tol, unsigned int max_iter, bool parallel) {
+	unsigned int dim = ssvm_prob->Dimensions();
+	unsigned int sample_count =
+		static_cast<unsigned int>(training_instances.size());
+	std::vector<double> lambda;
+	if (ssvm_prob->RegularizerPrecision(lambda) == false) {
+		std::cout << "Error: BCFW requires a NormalPrior on every factor "
+			<< "type, the weights are not trained." << std::endl;
+		return (std::numeric_limits<double>::quiet_NaN());
+	}
+
+	// Dual iterate: block n holds the primal contribution w_n and the loss
+	// contribution ell_n, w = sum_n w_n and ell = sum_n ell_n.  The dual
+	// objective is ell - 0.5 sum_d lambda_d w_d^2 + Omega(0).
+	std::vector<std::vector<double> > w_block(sample_count,
+		std::vector<double>(dim, 0.0));
+	std::vector<double> ell_block(sample_count, 0.0);
+	std::vector<double> w(dim, 0.0);
+	double ell = 0.0;
+	ssvm_prob->LinearToFactorWeights(w);
+	ssvm_prob->ClearParameterGradient();
+	double omega_zero = ssvm_prob->AddRegularizer();
+
+	int batch_size = 1;
+#ifdef _OPENMP
+	if (parallel) {
+		batch_size = std::max(1, std::min(omp_get_max_threads(),
+			static_cast<int>(sample_count)));
+	}
+#endif
+	std::vector<std::unordered_map<std::string, std::vector<double> > >
+		batch_gradient(batch_size);
+	std::vector<double> batch_obj(batch_size);
+
+	Likelihood lh(fg_model);
+	std::vector<unsigned int> order(sample_count);
+	for (unsigned int n = 0; n < sample_count; ++n)
+		order[n] = n;
+	std::vector<double> w_batch(dim);
+	std::vector<double> grad(dim);
+	std::vector<double> w_s(dim);
+	double gap = std::numeric_limits<double>::infinity();
+	for (unsigned int iter = 1; (max_iter == 0 || iter <= max_iter) &&
+		gap >= conv_tol; ++iter) {
+		RandomSource::ShuffleRandom(order);
+		gap = 0.0;
+		for (unsigned int bi = 0; bi < sample_count; bi += batch_size) {
+			int cur_batch = std::min(batch_size,
+				static_cast<int>(sample_count - bi));
+
+			// Loss-augmented MAP inference for the batch at weights w
+			w_batch = w;
+			#pragma omp parallel for schedule(static, 1) num_threads(cur_batch)
+			for (int b = 0; b < cur_batch; ++b) {
+				ssvm_prob->ClearGradient(batch_gradient[b]);
+				batch_obj[b] = ssvm_prob->EvaluateLossGradient(lh,
+					order[bi + b], batch_gradient[b]);
+			}
+
+			// Frank-Wolfe step on each block.  With g the subgradient of
+			// the hinge loss of instance n at w_batch, the corner is
+			//    w_s = -g/lambda,  ell_s = obj_n - <w_batch,g>.
+			for (int b = 0; b < cur_batch; ++b) {
+				unsigned int n = order[bi + b];
+				ssvm_prob->GradientToLinear(batch_gradient[b], grad);
+				double ell_s = batch_obj[b] - std::inner_product(
+					w_batch.begin(), w_batch.end(), grad.begin(), 0.0);
+
+				// The block duality gap is taken at w_batch, where the
+				// corner is optimal and the gap is non-negative.  The exact
+				// line search is done at the current w, which differs from
+				// w_batch after earlier steps of the same batch.
+				double block_gap = ell_s - ell_block[n];
+				double slope = block_gap;
+				double denom = 0.0;
+				for (unsigned int d = 0; d < dim; ++d) {
+					w_s[d] = -grad[d] / lambda[d];
+					double diff = w_block[n][d] - w_s[d];
+					block_gap += lambda[d] * diff * w_batch[d];
+					slope += lambda[d] * diff * w[d];
+					denom += lambda[d] * diff * diff;
+				}
+				gap += block_gap;
+				double gamma = (slope > 0.0) ? 1.0 : 0.0;
+				if (denom > 0.0)
+					gamma = std::min(1.0, std::max(0.0, slope / denom));
+
+				for (unsigned int d = 0; d < dim; ++d) {
+					double w_n_new = (1.0 - gamma) * w_block[n][d] +
+						gamma * w_s[d];
+					w[d] += w_n_new - w_block[n][d];
+					w_block[n][d] = w_n_new;
+				}
+				double ell_n_new = (1.0 - gamma) * ell_block[n] + gamma * ell_s;
+				ell += ell_n_new - ell_block[n];
+				ell_block[n] = ell_n_new;
+			}
+			ssvm_prob->LinearToFactorWeights(w);
+		}
+
+		double dual = ell + omega_zero;
+		for (unsigned int d = 0; d < dim; ++d)
+			dual -= 0.5 * lambda[d] * w[d] * w[d];
+		std::cout << "BCFW pass " << iter << ", dual " << dual
+			<< ", gap " << gap << std::endl;
+
+		// The block gaps of a pass are taken at different weights.  Before
+		// stopping, check the duality gap at the current weights.
+		if (gap < conv_tol) {
+			ssvm_prob->ClearParameterGradient();
+			double primal = ssvm_prob->EvaluateLossGradient();
+			primal += ssvm_prob->AddRegularizer();
+			gap = primal - dual;
+			std::cout << "BCFW primal " << primal << ", duality gap "
+				<< gap << std::endl;
+		}
+	}
+
+	// Exact primal objective at the final weights
+	ssvm_prob->ClearParameterGradient();
+	double obj = ssvm_prob->EvaluateLossGradient();
+	obj += ssvm_prob->AddRegularizer();
+	std::cout << "BCFW primal objective " << obj << std::endl;
+
+	return (obj);
+}
+
 StructuredSVM::StructuredSVMProblem::StructuredSVMProblem(
 	StructuredSVM* ssvm_base)
 	: ssvm_base(ssvm_base) {
@@ -164,24 +354,64 @@ StructuredSVM::StructuredSVMProblem::StructuredSVMProblem(
 StructuredSVM::StructuredSVMProblem::~StructuredSVMProblem() {
 }
 
-double StructuredSVM::StructuredSVMProblem::EvaluateLossGradient() {
+double StructuredSVM::StructuredSVMProblem::EvaluateLossGradient(
+	bool from_cache) {
 	Likelihood lh(ssvm_base->fg_model);
-	double obj = 0.0;
 	int sample_count = static_cast<int>(ssvm_base->training_instances.size());
-	#pragma omp parallel for schedule(dynamic)
+	int thread_count = 1;
+#ifdef _OPENMP
+	thread_count = std::max(1, std::min(omp_get_max_threads(), sample_count));
+#endif
+
+	// Per-thread gradients, the gradient of thread 0 is parameter_gradient.
+	// With round-robin scheduling thread ti handles the instances n with
+	// n % thread_count == ti.  The objectives are kept per instance.  Both
+	// are reduced in a fixed order, such that the result is deterministic
+	// for a given number of threads.
+	std::vector<std::unordered_map<std::string, std::vector<double> > >
+		thread_gradient(thread_count);
+	for (int ti = 1; ti < thread_count; ++ti) {
+		for (std::vector<std::string>::const_iterator
+			ft_name = parameter_order.begin();
+			ft_name != parameter_order.end(); ++ft_name) {
+			thread_gradient[ti][*ft_name] = std::vector<double>(
+				parameter_gradient[*ft_name].size(), 0.0);
+		}
+	}
+	std::vector<double> obj_n(sample_count, 0.0);
+
+	#pragma omp parallel for schedule(static, 1) num_threads(thread_count)
 	for (int n = 0; n < sample_count; ++n) {
-		double obj_n = EvaluateLossGradient(lh, static_cast<unsigned int>(n));
-		#pragma omp critical
-		{
-			obj += obj_n;
+		int ti = 0;
+#ifdef _OPENMP
+		ti = omp_get_thread_num();
+#endif
+		obj_n[n] = EvaluateLossGradient(lh, static_cast<unsigned int>(n),
+			ti == 0 ? parameter_gradient : thread_gradient[ti], from_cache);
+	}
+
+	for (int ti = 1; ti < thread_count; ++ti) {
+		for (std::vector<std::string>::const_iterator
+			ft_name = parameter_order.begin();
+			ft_name != parameter_order.end(); ++ft_name) {
+			std::vector<double>& grad = parameter_gradient[*ft_name];
+			const std::vector<double>& t_grad = thread_gradient[ti][*ft_name];
+			std::transform(grad.begin(), grad.end(), t_grad.begin(),
+				grad.begin(), std::plus<double>());
 		}
 	}
+	return (std::accumulate(obj_n.begin(), obj_n.end(), 0.0));
+}
 
-	return (obj);
+double StructuredSVM::StructuredSVMProblem::EvaluateLossGradient(
+	const Likelihood& lh, unsigned int n) {
+	return (EvaluateLossGradient(lh, n, parameter_gradient));
 }
 
 double StructuredSVM::StructuredSVMProblem::EvaluateLossGradient(
-	Likelihood& lh, unsigned int n) {
+	const Likelihood& lh, unsigned int n,
+	std::unordered_map<std::string, std::vector<double> >& gradient,
+	bool from_cache) const {
 	// For each sample: run forward map, loss-augmentation, run MAP inference,
 	// compute gradient
 	double obj = 0.0;
@@ -198,29 +428,63 @@ double StructuredSVM::StructuredSVMProblem::EvaluateLossGradient(
 	ts_fg->ForwardMap();
 
 	// Compute: -E(y_n;x_n,w)
-	#pragma omp critical
-	{
-		double obj_e = lh.ComputeObservationEnergy(ts_fg,
-			h_loss->Truth(), parameter_gradient, reg_scale);
-		obj += obj_e;
+	obj += lh.ComputeObservationEnergy(ts_fg, h_loss->Truth(), gradient,
+		reg_scale);
+
+	// Use the most violated cached labeling,
+	//    min_{y in cache} [E(y;x_n,w)-Delta(y,y_n)]
+	if (from_cache) {
+		std::vector<std::vector<unsigned int> >& cache =
+			ssvm_base->inference_cache[n];
+		assert(cache.empty() == false);
+		double best_val = std::numeric_limits<double>::infinity();
+		size_t best_ci = 0;
+		for (size_t ci = 0; ci < cache.size(); ++ci) {
+			double val = ts_fg->EvaluateEnergy(cache[ci]) -
+				h_loss->Eval(cache[ci]);
+			if (val < best_val) {
+				best_val = val;
+				best_ci = ci;
+			}
+		}
+		ssvm_base->UpdateInferenceCache(n, cache[best_ci]);
+
+		// Gradient of -E(y;x_n,w), the loss is constant
+		obj += lh.ComputeObservationEnergy(ts_fg, cache[0], gradient,
+			-reg_scale);
+		obj += reg_scale * h_loss->Eval(cache[0]);
+
+		return (obj);
 	}
 
 	// Compute: min_y [E(y;x_n,w)-Delta(y,y_n)]
-	//   i) Find loss-augmented MAP state (y_star)
+	//   i) Find loss-augmented MAP state (y_star).  If possible, the loss is
+	//      passed as unary overlay and the energies of ts_fg remain valid.
 	std::vector<unsigned int> y_star;
-	h_loss->PerformLossAugmentation(ts_fg, -1.0);	// +Delta(.,y_n)
+	std::vector<std::vector<double> > loss_overlay;
+	bool use_overlay = ts_inf->SupportsUnaryOverlay() &&
+		h_loss->ComputeUnaryLossAugmentation(ts_fg, loss_overlay, -1.0);
+	if (use_overlay) {
+		ts_inf->SetUnaryOverlay(&loss_overlay);
+	} else {
+		h_loss->PerformLossAugmentation(ts_fg, -1.0);	// +Delta(.,y_n)
+	}
 	double obj_m_1 = -reg_scale * ts_inf->MinimizeEnergy(y_star);
 
 	//  ii) Compute gradient (already of negative sign)
-	#pragma omp critical
-	{
-		double obj_m = lh.ComputeObservationEnergy(ts_fg, y_star,
-			parameter_gradient, -reg_scale);
-		assert(std::fabs(obj_m_1 - obj_m) < 1e-8);
-		obj += obj_m;
+	double obj_m = lh.ComputeObservationEnergy(ts_fg, y_star, gradient,
+		-reg_scale);
+	if (use_overlay) {
+		ts_inf->SetUnaryOverlay(0);
+		for (size_t vi = 0; vi < y_star.size(); ++vi)
+			obj_m -= reg_scale * loss_overlay[vi][y_star[vi]];
 	}
+	assert(std::fabs(obj_m_1 - obj_m) < 1e-8);
+	obj += obj_m;
 
 	ts_inf->ClearInferenceResult();
+	if (ssvm_base->cache_size > 0 && ssvm_base->inference_cache.size() > n)
+		ssvm_base->UpdateInferenceCache(n, y_star);
 
 	return (obj);
 }
@@ -252,12 +516,16 @@ double StructuredSVM::StructuredSVMProblem::EvaluateFenchelDual(void) {
 }
 
 void StructuredSVM::StructuredSVMProblem::ClearParameterGradient() {
+	ClearGradient(parameter_gradient);
+}
+
+void StructuredSVM::StructuredSVMProblem::ClearGradient(
+	std::unordered_map<std::string, std::vector<double> >& gradient) const {
 	for (std::vector<std::string>::const_iterator
 		ft_name = parameter_order.begin();
 		ft_name != parameter_order.end(); ++ft_name) {
 		FactorType* ft = ssvm_base->fg_model->FindFactorType(*ft_name);
-		parameter_gradient[*ft_name] =
-			std::vector<double>(ft->WeightDimension(), 0.0);
+		gradient[*ft_name] = std::vector<double>(ft->WeightDimension(), 0.0);
 	}
 }
 
@@ -295,16 +563,57 @@ void StructuredSVM::StructuredSVMProblem::FactorWeightsToLinear(
 
 void StructuredSVM::StructuredSVMProblem::ParameterGradientToLinear(
 	std::vector<double>& grad) {
+	GradientToLinear(parameter_gradient, grad);
+}
+
+void StructuredSVM::StructuredSVMProblem::GradientToLinear(
+	const std::unordered_map<std::string, std::vector<double> >& gradient,
+	std::vector<double>& grad) const {
 	size_t base_idx = 0;
 	for (std::vector<std::string>::const_iterator
 		ft_name = parameter_order.begin();
 		ft_name != parameter_order.end(); ++ft_name) {
-		std::copy(parameter_gradient[*ft_name].begin(),
-			parameter_gradient[*ft_name].end(), grad.begin() + base_idx);
-		base_idx += parameter_gradient[*ft_name].size();
+		const std::vector<double>& ft_grad = gradient.at(*ft_name);
+		std::copy(ft_grad.begin(), ft_grad.end(), grad.begin() + base_idx);
+		base_idx += ft_grad.size();
 	}
 }
 
+bool StructuredSVM::StructuredSVMProblem::RegularizerPrecision(
+	std::vector<double>& lambda) const {
+	lambda.resize(dim);
+	std::fill(lambda.begin(), lambda.end(), 0.0);
+	unsigned int base_idx = 0;
+	for (std::vector<std::string>::const_iterator
+		ft_name = parameter_order.begin();
+		ft_name != parameter_order.end(); ++ft_name) {
+		FactorType* ft = ssvm_base->fg_model->FindFactorType(*ft_name);
+		unsigned int ft_w_len = ft->WeightDimension();
+
+		// Precisions of multiple priors add up
+		typedef std::multimap<std::string, Prior*>::const_iterator prior_it;
+		std::pair<prior_it, prior_it> ft_priors =
+			ssvm_base->priors.equal_range(*ft_name);
+		for (prior_it prior = ft_priors.first; prior != ft_priors.second;
+			++prior) {
+			const NormalPrior* nprior =
+				dynamic_cast<const NormalPrior*>(prior->second);
+			if (nprior == 0)
+				return (false);
+			double prec = 1.0 / (nprior->Sigma() * nprior->Sigma());
+			for (unsigned int wi = 0; wi < ft_w_len; ++wi)
+				lambda[base_idx + wi] += prec;
+		}
+		base_idx += ft_w_len;
+	}
+	assert(base_idx == dim);
+	for (unsigned int d = 0; d < dim; ++d) {
+		if (lambda[d] <= 0.0)
+			return (false);
+	}
+	return (true);
+}
+
 unsigned int StructuredSVM::StructuredSVMProblem::Dimensions() const {
 	return (dim);
 }
@@ -629,6 +938,18 @@ double StructuredSVM::BMRM2StructuredSVMProblem::EvalPrimal(
 	return (obj_primal);
 }
 
+double StructuredSVM::BMRM2StructuredSVMProblem::EvaluateModel(
+	const std::vector<double>& w) const {
+	size_t t = At.size();
+	assert(t >= 1);
+	std::vector<double> nATw(t, 0.0);
+	Eval_neg_AT_u(w, nATw);	// -A'w
+	double max_resp = -std::numeric_limits<double>::infinity();
+	for (size_t ti = 0; ti < t; ++ti)
+		max_resp = std::max(max_resp, bt[ti] - nATw[ti]);
+	return (max_resp);
+}
+
 // neg_A_alpha = -A alpha, A is (n,t), alpha is (t,1)
 void StructuredSVM::BMRM2StructuredSVMProblem::Eval_neg_A_alpha(
 	const std::vector<double>& alpha,
@@ -41,6 +41,10 @@ public:
 	// ssvm_C: Structured SVM regularization parameter.
 	// opt_method: "stochastic", "batch", "bmrm", or "bmrm2".  Only
 	//    "stochastic" and "bmrm2" are robust, and "bmrm2" is recommended.
+	//    "bcfw" and "bcfw-parallel" select the block-coordinate Frank-Wolfe
+	//    method, which requires NormalPrior priors for all factor types;
+	//    with other priors, Train returns NaN and leaves the weights
+	//    unchanged.
 	//
 	// NOTE: you must add a prior for all factor types before calling Train.
 	StructuredSVM(FactorGraphModel* fg_model, double ssvm_C,
@@ -62,11 +66,29 @@ public:
 
 	virtual double Train(double conv_tol, unsigned int max_iter = 0);
 
+	// Inference caching for "bmrm" training.  The last cache_size
+	// loss-augmented MAP labelings of each instance are kept.  In each
+	// iteration the cutting plane is first computed from the most violated
+	// cached labelings, which requires only energy evaluations.  MAP
+	// inference is performed only if this plane improves the cutting plane
+	// model by less than conv_tol.  A cache_size of zero disables caching
+	// (default).
+	void SetInferenceCacheSize(unsigned int cache_size);
+
 private:
 	std::vector<FactorGraph*> training_instances;
 	std::vector<StructuredLossFunction*> loss_functions;
 	std::vector<InferenceMethod*> inference_methods;
 
+	// Inference cache: [n] are the cached labelings of instance n, the most
+	// recently used first.
+	unsigned int cache_size;
+	std::vector<std::vector<std::vector<unsigned int> > > inference_cache;
+
+	// Make y the most recently used labeling of instance n
+	void UpdateInferenceCache(unsigned int n,
+		const std::vector<unsigned int>& y);
+
 	// Utility storage to support ParameterEstimationMethod interface
 	std::vector<FactorGraph*> t_instances;
 	std::vector<StructuredLossFunction*> t_loss;
@@ -80,10 +102,20 @@ private:
 		StructuredSVMProblem(StructuredSVM* ssvm_base);
 		~StructuredSVMProblem();
 
-		// Evaluate loss gradient for all instances
-		double EvaluateLossGradient();
+		// Evaluate loss gradient for all instances.  The instances are
+		// processed in parallel, each thread adding into its own gradient.
+		// If from_cache is true, the most violated cached labeling of each
+		// instance is used instead of loss-augmented MAP inference; the
+		// result is a lower bound on the loss.
+		double EvaluateLossGradient(bool from_cache = false);
 		// Evaluate loss gradient for a single instance
-		double EvaluateLossGradient(Likelihood& lh, unsigned int n);
+		double EvaluateLossGradient(const Likelihood& lh, unsigned int n);
+		// Same, but add the gradient to the given gradient instead.  The
+		// inference method, factor graph and inference cache of instance n
+		// are modified.
+		double EvaluateLossGradient(const Likelihood& lh, unsigned int n,
+			std::unordered_map<std::string, std::vector<double> >& gradient,
+			bool from_cache = false) const;
 		double AddRegularizer(double scale = 1.0);
 
 		// Input: u (stored in model weights),
@@ -95,6 +127,19 @@ private:
 		void ParameterGradientToLinear(std::vector<double>& grad);
 		unsigned int Dimensions() const;
 
+		// Same as ClearParameterGradient and ParameterGradientToLinear,
+		// for a gradient other than parameter_gradient
+		void ClearGradient(std::unordered_map<std::string,
+			std::vector<double> >& gradient) const;
+		void GradientToLinear(const std::unordered_map<std::string,
+			std::vector<double> >& gradient, std::vector<double>& grad) const;
+
+		// Diagonal precision lambda of the regularizer,
+		//    Omega(w) = 0.5 sum_d lambda_d w_d^2 + const.
+		// Return false if a prior is not a NormalPrior or a weight has no
+		// prior, in which case lambda is not valid.
+		bool RegularizerPrecision(std::vector<double>& lambda) const;
+
 		StructuredSVM* Base();
 
 	private:
@@ -143,6 +188,8 @@ private:
 		virtual ~BMRM2StructuredSVMProblem();
 
 		void AddCurrentSubgradient(double R_emp);
+		// Value of the cutting plane model, max_i [<a_i,w> + b_i]
+		double EvaluateModel(const std::vector<double>& w) const;
 
 		// Solve the dual BMRM subproblem using the spectral projected
 		// gradient algorithm, SPG2, described in
@@ -192,6 +239,25 @@ private:
 	// Methods for Regularized Risk Minimization", JMLR 2009.
 	double TrainBMRM(StructuredSVMProblem* ssvm_prob,
 		double conv_tol, unsigned int max_iter);
+
+	// Train using block-coordinate Frank-Wolfe on the structured SVM dual,
+	//
+	// [LacosteJulien2013] Simon Lacoste-Julien, Martin Jaggi, Mark Schmidt,
+	//    Patrick Pletscher, "Block-Coordinate Frank-Wolfe Optimization for
+	//    Structural SVMs", ICML 2013.
+	//
+	// The method of the paper is generalized to the diagonal quadratic
+	// regularizer given by the Normal priors.  Each step performs one
+	// loss-augmented MAP inference and an exact line search on the block of
+	// one instance.  max_iter is the number of passes over the data and
+	// conv_tol is the tolerance on the duality gap, estimated from the
+	// block gaps of the last pass.
+	//
+	// If parallel is true, the MAP problems of mini-batches of as many
+	// instances as there are threads are solved in parallel at the same
+	// weights; the block updates are then applied sequentially.
+	double TrainBCFW(StructuredSVMProblem* ssvm_prob,
+		double conv_tol, unsigned int max_iter, bool parallel);
 };
 
 }
@@ -0,0 +1,207 @@
+
+#include "grante/StructuredSVM.h"
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <omp.h>
+
+#include "gmock/gmock.h"
+#include "grante/Factor.h"
+#include "grante/FactorGraph.h"
+#include "grante/FactorGraphModel.h"
+#include "grante/FactorGraphObservation.h"
+#include "grante/FactorType.h"
+#include "grante/LaplacePrior.h"
+#include "grante/NormalPrior.h"
+#include "grante/TreeInference.h"
+#include "gtest/gtest.h"
+
+namespace {
+
+// Small chain CRF training problem: binary labels, unary factors on two
+// noisy features and a bias, and a data-independent pairwise factor.  The
+// instances are the same for every call.
+class ChainProblem {
+public:
+    ChainProblem() {
+        std::vector<unsigned int> card1(1, 2);
+        std::vector<double> w1(2 * 3, 0.0);
+        model.AddFactorType(new Grante::FactorType("unary", card1, w1));
+        std::vector<unsigned int> card2(2, 2);
+        std::vector<double> w2(4, 0.0);
+        model.AddFactorType(new Grante::FactorType("pairwise", card2, w2));
+
+        std::default_random_engine e1(5);
+        std::normal_distribution<double> randn(0.0, 1.0);
+        unsigned int N = 10;
+        unsigned int length = 6;
+        for (unsigned int n = 0; n < N; ++n) {
+            std::vector<unsigned int> vc(length, 2);
+            Grante::FactorGraph* fg = new Grante::FactorGraph(&model, vc);
+            std::vector<unsigned int> label(length);
+            unsigned int y = n % 2;
+            for (unsigned int vi = 0; vi < length; ++vi) {
+                // Labels switch rarely, features are noisy
+                if (randn(e1) > 1.2)
+                    y = 1 - y;
+                label[vi] = y;
+                std::vector<double> data(3);
+                data[0] = (y == 1 ? 0.5 : -0.5) + randn(e1);
+                data[1] = randn(e1);
+                data[2] = 1.0;
+                std::vector<unsigned int> var_index1(1, vi);
+                fg->AddFactor(new Grante::Factor(
+                    model.FindFactorType("unary"), var_index1, data));
+                if (vi > 0) {
+                    std::vector<unsigned int> var_index2(2);
+                    var_index2[0] = vi - 1;
+                    var_index2[1] = vi;
+                    std::vector<double> data2;
+                    fg->AddFactor(new Grante::Factor(
+                        model.FindFactorType("pairwise"), var_index2, data2));
+                }
+            }
+            fgs.push_back(fg);
+            labels.push_back(label);
+            inference_methods.push_back(new Grante::TreeInference(fg));
+        }
+    }
+
+    ~ChainProblem() {
+        for (unsigned int n = 0; n < fgs.size(); ++n) {
+            delete inference_methods[n];
+            delete fgs[n];
+        }
+    }
+
+    // Create a trainer with unit-variance normal priors on all weights, or
+    // Laplace priors if laplace is true
+    Grante::StructuredSVM* CreateTrainer(double C,
+        const std::string& opt_method, bool laplace = false) {
+        Grante::StructuredSVM* ssvm =
+            new Grante::StructuredSVM(&model, C, opt_method);
+        if (laplace) {
+            ssvm->AddPrior("unary", new Grante::LaplacePrior(1.0, 6));
+            ssvm->AddPrior("pairwise", new Grante::LaplacePrior(1.0, 4));
+        } else {
+            ssvm->AddPrior("unary", new Grante::NormalPrior(1.0, 6));
+            ssvm->AddPrior("pairwise", new Grante::NormalPrior(1.0, 4));
+        }
+
+        // The observations are owned by the loss functions of the trainer
+        std::vector<Grante::ParameterEstimationMethod::labeled_instance_type>
+            training_data;
+        for (unsigned int n = 0; n < fgs.size(); ++n) {
+            training_data.push_back(
+                Grante::ParameterEstimationMethod::labeled_instance_type(
+                    fgs[n], new Grante::FactorGraphObservation(labels[n])));
+        }
+        ssvm->SetupTrainingData(training_data, inference_methods);
+
+        return (ssvm);
+    }
+
+    Grante::FactorGraphModel model;
+    std::vector<Grante::FactorGraph*> fgs;
+    std::vector<std::vector<unsigned int> > labels;
+    std::vector<Grante::InferenceMethod*> inference_methods;
+};
+
+}
+
+TEST(StructuredSVM, BMRMInferenceCache) {
+    double conv_tol = 1.0e-4;
+
+    ChainProblem prob_nocache;
+    Grante::StructuredSVM* ssvm = prob_nocache.CreateTrainer(1.0, "bmrm");
+    double obj_nocache = ssvm->Train(conv_tol, 500);
+    delete ssvm;
+
+    ChainProblem prob_cache;
+    ssvm = prob_cache.CreateTrainer(1.0, "bmrm");
+    ssvm->SetInferenceCacheSize(5);
+    double obj_cache = ssvm->Train(conv_tol, 500);
+    delete ssvm;
+
+    // Both runs stop within conv_tol of the optimum, up to the accuracy of
+    // the cutting plane subproblems
+    EXPECT_GT(obj_nocache, 0.0);
+    EXPECT_THAT(obj_cache, testing::DoubleNear(obj_nocache, 10.0 * conv_tol));
+}
+
+TEST(StructuredSVM, ParallelLossGradientMatchesSerial) {
+    ChainProblem prob_serial;
+    int max_threads = omp_get_max_threads();
+    omp_set_num_threads(1);
+    Grante::StructuredSVM* ssvm = prob_serial.CreateTrainer(1.0, "bmrm");
+    double obj_serial = ssvm->Train(1.0e-5, 4);
+    delete ssvm;
+
+    // The per-thread loss gradients are summed in thread order, so the
+    // training runs only differ in floating point rounding.  Only the first
+    // iterations are compared, the sub problem solver amplifies rounding
+    // differences near convergence.  Three threads do not divide the number
+    // of instances.
+    int thread_counts[] = { 2, 3, 4 };
+    for (unsigned int ti = 0; ti < 3; ++ti) {
+        omp_set_num_threads(thread_counts[ti]);
+        ChainProblem prob;
+        ssvm = prob.CreateTrainer(1.0, "bmrm");
+        double obj = ssvm->Train(1.0e-5, 4);
+        delete ssvm;
+
+        EXPECT_THAT(obj, testing::DoubleNear(obj_serial, 1.0e-10));
+        for (unsigned int fti = 0; fti < prob.model.FactorTypes().size();
+            ++fti) {
+            const std::vector<double>& w =
+                prob.model.FactorTypes()[fti]->Weights();
+            const std::vector<double>& w_serial =
+                prob_serial.model.FactorTypes()[fti]->Weights();
+            ASSERT_EQ(w_serial.size(), w.size());
+            for (unsigned int wi = 0; wi < w.size(); ++wi)
+                EXPECT_THAT(w[wi], testing::DoubleNear(w_serial[wi], 1.0e-10));
+        }
+    }
+    omp_set_num_threads(max_threads);
+}
+
+TEST(StructuredSVM, BCFWMatchesBMRM) {
+    ChainProblem prob_bmrm;
+    Grante::StructuredSVM* ssvm = prob_bmrm.CreateTrainer(1.0, "bmrm");
+    double obj_bmrm = ssvm->Train(1.0e-5, 500);
+    delete ssvm;
+
+    // BCFW stops once the duality gap at its final weights is below the
+    // tolerance.  The parallel variant steps on stale weights within a
+    // batch and is run with several batch sizes.
+    const char* methods[] = { "bcfw", "bcfw-parallel", "bcfw-parallel",
+        "bcfw-parallel" };
+    int thread_counts[] = { 1, 2, 4, 8 };
+    int max_threads = omp_get_max_threads();
+    for (unsigned int mi = 0; mi < 4; ++mi) {
+        omp_set_num_threads(thread_counts[mi]);
+        ChainProblem prob_bcfw;
+        ssvm = prob_bcfw.CreateTrainer(1.0, methods[mi]);
+        double obj_bcfw = ssvm->Train(1.0e-4, 5000);
+        delete ssvm;
+
+        EXPECT_GE(obj_bcfw, obj_bmrm - 1.0e-4);
+        EXPECT_THAT(obj_bcfw, testing::DoubleNear(obj_bmrm, 2.0e-4));
+    }
+    omp_set_num_threads(max_threads);
+}
+
+TEST(StructuredSVM, BCFWRejectsUnsupportedPrior) {
+    // BCFW supports only normal priors and does not train otherwise
+    ChainProblem prob;
+    prob.model.FindFactorType("pairwise")->Weights()[1] = 0.5;
+    Grante::StructuredSVM* ssvm = prob.CreateTrainer(1.0, "bcfw", true);
+    double obj = ssvm->Train(1.0e-4, 500);
+    delete ssvm;
+
+    EXPECT_TRUE(std::isnan(obj));
+    EXPECT_EQ(0.5, prob.model.FindFactorType("pairwise")->Weights()[1]);
+    EXPECT_EQ(0.0, prob.model.FindFactorType("unary")->Weights()[0]);
+}
@@ -14,7 +14,8 @@ SwendsenWangInference::SwendsenWangInference(const FactorGraph* fg,
 	const std::vector<std::vector<double> >& marg)
 	: InferenceMethod(fg), log_z(std::numeric_limits<double>::signaling_NaN()),
 		verbose(false), sw(0), burnin_sweeps(50), spacing_sweeps(0),
-		sample_count(100), use_single_swsteps(false) {
+		sample_count(100), use_single_swsteps(false),
+		use_cluster_sweeps(false) {
 	// Marginal same-state probabilities
 	size_t factor_count = fg->Factors().size();
 	const std::vector<Factor*>& factors = fg->Factors();
@@ -78,7 +79,8 @@ SwendsenWangInference::SwendsenWangInference(const FactorGraph* fg,
 	const std::vector<double>& qf, bool cocluster_prob)
 	: InferenceMethod(fg), log_z(std::numeric_limits<double>::signaling_NaN()),
 		verbose(false), sw(0), burnin_sweeps(50), spacing_sweeps(0),
-		sample_count(100), use_single_swsteps(false) {
+		sample_count(100), use_single_swsteps(false),
+		use_cluster_sweeps(false) {
 	assert(qf.size() == fg->Factors().size());
 
 	if (cocluster_prob) {
@@ -95,20 +97,22 @@ InferenceMethod* SwendsenWangInference::Produce(const FactorGraph* fg) const {
 	SwendsenWangInference* sw_new =
 		new SwendsenWangInference(fg, edgeprob_out, false);
 	sw_new->SetSamplingParameters(verbose, burnin_sweeps, spacing_sweeps,
-		sample_count);
+		sample_count, use_single_swsteps, use_cluster_sweeps);
 
 	return (sw_new);
 }
 
 void SwendsenWangInference::SetSamplingParameters(bool verbose,
 	unsigned int burnin_sweeps, unsigned int spacing_sweeps,
-	unsigned int sample_count, bool use_single_swsteps) {
+	unsigned int sample_count, bool use_single_swsteps,
+	bool use_cluster_sweeps) {
 	this->verbose = verbose;
 	this->burnin_sweeps = burnin_sweeps;
 	this->spacing_sweeps = spacing_sweeps;
 	assert(sample_count > 0);
 	this->sample_count = sample_count;
 	this->use_single_swsteps = use_single_swsteps;
+	this->use_cluster_sweeps = use_cluster_sweeps;
 }
 
 void SwendsenWangInference::PerformInference() {
@@ -126,7 +130,9 @@ void SwendsenWangInference::PerformInference() {
 	double sample_contribution = 1.0 / static_cast<double>(sample_count);
 	double mean_part_size = 0.0;
 	for (unsigned int si = 0; si < sample_count; ++si) {
-		if (use_single_swsteps) {
+		if (use_cluster_sweeps) {
+			mean_part_size += sw->ClusterSweep(1 + spacing_sweeps);
+		} else if (use_single_swsteps) {
 			double step_mps = 0.0;
 			for (unsigned int swi = 0; swi <= spacing_sweeps; ++swi)
 				step_mps += sw->SingleStep();
@@ -170,7 +176,9 @@ void SwendsenWangInference::PerformBurninPhase() {
 			double cur_beta = 0.0;
 			for (unsigned int k = 0; k < burnin_anneal; ++k) {
 				sw->SetInverseTemperature(cur_beta);
-				if (use_single_swsteps) {
+				if (use_cluster_sweeps) {
+					sw->ClusterSweep(1);
+				} else if (use_single_swsteps) {
 					sw->SingleStep();
 				} else {
 					sw->Sweep(1);
@@ -179,10 +187,16 @@ void SwendsenWangInference::PerformBurninPhase() {
 				cur_beta = std::pow(gamma, static_cast<double>(k)) * beta_1;
 			}
 			sw->SetInverseTemperature(1.0);
-			sw->Sweep(1);
+			if (use_cluster_sweeps) {
+				sw->ClusterSweep(1);
+			} else {
+				sw->Sweep(1);
+			}
 		}
 		// Normal SW sweeps (temperature 1)
-		if (use_single_swsteps) {
+		if (use_cluster_sweeps) {
+			sw->ClusterSweep(burnin_sweeps - burnin_anneal);
+		} else if (use_single_swsteps) {
 			for (unsigned int swi = 0; swi < (burnin_sweeps - burnin_anneal);
 				++swi) {
 				sw->SingleStep();
@@ -218,7 +232,9 @@ void SwendsenWangInference::Sample(
 	unsigned int sample_count) {
 	states.resize(sample_count);
 	for (unsigned int si = 0; si < sample_count; ++si) {
-		if (use_single_swsteps) {
+		if (use_cluster_sweeps) {
+			sw->ClusterSweep(1 + spacing_sweeps);
+		} else if (use_single_swsteps) {
 			for (unsigned int swi = 0; swi <= spacing_sweeps; ++swi)
 				sw->SingleStep();
 		} else {
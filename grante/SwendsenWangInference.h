@@ -41,9 +41,12 @@ public:
 	// sample_count: number of samples used to estimate marginals.
 	// use_single_swsteps: if true, one 'sweep' is a single SW transition.  If
 	//    false one sweep is an equivalent-sample sweep.
+	// use_cluster_sweeps: if true, one 'sweep' is a full parallel cluster
+	//    decomposition sweep, see SwendsenWangSampler::ClusterSweep.  This
+	//    overrides use_single_swsteps.
 	void SetSamplingParameters(bool verbose, unsigned int burnin_sweeps,
 		unsigned int spacing_sweeps, unsigned int sample_count,
-		bool use_single_swsteps = false);
+		bool use_single_swsteps = false, bool use_cluster_sweeps = false);
 
 	// Perform SW sampling to compute marginals.
 	virtual void PerformInference();
@@ -89,6 +92,7 @@ private:
 	unsigned int spacing_sweeps;
 	unsigned int sample_count;
 	bool use_single_swsteps;
+	bool use_cluster_sweeps;
 
 	void PerformBurninPhase();
 	void EdgeAppearanceFromCoclusterProb(const std::vector<double>& qf);
@@ -2,6 +2,8 @@
 #include <algorithm>
 #include <iostream>
 #include <queue>
+#include <numeric>
+#include <limits>
 #include <cmath>
 #include <cassert>
 
@@ -19,7 +21,8 @@ SwendsenWangSampler::SwendsenWangSampler(const FactorGraph* fg,
 		rgen(RandomSource::GetGlobalRandomSeed()), randu(rgen, rdestu),
 		rgen_var(RandomSource::GetGlobalRandomSeed()),
 		rdest_var(0, static_cast<int>(fg->Cardinalities().size()-1)),
-		randu_var(rgen_var, rdest_var) {
+		randu_var(rgen_var, rdest_var),
+		cluster_dset(fg->Cardinalities().size()) {
 	// Check dimension
 	assert(qf.size() == fg->Factors().size());
 
@@ -236,6 +239,179 @@ double SwendsenWangSampler::Sweep(unsigned int sweep_count) {
 	return (part_size_sum / static_cast<double>(parts_sampled));
 }
 
+double SwendsenWangSampler::ClusterSweep(unsigned int sweep_count) {
+	if (sweep_count == 0)
+		return (0.0);
+
+	const std::vector<Factor*>& factors = fg->Factors();
+	size_t var_count = state.size();
+	int factor_count = static_cast<int>(factors.size());
+	double cluster_size_sum = 0.0;
+	for (unsigned int sweep = 0; sweep < sweep_count; ++sweep) {
+		// 1. Switch on bonds of all agreeing pairwise factors in parallel
+		boost::uint64_t bond_seed =
+			static_cast<boost::uint64_t>(randu() * 9007199254740992.0);
+		cluster_dset.Reset();
+		#pragma omp parallel for
+		for (int fi = 0; fi < factor_count; ++fi) {
+			const std::vector<unsigned int>& fvars = factors[fi]->Variables();
+			if (fvars.size() <= 1)
+				continue;
+			assert(fvars.size() == 2);	// only pairwise for now
+
+			if (state[fvars[0]] != state[fvars[1]])
+				continue;	// factor cannot be a bond
+			if (HashUniform(bond_seed, fi) >= qf[fi])
+				continue;	// turned off with prob 1-qf
+
+			cluster_dset.Union(fvars[0], fvars[1]);
+		}
+
+		// 2. Connected components of the bond graph are the clusters
+		unsigned int cluster_count =
+			cluster_dset.UniqueLabeling(cluster_label);
+		cluster_vars_start.assign(cluster_count + 1, 0);
+		for (size_t vi = 0; vi < var_count; ++vi)
+			cluster_vars_start[cluster_label[vi] + 1] += 1;
+		std::partial_sum(cluster_vars_start.begin(), cluster_vars_start.end(),
+			cluster_vars_start.begin());
+		cluster_vars.resize(var_count);
+		std::vector<unsigned int> cluster_fill(cluster_vars_start.begin(),
+			cluster_vars_start.end() - 1);
+		for (size_t vi = 0; vi < var_count; ++vi) {
+			cluster_vars[cluster_fill[cluster_label[vi]]] =
+				static_cast<unsigned int>(vi);
+			cluster_fill[cluster_label[vi]] += 1;
+		}
+
+		// 3. Greedy coloring of the cluster adjacency graph.  Clusters of
+		// one color share no factor and are conditionally independent.
+		std::vector<std::vector<unsigned int> > cluster_adj(cluster_count);
+		for (int fi = 0; fi < factor_count; ++fi) {
+			const std::vector<unsigned int>& fvars = factors[fi]->Variables();
+			if (fvars.size() <= 1)
+				continue;
+
+			unsigned int c0 = cluster_label[fvars[0]];
+			unsigned int c1 = cluster_label[fvars[1]];
+			if (c0 == c1)
+				continue;
+			cluster_adj[c0].push_back(c1);
+			cluster_adj[c1].push_back(c0);
+		}
+		std::vector<unsigned int> cluster_color(cluster_count,
+			std::numeric_limits<unsigned int>::max());
+		std::vector<unsigned int> color_mark;
+		std::vector<std::vector<unsigned int> > color_clusters;
+		for (unsigned int ci = 0; ci < cluster_count; ++ci) {
+			for (std::vector<unsigned int>::const_iterator
+				ai = cluster_adj[ci].begin(); ai != cluster_adj[ci].end();
+				++ai) {
+				if (cluster_color[*ai] < color_mark.size())
+					color_mark[cluster_color[*ai]] = ci;
+			}
+			unsigned int color = 0;
+			while (color < color_mark.size() && color_mark[color] == ci)
+				color += 1;
+			if (color == color_mark.size()) {
+				color_mark.push_back(std::numeric_limits<unsigned int>::max());
+				color_clusters.push_back(std::vector<unsigned int>());
+			}
+			cluster_color[ci] = color;
+			color_clusters[color].push_back(ci);
+		}
+
+		// 4. Relabel all clusters, one color class at a time
+		boost::uint64_t relabel_seed =
+			static_cast<boost::uint64_t>(randu() * 9007199254740992.0);
+		for (unsigned int color = 0; color < color_clusters.size(); ++color) {
+			const std::vector<unsigned int>& cc = color_clusters[color];
+			int cc_count = static_cast<int>(cc.size());
+			#pragma omp parallel for schedule(dynamic, 16)
+			for (int cci = 0; cci < cc_count; ++cci)
+				SampleCluster(cc[cci], HashUniform(relabel_seed, cc[cci]));
+		}
+		cluster_size_sum += static_cast<double>(var_count) /
+			static_cast<double>(cluster_count);
+	}
+	return (cluster_size_sum / static_cast<double>(sweep_count));
+}
+
+void SwendsenWangSampler::SampleCluster(unsigned int ci, double u) {
+	const std::vector<Factor*>& factors = fg->Factors();
+	unsigned int cv_begin = cluster_vars_start[ci];
+	unsigned int cv_end = cluster_vars_start[ci+1];
+
+	// SW weights: cut factors to neighboring clusters that have label li are
+	// not bonds, log \omega_li = \sum log(1-qf)
+	std::vector<double> log_sw_weights(label_count, 0.0);
+	for (unsigned int cvi = cv_begin; cvi < cv_end; ++cvi) {
+		unsigned int vi = cluster_vars[cvi];
+		const std::set<unsigned int>& adj_facs = fgu.AdjacentFactors(vi);
+		for (std::set<unsigned int>::const_iterator afi = adj_facs.begin();
+			afi != adj_facs.end(); ++afi) {
+			const std::vector<unsigned int>& fvars = factors[*afi]->Variables();
+			if (fvars.size() <= 1)
+				continue;
+
+			unsigned int vi_other = (fvars[0] == vi) ? fvars[1] : fvars[0];
+			if (cluster_label[vi_other] == ci)
+				continue;	// inside the cluster
+			log_sw_weights[state[vi_other]] += std::log(1.0 - qf[*afi]);
+		}
+	}
+
+	// Tempered energies of all factors touching the cluster, minus the SW
+	// correction
+	std::vector<double> part_energy(label_count, 0.0);
+	for (unsigned int li = 0; li < label_count; ++li) {
+		for (unsigned int cvi = cv_begin; cvi < cv_end; ++cvi)
+			state[cluster_vars[cvi]] = li;
+
+		double energy = 0.0;
+		for (unsigned int cvi = cv_begin; cvi < cv_end; ++cvi) {
+			unsigned int vi = cluster_vars[cvi];
+			const std::set<unsigned int>& adj_facs = fgu.AdjacentFactors(vi);
+			for (std::set<unsigned int>::const_iterator afi = adj_facs.begin();
+				afi != adj_facs.end(); ++afi) {
+				const std::vector<unsigned int>& fvars =
+					factors[*afi]->Variables();
+				// Count factors inside the cluster only once
+				if (fvars.size() == 2 && fvars[0] != vi &&
+					cluster_label[fvars[0]] == ci)
+					continue;
+				energy += factors[*afi]->EvaluateEnergy(state);
+			}
+		}
+		part_energy[li] = inv_temperature*energy - log_sw_weights[li];
+	}
+
+	// Sample label from the normalized distribution
+	double lse = LogSumExp::ComputeNeg(part_energy);
+	double runsum = 0.0;
+	unsigned int new_label = label_count - 1;
+	for (unsigned int li = 0; li < label_count; ++li) {
+		runsum += std::exp(-part_energy[li] - lse);
+		if (u < runsum) {
+			new_label = li;
+			break;
+		}
+	}
+	for (unsigned int cvi = cv_begin; cvi < cv_end; ++cvi)
+		state[cluster_vars[cvi]] = new_label;
+}
+
+double SwendsenWangSampler::HashUniform(boost::uint64_t seed,
+	boost::uint64_t counter) {
+	// splitmix64 finalizer
+	boost::uint64_t z = seed + (counter + 1) * 0x9e3779b97f4a7c15ULL;
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	z = z ^ (z >> 31);
+	// Upper 53 bits as double in [0,1)
+	return (static_cast<double>(z >> 11) * (1.0 / 9007199254740992.0));
+}
+
 const std::vector<unsigned int>& SwendsenWangSampler::State() const {
 	return (state);
 }
@@ -9,6 +9,7 @@
 
 #include "FactorGraph.h"
 #include "FactorGraphUtility.h"
+#include "ConcurrentDisjointSet.h"
 
 namespace Grante {
 
@@ -51,6 +52,18 @@ public:
 	// Return the partition size of the cluster grown.
 	size_t SingleStep(void);
 
+	// Perform full-decomposition SW sweeps.  In each sweep the bonds of all
+	// pairwise factors are switched on in parallel, the connected components
+	// of all bonds are formed using a concurrent union-find and all clusters
+	// are relabeled.  Each cluster is resampled from its SW conditional
+	// given the labels of the other clusters, clusters that do not share a
+	// factor are relabeled in parallel.  This is a Gibbs sampler on the
+	// joint distribution of states and bonds and leaves the target
+	// distribution invariant for any edge appearance probabilities.
+	//
+	// Return the mean cluster size or zero if no sampling was done.
+	double ClusterSweep(unsigned int sweep_count);
+
 	const std::vector<unsigned int>& State() const;
 
 	// Set temperature: 1.0 is the original distribution, 0.0 the uniform
@@ -134,6 +147,22 @@ private:
 	boost::uniform_int<int> rdest_var;	// range [0,var_count-1]
 	boost::variate_generator<boost::mt19937,
 		boost::uniform_int<int> > randu_var;
+
+	// Full-sweep clustering: concurrent union-find over the variables and
+	// per-cluster data.  cluster_vars[cluster_vars_start[c]] to
+	// cluster_vars[cluster_vars_start[c+1]-1] are the variables of cluster c.
+	ConcurrentDisjointSet cluster_dset;
+	std::vector<unsigned int> cluster_label;
+	std::vector<unsigned int> cluster_vars_start;
+	std::vector<unsigned int> cluster_vars;
+
+	// Counter-based uniform random number in [0,1), independent of the
+	// order in which parallel threads request numbers.
+	static double HashUniform(boost::uint64_t seed, boost::uint64_t counter);
+
+	// Sample a new label for cluster ci from its SW conditional distribution
+	// given the labels of all other clusters.  u is a uniform random number.
+	void SampleCluster(unsigned int ci, double u);
 };
 
 }
@@ -10,6 +10,7 @@
 
 #include "TreeInference.h"
 #include "LogSumExp.h"
+#include "VectorMath.h"
 #include "FactorGraphStructurizer.h"
 
 namespace Grante {
@@ -100,6 +101,7 @@ double TreeInference::Entropy() const {
 	std::cout << "<mu,theta> (" << H << ") - logZ (" << log_z << ") = "
 		<< (H-log_z) << std::endl;
 #endif
+	H += EvaluateOverlayEnergy(marginals);
 	H += log_z;
 	return (H);
 }
@@ -137,16 +139,36 @@ double TreeInference::MinimizeEnergy(std::vector<unsigned int>& state) {
 
 	// Return energy (this could be made faster by using the max-product
 	// result)
-	if (std::fabs(fg->EvaluateEnergy(state) + log_z) > 1.0e-6) {
+	double energy = fg->EvaluateEnergy(state) + EvaluateOverlayEnergy(state);
+	if (std::fabs(energy + log_z) > 1.0e-6) {
 		std::cout << "WARNING: min-sum computed energy and factor graph energy "
 			<< "disagree" << std::endl;
-		std::cout << "  EvaluateEnergy: " << fg->EvaluateEnergy(state) << std::endl;
+		std::cout << "  EvaluateEnergy: " << energy << std::endl;
 		std::cout << "  -log_z: " << -log_z << std::endl;
 	}
-	assert(std::fabs(fg->EvaluateEnergy(state) + log_z) <= 1.0e-2);
+	assert(std::fabs(energy + log_z) <= 1.0e-2);
 	return (-log_z);
 }
 
+bool TreeInference::SupportsUnaryOverlay() const {
+	return (true);
+}
+
+bool TreeInference::SupportsEvidence() const {
+	return (true);
+}
+
+void TreeInference::SubtractOverlay(unsigned int var_index,
+	std::vector<double>& log_msg) const {
+	if (unary_overlay == 0)
+		return;
+
+	const std::vector<double>& ov = (*unary_overlay)[var_index];
+	assert(ov.size() == log_msg.size());
+	std::transform(log_msg.begin(), log_msg.end(), ov.begin(),
+		log_msg.begin(), std::minus<double>());
+}
+
 unsigned int TreeInference::SampleConditionalUnnormalized(
 	const std::vector<double>& cond_unnorm) const {
 	double Z = std::accumulate(cond_unnorm.begin(), cond_unnorm.end(), 0.0);
@@ -212,53 +234,36 @@ void TreeInference::PassLeafToRoot(std::vector<std::vector<double> >& msg,
 			//
 			// (26.12) in McKay, but in log-domain.
 			size_t energies_size = energies.size();
-			std::vector<double> msum_xn_max(card[up_var_index],
-				-std::numeric_limits<double>::infinity());
-			for (size_t ei = 0; ei < energies_size; ++ei) {
+			for (size_t ei = 0; ei < energies_size; ++ei)
 				msum_xn[ei] = -energies[ei];
 
-				// Sum adjacent leaf-variables of this factor
-				for (unsigned int fvi = 0; fvi < fvars.size(); ++fvi) {
-					if (fvi == fvi_up)
-						continue;	// Upward variable
+			// Sum adjacent leaf-variables of this factor
+			for (unsigned int fvi = 0; fvi < fvars.size(); ++fvi) {
+				if (fvi == fvi_up)
+					continue;	// Upward variable
 
-					unsigned int var_index = fvars[fvi];
-					unsigned int var_msg = ltr_var_toroot[var_index];
-					unsigned int var_state =
-						ftype->LinearIndexToVariableState(ei, fvi);
+				unsigned int var_index = fvars[fvi];
+				unsigned int var_msg = ltr_var_toroot[var_index];
 
-					// + log q_{v->f}(v_state)
-					msum_xn[ei] += msg[var_msg][var_state];
-				}
-
-				// Compute maximum over state of xn for stable log-sum-exp.
-				unsigned int xn_state =
-					ftype->LinearIndexToVariableState(ei, fvi_up);
-				assert(xn_state < msum_xn_max.size());
-				if (msum_xn[ei] > msum_xn_max[xn_state])
-					msum_xn_max[xn_state] = msum_xn[ei];
+				// + log q_{v->f}(v_state)
+				VectorMath::StridedAdd(&msum_xn[0], energies_size,
+					card[var_index], ftype->VariableStride(fvi),
+					&msg[var_msg][0]);
 			}
 
+			assert(msg[lri].size() == card[up_var_index]);
 			if (min_sum) {
 				// Message: maximum negative energy value (minimum energy)
 				// over domain of xn
-				for (unsigned int xn_state = 0; xn_state < card[up_var_index];
-					++xn_state) {
-					msg[lri][xn_state] = msum_xn_max[xn_state];
-				}
+				VectorMath::StridedMax(&msum_xn[0], energies_size,
+					card[up_var_index], ftype->VariableStride(fvi_up),
+					&msg[lri][0]);
 			} else {
 				// Log-sum-exp (numerically stable), correctly split along msum_xn
-				for (unsigned int ei = 0; ei < energies_size; ++ei) {
-					unsigned int xn_state =
-						ftype->LinearIndexToVariableState(ei, fvi_up);
-					msg[lri][xn_state] +=
-						std::exp(msum_xn[ei] - msum_xn_max[xn_state]);
-				}
-				for (unsigned int xn_state = 0; xn_state < card[up_var_index];
-					++xn_state) {
-					msg[lri][xn_state] = msum_xn_max[xn_state] +
-						std::log(msg[lri][xn_state]);
-				}
+				std::vector<double> msum_xn_max(card[up_var_index]);
+				VectorMath::StridedLogSumExp(&msum_xn[0], energies_size,
+					card[up_var_index], ftype->VariableStride(fvi_up),
+					&msg[lri][0], &msum_xn_max[0]);
 			}
 		} else {
 			// Variable-to-factor message
@@ -278,6 +283,8 @@ void TreeInference::PassLeafToRoot(std::vector<std::vector<double> >& msg,
 					msg[lri].begin(), msg[lri].begin(),
 					std::plus<double>());
 			}
+			SubtractOverlay(var_index, msg[lri]);
+			ClampLogTable(var_index, msg[lri]);
 		}
 	}
 
@@ -294,6 +301,8 @@ void TreeInference::PassLeafToRoot(std::vector<std::vector<double> >& msg,
 			std::transform(msg[*mzi].begin(), msg[*mzi].end(),
 				log_z_sum.begin(), log_z_sum.begin(), std::plus<double>());
 		}
+		SubtractOverlay(*tri, log_z_sum);
+		ClampLogTable(*tri, log_z_sum);
 
 		if (min_sum) {
 			// Maximum negative energy
@@ -353,6 +362,8 @@ void TreeInference::PassRootToLeaf(std::vector<std::vector<double> >& msg,
 					m_root.begin(), m_root.begin(),
 					std::plus<double>());
 			}
+			SubtractOverlay(*tri, m_root);
+			ClampLogTable(*tri, m_root);
 			if (min_sum == false) {
 				for (unsigned int n = 0; n < m_root.size(); ++n)
 					m_root[n] = std::exp(m_root[n]);
@@ -424,6 +435,15 @@ void TreeInference::PassRootToLeaf(std::vector<std::vector<double> >& msg,
 						msg_rev[lri][n] += msg[*mi][sample[var_index]];
 				}
 			}
+			// - overlay energy of var
+			if (sample.empty()) {
+				SubtractOverlay(var_index, msg_rev[lri]);
+				ClampLogTable(var_index, msg_rev[lri]);
+			} else if (unary_overlay != 0) {
+				const std::vector<double>& ov = (*unary_overlay)[var_index];
+				for (unsigned int n = 0; n < msg_rev[lri].size(); ++n)
+					msg_rev[lri][n] -= ov[sample[var_index]];
+			}
 
 			// PART 2: Compute marginals of the factor
 
@@ -491,9 +511,7 @@ void TreeInference::PassRootToLeaf(std::vector<std::vector<double> >& msg,
 			// Normalization is only required for sampling or when there are
 			// multiple tree roots
 			if (min_sum == false) {
-				double log_z_fi = LogSumExp::Compute(M);
-				for (unsigned int ei = 0; ei < energies_size; ++ei)
-					M[ei] = std::exp(M[ei] - log_z_fi);
+				VectorMath::NormalizeLog(&M[0], energies_size);
 			}
 
 			// Sample all adjacent not-yet-sampled variables
@@ -542,8 +560,6 @@ void TreeInference::PassRootToLeaf(std::vector<std::vector<double> >& msg,
 			//
 			// (26.12) in McKay, but in log-domain.
 			size_t energies_size = energies.size();
-			std::vector<double> msum_xn_max(card[var_index],
-				-std::numeric_limits<double>::infinity());
 			for (size_t ei = 0; ei < energies_size; ++ei) {
 				msum_xn[ei] = -energies[ei];
 
@@ -586,33 +602,20 @@ void TreeInference::PassRootToLeaf(std::vector<std::vector<double> >& msg,
 					// + log q_{v->f}(v_state)
 					msum_xn[ei] += msg[var_msg][var_state];
 				}
-
-				// Compute maximum over state of xn
-				unsigned int xn_state =
-					ftype->LinearIndexToVariableState(ei, fvi_down);
-				if (msum_xn[ei] > msum_xn_max[xn_state])
-					msum_xn_max[xn_state] = msum_xn[ei];
 			}
 
+			assert(msg_rev[lri].size() == card[var_index]);
 			if (min_sum) {
 				// Message: maximum negative energy value
-				for (unsigned int xn_state = 0; xn_state < card[var_index];
-					++xn_state) {
-					msg_rev[lri][xn_state] = msum_xn_max[xn_state];
-				}
+				VectorMath::StridedMax(&msum_xn[0], energies_size,
+					card[var_index], ftype->VariableStride(fvi_down),
+					&msg_rev[lri][0]);
 			} else {
 				// Log-sum-exp, correctly split along msum_xn
-				for (unsigned int ei = 0; ei < energies_size; ++ei) {
-					unsigned int xn_state =
-						ftype->LinearIndexToVariableState(ei, fvi_down);
-					msg_rev[lri][xn_state] +=
-						std::exp(msum_xn[ei] - msum_xn_max[xn_state]);
-				}
-				for (unsigned int xn_state = 0; xn_state < card[var_index];
-					++xn_state) {
-					msg_rev[lri][xn_state] = msum_xn_max[xn_state] +
-						std::log(msg_rev[lri][xn_state]);
-				}
+				std::vector<double> msum_xn_max(card[var_index]);
+				VectorMath::StridedLogSumExp(&msum_xn[0], energies_size,
+					card[var_index], ftype->VariableStride(fvi_down),
+					&msg_rev[lri][0], &msum_xn_max[0]);
 			}
 		}
 	}
@@ -61,6 +61,10 @@ public:
 	// Exact max-sum energy minimization for tree-structured factor graphs.
 	virtual double MinimizeEnergy(std::vector<unsigned int>& state);
 
+	virtual bool SupportsUnaryOverlay() const;
+	// Observed variables are clamped in the variable-to-factor messages
+	virtual bool SupportsEvidence() const;
+
 private:
 	// Inference result 1: marginal distributions for all factors
 	std::vector<std::vector<double> > marginals;
@@ -94,6 +98,10 @@ private:
 		std::vector<std::vector<double> >& msg_rev,
 		std::vector<unsigned int>& sample, bool min_sum = false);
 
+	// log_msg -= overlay of var_index, messages are negative energies
+	void SubtractOverlay(unsigned int var_index,
+		std::vector<double>& log_msg) const;
+
 	// Utility functions to sample or maximize explicitly from an unnormalized
 	// distribution.
 	unsigned int SampleConditionalUnnormalized(
@@ -0,0 +1,640 @@
+
+#include <algorithm>
+#include <vector>
+#include <limits>
+#include <cstring>
+#include <cmath>
+#include <cassert>
+
+#include <boost/cstdint.hpp>
+
+#include "VectorMath.h"
+
+// The kernels are written once as templates over a vector type and are
+// instantiated for each instruction set with the native register width:
+// within a function compiled for one instruction set, operations on wider
+// vectors are split by the compiler and comparisons are scalarized.  The
+// kernel table of the best supported instruction set is selected by CPU
+// features on first use.
+#if defined(__GNUC__) && defined(__x86_64__)
+#define GRANTE_VECTOR_X86
+#endif
+#if defined(__GNUC__)
+#define GRANTE_VECTOR_TYPES
+#define GRANTE_VECTOR_INLINE inline __attribute__((always_inline))
+// Vector arguments of inlined helpers do not cross an ABI boundary
+#pragma GCC diagnostic ignored "-Wpsabi"
+#else
+#define GRANTE_VECTOR_INLINE inline
+#endif
+
+namespace Grante {
+
+namespace {
+
+// Operations on a single double, used for tails and as the fallback
+struct ScalarOps {
+	typedef double D;
+	typedef boost::uint64_t U;
+	typedef bool M;
+	static const size_t lanes = 1;
+
+	static GRANTE_VECTOR_INLINE D Load(const double* x) {
+		return (*x);
+	}
+	static GRANTE_VECTOR_INLINE D Load(const float* x) {
+		return (*x);
+	}
+	static GRANTE_VECTOR_INLINE void Store(double* x, D v) {
+		*x = v;
+	}
+	static GRANTE_VECTOR_INLINE D Broadcast(double c) {
+		return (c);
+	}
+	static GRANTE_VECTOR_INLINE D Select(M mask, D a, D b) {
+		return (mask ? a : b);
+	}
+	static GRANTE_VECTOR_INLINE U AsBits(D x) {
+		U u;
+		std::memcpy(&u, &x, sizeof(u));
+		return (u);
+	}
+	static GRANTE_VECTOR_INLINE D FromBits(U u) {
+		D x;
+		std::memcpy(&x, &u, sizeof(x));
+		return (x);
+	}
+	static GRANTE_VECTOR_INLINE double Element(D v, size_t) {
+		return (v);
+	}
+};
+
+#ifdef GRANTE_VECTOR_TYPES
+typedef float v2sf __attribute__((vector_size(8)));
+typedef double v2df __attribute__((vector_size(16)));
+typedef boost::uint64_t v2du __attribute__((vector_size(16)));
+typedef boost::int64_t v2di __attribute__((vector_size(16)));
+typedef float v4sf __attribute__((vector_size(16)));
+typedef double v4df __attribute__((vector_size(32)));
+typedef boost::uint64_t v4du __attribute__((vector_size(32)));
+typedef boost::int64_t v4di __attribute__((vector_size(32)));
+typedef float v8sf __attribute__((vector_size(32)));
+typedef double v8df __attribute__((vector_size(64)));
+typedef boost::uint64_t v8du __attribute__((vector_size(64)));
+typedef boost::int64_t v8di __attribute__((vector_size(64)));
+
+// Operations on a vector of doubles DT, UT and MT are the unsigned and
+// comparison result vector types of the same size, FT is the vector of
+// floats with the same number of lanes.
+template <typename DT, typename UT, typename MT, typename FT>
+struct VectorOps {
+	typedef DT D;
+	typedef UT U;
+	typedef MT M;
+	static const size_t lanes = sizeof(DT) / sizeof(double);
+
+	static GRANTE_VECTOR_INLINE D Load(const double* x) {
+		D v;
+		std::memcpy(&v, x, sizeof(v));
+		return (v);
+	}
+	// Single precision elements are widened, all arithmetic is in double
+	static GRANTE_VECTOR_INLINE D Load(const float* x) {
+		FT v;
+		std::memcpy(&v, x, sizeof(v));
+		return (__builtin_convertvector(v, D));
+	}
+	static GRANTE_VECTOR_INLINE void Store(double* x, D v) {
+		std::memcpy(x, &v, sizeof(v));
+	}
+	static GRANTE_VECTOR_INLINE D Broadcast(double c) {
+		return (D() + c);
+	}
+	// A bitwise blend, conditional expressions on vectors may be recognized
+	// as min/max and scalarized.
+	static GRANTE_VECTOR_INLINE D Select(M mask, D a, D b) {
+		U m = (U)(mask);
+		return ((D)(((U)(a) & m) | ((U)(b) & ~m)));
+	}
+	static GRANTE_VECTOR_INLINE U AsBits(D x) {
+		return ((U)(x));
+	}
+	static GRANTE_VECTOR_INLINE D FromBits(U u) {
+		return ((D)(u));
+	}
+	static GRANTE_VECTOR_INLINE double Element(D v, size_t li) {
+		return (v[li]);
+	}
+};
+
+typedef VectorOps<v2df, v2du, v2di, v2sf> Vector2Ops;
+typedef VectorOps<v4df, v4du, v4di, v4sf> Vector4Ops;
+typedef VectorOps<v8df, v8du, v8di, v8sf> Vector8Ops;
+#endif
+
+// exp(x): x = k*log(2) + r with |r| <= log(2)/2, exp(r) by its Taylor
+// polynomial and 2^k constructed in the exponent bits.
+template <typename V>
+GRANTE_VECTOR_INLINE typename V::D ExpElement(typename V::D x) {
+	typedef typename V::D D;
+	typedef typename V::U U;
+	const double log2e = 1.44269504088896340736;
+	const double ln2_hi = 6.93147180369123816490e-01;
+	const double ln2_lo = 1.90821492927058770002e-10;
+	const double shifter = 6755399441055744.0;	// 1.5 * 2^52
+
+	// The low bits of kd hold k = round(x / log(2)).  Outside of
+	// [-708, 709] 2^k is not a normal number and the result is replaced
+	// below, NaN is propagated.
+	D kd = x * log2e + shifter;
+	U kbits = V::AsBits(kd);
+	kd -= shifter;
+	D r = (x - kd * ln2_hi) - kd * ln2_lo;
+
+	// Estrin's scheme keeps the dependency chain short
+	D r2 = r * r;
+	D r4 = r2 * r2;
+	D r8 = r4 * r4;
+	D p01 = r + 1.0;
+	D p23 = r * 1.6666666666666666e-01 + 0.5;
+	D p45 = r * 8.3333333333333332e-03 + 4.1666666666666664e-02;
+	D p67 = r * 1.9841269841269841e-04 + 1.3888888888888889e-03;
+	D p89 = r * 2.7557319223985893e-06 + 2.4801587301587302e-05;
+	D p1011 = r * 2.5052108385441720e-08 + 2.7557319223985888e-07;
+	D p1213 = r * 1.6059043836821613e-10 + 2.0876756987868100e-09;
+	D p03 = p23 * r2 + p01;
+	D p47 = p67 * r2 + p45;
+	D p811 = p1011 * r2 + p89;
+	D p813 = p1213 * r4 + p811;
+	D p07 = p47 * r4 + p03;
+	D p = p813 * r8 + p07;
+
+	U sbits = (kbits + 1023) << 52;
+	D y = p * V::FromBits(sbits);
+	y = V::Select(x < -708.0, V::Broadcast(0.0), y);
+	y = V::Select(x > 709.0,
+		V::Broadcast(std::numeric_limits<double>::infinity()), y);
+	return (y);
+}
+
+// log(x) for normal positive finite x: x = m * 2^e with
+// sqrt(1/2) <= m < sqrt(2) and log(m) = 2 atanh(s), s = (m-1)/(m+1).
+template <typename V>
+GRANTE_VECTOR_INLINE typename V::D LogElement(typename V::D x) {
+	typedef typename V::D D;
+	typedef typename V::U U;
+	const double ln2_hi = 6.93147180369123816490e-01;
+	const double ln2_lo = 1.90821492927058770002e-10;
+
+	U bits = V::AsBits(x);
+	// Biased exponent as a double: 2^52 + ebits - (2^52 + 1023)
+	D e = V::FromBits((bits >> 52) | 0x4330000000000000ULL);
+	e -= 4503599627371519.0;
+	D m = V::FromBits((bits & 0x000fffffffffffffULL) |
+		0x3ff0000000000000ULL);
+	typename V::M m_high = m > 1.41421356237309504880;
+	m = V::Select(m_high, m * 0.5, m);
+	e = V::Select(m_high, e + 1.0, e);
+
+	D s = (m - 1.0) / (m + 1.0);
+	D z = s * s;
+	D z2 = z * z;
+	D z4 = z2 * z2;
+	D q01 = z * (1.0 / 5.0) + 1.0 / 3.0;
+	D q23 = z * (1.0 / 9.0) + 1.0 / 7.0;
+	D q45 = z * (1.0 / 13.0) + 1.0 / 11.0;
+	D q67 = z * (1.0 / 17.0) + 1.0 / 15.0;
+	D q89 = z * (1.0 / 21.0) + 1.0 / 19.0;
+	D q03 = q23 * z2 + q01;
+	D q47 = q67 * z2 + q45;
+	D q09 = (q89 * z4 + q47) * z4 + q03;
+	D s2 = s * 2.0;
+	return (e * ln2_hi + (s2 * z * q09 + e * ln2_lo + s2));
+}
+
+template <typename V, typename T>
+GRANTE_VECTOR_INLINE double MinRange(const T* x, size_t n) {
+	double m = std::numeric_limits<double>::infinity();
+	size_t i = 0;
+	if (V::lanes > 1 && n >= V::lanes) {
+		typename V::D acc = V::Broadcast(m);
+		for (; i + V::lanes <= n; i += V::lanes) {
+			typename V::D v = V::Load(x + i);
+			acc = V::Select(v < acc, v, acc);
+		}
+		for (size_t li = 0; li < V::lanes; ++li)
+			m = std::min(m, V::Element(acc, li));
+	}
+	for (; i < n; ++i)
+		m = x[i] < m ? x[i] : m;
+	return (m);
+}
+
+template <typename V, typename T>
+GRANTE_VECTOR_INLINE double MaxRange(const T* x, size_t n) {
+	double m = -std::numeric_limits<double>::infinity();
+	size_t i = 0;
+	if (V::lanes > 1 && n >= V::lanes) {
+		typename V::D acc = V::Broadcast(m);
+		for (; i + V::lanes <= n; i += V::lanes) {
+			typename V::D v = V::Load(x + i);
+			acc = V::Select(v > acc, v, acc);
+		}
+		for (size_t li = 0; li < V::lanes; ++li)
+			m = std::max(m, V::Element(acc, li));
+	}
+	for (; i < n; ++i)
+		m = x[i] > m ? x[i] : m;
+	return (m);
+}
+
+// sum_i exp(sign*x_i - shift)
+template <typename V, typename T>
+GRANTE_VECTOR_INLINE double SumExpRange(const T* x, size_t n,
+	double sign, double shift) {
+	double sum = 0.0;
+	size_t i = 0;
+	if (V::lanes > 1 && n >= V::lanes) {
+		typename V::D acc = V::Broadcast(0.0);
+		for (; i + V::lanes <= n; i += V::lanes)
+			acc += ExpElement<V>(V::Load(x + i) * sign - shift);
+		for (size_t li = 0; li < V::lanes; ++li)
+			sum += V::Element(acc, li);
+	}
+	for (; i < n; ++i)
+		sum += ExpElement<ScalarOps>(sign * x[i] - shift);
+	return (sum);
+}
+
+// y[i] = exp(x[i] - shift)
+template <typename V>
+GRANTE_VECTOR_INLINE void ExpLoop(const double* x, double shift, double* y,
+	size_t n) {
+	size_t i = 0;
+	if (V::lanes > 1) {
+		for (; i + V::lanes <= n; i += V::lanes)
+			V::Store(y + i, ExpElement<V>(V::Load(x + i) - shift));
+	}
+	for (; i < n; ++i)
+		y[i] = ExpElement<ScalarOps>(x[i] - shift);
+}
+
+template <typename V>
+GRANTE_VECTOR_INLINE void LogLoop(const double* x, double* y, size_t n) {
+	size_t i = 0;
+	if (V::lanes > 1) {
+		for (; i + V::lanes <= n; i += V::lanes)
+			V::Store(y + i, LogElement<V>(V::Load(x + i)));
+	}
+	for (; i < n; ++i)
+		y[i] = LogElement<ScalarOps>(x[i]);
+}
+
+// Strided reductions: for stride one the reduction is over the states of
+// each block (typically few), otherwise over the contiguous inner index.
+template <typename V, typename T>
+GRANTE_VECTOR_INLINE void StridedMinLoop(const T* x, size_t n,
+	unsigned int card, size_t stride, double* r) {
+	std::fill(r, r + card, std::numeric_limits<double>::infinity());
+	size_t block = card * stride;
+	for (size_t oi = 0; oi < n; oi += block) {
+		const T* xb = x + oi;
+		if (stride == 1) {
+			for (unsigned int si = 0; si < card; ++si)
+				r[si] = xb[si] < r[si] ? xb[si] : r[si];
+			continue;
+		}
+		for (unsigned int si = 0; si < card; ++si)
+			r[si] = std::min(r[si], MinRange<V>(xb + si*stride, stride));
+	}
+}
+
+template <typename V, typename T>
+GRANTE_VECTOR_INLINE void StridedMaxLoop(const T* x, size_t n,
+	unsigned int card, size_t stride, double* r) {
+	std::fill(r, r + card, -std::numeric_limits<double>::infinity());
+	size_t block = card * stride;
+	for (size_t oi = 0; oi < n; oi += block) {
+		const T* xb = x + oi;
+		if (stride == 1) {
+			for (unsigned int si = 0; si < card; ++si)
+				r[si] = xb[si] > r[si] ? xb[si] : r[si];
+			continue;
+		}
+		for (unsigned int si = 0; si < card; ++si)
+			r[si] = std::max(r[si], MaxRange<V>(xb + si*stride, stride));
+	}
+}
+
+// r[s] = sum_{ei: state(ei) = s} exp(x[ei] - shift[s])
+template <typename V, typename T>
+GRANTE_VECTOR_INLINE void StridedSumExpLoop(const T* x, size_t n,
+	unsigned int card, size_t stride, const double* shift, double* r) {
+	std::fill(r, r + card, 0.0);
+	size_t block = card * stride;
+	for (size_t oi = 0; oi < n; oi += block) {
+		const T* xb = x + oi;
+		if (stride == 1) {
+			for (unsigned int si = 0; si < card; ++si)
+				r[si] += ExpElement<ScalarOps>(xb[si] - shift[si]);
+			continue;
+		}
+		for (unsigned int si = 0; si < card; ++si)
+			r[si] += SumExpRange<V>(xb + si*stride, stride, 1.0, shift[si]);
+	}
+}
+
+template <typename V, typename T>
+GRANTE_VECTOR_INLINE void StridedAddLoop(T* x, size_t n,
+	unsigned int card, size_t stride, const double* delta) {
+	size_t block = card * stride;
+	for (size_t oi = 0; oi < n; oi += block) {
+		T* xb = x + oi;
+		if (stride == 1) {
+			for (unsigned int si = 0; si < card; ++si)
+				xb[si] += delta[si];
+			continue;
+		}
+		for (unsigned int si = 0; si < card; ++si) {
+			T* xs = xb + si*stride;
+			double d = delta[si];
+			for (size_t ii = 0; ii < stride; ++ii)
+				xs[ii] += d;
+		}
+	}
+}
+
+// Kernels compiled for one instruction set
+struct KernelTable {
+	const char* name;
+	void (*exp)(const double* x, double shift, double* y, size_t n);
+	void (*log)(const double* x, double* y, size_t n);
+	double (*min)(const double* x, size_t n);
+	double (*max)(const double* x, size_t n);
+	double (*sum_exp)(const double* x, size_t n, double sign, double shift);
+	void (*strided_min)(const double* x, size_t n, unsigned int card,
+		size_t stride, double* r);
+	void (*strided_max)(const double* x, size_t n, unsigned int card,
+		size_t stride, double* r);
+	void (*strided_sum_exp)(const double* x, size_t n, unsigned int card,
+		size_t stride, const double* shift, double* r);
+	void (*strided_add)(double* x, size_t n, unsigned int card,
+		size_t stride, const double* delta);
+	// Single precision tables
+	double (*min_f)(const float* x, size_t n);
+	void (*strided_min_f)(const float* x, size_t n, unsigned int card,
+		size_t stride, double* r);
+	void (*strided_max_f)(const float* x, size_t n, unsigned int card,
+		size_t stride, double* r);
+	void (*strided_sum_exp_f)(const float* x, size_t n, unsigned int card,
+		size_t stride, const double* shift, double* r);
+	void (*strided_add_f)(float* x, size_t n, unsigned int card,
+		size_t stride, const double* delta);
+};
+
+// Instantiate the strided kernels for tables of element type T, the
+// function names have the given suffix.
+#define GRANTE_VECTOR_STRIDED_KERNELS(ISA, ATTR, V, T, SUFFIX) \
+	ATTR void StridedMin##SUFFIX##_##ISA(const T* x, size_t n, \
+		unsigned int card, size_t stride, double* r) { \
+		StridedMinLoop<V>(x, n, card, stride, r); \
+	} \
+	ATTR void StridedMax##SUFFIX##_##ISA(const T* x, size_t n, \
+		unsigned int card, size_t stride, double* r) { \
+		StridedMaxLoop<V>(x, n, card, stride, r); \
+	} \
+	ATTR void StridedSumExp##SUFFIX##_##ISA(const T* x, size_t n, \
+		unsigned int card, size_t stride, const double* shift, double* r) { \
+		StridedSumExpLoop<V>(x, n, card, stride, shift, r); \
+	} \
+	ATTR void StridedAdd##SUFFIX##_##ISA(T* x, size_t n, unsigned int card, \
+		size_t stride, const double* delta) { \
+		StridedAddLoop<V>(x, n, card, stride, delta); \
+	}
+
+// Instantiate all kernels of vector operations V with the given function
+// attributes and define the kernel table kernels_ISA.
+#define GRANTE_VECTOR_KERNELS(ISA, ATTR, V) \
+	ATTR void Exp_##ISA(const double* x, double shift, double* y, \
+		size_t n) { \
+		ExpLoop<V>(x, shift, y, n); \
+	} \
+	ATTR void Log_##ISA(const double* x, double* y, size_t n) { \
+		LogLoop<V>(x, y, n); \
+	} \
+	ATTR double Min_##ISA(const double* x, size_t n) { \
+		return (MinRange<V>(x, n)); \
+	} \
+	ATTR double Max_##ISA(const double* x, size_t n) { \
+		return (MaxRange<V>(x, n)); \
+	} \
+	ATTR double SumExp_##ISA(const double* x, size_t n, double sign, \
+		double shift) { \
+		return (SumExpRange<V>(x, n, sign, shift)); \
+	} \
+	GRANTE_VECTOR_STRIDED_KERNELS(ISA, ATTR, V, double, ) \
+	GRANTE_VECTOR_STRIDED_KERNELS(ISA, ATTR, V, float, F) \
+	ATTR double MinF_##ISA(const float* x, size_t n) { \
+		return (MinRange<V>(x, n)); \
+	} \
+	const KernelTable kernels_##ISA = { #ISA, Exp_##ISA, Log_##ISA, \
+		Min_##ISA, Max_##ISA, SumExp_##ISA, StridedMin_##ISA, \
+		StridedMax_##ISA, StridedSumExp_##ISA, StridedAdd_##ISA, \
+		MinF_##ISA, StridedMinF_##ISA, StridedMaxF_##ISA, \
+		StridedSumExpF_##ISA, StridedAddF_##ISA };
+
+#ifdef GRANTE_VECTOR_TYPES
+GRANTE_VECTOR_KERNELS(baseline, , Vector2Ops)
+#else
+GRANTE_VECTOR_KERNELS(baseline, , ScalarOps)
+#endif
+#ifdef GRANTE_VECTOR_X86
+GRANTE_VECTOR_KERNELS(sse42, __attribute__((target("sse4.2"))), Vector2Ops)
+GRANTE_VECTOR_KERNELS(avx2, __attribute__((target("avx2,fma"))),
+	Vector4Ops)
+GRANTE_VECTOR_KERNELS(avx512, __attribute__((target("avx512f"))),
+	Vector8Ops)
+#endif
+
+// Kernel tables supported by this CPU, the best first
+std::vector<const KernelTable*> SupportedKernels() {
+	std::vector<const KernelTable*> supported;
+#ifdef GRANTE_VECTOR_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f"))
+		supported.push_back(&kernels_avx512);
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+		supported.push_back(&kernels_avx2);
+	if (__builtin_cpu_supports("sse4.2"))
+		supported.push_back(&kernels_sse42);
+#endif
+	supported.push_back(&kernels_baseline);
+	return (supported);
+}
+
+const KernelTable*& SelectedKernels() {
+	static const KernelTable* kernels = SupportedKernels()[0];
+	return (kernels);
+}
+
+const KernelTable& Kernels() {
+	return (*SelectedKernels());
+}
+
+// Finish a log-sum-exp given the maximum and the sum relative to it
+double LogSumExpFinish(double xmax, double sum) {
+	// All elements -inf, or an +inf/NaN element
+	if (std::isfinite(xmax) == false)
+		return (xmax);
+	return (xmax + std::log(sum));
+}
+
+}
+
+void VectorMath::Exp(const double* x, double* y, size_t n) {
+	Kernels().exp(x, 0.0, y, n);
+}
+
+void VectorMath::Log(const double* x, double* y, size_t n) {
+	// The kernel handles normal positive numbers, all others (zero,
+	// negative, subnormal, inf, NaN) are treated by the standard library.
+	const size_t block = 64;
+	double y_block[block];
+	const KernelTable& kernels = Kernels();
+	for (size_t bi = 0; bi < n; bi += block) {
+		size_t bn = std::min(block, n - bi);
+		kernels.log(x + bi, y_block, bn);
+		for (size_t i = 0; i < bn; ++i) {
+			double xi = x[bi + i];
+			if (xi >= std::numeric_limits<double>::min() &&
+				xi <= std::numeric_limits<double>::max()) {
+				y[bi + i] = y_block[i];
+			} else {
+				y[bi + i] = std::log(xi);
+			}
+		}
+	}
+}
+
+double VectorMath::LogSumExp(const double* x, size_t n) {
+	const KernelTable& kernels = Kernels();
+	double xmax = kernels.max(x, n);
+	if (std::isfinite(xmax) == false)
+		return (LogSumExpFinish(xmax, 0.0));
+	return (LogSumExpFinish(xmax, kernels.sum_exp(x, n, 1.0, xmax)));
+}
+
+double VectorMath::LogSumExpNeg(const double* x, size_t n) {
+	const KernelTable& kernels = Kernels();
+	double xmax = -kernels.min(x, n);
+	if (std::isfinite(xmax) == false)
+		return (LogSumExpFinish(xmax, 0.0));
+	return (LogSumExpFinish(xmax, kernels.sum_exp(x, n, -1.0, xmax)));
+}
+
+double VectorMath::NormalizeLog(double* x, size_t n) {
+	double lse = LogSumExp(x, n);
+	Kernels().exp(x, lse, x, n);
+	return (lse);
+}
+
+double VectorMath::Min(const double* x, size_t n) {
+	return (Kernels().min(x, n));
+}
+
+double VectorMath::Max(const double* x, size_t n) {
+	return (Kernels().max(x, n));
+}
+
+size_t VectorMath::ArgMin(const double* x, size_t n) {
+	assert(n > 0);
+	double xmin = Kernels().min(x, n);
+	for (size_t i = 0; i < n; ++i) {
+		if (x[i] == xmin)
+			return (i);
+	}
+	return (0);	// all NaN
+}
+
+size_t VectorMath::ArgMax(const double* x, size_t n) {
+	assert(n > 0);
+	double xmax = Kernels().max(x, n);
+	for (size_t i = 0; i < n; ++i) {
+		if (x[i] == xmax)
+			return (i);
+	}
+	return (0);	// all NaN
+}
+
+void VectorMath::StridedMin(const double* x, size_t n, unsigned int card,
+	size_t stride, double* r) {
+	assert(n % (card * stride) == 0);
+	Kernels().strided_min(x, n, card, stride, r);
+}
+
+void VectorMath::StridedMax(const double* x, size_t n, unsigned int card,
+	size_t stride, double* r) {
+	assert(n % (card * stride) == 0);
+	Kernels().strided_max(x, n, card, stride, r);
+}
+
+void VectorMath::StridedLogSumExp(const double* x, size_t n,
+	unsigned int card, size_t stride, double* r, double* scratch) {
+	assert(n % (card * stride) == 0);
+	const KernelTable& kernels = Kernels();
+	kernels.strided_max(x, n, card, stride, scratch);
+	kernels.strided_sum_exp(x, n, card, stride, scratch, r);
+	for (unsigned int si = 0; si < card; ++si)
+		r[si] = LogSumExpFinish(scratch[si], r[si]);
+}
+
+void VectorMath::StridedAdd(double* x, size_t n, unsigned int card,
+	size_t stride, const double* delta) {
+	assert(n % (card * stride) == 0);
+	Kernels().strided_add(x, n, card, stride, delta);
+}
+
+double VectorMath::Min(const float* x, size_t n) {
+	return (Kernels().min_f(x, n));
+}
+
+void VectorMath::StridedMin(const float* x, size_t n, unsigned int card,
+	size_t stride, double* r) {
+	assert(n % (card * stride) == 0);
+	Kernels().strided_min_f(x, n, card, stride, r);
+}
+
+void VectorMath::StridedLogSumExp(const float* x, size_t n,
+	unsigned int card, size_t stride, double* r, double* scratch) {
+	assert(n % (card * stride) == 0);
+	const KernelTable& kernels = Kernels();
+	kernels.strided_max_f(x, n, card, stride, scratch);
+	kernels.strided_sum_exp_f(x, n, card, stride, scratch, r);
+	for (unsigned int si = 0; si < card; ++si)
+		r[si] = LogSumExpFinish(scratch[si], r[si]);
+}
+
+void VectorMath::StridedAdd(float* x, size_t n, unsigned int card,
+	size_t stride, const double* delta) {
+	assert(n % (card * stride) == 0);
+	Kernels().strided_add_f(x, n, card, stride, delta);
+}
+
+const char* VectorMath::InstructionSet() {
+	return (Kernels().name);
+}
+
+bool VectorMath::SetInstructionSet(const char* name) {
+	std::vector<const KernelTable*> supported = SupportedKernels();
+	for (size_t ki = 0; ki < supported.size(); ++ki) {
+		if (std::strcmp(supported[ki]->name, name) != 0)
+			continue;
+
+		SelectedKernels() = supported[ki];
+		return (true);
+	}
+	return (false);
+}
+
+}
+
@@ -0,0 +1,90 @@
+
+#ifndef GRANTE_VECTORMATH_H
+#define GRANTE_VECTORMATH_H
+
+#include <cstddef>
+
+namespace Grante {
+
+/* Vectorized kernels for the exponential, logarithm, log-sum-exp and the
+ * reductions used in message passing and marginal computations.
+ *
+ * The kernels are compiled for several instruction sets (AVX-512, AVX2,
+ * SSE4.2 and the baseline) and the best one supported by the CPU is
+ * selected on first use.  exp and log are evaluated with a range reduction
+ * and polynomial approximation; the relative error is a few ulp, except
+ * that exp results below exp(-708) are flushed to zero and results above
+ * exp(709) overflow to +inf.  Reductions use a fixed number of partial
+ * accumulators, such that the results are deterministic for a given
+ * instruction set, but may differ in the last bits from a sequential
+ * summation.
+ */
+class VectorMath {
+public:
+	// y[i] = exp(x[i]), y may be equal to x.
+	static void Exp(const double* x, double* y, size_t n);
+	// y[i] = log(x[i]), y may be equal to x.
+	static void Log(const double* x, double* y, size_t n);
+
+	// Compute log sum_i exp(x_i) in a numerically stable way.  -inf elements
+	// are treated correctly, the empty sum is -inf.
+	static double LogSumExp(const double* x, size_t n);
+	//    log sum_i exp(-x_i)
+	static double LogSumExpNeg(const double* x, size_t n);
+	// Normalize in the log-domain (softmax),
+	//    x_i <- exp(x_i - log sum_j exp(x_j)),
+	// and return log sum_j exp(x_j).
+	static double NormalizeLog(double* x, size_t n);
+
+	// Minimum/maximum element, +inf/-inf for n = 0.  NaN elements are
+	// ignored.
+	static double Min(const double* x, size_t n);
+	static double Max(const double* x, size_t n);
+	// Index of the first minimum/maximum element, n > 0.
+	static size_t ArgMin(const double* x, size_t n);
+	static size_t ArgMax(const double* x, size_t n);
+
+	// Reductions of a table to a single dimension.  The table x has n
+	// elements, where element (oi*card + s)*stride + ii has state s in the
+	// remaining dimension.  This is the layout of factor energies and
+	// marginals, where stride is FactorType::VariableStride.  n must be a
+	// multiple of card*stride, the results r have card elements.
+	//
+	// r[s] = min_{ei: state(ei) = s} x[ei]
+	static void StridedMin(const double* x, size_t n, unsigned int card,
+		size_t stride, double* r);
+	// r[s] = max_{ei: state(ei) = s} x[ei]
+	static void StridedMax(const double* x, size_t n, unsigned int card,
+		size_t stride, double* r);
+	// r[s] = log sum_{ei: state(ei) = s} exp(x[ei]), scratch has card
+	// elements.
+	static void StridedLogSumExp(const double* x, size_t n,
+		unsigned int card, size_t stride, double* r, double* scratch);
+	// x[ei] += delta[state(ei)]
+	static void StridedAdd(double* x, size_t n, unsigned int card,
+		size_t stride, const double* delta);
+
+	// Single precision tables.  The elements are widened to double, all
+	// results and arithmetic are in double precision.
+	static double Min(const float* x, size_t n);
+	static void StridedMin(const float* x, size_t n, unsigned int card,
+		size_t stride, double* r);
+	static void StridedLogSumExp(const float* x, size_t n,
+		unsigned int card, size_t stride, double* r, double* scratch);
+	// x[ei] += delta[state(ei)], rounded to single precision
+	static void StridedAdd(float* x, size_t n, unsigned int card,
+		size_t stride, const double* delta);
+
+	// Name of the instruction set selected for this CPU.
+	static const char* InstructionSet();
+	// Select the kernels of the named instruction set ("baseline", "sse42",
+	// "avx2" or "avx512") instead of the best one.  Return false, leaving
+	// the selection unchanged, if the CPU does not support it.  For
+	// testing; must not be called while other threads use VectorMath.
+	static bool SetInstructionSet(const char* name);
+};
+
+}
+
+#endif
+
@@ -0,0 +1,137 @@
+
+#include "grante/VectorMath.h"
+
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace {
+
+// Distance of y from the reference value in units of the last place of
+// the reference
+double UlpError(double y, double ref) {
+    if (y == ref)
+        return (0.0);
+    double ulp = std::nextafter(ref, std::numeric_limits<double>::infinity())
+        - ref;
+    return (std::fabs(y - ref) / ulp);
+}
+
+// Run the checks of one instruction set; the selection is restored
+// afterwards
+class VectorMathTest : public testing::TestWithParam<std::string> {
+protected:
+    virtual void SetUp() {
+        default_isa = Grante::VectorMath::InstructionSet();
+        if (Grante::VectorMath::SetInstructionSet(GetParam().c_str())
+            == false) {
+            GTEST_SKIP() << GetParam() << " not supported by this CPU";
+        }
+        ASSERT_EQ(GetParam(), Grante::VectorMath::InstructionSet());
+    }
+    virtual void TearDown() {
+        Grante::VectorMath::SetInstructionSet(default_isa.c_str());
+    }
+
+    std::string default_isa;
+};
+
+}
+
+TEST_P(VectorMathTest, ExpUlpError) {
+    // An odd number of elements exercises the scalar tail
+    std::vector<double> x;
+    for (double v = -707.5; v <= 708.5; v += 0.6133)
+        x.push_back(v);
+    for (double v = -2.0; v <= 2.0; v += 0.001)
+        x.push_back(v);
+    if (x.size() % 2 == 0)
+        x.push_back(0.1);
+    std::vector<double> y(x.size());
+    Grante::VectorMath::Exp(&x[0], &y[0], x.size());
+
+    double max_ulp = 0.0;
+    for (size_t i = 0; i < x.size(); ++i)
+        max_ulp = std::max(max_ulp, UlpError(y[i], std::exp(x[i])));
+    EXPECT_LE(max_ulp, 4.0);
+
+    // Special values
+    double xs[5] = { -std::numeric_limits<double>::infinity(), -800.0, 0.0,
+        800.0, std::numeric_limits<double>::infinity() };
+    double ys[5];
+    Grante::VectorMath::Exp(xs, ys, 5);
+    EXPECT_EQ(0.0, ys[0]);
+    EXPECT_EQ(0.0, ys[1]);
+    EXPECT_EQ(1.0, ys[2]);
+    EXPECT_EQ(std::numeric_limits<double>::infinity(), ys[3]);
+    EXPECT_EQ(std::numeric_limits<double>::infinity(), ys[4]);
+}
+
+TEST_P(VectorMathTest, LogUlpError) {
+    std::vector<double> x;
+    for (double v = 1.0e-300; v < 1.0e300; v *= 1.37)
+        x.push_back(v);
+    for (double v = 0.5; v <= 2.0; v += 0.0007)
+        x.push_back(v);
+    if (x.size() % 2 == 0)
+        x.push_back(3.0);
+    std::vector<double> y(x.size());
+    Grante::VectorMath::Log(&x[0], &y[0], x.size());
+
+    double max_ulp = 0.0;
+    for (size_t i = 0; i < x.size(); ++i)
+        max_ulp = std::max(max_ulp, UlpError(y[i], std::log(x[i])));
+    EXPECT_LE(max_ulp, 4.0);
+
+    // Non-normal inputs
+    double xs[3] = { 0.0, std::numeric_limits<double>::denorm_min(),
+        std::numeric_limits<double>::infinity() };
+    double ys[3];
+    Grante::VectorMath::Log(xs, ys, 3);
+    EXPECT_EQ(-std::numeric_limits<double>::infinity(), ys[0]);
+    EXPECT_EQ(std::log(xs[1]), ys[1]);
+    EXPECT_EQ(std::numeric_limits<double>::infinity(), ys[2]);
+}
+
+TEST_P(VectorMathTest, LogSumExpSpecialValues) {
+    const double inf = std::numeric_limits<double>::infinity();
+
+    // The empty sum
+    double dummy = 0.0;
+    EXPECT_EQ(-inf, Grante::VectorMath::LogSumExp(&dummy, 0));
+
+    // All elements -inf
+    std::vector<double> x(7, -inf);
+    EXPECT_EQ(-inf, Grante::VectorMath::LogSumExp(&x[0], x.size()));
+
+    // -inf elements do not contribute
+    x[2] = 1.5;
+    x[5] = -0.5;
+    double ref = std::log(std::exp(1.5) + std::exp(-0.5));
+    EXPECT_NEAR(ref, Grante::VectorMath::LogSumExp(&x[0], x.size()),
+        1.0e-14);
+
+    // A +inf element dominates
+    x[3] = inf;
+    EXPECT_EQ(inf, Grante::VectorMath::LogSumExp(&x[0], x.size()));
+
+    // Large values do not overflow
+    std::vector<double> big(9, 1000.0);
+    EXPECT_NEAR(1000.0 + std::log(9.0),
+        Grante::VectorMath::LogSumExp(&big[0], big.size()), 1.0e-12);
+    EXPECT_NEAR(-1000.0 + std::log(9.0),
+        Grante::VectorMath::LogSumExpNeg(&big[0], big.size()), 1.0e-12);
+}
+
+INSTANTIATE_TEST_SUITE_P(InstructionSets, VectorMathTest,
+    testing::Values("baseline", "sse42", "avx2", "avx512"));
+
+TEST(VectorMath, UnknownInstructionSet) {
+    std::string isa = Grante::VectorMath::InstructionSet();
+    EXPECT_FALSE(Grante::VectorMath::SetInstructionSet("unknown"));
+    EXPECT_EQ(isa, Grante::VectorMath::InstructionSet());
+}
+